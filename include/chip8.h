@@ -5,10 +5,28 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
-#define CHIP8_MEM_SIZE 4096
+#define CHIP8_MEM_SIZE 0x10000 /* XO-CHIP 64 KB address space */
+#define CHIP8_MEM_LEGACY_SIZE 0x1000 /* COSMAC VIP and SUPER-CHIP memory */
+#define CHIP8_MEM_PAGE_SHIFT 10 /* 1 KB pages tracked by chip8_vm.dirty */
+#define CHIP8_COW_SHIFT 8 /* 256 byte copy-on-write pages of chip8_vm.pages */
+#define CHIP8_COW_SIZE (1 << CHIP8_COW_SHIFT)
+#define CHIP8_COW_PAGES (CHIP8_MEM_SIZE >> CHIP8_COW_SHIFT)
+#define CHIP8_STACK_SIZE 16
+#define CHIP8_ROM_ADDR 0x200
 #define CHIP8_GFX_RES_WIDTH 64
 #define CHIP8_GFX_RES_HEIGHT 32
+#define CHIP8_GFX_HIRES_WIDTH 128 /* SUPER-CHIP high resolution */
+#define CHIP8_GFX_HIRES_HEIGHT 64
+#define CHIP8_GFX_ROW_WORDS (CHIP8_GFX_HIRES_WIDTH / 64) /* words per row */
+#define CHIP8_GFX_PLANES 2 /* XO-CHIP bitplanes */
+#define CHIP8_GFX_COLORS (1 << CHIP8_GFX_PLANES)
+#define CHIP8_PATTERN_SIZE 16 /* XO-CHIP audio pattern bytes */
+#define CHIP8_RPL_SIZE 16 /* SUPER-CHIP RPL user flags */
+
+#define CHIP8_FRAME_RATE 60
+#define CHIP8_CYCLES_PER_FRAME 10
 
 typedef uint8_t chip8_byte;
 typedef uint16_t chip8_word;
@@ -53,23 +71,283 @@ typedef enum chip8_key {
 	CHIP8_KEY_SIZE
 } chip8_key;
 
+/*
+ * @brief Behaviour that differs between platforms, one profile per line as
+ * (name, shift_vy, mem_inc, jump_vx, wrap, vf_reset):
+ *  - shift_vy: 8XY6/8XYE shift V[Y] into V[X] instead of shifting V[X]
+ *  - mem_inc: FX55/FX65 leave the index past the last register
+ *  - jump_vx: BXNN jumps to XNN plus V[X] instead of NNN plus V[0]
+ *  - wrap: sprites wrap around the display edges instead of clipping
+ *  - vf_reset: 8XY1/8XY2/8XY3 clear V[F]
+ */
+#define CHIP8_QUIRK_PROFILES(X)                      \
+	X(VIP,    true,  true,  false, false, true)  \
+	X(SCHIP,  false, false, true,  false, false) \
+	X(MODERN, true,  true,  false, true,  false)
+
+#define CHIP8_QUIRK_ENUM(NAME, ...) CHIP8_QUIRKS_##NAME,
+
+/*
+ * @brief Quirk profiles, each has its own specialized instruction set.
+ */
+typedef enum chip8_quirks {
+	CHIP8_QUIRK_PROFILES(CHIP8_QUIRK_ENUM)
+	CHIP8_QUIRKS_SIZE
+} chip8_quirks;
+
+/*
+ * @brief Execution states of the virtual machine.
+ */
+typedef enum chip8_state {
+	CHIP8_RUNNING,
+	CHIP8_WAITING_KEY, /* FX0A blocked until a key changes */
+	CHIP8_HALTED /* 00FD exited the interpreter */
+} chip8_state;
+
+/*
+ * @brief Emulator faults detected in builds defining CHIP8_CHECKED.
+ *
+ * Release builds wrap the offending index around instead, checked builds
+ * still do so but record the first fault for fuzzers and tests to report.
+ */
+typedef enum chip8_fault {
+	CHIP8_FAULT_NONE,
+	CHIP8_FAULT_MEM, /* address past the memory of the quirk profile */
+	CHIP8_FAULT_GFX, /* pixel drawn outside the display of the resolution */
+	CHIP8_FAULT_STACK_OVERFLOW, /* 2NNN with a full stack */
+	CHIP8_FAULT_STACK_UNDERFLOW, /* 00EE with an empty stack */
+	CHIP8_FAULT_GFX_HASH, /* display hash out of step with the display */
+	CHIP8_FAULT_SIZE
+} chip8_fault;
+
+#ifdef CHIP8_CHECKED
+	#define CHIP8_CHECK(VM, COND, FAULT)                              \
+		do {                                                      \
+			if (!(COND) && CHIP8_FAULT_NONE == (VM)->fault) { \
+				(VM)->fault = (FAULT);                    \
+			}                                                 \
+		} while (0)
+#else
+	#define CHIP8_CHECK(VM, COND, FAULT) ((void) 0)
+#endif
+
+/*
+ * @brief Page of guest memory shared between virtual machines.
+ *
+ * Machines copied from one another map the same pages and a machine writing
+ * to a page it shares first gets a private copy, so instances of a ROM only
+ * pay for the pages they write.
+ */
+typedef struct chip8_page {
+	chip8_byte data[CHIP8_COW_SIZE];
+	atomic_uint refs; /* machines mapping the page, 0 for the zero page */
+} chip8_page;
+
 /* 
  * @brief Chip-8 virtual machine structure.
+ *
+ * The state touched by every instruction fills the first cache line.
+ * The display is stored as packed rows of 64-bit words with the leftmost
+ * pixel in the most significant bit, so drawing and scrolling operate on
+ * whole rows. Low resolution only uses the first word of the first 32 rows.
+ * Each XO-CHIP bitplane is a separate display, a pixel's color is the index
+ * formed by its bits across the planes. Instructions changing display rows
+ * keep gfx_hash up to date, so displays compare in constant time. Scrolls
+ * move every row, the display is hashed anew once at the end of the frame.
+ * Memory is a table of copy-on-write pages, machines must be copied with
+ * chip8_copy_vm() and released with chip8_free_vm() or chip8_drop_vm().
  */
 typedef struct chip8_virtual_machine {
-	chip8_word pc; /* program counter */
-	chip8_word sp; /* stack pointer */
+	_Alignas(64) chip8_word pc; /* program counter */
+	chip8_word sp; /* stack depth */
 	chip8_word idx; /* index register */
 	chip8_word istr; /* current instruction */
-
 	chip8_byte regs[REG_BANK_SIZE]; /* register unit array */
-	chip8_byte mem[CHIP8_MEM_SIZE]; /* memory array */
-	chip8_byte gfx[CHIP8_GFX_RES_HEIGHT][CHIP8_GFX_RES_WIDTH]; /* pixel array */
-
 	chip8_byte dly_tmr; /* used for timing events */
 	chip8_byte snd_tmr; /* used for sound effects */
+	chip8_byte state; /* execution state */
+	chip8_byte quirks; /* chip8_quirks profile selecting the instruction set */
+	chip8_byte plane; /* bitplanes selected by FN01 */
+	chip8_byte wait_reg; /* register receiving the key FX0A waits for */
+	chip8_word keys; /* keypad state, one bit per key */
+	uint32_t rng; /* xorshift state of CXNN, per machine for reproducibility */
+	bool draw_flag; /* pixel array changed since last render */
+	bool hires; /* 128x64 SUPER-CHIP resolution enabled */
+	chip8_byte fault; /* first chip8_fault, only detected with CHIP8_CHECKED */
+	bool gfx_stale; /* scrolled display, gfx_hash is redone after the frame */
+	uint64_t frame; /* number of emulated frames */
+	uint64_t dirty; /* memory pages written since this was last cleared */
+	uint64_t gfx_hash; /* XOR of the hashes of all display rows */
+
+	chip8_word stack[CHIP8_STACK_SIZE]; /* subroutine return addresses */
+	chip8_byte flags[CHIP8_RPL_SIZE]; /* RPL user flags saved by FX75 */
+	chip8_byte pattern[CHIP8_PATTERN_SIZE]; /* XO-CHIP audio pattern */
+	chip8_byte pitch; /* audio pattern playback pitch */
+	bool has_pattern; /* pattern loaded by F002 replaces the beep */
+	chip8_word keys_read; /* keys instructions read, cleared by the host */
+	chip8_page* pages[CHIP8_COW_PAGES]; /* memory array */
+	uint64_t gfx[CHIP8_GFX_PLANES][CHIP8_GFX_HIRES_HEIGHT]
+		[CHIP8_GFX_ROW_WORDS]; /* pixel rows per plane */
 } chip8_vm;
 
-bool draw_flag;
+/*
+ * @brief Whether running a frame has no observable effect until a key edge,
+ * which lets hosts block on input instead of running frames.
+ */
+static inline bool chip8_is_idle(const chip8_vm chip8[const static 1])
+{
+	return CHIP8_WAITING_KEY == chip8->state && !chip8->dly_tmr
+		&& !chip8->snd_tmr;
+}
+
+/*
+ * @brief Returns the width in pixels of the current resolution.
+ */
+static inline unsigned chip8_gfx_width(const chip8_vm chip8[const static 1])
+{
+	return chip8->hires ? CHIP8_GFX_HIRES_WIDTH : CHIP8_GFX_RES_WIDTH;
+}
+
+/*
+ * @brief Returns the height in pixels of the current resolution.
+ */
+static inline unsigned chip8_gfx_height(const chip8_vm chip8[const static 1])
+{
+	return chip8->hires ? CHIP8_GFX_HIRES_HEIGHT : CHIP8_GFX_RES_HEIGHT;
+}
+
+/*
+ * @brief Returns the color index of the pixel at (x, y) of the current
+ * resolution, zero when it is not set in any plane.
+ */
+static inline unsigned chip8_get_pixel(const chip8_vm chip8[const static 1],
+		const unsigned x, const unsigned y)
+{
+	unsigned color = 0;
+
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		color |= (chip8->gfx[p][y][x / 64] >> (63 - x % 64) & 1) << p;
+	}
+	return color;
+}
+
+/*
+ * @brief Hashes a display row with its plane and position, empty rows hash
+ * to zero.
+ */
+static inline uint64_t chip8_gfx_row_hash(const unsigned plane,
+		const unsigned y, const uint64_t row[const static CHIP8_GFX_ROW_WORDS])
+{
+	uint64_t hash;
+
+	if (!(row[0] | row[1])) {
+		return 0;
+	}
+	hash = row[0] ^ (row[1] << 32 | row[1] >> 32) * 0xC2B2AE3D27D4EB4FULL
+		^ (plane * CHIP8_GFX_HIRES_HEIGHT + y + 1) * 0x9E3779B97F4A7C15ULL;
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ULL;
+	return hash ^ hash >> 33;
+}
+
+/*
+ * @brief Returns the size of the memory of the quirk profile, only the
+ * modern profile has the whole XO-CHIP address space.
+ */
+static inline unsigned chip8_mem_size(const chip8_vm chip8[const static 1])
+{
+	return CHIP8_QUIRKS_MODERN == chip8->quirks ? CHIP8_MEM_SIZE
+		: CHIP8_MEM_LEGACY_SIZE;
+}
+
+/*
+ * @brief Reads a byte of memory without fault checks, addresses wrap around
+ * the address space.
+ */
+static inline chip8_byte chip8_mem_peek(const chip8_vm chip8[const static 1],
+		const unsigned addr)
+{
+	return chip8->pages[addr >> CHIP8_COW_SHIFT & (CHIP8_COW_PAGES-1)]
+		->data[addr & (CHIP8_COW_SIZE-1)];
+}
+
+/*
+ * @brief Reads a byte of memory, addresses wrap around the address space.
+ */
+static inline chip8_byte chip8_mem_read(chip8_vm chip8[const static 1],
+		const unsigned addr)
+{
+	CHIP8_CHECK(chip8, addr < chip8_mem_size(chip8), CHIP8_FAULT_MEM);
+	return chip8_mem_peek(chip8, addr);
+}
+
+extern chip8_page* chip8_own_page(chip8_vm[const static 1], const unsigned);
+
+/*
+ * @brief Writes a byte of memory, addresses wrap around the address space,
+ * and marks its page dirty. A shared page is copied first, the write is
+ * dropped and the machine halted when that copy cannot be allocated.
+ */
+static inline void chip8_mem_write(chip8_vm chip8[const static 1],
+		const unsigned addr, const chip8_byte value)
+{
+	const unsigned index = addr >> CHIP8_COW_SHIFT & (CHIP8_COW_PAGES-1);
+	chip8_page* page = chip8->pages[index];
+
+	CHIP8_CHECK(chip8, addr < chip8_mem_size(chip8), CHIP8_FAULT_MEM);
+
+	if (1 != atomic_load_explicit(&page->refs, memory_order_acquire)
+	    && !(page = chip8_own_page(chip8, index))) {
+		return;
+	}
+	page->data[addr & (CHIP8_COW_SIZE-1)] = value;
+	chip8->dirty |= 1ULL << ((addr & (CHIP8_MEM_SIZE-1)) >> CHIP8_MEM_PAGE_SHIFT);
+}
+
+extern chip8_vm* chip8_new_vm(void);
+
+extern void chip8_copy_vm(chip8_vm[restrict const static 1],
+		const chip8_vm[restrict const static 1]);
+
+extern void chip8_drop_vm(chip8_vm[const static 1]);
+
+extern void chip8_free_vm(chip8_vm* const);
+
+extern chip8_rc chip8_mem_load(chip8_vm[const static 1], unsigned,
+		const void* const, size_t);
+
+extern chip8_rc chip8_step(chip8_vm[const static 1]);
+
+extern chip8_rc chip8_count_step(chip8_vm[const static 1], uint32_t[const]);
+
+extern void chip8_start_frame(chip8_vm[const static 1]);
+
+extern void chip8_end_frame(chip8_vm[const static 1]);
+
+extern chip8_rc chip8_run_frame(chip8_vm[const static 1], const unsigned);
+
+extern chip8_rc chip8_count_frame(chip8_vm[const static 1], const unsigned,
+		uint32_t[const]);
+
+extern void chip8_set_key(chip8_vm[const static 1], const chip8_key,
+		const bool);
+
+extern void chip8_seed(chip8_vm[const static 1], const uint32_t);
+
+extern void chip8_tick_timers(chip8_vm[const static 1]);
+
+extern uint64_t chip8_rehash_gfx(const chip8_vm[const static 1]);
+
+/*
+ * @brief Returns a hash of the display and its resolution, equal displays
+ * hash alike.
+ */
+static inline uint64_t chip8_gfx_hash(const chip8_vm chip8[const static 1])
+{
+	return (chip8->gfx_stale ? chip8_rehash_gfx(chip8) : chip8->gfx_hash)
+		^ (chip8->hires ? 0x5851F42D4C957F2DULL : 0);
+}
 
 #endif /* CHIP8_H */
@@ -0,0 +1,71 @@
+#ifndef CHIP8_AUDIO_H
+#define CHIP8_AUDIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "chip8.h"
+#include "chip8_ring.h"
+
+#define CHIP8_AUDIO_RATE 48000 /* samples per second */
+#define CHIP8_AUDIO_FRAME (CHIP8_AUDIO_RATE / CHIP8_FRAME_RATE) /* per frame */
+#define CHIP8_AUDIO_PERIOD 240 /* samples per backend write, 5 ms */
+#define CHIP8_AUDIO_QUEUE_MAX CHIP8_AUDIO_PERIOD /* queued ahead of a frame */
+#define CHIP8_AUDIO_TONE 440.0 /* beep frequency in Hz */
+#define CHIP8_AUDIO_VOLUME 0.25
+#define CHIP8_AUDIO_PATTERN_RATE 4000.0 /* pattern bits per second at pitch 64 */
+#define CHIP8_AUDIO_PATTERN_BITS (CHIP8_PATTERN_SIZE * 8)
+
+#ifdef CHIP8_HAVE_ALSA
+	#define CHIP8_AUDIO_DEFAULT "alsa"
+#else
+	#define CHIP8_AUDIO_DEFAULT "null"
+#endif
+
+typedef struct chip8_audio chip8_audio;
+
+/*
+ * @brief Audio output backend driven by the consumer thread.
+ */
+typedef struct chip8_audio_backend {
+	const char* name; /* name used to select the backend */
+	bool realtime; /* consumes samples at the sample rate */
+	chip8_rc (*open)(chip8_audio*, const char*);
+	chip8_rc (*write)(chip8_audio*, const int16_t*, const size_t);
+	void (*close)(chip8_audio*);
+} chip8_audio_backend;
+
+/*
+ * @brief Sound timer audio output.
+ *
+ * The emulation thread synthesizes one frame of samples per emulated frame
+ * into the ring and the consumer thread drains it into the backend.
+ */
+struct chip8_audio {
+	chip8_ring ring; /* synthesized samples */
+	pthread_t thread; /* consumer thread */
+	sem_t drained; /* posted when recording backends free ring space */
+	atomic_bool running; /* consumer thread keeps draining */
+	const chip8_audio_backend* backend; /* output backend */
+	void* device; /* backend specific device handle */
+	uint32_t written; /* samples written by the backend */
+	uint64_t clock_ns; /* playback clock of the null backend */
+
+	bool muted; /* synthesize silence, set while fast-forwarding */
+	double phase; /* oscillator phase in cycles */
+	uint64_t overruns; /* samples trimmed by the producer */
+	atomic_uint_fast64_t underruns; /* periods padded by the consumer */
+};
+
+extern chip8_rc chip8_open_audio(chip8_audio[const static 1],
+		const char[static 1]);
+
+extern void chip8_audio_frame(chip8_audio[const static 1],
+		const chip8_vm[const static 1]);
+
+extern void chip8_close_audio(chip8_audio[const static 1]);
+
+#endif /* CHIP8_AUDIO_H */
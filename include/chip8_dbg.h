@@ -2,6 +2,7 @@
 #define CHIP8_DBG_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #ifdef NDEBUG
@@ -17,7 +18,7 @@
 do {															    	\
 	if (CHIP8_DBG_ON) {											    	\
 		fprintf(stderr, "great_chip-8::DEBUG::%s::%d::%s: " MSG "\n",	\
-		__FILE__, __LINE__+0UL, __func__, __VA_ARGS__);                 \
+		__FILE__, __LINE__, __func__, __VA_ARGS__);                      \
 	}															    	\
 } while (false)
 
@@ -46,7 +47,7 @@ CHIP8_DBG_PRE(CHIP8_DBG_FIRST(__VA_ARGS__) "%.0d",  \
 #define CHIP8_ISTR_LOG_PRE(MSG, ...)									\
 do {																    \
 	if (CHIP8_DBG_ON) {												    \
-		printf("great_chip-8::ISTR: " MSG "\n", __VA_ARGS__);	        \
+		fprintf(stderr, "great_chip-8::ISTR: " MSG "\n", __VA_ARGS__);  \
 	}																    \
 } while (false)
 
@@ -70,25 +71,26 @@ do {																    \
 			CHIP8_ISTR_LOG_LAST(__VA_ARGS__))
 
 /*
- * @brief Prints key input to standard output for debugging.
+ * @brief Prints key input to standard error for debugging.
  */
-#define CHIP8_KEY_PRESS(KEY)                                    \
-do {                                                            \
-	if (CHIP8_DBG_ON) {                                         \
-		printf("great_chip-8::INPUT: %X\n", (int) {0} = KEY);   \
-	}                                                           \
+#define CHIP8_KEY_PRESS(KEY)                                           \
+do {                                                                   \
+	if (CHIP8_DBG_ON) {                                                \
+		fprintf(stderr, "great_chip-8::INPUT: %X\n", (int) {0} = KEY); \
+	}                                                                  \
 } while (false)
 
 /*
- * @brief Dumps loaded memory contents to standard output.
+ * @brief Dumps loaded memory contents to standard error, keeping standard
+ * output free for the display stream.
  */
-#define CHIP8_MEM_DUMP(CHIP8_MEM)                                           \
+#define CHIP8_MEM_DUMP(CHIP8_VM)                                            \
 do {                                                                        \
 	if (CHIP8_DBG_ON) {                                                     \
-		if ((chip8_byte*){ 0 } = CHIP8_MEM) {                               \
-			for (chip8_word I_MEM = 0; I_MEM < CHIP8_MEM_SIZE; I_MEM++) {   \
-				printf("%04u: chip8->mem[0x%04X] = 0x%04X\n", I_MEM, I_MEM, \
-						CHIP8_MEM[I_MEM]);                                  \
+		if ((const chip8_vm*){ 0 } = CHIP8_VM) {                            \
+			for (uint32_t I_MEM = 0; I_MEM < CHIP8_MEM_SIZE; I_MEM++) {     \
+				fprintf(stderr, "%05u: chip8->mem[0x%04X] = 0x%02X\n",      \
+						I_MEM, I_MEM, chip8_mem_peek(CHIP8_VM, I_MEM));     \
 			}                                                               \
 		}                                                                   \
 	}                                                                       \
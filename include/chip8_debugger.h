@@ -0,0 +1,94 @@
+#ifndef CHIP8_DEBUGGER_H
+#define CHIP8_DEBUGGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "chip8.h"
+
+#define CHIP8_DEBUG_MAX_CONDS 64 /* conditional breakpoints */
+#define CHIP8_DEBUG_MAX_WATCHES 16
+#define CHIP8_DEBUG_WATCH_SIZE 64 /* largest watched range in bytes */
+#define CHIP8_DEBUG_LINE_SIZE 128
+
+/*
+ * @brief Flags of the per-address trap table.
+ */
+typedef enum chip8_trap {
+	CHIP8_TRAP_BREAK = 1 << 0, /* unconditional breakpoint */
+	CHIP8_TRAP_COND = 1 << 1 /* breakpoint with register conditions */
+} chip8_trap;
+
+/*
+ * @brief What the debugger runs until it stops again.
+ */
+typedef enum chip8_debug_mode {
+	CHIP8_DEBUG_RUN, /* until a breakpoint or watchpoint */
+	CHIP8_DEBUG_STEP, /* a number of instructions */
+	CHIP8_DEBUG_OVER, /* until back at the stack depth, over 2NNN calls */
+	CHIP8_DEBUG_OUT /* until 00EE returns from the current subroutine */
+} chip8_debug_mode;
+
+/*
+ * @brief Breakpoint condition comparing V[X] or I with a value.
+ */
+typedef struct chip8_debug_cond {
+	chip8_word addr; /* breakpoint address */
+	chip8_byte reg; /* register, REG_BANK_SIZE for the index */
+	char op[3]; /* ==, !=, <, <=, > or >= */
+	chip8_word value;
+} chip8_debug_cond;
+
+/*
+ * @brief Memory range stopping execution when an instruction changes it.
+ */
+typedef struct chip8_debug_watch {
+	chip8_word addr;
+	chip8_word size;
+	chip8_byte old[CHIP8_DEBUG_WATCH_SIZE]; /* contents when last checked */
+} chip8_debug_watch;
+
+/*
+ * @brief Console debugger attached to a virtual machine.
+ *
+ * Frames only run instruction by instruction while breakpoints, watchpoints
+ * or a step are pending, otherwise they run through chip8_run_frame() and
+ * the debugger costs nothing. Breakpoints are flags in a table indexed by
+ * address and watchpoints are checked only when the virtual machine marked
+ * one of their memory pages dirty.
+ */
+typedef struct chip8_debugger {
+	chip8_byte traps[CHIP8_MEM_SIZE]; /* chip8_trap flags per address */
+	unsigned trap_count; /* addresses with traps */
+	chip8_debug_cond conds[CHIP8_DEBUG_MAX_CONDS];
+	unsigned cond_count;
+	chip8_debug_watch watches[CHIP8_DEBUG_MAX_WATCHES];
+	unsigned watch_count;
+	uint64_t watch_pages; /* memory pages holding watched ranges */
+
+	chip8_debug_mode mode;
+	unsigned steps; /* instructions left with CHIP8_DEBUG_STEP */
+	chip8_word depth; /* stack depth to return to */
+	bool in_frame; /* stopped inside a frame */
+	unsigned executed; /* instructions of the current frame */
+	bool resume; /* skip the trap of the instruction it stopped at */
+	bool stopped; /* waiting at the prompt */
+	atomic_bool interrupt; /* stop before the next frame */
+	char last[CHIP8_DEBUG_LINE_SIZE]; /* command an empty line repeats */
+} chip8_debugger;
+
+extern chip8_debugger* chip8_new_debugger(void);
+
+extern void chip8_debug_catch_interrupt(chip8_debugger[static 1]);
+
+extern chip8_rc chip8_debug_frame(chip8_debugger[static 1],
+		chip8_vm[const static 1], const unsigned, uint32_t* const);
+
+extern chip8_rc chip8_debug_prompt(chip8_debugger[static 1],
+		chip8_vm[const static 1]);
+
+extern chip8_word chip8_debug_format(const chip8_vm[const static 1],
+		const chip8_word, char[const], const size_t);
+
+#endif /* CHIP8_DEBUGGER_H */
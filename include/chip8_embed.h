@@ -0,0 +1,20 @@
+#ifndef CHIP8_EMBED_H
+#define CHIP8_EMBED_H
+
+#include "chip8.h"
+
+#define CHIP8_FONT_ADDR 0x000
+#define CHIP8_FONT_SIZE 80 /* 16 glyphs of 8x5 */
+#define CHIP8_BIG_FONT_ADDR (CHIP8_FONT_ADDR + CHIP8_FONT_SIZE)
+#define CHIP8_BIG_FONT_SIZE 160 /* 16 SUPER-CHIP glyphs of 8x10 */
+
+/*
+ * Generated at build time by tools/chip8_font_gen.c so the emulator does not
+ * touch the file system on startup.
+ */
+extern const chip8_byte chip8_font[CHIP8_FONT_SIZE];
+extern const chip8_byte chip8_big_font[CHIP8_BIG_FONT_SIZE];
+extern const char chip8_vert_shader_src[];
+extern const char chip8_frag_shader_src[];
+
+#endif /* CHIP8_EMBED_H */
@@ -0,0 +1,104 @@
+#ifndef CHIP8_ENV_H
+#define CHIP8_ENV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "chip8.h"
+
+#define CHIP8_ENV_MAX_ACTIONS 256
+#define CHIP8_ENV_OBS_WIDTH CHIP8_GFX_RES_WIDTH
+#define CHIP8_ENV_OBS_HEIGHT CHIP8_GFX_RES_HEIGHT
+
+/*
+ * @brief Observation layouts, high resolution displays are downsampled to
+ * 64x32 by combining 2x2 pixel blocks.
+ */
+typedef enum chip8_env_obs {
+	CHIP8_ENV_OBS_PACKED, /* 1 bit per pixel of any plane, 8 bytes per row */
+	CHIP8_ENV_OBS_BYTES /* 1 byte color index per pixel */
+} chip8_env_obs;
+
+typedef float (*chip8_env_reward)(const chip8_vm*, unsigned, void*);
+
+typedef bool (*chip8_env_done)(const chip8_vm*, unsigned, void*);
+
+/*
+ * @brief Environment parameters, zeroed fields select the defaults.
+ */
+typedef struct chip8_env_config {
+	unsigned count; /* virtual machines stepped together */
+	unsigned threads; /* stepping threads, 0 for one per core */
+	unsigned cycles; /* instructions per frame */
+	unsigned frame_skip; /* frames run per step with the action held */
+	uint64_t max_frames; /* frames per episode, 0 for unlimited */
+	chip8_env_obs obs; /* observation layout */
+	unsigned action_count; /* 0 for no key and each single key */
+	chip8_word actions[CHIP8_ENV_MAX_ACTIONS]; /* keypad bitmask per action */
+	chip8_env_reward reward; /* reward per frame, NULL for none */
+	chip8_env_done done; /* ends episodes besides halting, may be NULL */
+	void* user; /* passed to reward and done */
+} chip8_env_config;
+
+typedef struct chip8_env chip8_env;
+
+/*
+ * @brief Thread stepping a contiguous slice of the virtual machines.
+ */
+typedef struct chip8_env_worker {
+	chip8_env* env;
+	pthread_t thread;
+	unsigned begin;
+	unsigned end;
+	uint64_t generation; /* last batch this worker ran */
+} chip8_env_worker;
+
+/*
+ * @brief Batch of virtual machines stepped in lockstep.
+ *
+ * Observations, rewards and done flags are written straight into caller
+ * buffers, which may live in shared memory. Episodes that end are reset
+ * within the step and their observation is the first one of the next
+ * episode.
+ */
+struct chip8_env {
+	chip8_env_config config;
+	chip8_vm* rom; /* state every episode starts from */
+	chip8_vm* vms;
+	uint32_t* seeds; /* seed of each machine's current episode */
+	size_t obs_size; /* observation bytes per machine */
+
+	/* batch being stepped */
+	const uint32_t* actions; /* NULL to reset */
+	const uint32_t* reset_seeds; /* NULL for the machine indices */
+	chip8_byte* obs;
+	float* rewards;
+	uint8_t* dones;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start; /* signals a new generation */
+	uint64_t generation; /* batches started */
+	atomic_uint pending; /* workers still running the batch */
+	bool stop;
+	unsigned worker_count; /* including the calling thread */
+	chip8_env_worker* workers;
+};
+
+extern chip8_env* chip8_new_env(const chip8_env_config[const static 1],
+		const char[static 1]);
+
+extern size_t chip8_env_obs_size(const chip8_env[const static 1]);
+
+extern void chip8_env_reset(chip8_env[const static 1], const uint32_t* const,
+		void* const);
+
+extern void chip8_env_step(chip8_env[const static 1],
+		const uint32_t[const static 1], void* const, float[const static 1],
+		uint8_t[const static 1]);
+
+extern void chip8_free_env(chip8_env* const);
+
+#endif /* CHIP8_ENV_H */
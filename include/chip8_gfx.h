@@ -2,12 +2,14 @@
 #define CHIP8_GFX_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <GLFW/glfw3.h>
 
 #include "chip8.h"
 
-#define CHIP8_VERT_SHADER_PATH "./src/shaders/chip8_shader.v.glsl"
-#define CHIP8_FRAG_SHADER_PATH "./src/shaders/chip8_shader.f.glsl"
+#define CHIP8_PROGRAM_CACHE "great_chip-8/program.bin"
+#define CHIP8_PROGRAM_CACHE_MAGIC "C8PB"
+#define CHIP8_PROGRAM_CACHE_VERSION 1
 
 #define CHIP8_DEFAULT_RES_SCALE 12.5f
 
@@ -17,15 +19,17 @@
 typedef struct chip8_renderer {
 	GLuint shader_program; /* shader program ID */
 	GLuint vertex_array; /* vertex array ID */
-	GLint model_location; /* model matrix location */
+	GLuint texture; /* display texture ID */
 
-	GLfloat projection[16]; /* projection matrix */
-	GLfloat model[16]; /* model matrix */
-	GLfloat sprite_color[3]; /* sprite color */
+	GLfloat palette[CHIP8_GFX_COLORS][3]; /* color of each plane combination */
+	GLubyte pixels[CHIP8_GFX_HIRES_HEIGHT * CHIP8_GFX_HIRES_WIDTH]; /* indices */
 
 	GLfloat scale; /* resolution scalar */
 	GLuint width; /* resolution width */
 	GLuint height; /* resolution height */
+
+	uint64_t program_ns; /* time spent building the shader program */
+	bool program_cached; /* shader program loaded from binary cache */
 } chip8_renderer;
 
 extern chip8_rc chip8_init_gfx(GLFWwindow** const, chip8_renderer** const,
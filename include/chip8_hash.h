@@ -0,0 +1,59 @@
+#ifndef CHIP8_HASH_H
+#define CHIP8_HASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+/*
+ * @brief 128-bit hash, two independently mixed 64-bit lanes.
+ */
+typedef struct chip8_hash128 {
+	uint64_t lo;
+	uint64_t hi;
+} chip8_hash128;
+
+static inline uint64_t chip8_rotl64(const uint64_t x, const unsigned r)
+{
+	return x << r | x >> (64 - r);
+}
+
+/*
+ * @brief Mixes a 64-bit word into both lanes, each lane is an xxHash64
+ * style round with its own constants.
+ */
+static inline void chip8_hash_word(chip8_hash128 hash[const static 1],
+		const uint64_t word)
+{
+	hash->lo = chip8_rotl64(hash->lo + word * 0xC2B2AE3D27D4EB4FULL, 31)
+		* 0x9E3779B185EBCA87ULL;
+	hash->hi = chip8_rotl64(hash->hi ^ word * 0x165667B19E3779F9ULL, 27)
+		* 0xD6E8FEB86659FD93ULL + 0x27D4EB2F165667C5ULL;
+}
+
+/*
+ * @brief Avalanches both lanes into each other, the result of a hash.
+ */
+static inline chip8_hash128 chip8_hash_final(chip8_hash128 hash)
+{
+	hash.lo ^= hash.hi;
+	hash.lo ^= hash.lo >> 33;
+	hash.lo *= 0xFF51AFD7ED558CCDULL;
+	hash.lo ^= hash.lo >> 33;
+	hash.hi += hash.lo;
+	hash.hi ^= hash.hi >> 29;
+	hash.hi *= 0xC4CEB9FE1A85EC53ULL;
+	hash.hi ^= hash.hi >> 32;
+	return hash;
+}
+
+static inline bool chip8_hash_equal(const chip8_hash128 a,
+		const chip8_hash128 b)
+{
+	return a.lo == b.lo && a.hi == b.hi;
+}
+
+extern chip8_hash128 chip8_hash_vm(const chip8_vm[const static 1]);
+
+#endif /* CHIP8_HASH_H */
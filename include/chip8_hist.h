@@ -0,0 +1,59 @@
+#ifndef CHIP8_HIST_H
+#define CHIP8_HIST_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define CHIP8_HIST_SUB_BITS 6 /* log2 of the buckets per power of two */
+#define CHIP8_HIST_SUB (1 << CHIP8_HIST_SUB_BITS)
+#define CHIP8_HIST_BUCKETS ((64 - CHIP8_HIST_SUB_BITS) * CHIP8_HIST_SUB / 2 \
+		+ CHIP8_HIST_SUB)
+
+/*
+ * @brief Fixed size histogram of 64-bit values with a bounded relative
+ * error, in the manner of HdrHistogram.
+ *
+ * Values below CHIP8_HIST_SUB have a bucket each, every power of two above
+ * is split into CHIP8_HIST_SUB / 2 buckets, so a reported value is at most
+ * 1 / 32 above the recorded one over the whole range.
+ */
+typedef struct chip8_hist {
+	uint64_t count;
+	uint64_t max;
+	uint64_t buckets[CHIP8_HIST_BUCKETS];
+} chip8_hist;
+
+/*
+ * @brief Returns the bucket of a value.
+ */
+static inline unsigned chip8_hist_bucket(const uint64_t value)
+{
+	if (value < CHIP8_HIST_SUB) {
+		return value;
+	}
+	const unsigned shift = 63 - __builtin_clzll(value)
+		- (CHIP8_HIST_SUB_BITS - 1);
+
+	return shift * CHIP8_HIST_SUB / 2 + (value >> shift);
+}
+
+static inline void chip8_hist_record(chip8_hist hist[const static 1],
+		const uint64_t value)
+{
+	hist->buckets[chip8_hist_bucket(value)]++;
+	hist->count++;
+	hist->max = value > hist->max ? value : hist->max;
+}
+
+extern uint64_t chip8_hist_percentile(const chip8_hist[const static 1],
+		const double);
+
+extern void chip8_merge_hist(chip8_hist[restrict const static 1],
+		const chip8_hist[restrict const static 1]);
+
+extern void chip8_print_hist(FILE* const, const char[static 1],
+		const chip8_hist[const static 1], const double, const char[static 1]);
+
+#endif /* CHIP8_HIST_H */
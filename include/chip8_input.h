@@ -0,0 +1,41 @@
+#ifndef CHIP8_INPUT_H
+#define CHIP8_INPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+#define CHIP8_INPUT_QUEUE_SIZE 64 /* must be a power of two */
+
+/*
+ * @brief Single keypad transition as delivered by the host.
+ */
+typedef struct chip8_input_event {
+	uint64_t time_ns; /* host timestamp of the event */
+	uint64_t frame; /* emulated frame the event was polled in */
+	chip8_byte key; /* chip-8 key */
+	bool pressed; /* key pressed or released */
+} chip8_input_event;
+
+/*
+ * @brief Fixed-capacity queue of keypad events between host and core.
+ *
+ * The host pushes events as they are polled once per frame and the core
+ * applies them at the start of the next emulated frame.
+ */
+typedef struct chip8_input_queue {
+	uint32_t head; /* next event to apply */
+	uint32_t tail; /* next free slot */
+	uint64_t frame; /* frame newly pushed events are tagged with */
+	bool fast_forward; /* host holds the fast-forward key */
+	chip8_input_event events[CHIP8_INPUT_QUEUE_SIZE];
+} chip8_input_queue;
+
+extern chip8_rc chip8_push_input(chip8_input_queue[const static 1],
+		const chip8_key, const bool, const uint64_t);
+
+extern void chip8_apply_input(chip8_input_queue[const static 1],
+		chip8_vm[const static 1]);
+
+#endif /* CHIP8_INPUT_H */
@@ -13,12 +13,23 @@ typedef enum chip8_opcode {
 	MIV, JMPI, RNDMSK, DRWSPT, SKPKEY,
 	SKPNKEY, MOVDLY, WTKEY, SETDLY, SETSND,
 	IADD, ISETSPT, IBCD, REGDMP, REGLD,
+	SCD, SCR, SCL, HALT, LORES,
+	HIRES, DRWBIG, BIGSPT, RPLDMP, RPLLD,
+	SCU, LDIL, PLANE, AUDIO, PITCH,
+	RNGDMP, RNGLD,
 	CHIP8_ISTR_SET_SIZE
 } chip8_opcode;
 
 typedef void chip8_istr(chip8_vm[const static 1]);
 
-extern chip8_istr* chip8_istr_set[CHIP8_ISTR_SET_SIZE];
+extern chip8_istr* const chip8_istr_set[CHIP8_QUIRKS_SIZE][CHIP8_ISTR_SET_SIZE];
+
+extern const char* const chip8_quirks_name[CHIP8_QUIRKS_SIZE];
+
+extern const char* const chip8_istr_name[CHIP8_ISTR_SET_SIZE];
+
+extern chip8_rc chip8_parse_quirks(chip8_quirks[const static 1],
+		const char[static 1]);
 
 extern chip8_opcode chip8_disassemble(const chip8_word);
 
@@ -0,0 +1,54 @@
+#ifndef CHIP8_LATENCY_H
+#define CHIP8_LATENCY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_hist.h"
+#include "chip8_input.h"
+
+/*
+ * @brief Input to photon latency and frame pacing measurements of a host.
+ *
+ * A keypad edge is followed from its host event timestamp to the first
+ * instruction reading the key, SKPKEY, SKPNKEY or a completed WTKEY, to the
+ * return of the next render and of the buffer swap after it. All times are
+ * in nanoseconds.
+ */
+typedef struct chip8_latency {
+	uint64_t event_ns[CHIP8_KEY_SIZE]; /* oldest unread edge, 0 for none */
+	uint64_t read_event_ns[CHIP8_KEY_SIZE]; /* read edges awaiting a present */
+	uint64_t read_ns[CHIP8_KEY_SIZE]; /* when the edge was read, 0 for none */
+	uint64_t frame_ns; /* start of the last paced frame, 0 after a pause */
+
+	chip8_hist to_read; /* key event to the first instruction reading it */
+	chip8_hist to_render; /* read to the return of the render */
+	chip8_hist to_swap; /* render to the return of the buffer swap */
+	chip8_hist total; /* key event to the return of the buffer swap */
+	chip8_hist frame_interval; /* between starts of paced frames */
+	chip8_hist jitter; /* deviation of the interval from a 60 Hz frame */
+} chip8_latency;
+
+/*
+ * @brief Restarts frame interval measurements after the loop stopped
+ * pacing, while it waited for input, the debugger or fast-forwarded.
+ */
+static inline void chip8_latency_pause(chip8_latency latency[const static 1])
+{
+	latency->frame_ns = 0;
+}
+
+extern void chip8_latency_input(chip8_latency[const static 1],
+		const chip8_input_queue[const static 1], uint32_t);
+
+extern void chip8_latency_frame(chip8_latency[const static 1],
+		chip8_vm[const static 1], const uint64_t, const uint64_t);
+
+extern void chip8_latency_present(chip8_latency[const static 1],
+		const uint64_t, const uint64_t);
+
+extern void chip8_print_latency(FILE* const,
+		const chip8_latency[const static 1]);
+
+#endif /* CHIP8_LATENCY_H */
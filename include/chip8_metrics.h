@@ -0,0 +1,100 @@
+#ifndef CHIP8_METRICS_H
+#define CHIP8_METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "chip8_istr.h"
+
+#define CHIP8_METRICS_NAME_SIZE 32
+#define CHIP8_METRICS_RESPONSE_SIZE (64 * 1024)
+
+/*
+ * @brief Counters and gauges a recording thread keeps, summed over threads
+ * when scraped.
+ */
+typedef enum chip8_metric {
+	CHIP8_METRIC_ISTRS, /* instructions executed */
+	CHIP8_METRIC_FRAMES, /* emulated 60 Hz frames */
+	CHIP8_METRIC_PRESENTS, /* frames presented or sent to a client */
+	CHIP8_METRIC_SKIPPED, /* emulated frames with a draw not presented */
+	CHIP8_METRIC_DROPPED, /* 60 Hz frames the host fell behind and gave up */
+	CHIP8_METRIC_WAIT_KEY_NS, /* host time machines spent blocked in FX0A */
+	CHIP8_METRIC_WAITING, /* gauge, machines blocked in FX0A */
+	CHIP8_METRICS_SIZE
+} chip8_metric;
+
+/*
+ * @brief Metrics of one recording thread.
+ *
+ * Only the owning thread writes a shard, with relaxed loads and stores
+ * that compile to plain moves, so recording never waits on a locked
+ * read-modify-write or on another core's cache line. The exporter thread
+ * reads every shard when scraped. Shards are cache line aligned to keep
+ * threads from sharing lines.
+ */
+typedef struct chip8_metrics_shard {
+	_Alignas(64) atomic_uint_fast64_t values[CHIP8_METRICS_SIZE];
+	atomic_uint_fast64_t opcodes[CHIP8_ISTR_SET_SIZE]; /* by chip8_opcode */
+	atomic_bool registered; /* set once the fields below are */
+	bool cpu_clocked; /* the owning thread's CPU time clock is known */
+	clockid_t cpu_clock;
+	char name[CHIP8_METRICS_NAME_SIZE];
+} chip8_metrics_shard;
+
+/*
+ * @brief Exporter thread serving the metrics of all shards in Prometheus
+ * text format over a Unix socket or a loopback TCP port.
+ *
+ * Every connection is answered with an HTTP response of the current values
+ * and closed, whatever was requested.
+ */
+typedef struct chip8_metrics {
+	chip8_metrics_shard* shards;
+	unsigned capacity; /* shards allocated */
+	atomic_uint count; /* shards handed out */
+	pthread_t thread; /* exporter thread */
+	atomic_bool running; /* exporter thread keeps serving */
+	int listen_fd;
+	const char* path; /* Unix socket path, NULL for a TCP port */
+	uint64_t scrapes; /* exporter thread only */
+	char response[CHIP8_METRICS_RESPONSE_SIZE]; /* exporter thread only */
+} chip8_metrics;
+
+/*
+ * @brief Adds to a counter or gauge of the calling thread's shard.
+ */
+static inline void chip8_metrics_add(chip8_metrics_shard shard[const static 1],
+		const chip8_metric metric, const uint64_t value)
+{
+	atomic_store_explicit(&shard->values[metric],
+			atomic_load_explicit(&shard->values[metric], memory_order_relaxed)
+			+ value, memory_order_relaxed);
+}
+
+static inline void chip8_metrics_set(chip8_metrics_shard shard[const static 1],
+		const chip8_metric metric, const uint64_t value)
+{
+	atomic_store_explicit(&shard->values[metric], value, memory_order_relaxed);
+}
+
+extern chip8_rc chip8_open_metrics(chip8_metrics[const static 1],
+		const char* const, const unsigned);
+
+extern chip8_metrics_shard* chip8_metrics_register(
+		chip8_metrics[const static 1], const char[static 1]);
+
+extern void chip8_metrics_opcodes(chip8_metrics_shard[const static 1],
+		uint32_t[const static CHIP8_ISTR_SET_SIZE]);
+
+extern void chip8_metrics_wait(chip8_metrics_shard[const static 1],
+		uint64_t[const static 1], const chip8_vm[const static 1],
+		const uint64_t);
+
+extern void chip8_close_metrics(chip8_metrics[const static 1]);
+
+#endif /* CHIP8_METRICS_H */
@@ -0,0 +1,38 @@
+#ifndef CHIP8_RING_H
+#define CHIP8_RING_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "chip8.h"
+
+/*
+ * @brief Lock-free single-producer single-consumer byte ring.
+ *
+ * The producer only ever stores the tail and the consumer only the head, so
+ * neither side takes a lock or allocates once the ring is created.
+ * Positions increase monotonically and are masked by the power of two
+ * capacity when indexing.
+ */
+typedef struct chip8_ring {
+	_Alignas(64) atomic_size_t head; /* consumer position */
+	_Alignas(64) atomic_size_t tail; /* producer position */
+	size_t mask; /* capacity - 1 */
+	chip8_byte* data; /* ring storage */
+} chip8_ring;
+
+extern chip8_rc chip8_init_ring(chip8_ring[const static 1], const size_t);
+
+extern void chip8_free_ring(chip8_ring[const static 1]);
+
+extern size_t chip8_ring_readable(chip8_ring[const static 1]);
+
+extern size_t chip8_ring_writable(chip8_ring[const static 1]);
+
+extern size_t chip8_ring_write(chip8_ring[const restrict static 1],
+		const void* restrict, const size_t);
+
+extern size_t chip8_ring_read(chip8_ring[const restrict static 1],
+		void* restrict, const size_t);
+
+#endif /* CHIP8_RING_H */
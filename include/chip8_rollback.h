@@ -0,0 +1,91 @@
+#ifndef CHIP8_ROLLBACK_H
+#define CHIP8_ROLLBACK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+#include "chip8_hist.h"
+
+#define CHIP8_ROLLBACK_DEPTH 8 /* default frames a misprediction reaches back */
+#define CHIP8_ROLLBACK_DEPTH_MAX 16
+#define CHIP8_ROLLBACK_INPUTS 64 /* frames of inputs kept, a power of two */
+#define CHIP8_ROLLBACK_MAGIC 0xC8
+#define CHIP8_ROLLBACK_HEADER_SIZE 22
+#define CHIP8_ROLLBACK_PACKET_SIZE \
+	(CHIP8_ROLLBACK_HEADER_SIZE + 2 * CHIP8_ROLLBACK_INPUTS)
+
+/* 1 2 4 5 7 8 A 0, the left half of the keypad, the rest is player 2's */
+#define CHIP8_ROLLBACK_LEFT_KEYS 0x05B7
+
+/*
+ * @brief Hash of the state at the start of a frame both peers have all
+ * inputs of, compared to detect desynchronization.
+ */
+typedef struct chip8_rollback_hash {
+	uint64_t frame;
+	uint64_t hash;
+} chip8_rollback_hash;
+
+/*
+ * @brief Rollback netplay of two peers sharing the keypad.
+ *
+ * Each peer runs a frame as soon as its own input is known, predicting that
+ * the remote player still holds the keys of their last received frame.
+ * The state at the start of each of the last depth frames is kept in a
+ * preallocated ring of snapshots. Memory pages are shared copy-on-write
+ * with the live machine, so a snapshot costs the state outside memory and
+ * the pages written since the slot was last used. A received input that
+ * differs from its prediction restores the snapshot of its frame and runs
+ * the frames since again, all before the next frame is presented. A peer
+ * more than depth frames ahead of the inputs it received stalls instead.
+ *
+ * Packets carry the local inputs the peer has not acknowledged, so lost
+ * packets are made up for by the next one, the number of remote frames
+ * received and the state hash of the latest frame with all inputs known.
+ * Numbers are little-endian: magic byte, input count, first input frame,
+ * acknowledged frames, hash frame (32 bits each), hash (64 bits), inputs
+ * (16 bits each).
+ */
+typedef struct chip8_rollback {
+	chip8_vm* snapshots; /* states at the start of frames, depth + 1 */
+	unsigned depth; /* frames a misprediction may reach back */
+	unsigned cycles; /* instructions per frame */
+	chip8_word mask; /* keys of the local player */
+	uint64_t frame; /* next frame to run */
+	uint64_t received; /* remote inputs are known below this frame */
+	uint64_t acked; /* the peer has the local inputs below this frame */
+	uint64_t replay; /* first frame run on a wrong prediction, or frame */
+	chip8_word local[CHIP8_ROLLBACK_INPUTS];
+	chip8_word remote[CHIP8_ROLLBACK_INPUTS]; /* predicted from received */
+	chip8_rollback_hash hashes[CHIP8_ROLLBACK_INPUTS];
+	chip8_rollback_hash peer_hash; /* latest hash received */
+	uint64_t hashed; /* frames below are hashed */
+
+	uint64_t rollbacks; /* mispredictions replayed */
+	uint64_t replayed; /* frames run again */
+	uint64_t stalls; /* host frames waiting for remote input */
+	uint64_t desyncs; /* hashes differing from the peer's */
+	uint64_t desync_frame; /* first frame with a differing hash */
+	uint64_t replay_ns; /* sum of replay times */
+	chip8_hist replay_time; /* time of each replay in ns */
+} chip8_rollback;
+
+extern chip8_rc chip8_init_rollback(chip8_rollback[const static 1],
+		const unsigned, const unsigned, const unsigned);
+
+extern void chip8_free_rollback(chip8_rollback[const static 1]);
+
+extern chip8_rc chip8_rollback_advance(chip8_rollback[const static 1],
+		chip8_vm[const static 1], const chip8_word);
+
+extern chip8_rc chip8_rollback_sync(chip8_rollback[const static 1],
+		chip8_vm[const static 1]);
+
+extern size_t chip8_rollback_pack(const chip8_rollback[const static 1],
+		chip8_byte[const static CHIP8_ROLLBACK_PACKET_SIZE]);
+
+extern chip8_rc chip8_rollback_unpack(chip8_rollback[const static 1],
+		const chip8_byte* const, const size_t);
+
+#endif /* CHIP8_ROLLBACK_H */
@@ -0,0 +1,77 @@
+#ifndef CHIP8_ROM_H
+#define CHIP8_ROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define CHIP8_ROM_MAX_SIZE (CHIP8_MEM_SIZE - CHIP8_ROM_ADDR)
+#define CHIP8_ROM_EXT ".ch8"
+#define CHIP8_ROM_NAME_MAX 255
+#define CHIP8_PATH_MAX 4096
+
+#define CHIP8_CATALOG_FILE ".chip8_catalog"
+#define CHIP8_CATALOG_VERSION 3
+
+/*
+ * @brief Hints gathered by statically scanning a ROM image.
+ */
+typedef enum chip8_rom_flag {
+	CHIP8_ROM_INPUT = 1 << 0, /* reads the keypad */
+	CHIP8_ROM_SOUND = 1 << 1, /* sets the sound timer */
+	CHIP8_ROM_SCHIP = 1 << 2, /* contains SUPER-CHIP opcodes */
+	CHIP8_ROM_XOCHIP = 1 << 3 /* contains XO-CHIP opcodes */
+} chip8_rom_flag;
+
+/*
+ * @brief Read-only memory mapping of a ROM file.
+ */
+typedef struct chip8_rom {
+	const chip8_byte* data; /* mapped ROM contents */
+	size_t size; /* ROM size in bytes */
+	uint64_t hash; /* content hash */
+} chip8_rom;
+
+/*
+ * @brief Cached description of a single ROM inside a catalog.
+ */
+typedef struct chip8_rom_entry {
+	char name[CHIP8_ROM_NAME_MAX+1]; /* file name relative to catalog */
+	uint64_t hash; /* content hash */
+	uint32_t size; /* ROM size in bytes */
+	uint32_t flags; /* chip8_rom_flag analysis results */
+	int64_t mtime; /* modification time in nanoseconds */
+} chip8_rom_entry;
+
+/*
+ * @brief ROM directory listing backed by an on-disk cache.
+ */
+typedef struct chip8_catalog {
+	char dir[CHIP8_PATH_MAX]; /* ROM directory */
+	size_t count; /* number of entries */
+	size_t capacity; /* allocated entries */
+	chip8_rom_entry* entries; /* entries sorted by name */
+} chip8_catalog;
+
+extern uint64_t chip8_hash(const void* const, const size_t);
+
+extern chip8_rc chip8_map_rom(chip8_rom[const static 1], const char[static 1]);
+
+extern void chip8_unmap_rom(chip8_rom[const static 1]);
+
+extern chip8_quirks chip8_rom_quirks(const chip8_rom[const static 1]);
+
+extern chip8_rc chip8_load_rom(chip8_vm[const static 1], const char[static 1]);
+
+extern uint32_t chip8_analyze_rom(const chip8_byte[const], const size_t);
+
+extern chip8_rc chip8_open_catalog(chip8_catalog[const static 1],
+		const char[static 1]);
+
+extern const chip8_rom_entry* chip8_find_rom(const chip8_catalog[const static 1],
+		const char[static 1]);
+
+extern void chip8_close_catalog(chip8_catalog[const static 1]);
+
+#endif /* CHIP8_ROM_H */
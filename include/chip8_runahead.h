@@ -0,0 +1,43 @@
+#ifndef CHIP8_RUNAHEAD_H
+#define CHIP8_RUNAHEAD_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_hist.h"
+
+#define CHIP8_RUNAHEAD_MAX 8 /* frames a host frame may run ahead */
+
+/*
+ * @brief Run-ahead presentation, hiding the frames a ROM takes to act on
+ * the input it read.
+ *
+ * Every host frame the machine is copied to a scratch machine, which runs
+ * frames ahead with the current keys and is presented in place of the
+ * machine. Memory pages are shared copy-on-write, so the copy costs the
+ * state outside memory and the pages the scratch machine last wrote, and
+ * the machine itself is never restored since it never ran ahead. Sound,
+ * streams and exports follow the machine, not the scratch machine.
+ */
+typedef struct chip8_runahead {
+	chip8_vm ahead; /* the machine frames ahead, what is presented */
+	unsigned frames; /* frames run ahead, 0 when disabled */
+	unsigned cycles; /* instructions per frame */
+	uint64_t runs; /* host frames run ahead */
+	uint64_t run_ns; /* sum of copying and running ahead */
+	chip8_hist run_time; /* time of each run ahead in ns */
+} chip8_runahead;
+
+extern chip8_rc chip8_init_runahead(chip8_runahead[const static 1],
+		const unsigned, const unsigned);
+
+extern void chip8_free_runahead(chip8_runahead[const static 1]);
+
+extern chip8_rc chip8_run_ahead(chip8_runahead[const static 1],
+		const chip8_vm[const static 1]);
+
+extern void chip8_print_runahead(FILE* const,
+		const chip8_runahead[const static 1]);
+
+#endif /* CHIP8_RUNAHEAD_H */
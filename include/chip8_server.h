@@ -0,0 +1,40 @@
+#ifndef CHIP8_SERVER_H
+#define CHIP8_SERVER_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define CHIP8_SERVER_SOCKET "/tmp/great_chip-8.sock"
+#define CHIP8_SERVER_MSG_SIZE 8 /* client messages */
+#define CHIP8_SERVER_ACK_SIZE 5
+
+/*
+ * @brief Message types of the session protocol.
+ *
+ * A client sends fixed size messages of a type byte, the key, whether it is
+ * pressed, a zero byte and a little-endian sequence number. The server
+ * starts with the display stream header, then sends messages of a type
+ * byte followed by a stream record or a little-endian sequence number.
+ */
+typedef enum chip8_server_msg {
+	CHIP8_SERVER_KEY = 1, /* client keypad event */
+	CHIP8_SERVER_FRAME, /* display stream record of the session */
+	CHIP8_SERVER_ACK /* last input applied before the next frame record */
+} chip8_server_msg;
+
+static inline void chip8_put_le32(chip8_byte dst[const static 4],
+		const uint32_t value)
+{
+	for (unsigned i = 0; i < 4; i++) {
+		dst[i] = value >> 8 * i;
+	}
+}
+
+static inline uint32_t chip8_get_le32(const chip8_byte src[const static 4])
+{
+	return src[0] | src[1] << 8 | (uint32_t) src[2] << 16
+		| (uint32_t) src[3] << 24;
+}
+
+#endif /* CHIP8_SERVER_H */
@@ -0,0 +1,86 @@
+#ifndef CHIP8_SHM_H
+#define CHIP8_SHM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "chip8.h"
+
+#define CHIP8_SHM_MAGIC "C8SM"
+#define CHIP8_SHM_VERSION 1
+#define CHIP8_SHM_NAME "/great_chip-8" /* default shared memory object */
+#define CHIP8_SHM_SLOTS 16 /* frames kept for readers that fall behind */
+
+/*
+ * @brief Machine state published at the end of a frame.
+ */
+typedef struct chip8_shm_state {
+	uint64_t index; /* publication number, slot index modulo the slots */
+	uint64_t frame; /* emulated frame number */
+	chip8_word pc;
+	chip8_word sp;
+	chip8_word idx;
+	chip8_word keys;
+	chip8_byte regs[REG_BANK_SIZE];
+	chip8_word stack[CHIP8_STACK_SIZE];
+	chip8_byte dly_tmr;
+	chip8_byte snd_tmr;
+	chip8_byte state;
+	chip8_byte quirks;
+	bool hires;
+	chip8_byte plane;
+	uint64_t gfx[CHIP8_GFX_PLANES][CHIP8_GFX_HIRES_HEIGHT]
+		[CHIP8_GFX_ROW_WORDS]; /* same layout as chip8_vm.gfx */
+} chip8_shm_state;
+
+/*
+ * @brief Slot versioned as a seqlock, the sequence is odd while the writer
+ * is filling it.
+ */
+typedef struct chip8_shm_slot {
+	_Alignas(64) atomic_uint seq;
+	chip8_shm_state state;
+} chip8_shm_slot;
+
+/*
+ * @brief Layout of the shared memory object.
+ *
+ * The emulator is the only writer and never waits for readers: a frame
+ * goes into slot published modulo the slots and published is incremented
+ * after it. Readers copy a slot and retry when its sequence was odd or
+ * changed during the copy, so they need no syscalls and cannot slow the
+ * emulator down. The magic is written last and cleared first.
+ */
+typedef struct chip8_shm_ring {
+	char magic[4];
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t slot_size; /* sizeof(chip8_shm_slot) of the writer */
+	_Alignas(64) atomic_uint_fast64_t published; /* frames published */
+	chip8_shm_slot slots[CHIP8_SHM_SLOTS];
+} chip8_shm_ring;
+
+/*
+ * @brief Writer side of the shared memory export.
+ */
+typedef struct chip8_shm {
+	chip8_shm_ring* ring;
+	const char* name;
+} chip8_shm;
+
+extern chip8_rc chip8_open_shm(chip8_shm[const static 1], const char* const);
+
+extern void chip8_shm_publish(chip8_shm[const static 1],
+		const chip8_vm[const static 1]);
+
+extern void chip8_close_shm(chip8_shm[const static 1]);
+
+extern chip8_shm_ring* chip8_map_shm(const char[const static 1]);
+
+extern chip8_rc chip8_shm_read(chip8_shm_ring[const static 1], const uint64_t,
+		chip8_shm_state[const static 1]);
+
+extern void chip8_unmap_shm(chip8_shm_ring* const);
+
+#endif /* CHIP8_SHM_H */
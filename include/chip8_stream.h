@@ -0,0 +1,145 @@
+#ifndef CHIP8_STREAM_H
+#define CHIP8_STREAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "chip8.h"
+#include "chip8_ring.h"
+
+#define CHIP8_STREAM_MAGIC "C8FS"
+#define CHIP8_STREAM_VERSION 1
+#define CHIP8_STREAM_HEADER_SIZE 5 /* magic and version */
+#define CHIP8_STREAM_PLANE_SIZE \
+	(CHIP8_GFX_HIRES_WIDTH * CHIP8_GFX_HIRES_HEIGHT / 8)
+#define CHIP8_STREAM_FRAME_SIZE (CHIP8_GFX_PLANES * CHIP8_STREAM_PLANE_SIZE)
+#define CHIP8_STREAM_RECORD_SIZE (2 * CHIP8_STREAM_FRAME_SIZE + 32) /* bound */
+#define CHIP8_STREAM_QUEUE 16 /* frames queued for the writer thread */
+#define CHIP8_STREAM_KEY_INTERVAL 600 /* frames between keyframes */
+
+/*
+ * @brief Flags leading every frame record.
+ */
+typedef enum chip8_stream_flag {
+	CHIP8_STREAM_KEY = 1 << 0, /* payload is the frame, not an XOR delta */
+	CHIP8_STREAM_HIRES = 1 << 1 /* frame is 128x64 */
+} chip8_stream_flag;
+
+/*
+ * @brief Display packed to 1 bit per pixel, plane after plane, rows of the
+ * current resolution top to bottom with the leftmost pixel in the high bit.
+ */
+typedef struct chip8_stream_frame {
+	uint64_t frame; /* emulated frame number */
+	bool hires; /* 128x64 SUPER-CHIP resolution */
+	chip8_byte bits[CHIP8_STREAM_FRAME_SIZE];
+} chip8_stream_frame;
+
+/*
+ * @brief Delta encoding state of one viewer.
+ */
+typedef struct chip8_stream_encoder {
+	chip8_stream_frame last; /* frame the viewer has */
+	bool synced; /* the viewer has a keyframe to apply deltas to */
+	uint64_t key_frame; /* frame number of the last keyframe */
+	uint64_t keyframes; /* keyframe records encoded */
+	chip8_byte delta[CHIP8_STREAM_RECORD_SIZE]; /* XOR delta, then keyframe */
+} chip8_stream_encoder;
+
+/*
+ * @brief Delta-encoded display output.
+ *
+ * The emulation thread packs displays into the ring and a writer thread
+ * encodes and writes them, so a slow or absent viewer drops frames instead
+ * of stalling emulation. Frame records start with chip8_stream_flag bits,
+ * followed by the LEB128 varint frame number and payload length. Payloads
+ * are run-length encoded, a varint token of n << 1 | 1 is followed by n
+ * literal bytes and n << 1 stands for n zero bytes.
+ */
+typedef struct chip8_stream {
+	chip8_ring ring; /* packed frames */
+	pthread_t thread; /* writer thread */
+	atomic_bool running; /* writer thread keeps encoding */
+	atomic_bool connected; /* a viewer is attached */
+	const char* path; /* FIFO or socket path */
+	int fd; /* output, -1 while no viewer is attached */
+	int listen_fd; /* Unix socket accepting viewers, -1 otherwise */
+	uint64_t attach_ns; /* when to look for a viewer again */
+
+	/* emulation thread only */
+	bool primed; /* the attached viewer was sent the current display */
+	uint64_t gfx_hash; /* display hash of the last queued frame */
+	uint64_t dropped; /* frames the full ring dropped */
+
+	/* writer thread only */
+	chip8_stream_frame next; /* frame being encoded */
+	chip8_stream_encoder encoder;
+	chip8_byte record[CHIP8_STREAM_RECORD_SIZE];
+	uint64_t frames; /* records written */
+	uint64_t bytes; /* bytes written */
+} chip8_stream;
+
+/*
+ * @brief Stream reader state, the display of the last decoded frame.
+ */
+typedef struct chip8_stream_decoder {
+	chip8_stream_frame current;
+	bool synced; /* a keyframe was decoded */
+	uint64_t bytes; /* record bytes read */
+	chip8_byte record[CHIP8_STREAM_RECORD_SIZE];
+} chip8_stream_decoder;
+
+/*
+ * @brief Returns the packed size of one plane at the given resolution.
+ */
+static inline size_t chip8_stream_plane_size(const bool hires)
+{
+	return hires ? CHIP8_STREAM_PLANE_SIZE : CHIP8_STREAM_PLANE_SIZE / 4;
+}
+
+/*
+ * @brief Returns the color index of a pixel of a packed frame.
+ */
+static inline chip8_byte chip8_stream_pixel(
+		const chip8_stream_frame frame[const static 1], const unsigned x,
+		const unsigned y)
+{
+	const unsigned width = frame->hires ? CHIP8_GFX_HIRES_WIDTH
+		: CHIP8_GFX_RES_WIDTH;
+	const size_t bit = (size_t) y * width + x;
+	chip8_byte color = 0;
+
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		color |= (frame->bits[p * chip8_stream_plane_size(frame->hires)
+				+ bit / 8] >> (7 - bit % 8) & 1) << p;
+	}
+	return color;
+}
+
+extern void chip8_stream_header(chip8_byte[const static
+		CHIP8_STREAM_HEADER_SIZE]);
+
+extern void chip8_stream_pack(chip8_stream_frame[const static 1],
+		const chip8_vm[const static 1]);
+
+extern size_t chip8_stream_encode(chip8_stream_encoder[const static 1],
+		const chip8_stream_frame[const static 1],
+		chip8_byte[const static CHIP8_STREAM_RECORD_SIZE]);
+
+extern chip8_rc chip8_open_stream(chip8_stream[const static 1],
+		const char* const);
+
+extern void chip8_stream_push(chip8_stream[const static 1],
+		const chip8_vm[const static 1]);
+
+extern void chip8_close_stream(chip8_stream[const static 1]);
+
+extern chip8_rc chip8_stream_read_header(FILE* const);
+
+extern chip8_rc chip8_stream_decode(chip8_stream_decoder[const static 1],
+		FILE* const);
+
+#endif /* CHIP8_STREAM_H */
@@ -0,0 +1,42 @@
+#ifndef CHIP8_TIME_H
+#define CHIP8_TIME_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+#include "chip8.h"
+
+#define CHIP8_NS_PER_SEC 1000000000ULL
+#define CHIP8_NS_PER_MS 1000000.0
+#define CHIP8_FRAME_NS (CHIP8_NS_PER_SEC / CHIP8_FRAME_RATE)
+
+/*
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ *
+ * Translation units using this must define _POSIX_C_SOURCE before including
+ * any system header.
+ */
+static inline uint64_t chip8_time_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * CHIP8_NS_PER_SEC + now.tv_nsec;
+}
+
+/*
+ * @brief Sleeps until the given monotonic timestamp has passed.
+ */
+static inline void chip8_sleep_until(const uint64_t deadline_ns)
+{
+	const struct timespec deadline = {
+			.tv_sec = deadline_ns / CHIP8_NS_PER_SEC,
+			.tv_nsec = deadline_ns % CHIP8_NS_PER_SEC
+	};
+
+	while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+			NULL));
+}
+
+#endif /* CHIP8_TIME_H */
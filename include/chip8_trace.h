@@ -0,0 +1,34 @@
+#ifndef CHIP8_TRACE_H
+#define CHIP8_TRACE_H
+
+/*
+ * @brief Static tracepoints of the chip8 USDT provider.
+ *
+ * Built against systemtap's <sys/sdt.h> each probe is a single nop and an
+ * ELF note, which perf and bpftrace turn into a breakpoint only while they
+ * are attached. Without the header the probes compile to nothing.
+ *
+ * Probes and their arguments:
+ *  - frame_start(frame), frame_end(frame): chip8_start_frame() and
+ *    chip8_end_frame(), around every frame
+ *  - istr(pc, istr): every dispatched instruction
+ *  - draw(x, y, rows, erased), clear(planes): DXYN, DXY0 and 00E0
+ *  - timers(delay, sound): the 60 Hz timer tick
+ *  - wait_key(reg), key_resume(key): FX0A blocking and its key edge
+ *  - key(key, pressed): keypad keys from the window
+ *  - present_start(frame), present_end(frame): rendering and buffer swap
+ */
+#ifdef CHIP8_HAVE_SDT
+	#include <sys/sdt.h>
+
+	#define CHIP8_TRACE1(NAME, A) DTRACE_PROBE1(chip8, NAME, A)
+	#define CHIP8_TRACE2(NAME, A, B) DTRACE_PROBE2(chip8, NAME, A, B)
+	#define CHIP8_TRACE4(NAME, A, B, C, D) \
+		DTRACE_PROBE4(chip8, NAME, A, B, C, D)
+#else
+	#define CHIP8_TRACE1(NAME, A) ((void) 0)
+	#define CHIP8_TRACE2(NAME, A, B) ((void) 0)
+	#define CHIP8_TRACE4(NAME, A, B, C, D) ((void) 0)
+#endif
+
+#endif /* CHIP8_TRACE_H */
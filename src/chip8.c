@@ -1,133 +1,562 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <inttypes.h>
+#include <math.h>
 #include <getopt.h>
+#include <signal.h>
 #include <GLFW/glfw3.h>
 
 #include "chip8.h"
 #include "chip8_io.h"
 #include "chip8_istr.h"
+#include "chip8_input.h"
+#include "chip8_audio.h"
+#include "chip8_rom.h"
 #include "chip8_gfx.h"
+#include "chip8_time.h"
+#include "chip8_debugger.h"
+#include "chip8_stream.h"
+#include "chip8_shm.h"
+#include "chip8_latency.h"
+#include "chip8_metrics.h"
+#include "chip8_runahead.h"
+#include "chip8_trace.h"
 #include "chip8_dbg.h"
 
-static chip8_vm* chip8_new_vm(void)
-{
-	chip8_vm* chip8 = calloc(1, sizeof(*chip8));
+#define CHIP8_TURBO_SHARE 0.25 /* host time presenting may take in turbo */
+#define CHIP8_TURBO_SKIP_MAX 1024 /* emulated frames per presented frame */
 
-	if (!chip8) {
-		CHIP8_ERR("ERROR::Memory allocation failed");
-		return NULL;
-	}
-	chip8->pc = 0x200;
-	chip8->sp = 0xEA0;
-	chip8->idx = 0;
-	return chip8;
-}
+/* set by SIGUSR1 to print the latency histograms before the next frame */
+static volatile sig_atomic_t chip8_latency_requested;
+
+/*
+ * @brief Fast-forward state of the frame loop.
+ *
+ * While the fast-forward key is held frames run at speed times real time,
+ * or as fast as the host allows with speed 0, and only every skip-th frame
+ * is presented.
+ */
+typedef struct chip8_turbo {
+	unsigned speed; /* emulated frames per 60 Hz host frame, 0 unthrottled */
+	bool active; /* fast-forward key held */
+	unsigned skip; /* emulated frames per presented frame */
+	unsigned skipped; /* emulated frames since the last present */
+	double run_ns; /* moving average of emulating a frame */
+	double present_ns; /* moving average of rendering and swapping */
+	uint64_t audio_ns; /* when the next muted audio frame is due */
+} chip8_turbo;
 
 static chip8_rc chip8_init_vm(chip8_vm** const chip8_ptr,
-		const char* argv[static 2], const size_t rom_index)
+		const char rom_path[static 1], const char* const quirks_name)
 {
+	chip8_quirks quirks;
+
 	*chip8_ptr = chip8_new_vm();
 
 	if (!*chip8_ptr) {
 		CHIP8_PERROR("Virtual machine construction failed");
 		return CHIP8_FAILURE;
-	} else if (!chip8_load_data(&((*chip8_ptr)->mem), argv[rom_index], 0x200)) {
+	} else if (!chip8_load_rom(*chip8_ptr, rom_path)) {
 		CHIP8_PERROR("ROM load failed");
 		return CHIP8_FAILURE;
-	} else if (!chip8_load_data(&((*chip8_ptr)->mem), CHIP8_FONT_PATH, 0)) {
-		CHIP8_PERROR("Font load failed");
+	} else if (quirks_name) {
+		if (!chip8_parse_quirks(&quirks, quirks_name)) {
+			fprintf(stderr, "great_chip-8::ERROR: Unknown quirk profile %s\n",
+					quirks_name);
+			return CHIP8_FAILURE;
+		}
+		(*chip8_ptr)->quirks = quirks;
+	}
+	CHIP8_MEM_DUMP(*chip8_ptr);
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Prints the catalog of a ROM directory to standard output.
+ */
+static chip8_rc chip8_list_roms(const char rom_dir[static 1])
+{
+	chip8_catalog catalog;
+
+	if (!chip8_open_catalog(&catalog, rom_dir)) {
+		CHIP8_PERROR("ROM catalog failed");
 		return CHIP8_FAILURE;
 	}
-	CHIP8_MEM_DUMP((*chip8_ptr)->mem);
+
+	for (size_t i = 0; i < catalog.count; i++) {
+		const chip8_rom_entry* const entry = &catalog.entries[i];
+
+		printf("%-24s %5" PRIu32 " %016" PRIx64 "%s%s%s%s\n", entry->name,
+				entry->size, entry->hash,
+				entry->flags & CHIP8_ROM_INPUT ? " input" : "",
+				entry->flags & CHIP8_ROM_SOUND ? " sound" : "",
+				entry->flags & CHIP8_ROM_SCHIP ? " schip" : "",
+				entry->flags & CHIP8_ROM_XOCHIP ? " xochip" : "");
+	}
+	chip8_close_catalog(&catalog);
 	return CHIP8_SUCCESS;
 }
 
 /*
- * @brief Fetch next instruction from loaded chip-8 ROM.
+ * @brief Prints how long each startup phase took relative to process start.
  */
-static inline chip8_word chip8_fetch(chip8_vm chip8[const static 1])
+static void chip8_print_startup(const uint64_t phase_ns[const static 4],
+		const chip8_renderer renderer[const static 1])
+{
+	fprintf(stderr, "great_chip-8::STARTUP: vm %.3f ms, gfx %.3f ms "
+			"(program %.3f ms, %s), first frame %.3f ms, total %.3f ms\n",
+			(phase_ns[1] - phase_ns[0]) / CHIP8_NS_PER_MS,
+			(phase_ns[2] - phase_ns[1]) / CHIP8_NS_PER_MS,
+			renderer->program_ns / CHIP8_NS_PER_MS,
+			renderer->program_cached ? "cached" : "compiled",
+			(phase_ns[3] - phase_ns[2]) / CHIP8_NS_PER_MS,
+			(phase_ns[3] - phase_ns[0]) / CHIP8_NS_PER_MS);
+}
+
+static void chip8_usage(const char program[static 1])
+{
+	fprintf(stderr, "usage: %s [-dt] [-a audio] [-c cycles] [-f speed] "
+			"[-l rom_dir] [-m shm] [-o stream] [-p metrics] [-q quirks] "
+			"[-r frames] [rom]\n"
+			"  -a audio    audio backend null, wav:<path> or alsa[:<device>]"
+			" (default " CHIP8_AUDIO_DEFAULT ")\n"
+			"  -c cycles   instructions executed per 60 Hz frame (default %d)\n"
+			"  -d          start in the console debugger, ^C breaks into it\n"
+			"  -f speed    times real time while Tab is held,"
+			" 0 for unthrottled (default 0)\n"
+			"  -l rom_dir  list the ROMs catalogued in rom_dir and exit\n"
+			"  -m shm      publish every frame's state to the POSIX shared"
+			" memory object shm, e.g. " CHIP8_SHM_NAME "\n"
+			"  -o stream   write the display stream to -, a FIFO, a file"
+			" or unix:<socket>\n"
+			"  -p metrics  serve Prometheus metrics on a loopback port or"
+			" unix:<socket>\n"
+			"  -q quirks   quirk profile vip, schip or modern"
+			" (default chosen per ROM)\n"
+			"  -r frames   present the machine run this many frames ahead,"
+			" up to %d\n"
+			"  -t          print startup phase timings, and input latency"
+			" and frame time\n"
+			"              percentiles on exit or SIGUSR1\n",
+			program, CHIP8_CYCLES_PER_FRAME, CHIP8_RUNAHEAD_MAX);
+}
+
+static void chip8_latency_sigusr1(int sig)
 {
-	chip8_word istr = chip8->mem[chip8->pc];
-	istr <<= 8;
-	istr |= chip8->mem[chip8->pc+1];
-	return istr;
+	(void) sig;
+	chip8_latency_requested = 1;
 }
 
 /*
- * @brief Disassemble next instruction and execute with corresponding function.
+ * @brief Paces the frame loop to one frame per interval, starting over from
+ * the current time when the host has fallen more than a 60 Hz frame behind.
+ * Returns the number of 60 Hz frames given up on that way.
  */
-static inline chip8_rc chip8_execute(chip8_vm chip8[const static 1])
+static uint64_t chip8_pace_frame(uint64_t deadline_ns[const static 1],
+		const uint64_t interval_ns)
 {
-	static time_t timer;
-	static chip8_byte cycle;
-	const chip8_opcode opcode = chip8_disassemble(chip8->istr);
+	const uint64_t now_ns = chip8_time_ns();
+	uint64_t dropped = 0;
 
-	if (NOP == opcode) {
-		return CHIP8_FAILURE;
+	*deadline_ns += interval_ns;
+
+	if (*deadline_ns + CHIP8_FRAME_NS < now_ns) {
+		dropped = (now_ns - *deadline_ns) / CHIP8_FRAME_NS;
+		*deadline_ns = now_ns;
+	} else if (now_ns < *deadline_ns) {
+		chip8_sleep_until(*deadline_ns);
 	}
+	return dropped;
+}
 
-	if (cycle == 60) {
-		if (chip8->dly_tmr) {
-			chip8->dly_tmr--;
-		}
+/*
+ * @brief Enters or leaves fast-forward.
+ *
+ * Fast-forward presents without waiting for vertical sync, since a blocking
+ * swap would cap it at the refresh rate, and mutes audio. Present times are
+ * measured afresh, the ones with vertical sync would overestimate them.
+ */
+static void chip8_set_turbo(chip8_turbo turbo[const static 1],
+		chip8_audio audio[const static 1], const bool active)
+{
+	if (active == turbo->active) {
+		return;
+	}
+	turbo->active = active;
+	turbo->skip = 1;
+	turbo->skipped = 0;
+	turbo->present_ns = 0;
+	turbo->audio_ns = chip8_time_ns();
+	audio->muted = active;
+	glfwSwapInterval(!active);
+}
 
-		if (chip8->snd_tmr) {
-			chip8->snd_tmr--;
-		}
-	} else if (time(NULL) == timer) {
-		cycle++;
-	} else {
-		cycle = 0;
+/*
+ * @brief Returns the host time between emulated frames in fast-forward.
+ */
+static inline uint64_t chip8_turbo_interval(
+		const chip8_turbo turbo[const static 1])
+{
+	return turbo->speed ? CHIP8_FRAME_NS / turbo->speed : 0;
+}
+
+/*
+ * @brief Tells whether the frame with pending draws is presented, outside
+ * fast-forward every one is.
+ */
+static inline bool chip8_turbo_present(chip8_turbo turbo[const static 1])
+{
+	return !turbo->active || ++turbo->skipped >= turbo->skip;
+}
+
+/*
+ * @brief Updates the moving averages after a present and picks the smallest
+ * skip keeping presents below CHIP8_TURBO_SHARE of host time.
+ *
+ * Each emulated frame takes the longer of emulating it and the paced
+ * interval, so presents take a share of p / (skip * f + p) which is solved
+ * for skip.
+ */
+static void chip8_turbo_presented(chip8_turbo turbo[const static 1],
+		const uint64_t present_ns)
+{
+	const double interval_ns = chip8_turbo_interval(turbo);
+	const double frame_ns = turbo->run_ns > interval_ns
+		? turbo->run_ns : interval_ns;
+	double skip;
+
+	turbo->present_ns = turbo->present_ns
+		? turbo->present_ns + (present_ns - turbo->present_ns) / 8
+		: present_ns;
+	turbo->skipped = 0;
+
+	if (!turbo->active) {
+		return;
 	}
-	chip8_istr_set[opcode](chip8);
-	time(&timer);
-	return CHIP8_SUCCESS;
+	skip = ceil(turbo->present_ns * (1 - CHIP8_TURBO_SHARE)
+			/ (CHIP8_TURBO_SHARE * frame_ns));
+	turbo->skip = skip < 1 ? 1
+		: skip > CHIP8_TURBO_SKIP_MAX ? CHIP8_TURBO_SKIP_MAX : skip;
 }
 
 int main(int argc, char* argv[argc+1])
 {
+	uint64_t phase_ns[4] = { chip8_time_ns() };
+	uint64_t deadline_ns;
+	uint64_t start_ns;
+	uint64_t render_ns;
+	uint64_t frame;
+	uint64_t dropped;
+	uint64_t wait_ns = 0;
+	uint64_t shown_hash = 0;
+	unsigned cycles = CHIP8_CYCLES_PER_FRAME;
+	unsigned ahead = 0;
+	const char* audio_spec = CHIP8_AUDIO_DEFAULT;
+	const char* quirks_name = NULL;
+	const char* stream_spec = NULL;
+	const char* shm_name = NULL;
+	const char* metrics_spec = NULL;
+	bool timing = false;
+	int opt;
 	int exit_state = EXIT_SUCCESS;
-	chip8_vm* chip8;
+	chip8_vm* chip8 = NULL;
+	const chip8_vm* shown;
 	GLFWwindow* window;
-	chip8_renderer* renderer;
+	chip8_renderer* renderer = NULL;
+	chip8_input_queue input = { 0 };
+	chip8_audio audio = { 0 };
+	chip8_stream stream = { 0 };
+	chip8_shm shm = { 0 };
+	chip8_debugger* debugger = NULL;
+	chip8_latency* latency = NULL;
+	chip8_metrics metrics = { 0 };
+	chip8_metrics_shard* shard = NULL;
+	uint32_t opcodes[CHIP8_ISTR_SET_SIZE] = { 0 };
+	chip8_turbo turbo = { .skip = 1 };
+	chip8_runahead runahead = { 0 };
+	uint32_t input_head;
 
-	srand((unsigned) time(NULL));
+	while (-1 != (opt = getopt(argc, argv, "a:c:df:l:m:o:p:q:r:t"))) {
+		switch (opt) {
+			case 'a':
+				audio_spec = optarg;
+				break;
+			case 'c':
+				cycles = strtoul(optarg, NULL, 0);
+				break;
+			case 'd':
+				if (!debugger && !(debugger = chip8_new_debugger())) {
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'f':
+				turbo.speed = strtoul(optarg, NULL, 0);
+				break;
+			case 'l':
+				return chip8_list_roms(optarg) ? EXIT_SUCCESS : EXIT_FAILURE;
+			case 'm':
+				shm_name = optarg;
+				break;
+			case 'o':
+				stream_spec = optarg;
+				break;
+			case 'p':
+				metrics_spec = optarg;
+				break;
+			case 'q':
+				quirks_name = optarg;
+				break;
+			case 'r':
+				ahead = strtoul(optarg, NULL, 0);
+				break;
+			case 't':
+				timing = true;
+				break;
+			default:
+				chip8_usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
 
+	if (optind >= argc) {
+		chip8_usage(argv[0]);
+		return EXIT_FAILURE;
+	} else if (debugger && stream_spec && !strcmp(stream_spec, "-")) {
+		/* the prompt would interleave with the stream on standard output */
+		CHIP8_ERR("ERROR: The debugger cannot stream to standard output");
+		return EXIT_FAILURE;
+	}
 	/* initialize Chip-8 virtual machine */
-	if (!chip8_init_vm(&chip8, argv, 1)) {
+	if (!chip8_init_vm(&chip8, argv[optind], quirks_name)) {
 		CHIP8_ERR("ERROR: Virtual machine initialization failed");
-		exit_state = CHIP8_FAILURE;
+		exit_state = EXIT_FAILURE;
 		goto EXIT;
 	}
+	chip8_seed(chip8, (uint32_t) time(NULL));
+
+	phase_ns[1] = chip8_time_ns();
 
 	/* initialize graphics and create window */
 	if (!chip8_init_gfx(&window, &renderer, CHIP8_DEFAULT_RES_SCALE)) {
 		CHIP8_ERR("ERROR: OpenGL initialization failed");
-		exit_state = CHIP8_FAILURE;
+		exit_state = EXIT_FAILURE;
 		goto EXIT;
 	}
+	phase_ns[2] = chip8_time_ns();
 
-	/* fetch-execute cycle */
-	while (!glfwWindowShouldClose(window)) {
-		chip8->istr = chip8_fetch(chip8);
+	if (!chip8_open_audio(&audio, audio_spec)) {
+		CHIP8_ERR("ERROR: Audio initialization failed");
+		exit_state = EXIT_FAILURE;
+		goto EXIT;
+	}
+
+	if (stream_spec && !chip8_open_stream(&stream, stream_spec)) {
+		CHIP8_ERR("ERROR: Stream output initialization failed");
+		exit_state = EXIT_FAILURE;
+		goto EXIT;
+	}
+
+	if (shm_name && !chip8_open_shm(&shm, shm_name)) {
+		CHIP8_ERR("ERROR: Shared memory export initialization failed");
+		exit_state = EXIT_FAILURE;
+		goto EXIT;
+	}
+
+	if (metrics_spec) {
+		if (!chip8_open_metrics(&metrics, metrics_spec, 1)) {
+			CHIP8_ERR("ERROR: Metrics export initialization failed");
+			exit_state = EXIT_FAILURE;
+			goto EXIT;
+		}
+		shard = chip8_metrics_register(&metrics, "emulation");
+	}
+
+	if (!chip8_init_runahead(&runahead, ahead, cycles)) {
+		exit_state = EXIT_FAILURE;
+		goto EXIT;
+	}
+	glfwSetWindowUserPointer(window, &input);
+
+	if (timing) {
+		struct sigaction action = { .sa_handler = chip8_latency_sigusr1 };
+
+		if (!(latency = calloc(1, sizeof(*latency)))) {
+			CHIP8_PERROR("Latency histogram allocation failed");
+			exit_state = EXIT_FAILURE;
+			goto EXIT;
+		}
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGUSR1, &action, NULL);
+	}
+
+	if (debugger) {
+		chip8_debug_catch_interrupt(debugger);
+
+		if (!chip8_debug_prompt(debugger, chip8)) {
+			goto EXIT;
+		}
+	}
+	deadline_ns = chip8_time_ns();
+
+	/* frame loop, input is polled once per frame and applied before it */
+	while (!glfwWindowShouldClose(window) && CHIP8_HALTED != chip8->state) {
+		input.frame = chip8->frame;
+
+		/* a VM blocked on FX0A with idle timers sleeps until input arrives */
+		if (chip8_is_idle(chip8) && !chip8->draw_flag) {
+			glfwWaitEvents();
+			deadline_ns = chip8_time_ns();
+
+			if (latency) {
+				chip8_latency_pause(latency);
+			}
+		} else {
+			glfwPollEvents();
+		}
+		input_head = input.head;
+		chip8_apply_input(&input, chip8);
+		chip8_set_turbo(&turbo, &audio, input.fast_forward);
+		start_ns = chip8_time_ns();
 
-		if (!chip8_execute(chip8)) {
+		if (latency) {
+			chip8_latency_input(latency, &input, input_head);
+		}
+
+		frame = chip8->frame;
+
+		if (!(debugger ? chip8_debug_frame(debugger, chip8, cycles,
+		                                   shard ? opcodes : NULL)
+		      : shard ? chip8_count_frame(chip8, cycles, opcodes)
+		      : chip8_run_frame(chip8, cycles))) {
 			CHIP8_ERR("ERROR: chip-8 execution failed, this shouldn't happen");
-			exit_state = CHIP8_FAILURE;
+			exit_state = EXIT_FAILURE;
 			goto EXIT;
 		}
+		turbo.run_ns += ((double) (chip8_time_ns() - start_ns) - turbo.run_ns)
+			/ 8;
+
+		/* only paced frames count towards frame time and jitter */
+		if (latency) {
+			if (turbo.active) {
+				chip8_latency_pause(latency);
+			}
+			chip8_latency_frame(latency, chip8, start_ns, chip8_time_ns());
+		}
+
+		if (shard) {
+			chip8_metrics_opcodes(shard, opcodes);
+			chip8_metrics_add(shard, CHIP8_METRIC_FRAMES, chip8->frame - frame);
+			chip8_metrics_wait(shard, &wait_ns, chip8, chip8_time_ns());
+			chip8_metrics_set(shard, CHIP8_METRIC_WAITING,
+					CHIP8_WAITING_KEY == chip8->state);
+		}
 
-		if (draw_flag) {
-			chip8_render(chip8, renderer);
+		/* fast-forward keeps the audio stream at real time with silence */
+		if (!turbo.active) {
+			chip8_audio_frame(&audio, chip8);
+		} else if (turbo.audio_ns <= start_ns) {
+			chip8_audio_frame(&audio, chip8);
+			turbo.audio_ns = turbo.audio_ns + CHIP8_FRAME_NS < start_ns
+				? start_ns : turbo.audio_ns + CHIP8_FRAME_NS;
+		}
+
+		if (stream_spec) {
+			chip8_stream_push(&stream, chip8);
+		}
+		chip8_shm_publish(&shm, chip8);
+		shown = chip8;
+
+		/* the machine ahead is presented whenever its display changed */
+		if (runahead.frames && !turbo.active
+		    && !(debugger && debugger->stopped)) {
+			if (!chip8_run_ahead(&runahead, chip8)) {
+				CHIP8_ERR("ERROR: chip-8 execution failed, this shouldn't happen");
+				exit_state = EXIT_FAILURE;
+				goto EXIT;
+			}
+			shown = &runahead.ahead;
+			chip8->draw_flag = chip8_gfx_hash(shown) != shown_hash;
+		}
+
+		if (chip8->draw_flag && chip8_turbo_present(&turbo)) {
+			start_ns = chip8_time_ns();
+			CHIP8_TRACE1(present_start, chip8->frame);
+			chip8_render(shown, renderer);
+			render_ns = chip8_time_ns();
 			glfwSwapBuffers(window);
-			draw_flag = false;
+			CHIP8_TRACE1(present_end, chip8->frame);
+
+			if (latency) {
+				chip8_latency_present(latency, render_ns, chip8_time_ns());
+			}
+			chip8->draw_flag = false;
+			shown_hash = chip8_gfx_hash(shown);
+			chip8_turbo_presented(&turbo, chip8_time_ns() - start_ns);
+
+			if (shard) {
+				chip8_metrics_add(shard, CHIP8_METRIC_PRESENTS, 1);
+			}
+
+			if (!phase_ns[3]) {
+				phase_ns[3] = chip8_time_ns();
+
+				if (timing) {
+					chip8_print_startup(phase_ns, renderer);
+				}
+			}
+		} else if (chip8->draw_flag && shard) {
+			chip8_metrics_add(shard, CHIP8_METRIC_SKIPPED, 1);
+		}
+
+		/* the window shows the frame the debugger stopped in */
+		if (debugger && debugger->stopped) {
+			if (!chip8_debug_prompt(debugger, chip8)) {
+				break;
+			}
+			deadline_ns = chip8_time_ns();
+
+			if (latency) {
+				chip8_latency_pause(latency);
+			}
+		}
+
+		if (latency && chip8_latency_requested) {
+			chip8_latency_requested = 0;
+			chip8_print_latency(stderr, latency);
+
+			if (runahead.frames) {
+				chip8_print_runahead(stderr, &runahead);
+			}
+		}
+		dropped = chip8_pace_frame(&deadline_ns, turbo.active
+				? chip8_turbo_interval(&turbo) : CHIP8_FRAME_NS);
+
+		/* fast-forward runs behind real time on purpose */
+		if (shard && !turbo.active) {
+			chip8_metrics_add(shard, CHIP8_METRIC_DROPPED, dropped);
 		}
 	}
 
 EXIT:
-	free(chip8);
+	if (latency) {
+		chip8_print_latency(stderr, latency);
+		free(latency);
+	}
+
+	if (runahead.frames) {
+		chip8_print_runahead(stderr, &runahead);
+	}
+	chip8_free_runahead(&runahead);
+	chip8_close_audio(&audio);
+	chip8_close_stream(&stream);
+	chip8_close_shm(&shm);
+	chip8_close_metrics(&metrics);
+	free(debugger);
+	chip8_free_vm(chip8);
 	free(renderer);
 	return exit_state;
 }
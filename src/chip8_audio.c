@@ -0,0 +1,426 @@
+/*
+ * @file chip8_audio.c
+ * @brief Implements sound timer audio output.
+ *
+ * Once per emulated frame the emulation thread synthesizes a band-limited
+ * square wave beep, the XO-CHIP audio pattern or silence into a lock-free
+ * ring, so sound starts and stops exactly on frame boundaries.
+ * A consumer thread drains the ring into one of the backends below.
+ * Realtime backends are padded with silence when the ring runs dry. The
+ * producer trims the end of a frame rather than leave more than a period
+ * queued ahead of the next one, so a late consumer or an early frame
+ * shortens a frame instead of dropping it. A frame's first sample then
+ * waits behind at most a period in the ring, one in the consumer and the
+ * 10 ms device buffer, below 20 ms.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+
+#ifdef CHIP8_HAVE_ALSA
+	#include <alsa/asoundlib.h>
+#endif
+
+#include "chip8.h"
+#include "chip8_io.h"
+#include "chip8_audio.h"
+#include "chip8_time.h"
+#include "chip8_dbg.h"
+
+#define CHIP8_WAV_HEADER_SIZE 44
+#define CHIP8_ALSA_LATENCY_US 10000
+
+/*
+ * @brief Polynomial band-limited step correcting a discontinuity at phase 0.
+ */
+static inline double chip8_poly_blep(double phase, const double step)
+{
+	if (phase < step) {
+		phase /= step;
+		return phase + phase - phase * phase - 1.0;
+	} else if (phase > 1.0 - step) {
+		phase = (phase - 1.0) / step;
+		return phase * phase + phase + phase + 1.0;
+	}
+	return 0.0;
+}
+
+/*
+ * @brief Samples the XO-CHIP 1-bit audio pattern at the given phase, which
+ * covers all 128 bits of the pattern once per cycle.
+ */
+static inline double chip8_pattern(const chip8_byte pattern[const static
+		CHIP8_PATTERN_SIZE], const double phase)
+{
+	const unsigned bit = phase * CHIP8_AUDIO_PATTERN_BITS;
+
+	return pattern[bit / 8] >> (7 - bit % 8) & 1 ? 1.0 : -1.0;
+}
+
+/*
+ * @brief Samples a band-limited square wave at the given phase.
+ */
+static inline double chip8_square(const double phase, const double step)
+{
+	const double half_phase = phase < 0.5 ? phase + 0.5 : phase - 0.5;
+
+	return (phase < 0.5 ? 1.0 : -1.0) + chip8_poly_blep(phase, step)
+		- chip8_poly_blep(half_phase, step);
+}
+
+/*
+ * @brief Null backend, consumes samples at the sample rate and discards them.
+ */
+static chip8_rc chip8_null_open(chip8_audio* const audio,
+		const char* const arg)
+{
+	(void) audio;
+	(void) arg;
+	return CHIP8_SUCCESS;
+}
+
+static chip8_rc chip8_null_write(chip8_audio* const audio,
+		const int16_t* const samples, const size_t count)
+{
+	const uint64_t now_ns = chip8_time_ns();
+
+	(void) samples;
+
+	if (audio->clock_ns + CHIP8_FRAME_NS < now_ns) {
+		audio->clock_ns = now_ns;
+	}
+	audio->clock_ns += count * CHIP8_NS_PER_SEC / CHIP8_AUDIO_RATE;
+	chip8_sleep_until(audio->clock_ns);
+	audio->written += count;
+	return CHIP8_SUCCESS;
+}
+
+static void chip8_null_close(chip8_audio* const audio)
+{
+	(void) audio;
+}
+
+static void chip8_put_le(chip8_byte dst[const static 1], uint32_t value,
+		const size_t size)
+{
+	for (size_t i = 0; i < size; i++, value >>= 8) {
+		dst[i] = value & 0xFF;
+	}
+}
+
+/*
+ * @brief Writes a 16-bit mono PCM WAV header for the given sample count.
+ */
+static chip8_rc chip8_write_wav_header(FILE* const file, const uint32_t count)
+{
+	chip8_byte header[CHIP8_WAV_HEADER_SIZE];
+	const uint32_t data_size = count * sizeof(int16_t);
+
+	memcpy(&header[0], "RIFF", 4);
+	chip8_put_le(&header[4], CHIP8_WAV_HEADER_SIZE - 8 + data_size, 4);
+	memcpy(&header[8], "WAVEfmt ", 8);
+	chip8_put_le(&header[16], 16, 4); /* fmt chunk size */
+	chip8_put_le(&header[20], 1, 2); /* PCM */
+	chip8_put_le(&header[22], 1, 2); /* mono */
+	chip8_put_le(&header[24], CHIP8_AUDIO_RATE, 4);
+	chip8_put_le(&header[28], CHIP8_AUDIO_RATE * sizeof(int16_t), 4);
+	chip8_put_le(&header[32], sizeof(int16_t), 2); /* block align */
+	chip8_put_le(&header[34], 16, 2); /* bits per sample */
+	memcpy(&header[36], "data", 4);
+	chip8_put_le(&header[40], data_size, 4);
+	return 1 == fwrite(header, sizeof(header), 1, file) ? CHIP8_SUCCESS
+		: CHIP8_FAILURE;
+}
+
+/*
+ * @brief WAV backend, records every emulated sample to a file.
+ */
+static chip8_rc chip8_wav_open(chip8_audio* const audio,
+		const char* const wav_path)
+{
+	if (!wav_path || !*wav_path) {
+		CHIP8_ERR("ERROR::AUDIO::WAV: Expected wav:<path>");
+		return CHIP8_FAILURE;
+	} else if (!(audio->device = fopen(wav_path, "wb"))) {
+		return CHIP8_FAILURE;
+	}
+	return chip8_write_wav_header(audio->device, 0);
+}
+
+static chip8_rc chip8_wav_write(chip8_audio* const audio,
+		const int16_t* const samples, const size_t count)
+{
+	chip8_byte data[CHIP8_AUDIO_PERIOD * sizeof(int16_t)];
+
+	for (size_t i = 0; i < count; i++) {
+		chip8_put_le(&data[i * sizeof(int16_t)], (uint16_t) samples[i],
+				sizeof(int16_t));
+	}
+
+	if (count != fwrite(data, sizeof(int16_t), count, audio->device)) {
+		return CHIP8_FAILURE;
+	}
+	audio->written += count;
+	return CHIP8_SUCCESS;
+}
+
+static void chip8_wav_close(chip8_audio* const audio)
+{
+	if (audio->device) {
+		rewind(audio->device);
+		chip8_write_wav_header(audio->device, audio->written);
+		fclose(audio->device);
+	}
+}
+
+#ifdef CHIP8_HAVE_ALSA
+/*
+ * @brief ALSA backend, plays through the default PCM device which is routed
+ * through PulseAudio or PipeWire when those are running.
+ */
+static chip8_rc chip8_alsa_open(chip8_audio* const audio,
+		const char* const device_name)
+{
+	snd_pcm_t* pcm;
+	const char* const name = device_name && *device_name ? device_name
+		: "default";
+
+	if (snd_pcm_open(&pcm, name, SND_PCM_STREAM_PLAYBACK, 0) < 0) {
+		CHIP8_ERR("ERROR::AUDIO::ALSA: Device open failed");
+		return CHIP8_FAILURE;
+	} else if (snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16,
+			SND_PCM_ACCESS_RW_INTERLEAVED, 1, CHIP8_AUDIO_RATE, 1,
+			CHIP8_ALSA_LATENCY_US) < 0) {
+		CHIP8_ERR("ERROR::AUDIO::ALSA: Device configuration failed");
+		snd_pcm_close(pcm);
+		return CHIP8_FAILURE;
+	}
+	audio->device = pcm;
+	return CHIP8_SUCCESS;
+}
+
+static chip8_rc chip8_alsa_write(chip8_audio* const audio,
+		const int16_t* const samples, const size_t count)
+{
+	snd_pcm_sframes_t frames = snd_pcm_writei(audio->device, samples, count);
+
+	if (frames < 0) {
+		atomic_fetch_add_explicit(&audio->underruns, 1, memory_order_relaxed);
+		frames = snd_pcm_recover(audio->device, frames, 1);
+	}
+
+	if (frames < 0) {
+		CHIP8_ERR("ERROR::AUDIO::ALSA: Write failed");
+		return CHIP8_FAILURE;
+	}
+	audio->written += frames;
+	return CHIP8_SUCCESS;
+}
+
+static void chip8_alsa_close(chip8_audio* const audio)
+{
+	if (audio->device) {
+		snd_pcm_drain(audio->device);
+		snd_pcm_close(audio->device);
+	}
+}
+#endif
+
+static const chip8_audio_backend chip8_audio_backends[] = {
+	{ "null", true, chip8_null_open, chip8_null_write, chip8_null_close },
+	{ "wav", false, chip8_wav_open, chip8_wav_write, chip8_wav_close },
+#ifdef CHIP8_HAVE_ALSA
+	{ "alsa", true, chip8_alsa_open, chip8_alsa_write, chip8_alsa_close },
+#endif
+};
+
+/*
+ * @brief Consumer thread draining the ring into the backend period by period.
+ */
+static void* chip8_audio_thread(void* const arg)
+{
+	chip8_audio* const audio = arg;
+	int16_t period[CHIP8_AUDIO_PERIOD];
+	int posts;
+
+	while (atomic_load_explicit(&audio->running, memory_order_acquire)) {
+		size_t count = chip8_ring_read(&audio->ring, period, sizeof(period))
+			/ sizeof(*period);
+
+		if (audio->backend->realtime && count < CHIP8_AUDIO_PERIOD) {
+			if (count) {
+				atomic_fetch_add_explicit(&audio->underruns, 1,
+						memory_order_relaxed);
+			}
+			memset(&period[count], 0,
+					(CHIP8_AUDIO_PERIOD - count) * sizeof(*period));
+			count = CHIP8_AUDIO_PERIOD;
+		} else if (!count) {
+			chip8_sleep_until(chip8_time_ns() + CHIP8_NS_PER_SEC / 1000);
+			continue;
+		}
+
+		/* one pending post is enough to wake the producer */
+		if (!audio->backend->realtime && !sem_getvalue(&audio->drained, &posts)
+		    && !posts) {
+			sem_post(&audio->drained);
+		}
+
+		if (!audio->backend->write(audio, period, count)) {
+			CHIP8_ERR("ERROR::AUDIO: Backend write failed");
+			break;
+		}
+	}
+
+	/* a producer waiting for space gives up */
+	atomic_store_explicit(&audio->running, false, memory_order_release);
+	sem_post(&audio->drained);
+	return NULL;
+}
+
+/*
+ * @brief Opens the backend selected by "name[:argument]" and starts the
+ * consumer thread.
+ */
+chip8_rc chip8_open_audio(chip8_audio audio[const static 1],
+		const char spec[static 1])
+{
+	const char* const separator = strchr(spec, ':');
+	const size_t name_length = separator ? (size_t) (separator - spec)
+		: strlen(spec);
+	size_t capacity;
+
+	memset(audio, 0, sizeof(*audio));
+
+	for (size_t i = 0; i < sizeof(chip8_audio_backends)
+			/ sizeof(*chip8_audio_backends); i++) {
+		if (strlen(chip8_audio_backends[i].name) == name_length
+		    && !strncmp(chip8_audio_backends[i].name, spec, name_length)) {
+			audio->backend = &chip8_audio_backends[i];
+		}
+	}
+
+	if (!audio->backend) {
+		fprintf(stderr, "great_chip-8::ERROR::AUDIO: Unknown backend %s\n",
+				spec);
+		return CHIP8_FAILURE;
+	}
+	capacity = audio->backend->realtime ? 2 * CHIP8_AUDIO_FRAME
+		: 16 * CHIP8_AUDIO_FRAME;
+
+	if (!chip8_init_ring(&audio->ring, capacity * sizeof(int16_t))) {
+		return CHIP8_FAILURE;
+	} else if (sem_init(&audio->drained, 0, 0)) {
+		CHIP8_PERROR("Audio semaphore creation failed");
+		chip8_free_ring(&audio->ring);
+		return CHIP8_FAILURE;
+	} else if (!audio->backend->open(audio, separator ? separator + 1 : NULL)) {
+		sem_destroy(&audio->drained);
+		chip8_free_ring(&audio->ring);
+		return CHIP8_FAILURE;
+	}
+	atomic_init(&audio->running, true);
+	atomic_init(&audio->underruns, 0);
+
+	if (pthread_create(&audio->thread, NULL, chip8_audio_thread, audio)) {
+		CHIP8_ERR("ERROR::AUDIO: Thread creation failed");
+		audio->backend->close(audio);
+		sem_destroy(&audio->drained);
+		chip8_free_ring(&audio->ring);
+		return CHIP8_FAILURE;
+	}
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Synthesizes one emulated frame of audio, the beep or the loaded
+ * XO-CHIP pattern when the sound timer is active and silence otherwise.
+ *
+ * Called from the emulation thread only, it never allocates and only waits
+ * for the consumer when recording to a file, blocked until it frees space.
+ */
+void chip8_audio_frame(chip8_audio audio[const static 1],
+		const chip8_vm chip8[const static 1])
+{
+	int16_t samples[CHIP8_AUDIO_FRAME];
+	size_t count = CHIP8_AUDIO_FRAME;
+	size_t queued;
+	const bool tone = chip8->snd_tmr && !audio->muted;
+	const double step = chip8->has_pattern
+		? CHIP8_AUDIO_PATTERN_RATE * exp2((chip8->pitch - 64) / 48.0)
+			/ CHIP8_AUDIO_PATTERN_BITS / CHIP8_AUDIO_RATE
+		: CHIP8_AUDIO_TONE / CHIP8_AUDIO_RATE;
+
+	if (!audio->backend->realtime) {
+		/* recording backends must not lose samples, wait for the writer */
+		while (chip8_ring_writable(&audio->ring) < sizeof(samples)) {
+			if (!atomic_load_explicit(&audio->running, memory_order_acquire)) {
+				return;
+			}
+			sem_wait(&audio->drained);
+		}
+	} else if ((queued = chip8_ring_readable(&audio->ring) / sizeof(*samples))
+		   > CHIP8_AUDIO_QUEUE_MAX) {
+		/* the oscillator stops where the frame is cut, so it stays in phase */
+		count = queued - CHIP8_AUDIO_QUEUE_MAX < CHIP8_AUDIO_FRAME
+			? CHIP8_AUDIO_FRAME - (queued - CHIP8_AUDIO_QUEUE_MAX) : 0;
+		audio->overruns += CHIP8_AUDIO_FRAME - count;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (tone && chip8->has_pattern) {
+			samples[i] = CHIP8_AUDIO_VOLUME * INT16_MAX
+				* chip8_pattern(chip8->pattern, audio->phase);
+			audio->phase += step;
+
+			if (audio->phase >= 1.0) {
+				audio->phase -= 1.0;
+			}
+		} else if (tone) {
+			samples[i] = CHIP8_AUDIO_VOLUME * INT16_MAX
+				* chip8_square(audio->phase, step);
+			audio->phase += step;
+
+			if (audio->phase >= 1.0) {
+				audio->phase -= 1.0;
+			}
+		} else {
+			samples[i] = 0;
+		}
+	}
+	chip8_ring_write(&audio->ring, samples, count * sizeof(*samples));
+}
+
+/*
+ * @brief Stops the consumer thread, flushes what is left and closes the
+ * backend.
+ */
+void chip8_close_audio(chip8_audio audio[const static 1])
+{
+	int16_t period[CHIP8_AUDIO_PERIOD];
+	size_t count;
+
+	if (!audio->backend) {
+		return;
+	}
+	atomic_store_explicit(&audio->running, false, memory_order_release);
+	pthread_join(audio->thread, NULL);
+
+	while (!audio->backend->realtime && (count = chip8_ring_read(&audio->ring,
+			period, sizeof(period)) / sizeof(*period))) {
+		audio->backend->write(audio, period, count);
+	}
+	audio->backend->close(audio);
+	sem_destroy(&audio->drained);
+	chip8_free_ring(&audio->ring);
+	CHIP8_DBG("Audio closed after %u samples, %" PRIu64 " trimmed, %" PRIu64
+			" underruns", audio->written, audio->overruns,
+			(uint64_t) atomic_load(&audio->underruns));
+	audio->backend = NULL;
+}
@@ -0,0 +1,653 @@
+/*
+ * @file chip8_debugger.c
+ * @brief Implements the console debugger.
+ *
+ * Commands are read from standard input whenever the debugger stops:
+ *  c                   continue
+ *  s [n]               step n instructions
+ *  n                   step over 2NNN calls
+ *  o                   run until the current subroutine returns
+ *  b addr [reg op val] break at addr, when V[X] or I compares true
+ *  d [addr]            delete the breakpoints at addr or all of them
+ *  w addr [size]       stop when an instruction changes memory
+ *  u [addr]            delete the watchpoint at addr or all of them
+ *  r                   registers
+ *  l [addr] [n]        disassemble n instructions
+ *  x addr [n]          dump n bytes of memory
+ *  q                   quit
+ * An empty line repeats the previous command.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <signal.h>
+
+#include "chip8.h"
+#include "chip8_istr.h"
+#include "chip8_io.h"
+#include "chip8_debugger.h"
+#include "chip8_dbg.h"
+
+/*
+ * @brief Operands encoded in an instruction word, used to disassemble it.
+ */
+typedef enum chip8_operands {
+	CHIP8_OPERANDS_NONE,
+	CHIP8_OPERANDS_NNN,
+	CHIP8_OPERANDS_N,
+	CHIP8_OPERANDS_X,
+	CHIP8_OPERANDS_XNN,
+	CHIP8_OPERANDS_XY,
+	CHIP8_OPERANDS_XYN,
+	CHIP8_OPERANDS_LONG /* address in the following word */
+} chip8_operands;
+
+static const chip8_operands chip8_debug_operands[CHIP8_ISTR_SET_SIZE] = {
+	[RCA] = CHIP8_OPERANDS_NNN,
+	[CLS] = CHIP8_OPERANDS_NONE,
+	[RET] = CHIP8_OPERANDS_NONE,
+	[JMP] = CHIP8_OPERANDS_NNN,
+	[CALL] = CHIP8_OPERANDS_NNN,
+	[SKPEI] = CHIP8_OPERANDS_XNN,
+	[SKPNEI] = CHIP8_OPERANDS_XNN,
+	[SKPE] = CHIP8_OPERANDS_XY,
+	[MOVI] = CHIP8_OPERANDS_XNN,
+	[ADDI] = CHIP8_OPERANDS_XNN,
+	[MOV] = CHIP8_OPERANDS_XY,
+	[OR] = CHIP8_OPERANDS_XY,
+	[AND] = CHIP8_OPERANDS_XY,
+	[XOR] = CHIP8_OPERANDS_XY,
+	[ADD] = CHIP8_OPERANDS_XY,
+	[SUB] = CHIP8_OPERANDS_XY,
+	[SHFR] = CHIP8_OPERANDS_XY,
+	[SUBB] = CHIP8_OPERANDS_XY,
+	[SHFL] = CHIP8_OPERANDS_XY,
+	[SKPNE] = CHIP8_OPERANDS_XY,
+	[MIV] = CHIP8_OPERANDS_NNN,
+	[JMPI] = CHIP8_OPERANDS_NNN,
+	[RNDMSK] = CHIP8_OPERANDS_XNN,
+	[DRWSPT] = CHIP8_OPERANDS_XYN,
+	[SKPKEY] = CHIP8_OPERANDS_X,
+	[SKPNKEY] = CHIP8_OPERANDS_X,
+	[MOVDLY] = CHIP8_OPERANDS_X,
+	[WTKEY] = CHIP8_OPERANDS_X,
+	[SETDLY] = CHIP8_OPERANDS_X,
+	[SETSND] = CHIP8_OPERANDS_X,
+	[IADD] = CHIP8_OPERANDS_X,
+	[ISETSPT] = CHIP8_OPERANDS_X,
+	[IBCD] = CHIP8_OPERANDS_X,
+	[REGDMP] = CHIP8_OPERANDS_X,
+	[REGLD] = CHIP8_OPERANDS_X,
+	[SCD] = CHIP8_OPERANDS_N,
+	[SCR] = CHIP8_OPERANDS_NONE,
+	[SCL] = CHIP8_OPERANDS_NONE,
+	[HALT] = CHIP8_OPERANDS_NONE,
+	[LORES] = CHIP8_OPERANDS_NONE,
+	[HIRES] = CHIP8_OPERANDS_NONE,
+	[DRWBIG] = CHIP8_OPERANDS_XY,
+	[BIGSPT] = CHIP8_OPERANDS_X,
+	[RPLDMP] = CHIP8_OPERANDS_X,
+	[RPLLD] = CHIP8_OPERANDS_X,
+	[SCU] = CHIP8_OPERANDS_N,
+	[LDIL] = CHIP8_OPERANDS_LONG,
+	[PLANE] = CHIP8_OPERANDS_X,
+	[AUDIO] = CHIP8_OPERANDS_NONE,
+	[PITCH] = CHIP8_OPERANDS_X,
+	[RNGDMP] = CHIP8_OPERANDS_XY,
+	[RNGLD] = CHIP8_OPERANDS_XY
+};
+
+static const char* const chip8_state_name[] = {
+	"running", "waiting for a key", "halted"
+};
+
+/* debugger stopped by SIGINT */
+static chip8_debugger* chip8_debug_interrupted;
+
+/*
+ * @brief Allocates a debugger without any breakpoints or watchpoints.
+ */
+chip8_debugger* chip8_new_debugger(void)
+{
+	chip8_debugger* const dbg = calloc(1, sizeof(*dbg));
+
+	if (!dbg) {
+		CHIP8_ERR("ERROR::Memory allocation failed");
+	}
+	return dbg;
+}
+
+/*
+ * @brief Signal handler stopping the debugger before the next frame.
+ */
+static void chip8_debug_sigint(int sig)
+{
+	(void) sig;
+	atomic_store(&chip8_debug_interrupted->interrupt, true);
+}
+
+/*
+ * @brief Makes SIGINT stop the debugger instead of ending the process.
+ */
+void chip8_debug_catch_interrupt(chip8_debugger dbg[static 1])
+{
+	struct sigaction action = { .sa_handler = chip8_debug_sigint };
+
+	chip8_debug_interrupted = dbg;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+}
+
+/*
+ * @brief Disassembles the instruction at an address into a line of text,
+ * returns the length of the instruction in bytes.
+ */
+chip8_word chip8_debug_format(const chip8_vm chip8[const static 1],
+		const chip8_word addr, char line[const], const size_t size)
+{
+	const chip8_word istr = chip8_mem_peek(chip8, addr) << 8
+		| chip8_mem_peek(chip8, addr+1);
+	const chip8_opcode opcode = chip8_disassemble(istr);
+	const unsigned x = (istr & 0x0F00) >> 8;
+	const unsigned y = (istr & 0x00F0) >> 4;
+	const char* const name = NOP == opcode ? "NOP"
+		: chip8_istr_name[opcode];
+	const int len = snprintf(line, size, "%04X  %04X  %-8s", addr, istr, name);
+
+	if (0 > len || size <= (size_t) len || NOP == opcode) {
+		return 2;
+	}
+
+	switch(chip8_debug_operands[opcode]) {
+		case CHIP8_OPERANDS_NONE:
+			break;
+		case CHIP8_OPERANDS_NNN:
+			snprintf(&line[len], size - len, "0x%03X", istr & 0x0FFF);
+			break;
+		case CHIP8_OPERANDS_N:
+			snprintf(&line[len], size - len, "%u", istr & 0x000F);
+			break;
+		case CHIP8_OPERANDS_X:
+			snprintf(&line[len], size - len, "V%X", x);
+			break;
+		case CHIP8_OPERANDS_XNN:
+			snprintf(&line[len], size - len, "V%X, 0x%02X", x, istr & 0x00FF);
+			break;
+		case CHIP8_OPERANDS_XY:
+			snprintf(&line[len], size - len, "V%X, V%X", x, y);
+			break;
+		case CHIP8_OPERANDS_XYN:
+			snprintf(&line[len], size - len, "V%X, V%X, %u", x, y,
+					istr & 0x000F);
+			break;
+		case CHIP8_OPERANDS_LONG:
+			snprintf(&line[len], size - len, "0x%02X%02X",
+					chip8_mem_peek(chip8, addr+2),
+					chip8_mem_peek(chip8, addr+3));
+			return 4;
+	}
+	return 2;
+}
+
+/*
+ * @brief Prints the registers, timers and stack.
+ */
+static void chip8_debug_print_regs(const chip8_vm chip8[const static 1])
+{
+	printf("PC %04X  I %04X  SP %u  DT %02X  ST %02X  keys %04X  frame %llu "
+			"(%s)\n", chip8->pc, chip8->idx, chip8->sp, chip8->dly_tmr,
+			chip8->snd_tmr, chip8->keys, (unsigned long long) chip8->frame,
+			chip8_state_name[chip8->state]);
+
+	for (unsigned i = 0; i < REG_BANK_SIZE; i++) {
+		printf("V%X %02X%s", i, chip8->regs[i], 7 == i % 8 ? "\n" : "  ");
+	}
+
+	if (chip8->sp) {
+		printf("stack");
+
+		for (unsigned i = 0; i < chip8->sp && i < CHIP8_STACK_SIZE; i++) {
+			printf(" %04X", chip8->stack[i]);
+		}
+		printf("\n");
+	}
+}
+
+/*
+ * @brief Prints the disassembly of a number of instructions.
+ */
+static void chip8_debug_list(const chip8_vm chip8[const static 1],
+		chip8_word addr, const unsigned count)
+{
+	char line[CHIP8_DEBUG_LINE_SIZE];
+
+	for (unsigned i = 0; i < count; i++) {
+		const chip8_word len = chip8_debug_format(chip8, addr, line,
+				sizeof(line));
+
+		printf("%s %s\n", addr == chip8->pc ? "=>" : "  ", line);
+		addr += len;
+	}
+}
+
+/*
+ * @brief Prints a range of memory as hex bytes.
+ */
+static void chip8_debug_dump(const chip8_vm chip8[const static 1],
+		const chip8_word addr, const unsigned count)
+{
+	for (unsigned i = 0; i < count; i++) {
+		if (!(i % 16)) {
+			printf("%s%04X ", i ? "\n" : "", (addr + i) & (CHIP8_MEM_SIZE-1));
+		}
+		printf(" %02X", chip8_mem_peek(chip8, addr + i));
+	}
+	printf("\n");
+}
+
+/*
+ * @brief Evaluates one breakpoint condition.
+ */
+static bool chip8_debug_cond_true(const chip8_vm chip8[const static 1],
+		const chip8_debug_cond cond[static 1])
+{
+	const unsigned value = REG_BANK_SIZE == cond->reg ? chip8->idx
+		: chip8->regs[cond->reg];
+
+	switch(cond->op[0]) {
+		case '=': return value == cond->value;
+		case '!': return value != cond->value;
+		case '<': return '=' == cond->op[1] ? value <= cond->value
+					: value < cond->value;
+		default: return '=' == cond->op[1] ? value >= cond->value
+					: value > cond->value;
+	}
+}
+
+/*
+ * @brief Returns whether the trap at the program counter stops execution,
+ * an address with several conditions stops when any of them is true.
+ */
+static bool chip8_debug_trapped(const chip8_debugger dbg[static 1],
+		const chip8_vm chip8[const static 1])
+{
+	const chip8_byte trap = dbg->traps[chip8->pc];
+
+	if (trap & CHIP8_TRAP_BREAK) {
+		return true;
+	}
+
+	for (unsigned i = 0; (trap & CHIP8_TRAP_COND) && i < dbg->cond_count;
+			i++) {
+		if (chip8->pc == dbg->conds[i].addr
+		    && chip8_debug_cond_true(chip8, &dbg->conds[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * @brief Checks the watched ranges on dirty pages, returns whether the last
+ * instruction changed any of them.
+ */
+static bool chip8_debug_watched(chip8_debugger dbg[static 1],
+		chip8_vm chip8[const static 1], const chip8_word pc)
+{
+	bool changed = false;
+
+	chip8->dirty &= ~dbg->watch_pages;
+
+	for (unsigned i = 0; i < dbg->watch_count; i++) {
+		chip8_debug_watch* const watch = &dbg->watches[i];
+
+		for (unsigned j = 0; j < watch->size; j++) {
+			const chip8_byte value = chip8_mem_peek(chip8, watch->addr + j);
+
+			if (watch->old[j] != value) {
+				printf("watchpoint %04X: %02X -> %02X by %04X\n",
+						watch->addr + j, watch->old[j], value, pc);
+				watch->old[j] = value;
+				changed = true;
+			}
+		}
+	}
+	return changed;
+}
+
+/*
+ * @brief Returns whether the step just executed completes the pending
+ * step, step over or step out.
+ */
+static bool chip8_debug_stepped(chip8_debugger dbg[static 1],
+		const chip8_vm chip8[const static 1])
+{
+	switch(dbg->mode) {
+		case CHIP8_DEBUG_STEP:
+			return !--dbg->steps;
+		case CHIP8_DEBUG_OVER:
+			return chip8->sp <= dbg->depth;
+		case CHIP8_DEBUG_OUT:
+			return chip8->sp < dbg->depth;
+		default:
+			return false;
+	}
+}
+
+/*
+ * @brief Runs the rest of the current frame, or a whole frame, stopping at
+ * breakpoints, watchpoints and completed steps.
+ *
+ * Without anything to stop at, the frame runs through chip8_run_frame().
+ * A stopped frame is resumed by the next call, its timers only tick once.
+ * Instructions are added to counts by opcode unless it is NULL.
+ */
+chip8_rc chip8_debug_frame(chip8_debugger dbg[static 1],
+		chip8_vm chip8[const static 1], const unsigned cycles,
+		uint32_t* const counts)
+{
+	if (!dbg->in_frame && atomic_exchange(&dbg->interrupt, false)) {
+		printf("interrupted\n");
+		dbg->stopped = true;
+		return CHIP8_SUCCESS;
+	} else if (!dbg->in_frame && !dbg->trap_count && !dbg->watch_count
+	           && CHIP8_DEBUG_RUN == dbg->mode) {
+		dbg->resume = false;
+		return counts ? chip8_count_frame(chip8, cycles, counts)
+			: chip8_run_frame(chip8, cycles);
+	} else if (!dbg->in_frame) {
+		chip8_start_frame(chip8);
+		dbg->executed = 0;
+		dbg->in_frame = true;
+	}
+
+	while (dbg->executed < cycles && CHIP8_RUNNING == chip8->state) {
+		const chip8_word pc = chip8->pc;
+
+		if (!dbg->resume && dbg->traps[pc] && chip8_debug_trapped(dbg, chip8)) {
+			printf("breakpoint %04X\n", pc);
+			dbg->stopped = true;
+			return CHIP8_SUCCESS;
+		}
+		dbg->resume = false;
+
+		if (!(counts ? chip8_count_step(chip8, counts) : chip8_step(chip8))) {
+			return CHIP8_FAILURE;
+		}
+		dbg->executed++;
+
+		if ((chip8->dirty & dbg->watch_pages && chip8_debug_watched(dbg, chip8,
+				pc)) || chip8_debug_stepped(dbg, chip8)) {
+			dbg->stopped = true;
+			return CHIP8_SUCCESS;
+		}
+	}
+	chip8_end_frame(chip8);
+	dbg->in_frame = false;
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Parses a breakpoint condition such as "v3 == 5" or "i >= 0x300".
+ */
+static chip8_rc chip8_debug_parse_cond(const char text[static 1],
+		chip8_debug_cond cond[static 1])
+{
+	char reg[4];
+	char op[3];
+	unsigned regx;
+	int value;
+
+	if (3 != sscanf(text, " %3s %2[=!<>] %i", reg, op, &value)) {
+		return CHIP8_FAILURE;
+	} else if (!strcasecmp(reg, "i")) {
+		cond->reg = REG_BANK_SIZE;
+	} else if (('v' == reg[0] || 'V' == reg[0]) && !reg[2]
+	           && 1 == sscanf(&reg[1], "%1x", &regx)) {
+		cond->reg = regx;
+	} else {
+		return CHIP8_FAILURE;
+	}
+
+	if (strcmp(op, "==") && strcmp(op, "!=") && strcmp(op, "<")
+	    && strcmp(op, "<=") && strcmp(op, ">") && strcmp(op, ">=")) {
+		return CHIP8_FAILURE;
+	}
+	memcpy(cond->op, op, sizeof(cond->op));
+	cond->value = value;
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Sets a breakpoint, with a condition if the text after the address
+ * holds one.
+ */
+static void chip8_debug_add_break(chip8_debugger dbg[static 1],
+		const chip8_word addr, const char cond_text[static 1])
+{
+	chip8_debug_cond cond = { .addr = addr };
+
+	if (!dbg->traps[addr]) {
+		dbg->trap_count++;
+	}
+
+	if (!*cond_text || '\n' == *cond_text) {
+		dbg->traps[addr] |= CHIP8_TRAP_BREAK;
+		printf("breakpoint at %04X\n", addr);
+	} else if (!chip8_debug_parse_cond(cond_text, &cond)) {
+		printf("invalid condition, expected e.g. v3 == 5 or i >= 0x300\n");
+		dbg->trap_count -= !dbg->traps[addr];
+	} else if (CHIP8_DEBUG_MAX_CONDS == dbg->cond_count) {
+		printf("too many conditional breakpoints\n");
+		dbg->trap_count -= !dbg->traps[addr];
+	} else {
+		dbg->conds[dbg->cond_count++] = cond;
+		dbg->traps[addr] |= CHIP8_TRAP_COND;
+		printf("conditional breakpoint at %04X\n", addr);
+	}
+}
+
+/*
+ * @brief Deletes the breakpoints at an address, or all with a negative one.
+ */
+static void chip8_debug_remove_break(chip8_debugger dbg[static 1],
+		const int addr)
+{
+	unsigned kept = 0;
+
+	for (unsigned i = 0; i < dbg->cond_count; i++) {
+		if (0 <= addr && addr != dbg->conds[i].addr) {
+			dbg->conds[kept++] = dbg->conds[i];
+		}
+	}
+	dbg->cond_count = kept;
+
+	if (0 > addr) {
+		memset(dbg->traps, 0, sizeof(dbg->traps));
+		dbg->trap_count = 0;
+	} else if (dbg->traps[addr]) {
+		dbg->traps[addr] = 0;
+		dbg->trap_count--;
+	}
+}
+
+/*
+ * @brief Recomputes the memory pages holding watched ranges.
+ */
+static void chip8_debug_watch_pages(chip8_debugger dbg[static 1])
+{
+	dbg->watch_pages = 0;
+
+	for (unsigned i = 0; i < dbg->watch_count; i++) {
+		const chip8_debug_watch* const watch = &dbg->watches[i];
+
+		for (unsigned page = watch->addr >> CHIP8_MEM_PAGE_SHIFT;
+				page <= (watch->addr + watch->size - 1u) >> CHIP8_MEM_PAGE_SHIFT;
+				page++) {
+			dbg->watch_pages |= 1ULL << page;
+		}
+	}
+}
+
+/*
+ * @brief Watches a memory range for changes.
+ */
+static void chip8_debug_add_watch(chip8_debugger dbg[static 1],
+		chip8_vm chip8[const static 1], const chip8_word addr,
+		const unsigned size)
+{
+	chip8_debug_watch* watch;
+
+	if (!size || CHIP8_DEBUG_WATCH_SIZE < size
+	    || CHIP8_MEM_SIZE < addr + size) {
+		printf("watched ranges are 1 to %u bytes inside memory\n",
+				CHIP8_DEBUG_WATCH_SIZE);
+		return;
+	} else if (CHIP8_DEBUG_MAX_WATCHES == dbg->watch_count) {
+		printf("too many watchpoints\n");
+		return;
+	}
+	watch = &dbg->watches[dbg->watch_count++];
+	watch->addr = addr;
+	watch->size = size;
+
+	for (unsigned i = 0; i < size; i++) {
+		watch->old[i] = chip8_mem_peek(chip8, addr + i);
+	}
+	chip8_debug_watch_pages(dbg);
+	chip8->dirty &= ~dbg->watch_pages;
+	printf("watchpoint at %04X, %u bytes\n", addr, size);
+}
+
+/*
+ * @brief Deletes the watchpoint at an address, or all with a negative one.
+ */
+static void chip8_debug_remove_watch(chip8_debugger dbg[static 1],
+		const int addr)
+{
+	unsigned kept = 0;
+
+	for (unsigned i = 0; i < dbg->watch_count; i++) {
+		if (0 <= addr && addr != dbg->watches[i].addr) {
+			dbg->watches[kept++] = dbg->watches[i];
+		}
+	}
+	dbg->watch_count = kept;
+	chip8_debug_watch_pages(dbg);
+}
+
+/*
+ * @brief Reads and runs commands until one resumes execution, returns
+ * failure when the user quits.
+ */
+chip8_rc chip8_debug_prompt(chip8_debugger dbg[static 1],
+		chip8_vm chip8[const static 1])
+{
+	char line[CHIP8_DEBUG_LINE_SIZE];
+
+	chip8_debug_list(chip8, chip8->pc, 1);
+	dbg->stopped = false;
+	dbg->mode = CHIP8_DEBUG_RUN;
+
+	for (;;) {
+		char cmd = '\0';
+		int addr = -1;
+		int count = 0;
+		int consumed = 0;
+
+		printf("(chip8) ");
+		fflush(stdout);
+
+		if (!fgets(line, sizeof(line), stdin)) {
+			/* ^C at the prompt interrupts the read, execution already stopped */
+			if (ferror(stdin) && EINTR == errno) {
+				clearerr(stdin);
+				atomic_store(&dbg->interrupt, false);
+				printf("\n");
+				continue;
+			}
+			return CHIP8_FAILURE;
+		} else if ('\n' == line[0]) {
+			memcpy(line, dbg->last, sizeof(line));
+		} else {
+			memcpy(dbg->last, line, sizeof(line));
+		}
+		sscanf(line, " %c%n %i%n %i", &cmd, &consumed, &addr, &consumed,
+				&count);
+
+		if (0 < addr) {
+			addr &= CHIP8_MEM_SIZE-1;
+		}
+
+		switch(cmd) {
+			case 'c':
+				dbg->resume = true;
+				return CHIP8_SUCCESS;
+			case 's':
+				dbg->mode = CHIP8_DEBUG_STEP;
+				dbg->steps = 0 < addr ? (unsigned) addr : 1;
+				dbg->resume = true;
+				return CHIP8_SUCCESS;
+			case 'n':
+				dbg->mode = CHIP8_DEBUG_OVER;
+				dbg->depth = chip8->sp;
+				dbg->resume = true;
+				return CHIP8_SUCCESS;
+			case 'o':
+				if (!chip8->sp) {
+					printf("not inside a subroutine\n");
+					break;
+				}
+				dbg->mode = CHIP8_DEBUG_OUT;
+				dbg->depth = chip8->sp;
+				dbg->resume = true;
+				return CHIP8_SUCCESS;
+			case 'b':
+				if (0 > addr) {
+					printf("usage: b addr [v0-vf|i ==|!=|<|<=|>|>= value]\n");
+				} else {
+					chip8_debug_add_break(dbg, addr, &line[consumed]);
+				}
+				break;
+			case 'd':
+				chip8_debug_remove_break(dbg, addr);
+				break;
+			case 'w':
+				if (0 > addr) {
+					printf("usage: w addr [size]\n");
+				} else {
+					chip8_debug_add_watch(dbg, chip8, addr,
+							0 < count ? count : 1);
+				}
+				break;
+			case 'u':
+				chip8_debug_remove_watch(dbg, addr);
+				break;
+			case 'r':
+				chip8_debug_print_regs(chip8);
+				break;
+			case 'l':
+				chip8_debug_list(chip8, 0 > addr ? chip8->pc : addr,
+						0 < count ? count : 10);
+				break;
+			case 'x':
+				chip8_debug_dump(chip8, 0 > addr ? chip8->idx : addr,
+						0 < count ? count : 16);
+				break;
+			case 'q':
+				return CHIP8_FAILURE;
+			default:
+				printf("c continue, s [n] step, n step over, o step out,\n"
+						"b addr [reg op value] break, d [addr] delete, "
+						"w addr [size] watch, u [addr] unwatch,\n"
+						"r registers, l [addr] [n] list, x [addr] [n] memory, "
+						"q quit\n");
+				break;
+		}
+	}
+}
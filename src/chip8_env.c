@@ -0,0 +1,355 @@
+/*
+ * @file chip8_env.c
+ * @brief Implements the batched environment API for reinforcement learning.
+ *
+ * All virtual machines live in one array and every thread steps a fixed
+ * contiguous slice of it, the calling thread included, so a batch needs one
+ * wakeup per worker and no locking per machine. Observations are built from
+ * the packed display rows directly into the caller's buffer.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "chip8_io.h"
+#include "chip8_rom.h"
+#include "chip8_env.h"
+
+/*
+ * @brief Halves a display row word by combining adjacent pixel pairs, the
+ * leftmost pair ending up in the high bit of the result.
+ */
+static inline uint32_t chip8_env_halve(uint64_t row)
+{
+	row = (row | row >> 1) & 0x5555555555555555ULL;
+	row = (row | row >> 1) & 0x3333333333333333ULL;
+	row = (row | row >> 2) & 0x0F0F0F0F0F0F0F0FULL;
+	row = (row | row >> 4) & 0x00FF00FF00FF00FFULL;
+	row = (row | row >> 8) & 0x0000FFFF0000FFFFULL;
+	return row | row >> 16;
+}
+
+/*
+ * @brief Returns a plane's row of the observation, 64 pixels wide in either
+ * resolution.
+ */
+static inline uint64_t chip8_env_row(const chip8_vm chip8[const static 1],
+		const unsigned plane, const unsigned y)
+{
+	if (!chip8->hires) {
+		return chip8->gfx[plane][y][0];
+	}
+	const uint64_t (*const rows)[CHIP8_GFX_ROW_WORDS] =
+		&chip8->gfx[plane][2 * y];
+
+	return (uint64_t) chip8_env_halve(rows[0][0] | rows[1][0]) << 32
+		| chip8_env_halve(rows[0][1] | rows[1][1]);
+}
+
+/*
+ * @brief Spreads the 8 pixels of a row byte to one byte each, the leftmost
+ * pixel in the lowest byte.
+ */
+static inline uint64_t chip8_env_spread(const uint64_t pixels)
+{
+	return (pixels * 0x8040201008040201ULL) >> 7 & 0x0101010101010101ULL;
+}
+
+static void chip8_env_observe(const chip8_env env[const static 1],
+		const chip8_vm chip8[const static 1], chip8_byte obs[const])
+{
+	for (unsigned y = 0; y < CHIP8_ENV_OBS_HEIGHT; y++) {
+		uint64_t rows[CHIP8_GFX_PLANES];
+
+		for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+			rows[p] = chip8_env_row(chip8, p, y);
+		}
+
+		if (CHIP8_ENV_OBS_PACKED == env->config.obs) {
+			uint64_t row = 0;
+
+			for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+				row |= rows[p];
+			}
+
+			for (unsigned i = 0; i < 8; i++) {
+				obs[8 * y + i] = row >> (56 - 8 * i);
+			}
+			continue;
+		}
+
+		for (unsigned i = 0; i < 8; i++) {
+			uint64_t colors = 0;
+
+			for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+				colors |= chip8_env_spread(rows[p] >> (56 - 8 * i) & 0xFF) << p;
+			}
+
+			for (unsigned x = 0; x < 8; x++) {
+				obs[CHIP8_ENV_OBS_WIDTH * y + 8 * i + x] = colors >> 8 * x;
+			}
+		}
+	}
+}
+
+/*
+ * @brief Starts a new episode of one machine from the loaded ROM.
+ */
+static void chip8_env_restart(chip8_env env[const static 1], const unsigned i,
+		const uint32_t seed)
+{
+	chip8_copy_vm(&env->vms[i], env->rom);
+	env->seeds[i] = seed;
+	chip8_seed(&env->vms[i], seed);
+}
+
+/*
+ * @brief Changes the keypad to the action's keys, through chip8_set_key() so
+ * FX0A sees the edges.
+ */
+static inline void chip8_env_press(chip8_vm chip8[const static 1],
+		const chip8_word keys)
+{
+	for (chip8_word changed = chip8->keys ^ keys; changed;
+			changed &= changed - 1) {
+		const unsigned key = __builtin_ctz(changed);
+
+		chip8_set_key(chip8, key, keys >> key & 1);
+	}
+}
+
+/*
+ * @brief Steps or resets the machines of one slice of the batch.
+ */
+static void chip8_env_run(chip8_env env[const static 1], const unsigned begin,
+		const unsigned end)
+{
+	const chip8_env_config* const config = &env->config;
+
+	for (unsigned i = begin; i < end; i++) {
+		chip8_vm* const chip8 = &env->vms[i];
+		float reward = 0.0f;
+		bool done = false;
+
+		if (!env->actions) {
+			chip8_env_restart(env, i, env->reset_seeds ? env->reset_seeds[i]
+					: i + 1);
+			chip8_env_observe(env, chip8, &env->obs[i * env->obs_size]);
+			continue;
+		}
+		chip8_env_press(chip8, config->actions[env->actions[i]
+				< config->action_count ? env->actions[i] : 0]);
+
+		for (unsigned f = 0; f < config->frame_skip && !done; f++) {
+			chip8_run_frame(chip8, config->cycles);
+
+			if (config->reward) {
+				reward += config->reward(chip8, i, config->user);
+			}
+			done = CHIP8_HALTED == chip8->state
+				|| (config->max_frames && chip8->frame >= config->max_frames)
+				|| (config->done && config->done(chip8, i, config->user));
+		}
+		env->rewards[i] = reward;
+		env->dones[i] = done;
+
+		/* the next episode gets a seed derived from this one */
+		if (done) {
+			chip8_env_restart(env, i, env->seeds[i] * 747796405U + 2891336453U);
+		}
+		chip8_env_observe(env, chip8, &env->obs[i * env->obs_size]);
+	}
+}
+
+static void* chip8_env_thread(void* const arg)
+{
+	chip8_env_worker* const worker = arg;
+	chip8_env* const env = worker->env;
+
+	for (;;) {
+		pthread_mutex_lock(&env->lock);
+
+		while (worker->generation == env->generation && !env->stop) {
+			pthread_cond_wait(&env->start, &env->lock);
+		}
+		worker->generation = env->generation;
+		pthread_mutex_unlock(&env->lock);
+
+		if (env->stop) {
+			return NULL;
+		}
+		chip8_env_run(env, worker->begin, worker->end);
+		atomic_fetch_sub_explicit(&env->pending, 1, memory_order_acq_rel);
+	}
+}
+
+/*
+ * @brief Runs the batch described by the job fields on every thread and
+ * returns once all slices are done.
+ */
+static void chip8_env_batch(chip8_env env[const static 1])
+{
+	if (1 == env->worker_count) {
+		chip8_env_run(env, 0, env->config.count);
+		return;
+	}
+	atomic_store_explicit(&env->pending, env->worker_count - 1,
+			memory_order_relaxed);
+	pthread_mutex_lock(&env->lock);
+	env->generation++;
+	pthread_cond_broadcast(&env->start);
+	pthread_mutex_unlock(&env->lock);
+
+	chip8_env_run(env, env->workers[0].begin, env->workers[0].end);
+
+	while (atomic_load_explicit(&env->pending, memory_order_acquire)) {
+		sched_yield();
+	}
+}
+
+/*
+ * @brief Creates count virtual machines running the ROM and the threads
+ * stepping them, the machines are reset with seeds 1 to count.
+ */
+chip8_env* chip8_new_env(const chip8_env_config config[const static 1],
+		const char rom_path[static 1])
+{
+	chip8_env* const env = calloc(1, sizeof(*env));
+	unsigned threads = config->threads ? config->threads
+		: (unsigned) sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (!env) {
+		CHIP8_PERROR("Environment allocation failed");
+		return NULL;
+	}
+	env->config = *config;
+	env->config.count = config->count ? config->count : 1;
+	env->config.cycles = config->cycles ? config->cycles
+		: CHIP8_CYCLES_PER_FRAME;
+	env->config.frame_skip = config->frame_skip ? config->frame_skip : 1;
+	env->obs_size = CHIP8_ENV_OBS_PACKED == config->obs
+		? CHIP8_ENV_OBS_WIDTH * CHIP8_ENV_OBS_HEIGHT / 8
+		: CHIP8_ENV_OBS_WIDTH * CHIP8_ENV_OBS_HEIGHT;
+
+	if (!config->action_count || CHIP8_ENV_MAX_ACTIONS < config->action_count) {
+		env->config.action_count = 1 + CHIP8_KEY_SIZE;
+		env->config.actions[0] = 0;
+
+		for (unsigned key = 0; key < CHIP8_KEY_SIZE; key++) {
+			env->config.actions[1 + key] = 1 << key;
+		}
+	}
+	threads = threads < 1 ? 1 : threads > env->config.count
+		? env->config.count : threads;
+
+	if (!(env->rom = chip8_new_vm()) || !chip8_load_rom(env->rom, rom_path)
+	    || !(env->seeds = calloc(env->config.count, sizeof(*env->seeds)))
+	    || !(env->workers = calloc(threads, sizeof(*env->workers)))
+	    || !(env->vms = aligned_alloc(_Alignof(chip8_vm),
+			env->config.count * sizeof(*env->vms)))) {
+		CHIP8_PERROR("Environment initialization failed");
+		chip8_free_env(env);
+		return NULL;
+	}
+	/* zeroed machines own no pages for the first chip8_copy_vm() */
+	memset(env->vms, 0, env->config.count * sizeof(*env->vms));
+	pthread_mutex_init(&env->lock, NULL);
+	pthread_cond_init(&env->start, NULL);
+	atomic_init(&env->pending, 0);
+
+	for (unsigned i = 0; i < env->config.count; i++) {
+		chip8_env_restart(env, i, i + 1);
+	}
+
+	/* slice 0 is stepped by the thread calling chip8_env_step() */
+	for (unsigned t = 0; t < threads; t++) {
+		chip8_env_worker* const worker = &env->workers[t];
+
+		worker->env = env;
+		worker->begin = (uint64_t) env->config.count * t / threads;
+		worker->end = (uint64_t) env->config.count * (t + 1) / threads;
+
+		if (t && pthread_create(&worker->thread, NULL, chip8_env_thread,
+				worker)) {
+			fprintf(stderr, "great_chip-8::ERROR::ENV: Could not create "
+				"thread %u\n", t);
+			chip8_free_env(env);
+			return NULL;
+		}
+		env->worker_count = t + 1;
+	}
+	return env;
+}
+
+/*
+ * @brief Returns the observation bytes per machine, observation buffers
+ * hold count of them back to back.
+ */
+size_t chip8_env_obs_size(const chip8_env env[const static 1])
+{
+	return env->obs_size;
+}
+
+/*
+ * @brief Starts new episodes of all machines with the given seeds, or seeds
+ * 1 to count, and writes their first observations.
+ */
+void chip8_env_reset(chip8_env env[const static 1],
+		const uint32_t* const seeds, void* const obs)
+{
+	env->actions = NULL;
+	env->reset_seeds = seeds;
+	env->obs = obs;
+	chip8_env_batch(env);
+}
+
+/*
+ * @brief Runs frame_skip frames of every machine with its action's keys held
+ * and writes observations, summed rewards and done flags.
+ */
+void chip8_env_step(chip8_env env[const static 1],
+		const uint32_t actions[const static 1], void* const obs,
+		float rewards[const static 1], uint8_t dones[const static 1])
+{
+	env->actions = actions;
+	env->obs = obs;
+	env->rewards = rewards;
+	env->dones = dones;
+	chip8_env_batch(env);
+}
+
+void chip8_free_env(chip8_env* const env)
+{
+	if (!env) {
+		return;
+	} else if (1 < env->worker_count) {
+		pthread_mutex_lock(&env->lock);
+		env->stop = true;
+		pthread_cond_broadcast(&env->start);
+		pthread_mutex_unlock(&env->lock);
+
+		for (unsigned i = 1; i < env->worker_count; i++) {
+			pthread_join(env->workers[i].thread, NULL);
+		}
+	}
+
+	if (env->workers) {
+		pthread_mutex_destroy(&env->lock);
+		pthread_cond_destroy(&env->start);
+	}
+	free(env->workers);
+	free(env->seeds);
+
+	for (unsigned i = 0; env->vms && i < env->config.count; i++) {
+		chip8_drop_vm(&env->vms[i]);
+	}
+	free(env->vms);
+	chip8_free_vm(env->rom);
+	free(env);
+}
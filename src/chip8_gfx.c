@@ -1,12 +1,31 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include "chip8.h"
 #include "chip8_io.h"
 #include "chip8_gfx.h"
+#include "chip8_rom.h"
+#include "chip8_embed.h"
+#include "chip8_time.h"
+#include "chip8_dbg.h"
+
+/*
+ * @brief Header preceding the driver specific blob in the program cache.
+ */
+typedef struct chip8_program_cache_header {
+	char magic[4]; /* CHIP8_PROGRAM_CACHE_MAGIC */
+	uint32_t version; /* CHIP8_PROGRAM_CACHE_VERSION */
+	uint64_t key; /* hash of shader sources and driver strings */
+	uint32_t format; /* binary format reported by the driver */
+	uint32_t length; /* length of the binary in bytes */
+} chip8_program_cache_header;
 
 /*
  * @brief Serves as the GLFW error callback function.
@@ -79,21 +98,17 @@ static chip8_rc chip8_compile_shader(const GLuint shader,
 }
 
 /*
- * @brief Loads and compiles GLSL shader.
+ * @brief Compiles embedded GLSL shader source and attaches it to the program.
  */
-static chip8_rc chip8_init_shader(const char shader_path[const static 1],
+static chip8_rc chip8_init_shader(const char shader_src[const static 1],
 		const GLenum shader_type, const GLuint program)
 {
-	const char* shader_src;
 	const GLuint shader = glCreateShader(shader_type);
 	chip8_rc status = CHIP8_SUCCESS;
 
 	if (!shader) {
 		CHIP8_ERR("ERROR::OpenGL::GLSL: Shader creation failed");
 		status = CHIP8_FAILURE;
-	} else if (!chip8_load_shader(shader_path, &shader_src)) {
-		CHIP8_PERROR("GLSL load failed");
-		status = CHIP8_FAILURE;
 	} else if (!chip8_compile_shader(shader, shader_src)) {
 		if (GL_VERTEX_SHADER == shader_type) {
 			CHIP8_ERR("ERROR::OpenGL::GLSL::VERTEX: Compilation failed");
@@ -102,7 +117,6 @@ static chip8_rc chip8_init_shader(const char shader_path[const static 1],
 		}
 		status = CHIP8_FAILURE;
 	}
-	free(shader_src);
 
 	if (CHIP8_SUCCESS == status) {
 		glAttachShader(program, shader);
@@ -140,16 +154,199 @@ static chip8_rc chip8_link_gfx_program(const GLuint program)
 	return CHIP8_SUCCESS;
 }
 
+/*
+ * @brief Builds the program cache path inside the user cache directory.
+ */
+static bool chip8_program_cache_path(char cache_path[static CHIP8_PATH_MAX])
+{
+	const char* const cache_home = getenv("XDG_CACHE_HOME");
+	const char* const home = getenv("HOME");
+
+	int length;
+
+	if (cache_home && *cache_home) {
+		length = snprintf(cache_path, CHIP8_PATH_MAX, "%s/" CHIP8_PROGRAM_CACHE,
+				cache_home);
+	} else if (home && *home) {
+		length = snprintf(cache_path, CHIP8_PATH_MAX,
+				"%s/.cache/" CHIP8_PROGRAM_CACHE, home);
+	} else {
+		return false;
+	}
+	/* a truncated path would load or replace another file */
+	return 0 <= length && CHIP8_PATH_MAX > length;
+}
+
+/*
+ * @brief Derives the cache key from the shader sources and the driver, a
+ * driver update silently invalidates its previous program binaries.
+ */
+static uint64_t chip8_program_cache_key(void)
+{
+	const char* const keys[5] = {
+			chip8_vert_shader_src,
+			chip8_frag_shader_src,
+			(const char*) glGetString(GL_VENDOR),
+			(const char*) glGetString(GL_RENDERER),
+			(const char*) glGetString(GL_VERSION)
+	};
+	uint64_t key = 0;
+
+	for (size_t i = 0; i < sizeof(keys) / sizeof(*keys); i++) {
+		if (keys[i]) {
+			key = key * 31 ^ chip8_hash(keys[i], strlen(keys[i]));
+		}
+	}
+	return key;
+}
+
+/*
+ * @brief Links the program from a cached binary instead of compiling.
+ */
+static chip8_rc chip8_load_program_cache(const GLuint program,
+		const char cache_path[static 1], const uint64_t key)
+{
+	chip8_program_cache_header header;
+	void* binary = NULL;
+	GLint link_status = GL_FALSE;
+	FILE* const file = fopen(cache_path, "rb");
+
+	if (!file) {
+		return CHIP8_FAILURE;
+	}
+
+	if (1 == fread(&header, sizeof(header), 1, file)
+	    && !memcmp(header.magic, CHIP8_PROGRAM_CACHE_MAGIC, sizeof(header.magic))
+	    && CHIP8_PROGRAM_CACHE_VERSION == header.version && key == header.key
+	    && (binary = malloc(header.length))
+	    && 1 == fread(binary, header.length, 1, file)) {
+		glProgramBinary(program, header.format, binary, header.length);
+		glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+	}
+	free(binary);
+	fclose(file);
+	return GL_TRUE == link_status ? CHIP8_SUCCESS : CHIP8_FAILURE;
+}
+
+/*
+ * @brief Creates every missing directory leading up to a file path.
+ */
+static chip8_rc chip8_make_parent_dirs(const char file_path[static 1])
+{
+	char dir_path[CHIP8_PATH_MAX];
+
+	snprintf(dir_path, sizeof(dir_path), "%s", file_path);
+
+	for (char* sep = strchr(dir_path + 1, '/'); sep; sep = strchr(sep + 1, '/')) {
+		*sep = '\0';
+
+		if (-1 == mkdir(dir_path, 0755) && EEXIST != errno) {
+			return CHIP8_FAILURE;
+		}
+		*sep = '/';
+	}
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Stores the linked program binary for the next launch.
+ */
+static chip8_rc chip8_save_program_cache(const GLuint program,
+		const char cache_path[static 1], const uint64_t key)
+{
+	char tmp_path[CHIP8_PATH_MAX + sizeof(".tmp")];
+	GLint length = 0;
+	GLenum format;
+	void* binary;
+	FILE* file;
+	chip8_program_cache_header header = {
+			.magic = CHIP8_PROGRAM_CACHE_MAGIC,
+			.version = CHIP8_PROGRAM_CACHE_VERSION,
+			.key = key
+	};
+
+	/* a truncated path would write the binary to another file */
+	if (sizeof(tmp_path) <= (size_t) snprintf(tmp_path, sizeof(tmp_path),
+			"%s.tmp", cache_path)) {
+		return CHIP8_FAILURE;
+	}
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+	if (length <= 0 || !(binary = malloc(length))) {
+		return CHIP8_FAILURE;
+	}
+	glGetProgramBinary(program, length, &length, &format, binary);
+	header.format = format;
+	header.length = length;
+
+	if (!chip8_make_parent_dirs(cache_path) || !(file = fopen(tmp_path, "wb"))) {
+		free(binary);
+		return CHIP8_FAILURE;
+	}
+
+	if (1 != fwrite(&header, sizeof(header), 1, file)
+	    || 1 != fwrite(binary, length, 1, file)
+	    || fclose(file) || rename(tmp_path, cache_path)) {
+		remove(tmp_path);
+		free(binary);
+		return CHIP8_FAILURE;
+	}
+	free(binary);
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Builds the shader program, preferring the cached program binary over
+ * compiling and linking the embedded shader sources.
+ */
+static chip8_rc chip8_init_program(chip8_renderer renderer[const static 1])
+{
+	char cache_path[CHIP8_PATH_MAX];
+	const GLuint program = renderer->shader_program;
+	const uint64_t start_ns = chip8_time_ns();
+	const bool cacheable = GLEW_ARB_get_program_binary
+		&& chip8_program_cache_path(cache_path);
+	const uint64_t key = cacheable ? chip8_program_cache_key() : 0;
+
+	if (cacheable && chip8_load_program_cache(program, cache_path, key)) {
+		renderer->program_cached = true;
+		renderer->program_ns = chip8_time_ns() - start_ns;
+		return CHIP8_SUCCESS;
+	} else if (!chip8_init_shader(chip8_vert_shader_src, GL_VERTEX_SHADER,
+			program)
+		   || !chip8_init_shader(chip8_frag_shader_src, GL_FRAGMENT_SHADER,
+			program)) {
+		CHIP8_ERR("ERROR::OpenGL::GLSL: Initialization failed");
+		return CHIP8_FAILURE;
+	}
+
+	if (cacheable) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+				GL_TRUE);
+	}
+
+	if (!chip8_link_gfx_program(program)) {
+		CHIP8_ERR("ERROR::OpenGL::GLSL::PROGRAM:: Linking failed");
+		return CHIP8_FAILURE;
+	} else if (cacheable && !chip8_save_program_cache(program, cache_path,
+			key)) {
+		CHIP8_DBG("Program binary cache write failed");
+	}
+	renderer->program_ns = chip8_time_ns() - start_ns;
+	return CHIP8_SUCCESS;
+}
+
 /*
  * @brief Initializes OpenGL render data.
+ *
+ * The display is drawn as a single window-filling quad textured with the
+ * pixel array, so both resolutions cost one draw call.
  */
 static void chip8_init_render_data(chip8_renderer renderer[const static 1],
 		const GLfloat window_scale)
 {
 	GLuint vertex_buffer;
 	GLuint element_buffer;
-	const GLuint window_width = CHIP8_GFX_RES_WIDTH * window_scale;
-	const GLuint window_height = CHIP8_GFX_RES_HEIGHT * window_scale;
 
 	const GLfloat vertices[8] = {
 			0.0f, 0.0f,
@@ -163,13 +360,6 @@ static void chip8_init_render_data(chip8_renderer renderer[const static 1],
 			1, 2, 3
 	};
 
-	const GLfloat orthographic_projection[16] = {
-			 2.0f/window_width,                0.0f, 0.0f, 0.0f,
-			              0.0f, -2.0f/window_height, 0.0f, 0.0f,
-			              0.0f,                0.0f, 0.0f, 0.0f,
-			             -1.0f,                1.0f, 0.0f, 1.0f
-	};
-
 	/* generate VAO, VBO, and EBO */
 	glGenVertexArrays(1, &renderer->vertex_array);
 	glGenBuffers(1, &vertex_buffer);
@@ -198,28 +388,30 @@ static void chip8_init_render_data(chip8_renderer renderer[const static 1],
 	glDeleteBuffers(1, &vertex_buffer);
 	glDeleteBuffers(1, &element_buffer);
 
-	renderer->scale = window_scale;
-	renderer->width = window_width;
-	renderer->height = window_height;
-	renderer->model_location = glGetUniformLocation(renderer->shader_program,
-	                                                "model");
-	renderer->model[0]  = window_scale;
-	renderer->model[5]  = window_scale;
-	renderer->model[15] = 1.0f;
+	/* display texture, one color index per pixel looked up in the palette */
+	glGenTextures(1, &renderer->texture);
+	glBindTexture(GL_TEXTURE_2D, renderer->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-	memcpy(renderer->projection, orthographic_projection,
-			sizeof(renderer->projection));
+	renderer->scale = window_scale;
+	renderer->width = CHIP8_GFX_RES_WIDTH * window_scale;
+	renderer->height = CHIP8_GFX_RES_HEIGHT * window_scale;
 
-	memcpy(renderer->sprite_color, (const GLfloat[3]){1.0f, 1.0f, 1.0f},
-			sizeof(renderer->sprite_color));
+	memcpy(renderer->palette, (const GLfloat[CHIP8_GFX_COLORS][3]) {
+			{ 0.0f, 0.0f, 0.0f }, /* background */
+			{ 1.0f, 1.0f, 1.0f }, /* plane 0, the only plane before XO-CHIP */
+			{ 0.6f, 0.6f, 0.6f }, /* plane 1 */
+			{ 0.3f, 0.3f, 0.3f }  /* both planes */
+	}, sizeof(renderer->palette));
 
 	glUseProgram(renderer->shader_program);
-	glUniformMatrix4fv(
-			glGetUniformLocation(renderer->shader_program, "projection"),
-			1, GL_FALSE, renderer->projection);
-	glUniform3fv(
-			glGetUniformLocation(renderer->shader_program, "sprite_color"),
-			1, renderer->sprite_color);
+	glUniform1i(glGetUniformLocation(renderer->shader_program, "display"), 0);
+	glUniform3fv(glGetUniformLocation(renderer->shader_program, "palette"),
+			CHIP8_GFX_COLORS, &renderer->palette[0][0]);
 }
 
 /*
@@ -230,16 +422,7 @@ static chip8_rc chip8_init_renderer(chip8_renderer** const renderer_ptr,
 {
 	*renderer_ptr = chip8_new_renderer();
 
-	if (!*renderer_ptr) {
-		return CHIP8_FAILURE;
-	} else if (!chip8_init_shader(CHIP8_VERT_SHADER_PATH, GL_VERTEX_SHADER,
-			(*renderer_ptr)->shader_program)
-		    || !chip8_init_shader(CHIP8_FRAG_SHADER_PATH, GL_FRAGMENT_SHADER,
-    		(*renderer_ptr)->shader_program)) {
-		CHIP8_ERR("ERROR::OpenGL::GLSL: Initialization failed");
-		return CHIP8_FAILURE;
-	} else if (!chip8_link_gfx_program((*renderer_ptr)->shader_program)) {
-		CHIP8_ERR("ERROR::OpenGL::GLSL::PROGRAM:: Linking failed");
+	if (!*renderer_ptr || !chip8_init_program(*renderer_ptr)) {
 		return CHIP8_FAILURE;
 	}
 	chip8_init_render_data(*renderer_ptr, window_scale);
@@ -308,32 +491,33 @@ ERROR:
 }
 
 /*
- * @brief Draws quad at array coordinates scaled to window size.
- */
-static inline void chip8_draw(chip8_renderer renderer[const static 1],
-		const GLfloat x, const GLfloat y)
-{
-	renderer->model[12] = renderer->scale * x;
-	renderer->model[13] = renderer->scale * y;
-	glUniformMatrix4fv(renderer->model_location, 1, GL_FALSE, renderer->model);
-	glBindVertexArray(renderer->vertex_array);
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (GLvoid *) 0);
-}
-
-/*
- * @brief Traverses through pixel array and draws if a pixel is designated.
+ * @brief Combines the planes of the current resolution into one color index
+ * per pixel and draws them as a single textured quad, the fragment shader
+ * turns indices into colors.
  */
 void chip8_render(const chip8_vm chip8[const static 1],
 		chip8_renderer renderer[const static 1])
 {
-	glUseProgram(renderer->shader_program);
-	glClear(GL_COLOR_BUFFER_BIT);
+	const unsigned width = chip8_gfx_width(chip8);
+	const unsigned height = chip8_gfx_height(chip8);
+	GLubyte* texel = renderer->pixels;
+
+	for (unsigned i = 0; i < height; i++) {
+		for (unsigned w = 0; w < width / 64; w++) {
+			const uint64_t plane0 = chip8->gfx[0][i][w];
+			const uint64_t plane1 = chip8->gfx[1][i][w];
 
-	for (chip8_byte i = 0; i <  CHIP8_GFX_RES_HEIGHT; i++) {
-		for (chip8_byte j = 0; j < CHIP8_GFX_RES_WIDTH; j++) {
-			if (chip8->gfx[i][j]) {
-				chip8_draw(renderer, j, i);
+			for (int bit = 63; bit >= 0; bit--) {
+				*texel++ = (plane0 >> bit & 1) | (plane1 >> bit & 1) << 1;
 			}
 		}
 	}
+	glUseProgram(renderer->shader_program);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, renderer->texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, width, height, 0, GL_RED_INTEGER,
+			GL_UNSIGNED_BYTE, renderer->pixels);
+	glBindVertexArray(renderer->vertex_array);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (GLvoid *) 0);
 }
@@ -0,0 +1,64 @@
+/*
+ * @file chip8_hash.c
+ * @brief Implements hashing of the complete virtual machine state.
+ *
+ * Two machines hash alike when they behave alike from here on, whether or
+ * not they share memory pages. Bookkeeping that does not influence
+ * execution, the frame counter, the last instruction, the draw and dirty
+ * flags and checked build faults, is left out. The display's 2 KB of rows
+ * are mixed into both lanes, as its incrementally maintained hash has 64
+ * bits and serves the cheaper test of whether a display changed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_hash.h"
+
+/*
+ * @brief Mixes a byte array padded with zeroes to whole words.
+ */
+static inline void chip8_hash_bytes(chip8_hash128 hash[const static 1],
+		const void* const data, const size_t size)
+{
+	const chip8_byte* const bytes = data;
+
+	for (size_t i = 0; i < size; i += 8) {
+		uint64_t word = 0;
+
+		memcpy(&word, &bytes[i], size - i < 8 ? size - i : 8);
+		chip8_hash_word(hash, word);
+	}
+}
+
+chip8_hash128 chip8_hash_vm(const chip8_vm chip8[const static 1])
+{
+	static const chip8_byte zero[CHIP8_COW_SIZE];
+	chip8_hash128 hash = { 0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL };
+
+	chip8_hash_word(&hash, (uint64_t) chip8->pc | (uint64_t) chip8->sp << 16
+			| (uint64_t) chip8->idx << 32 | (uint64_t) chip8->keys << 48);
+	chip8_hash_bytes(&hash, chip8->regs, sizeof(chip8->regs));
+	chip8_hash_word(&hash, chip8->dly_tmr | chip8->snd_tmr << 8
+			| chip8->state << 16 | chip8->quirks << 24
+			| (uint64_t) chip8->plane << 32 | (uint64_t) chip8->wait_reg << 40
+			| (uint64_t) chip8->hires << 48 | (uint64_t) chip8->has_pattern << 56);
+	chip8_hash_word(&hash, chip8->rng | (uint64_t) chip8->pitch << 32);
+	chip8_hash_bytes(&hash, chip8->stack, sizeof(chip8->stack));
+	chip8_hash_bytes(&hash, chip8->flags, sizeof(chip8->flags));
+	chip8_hash_bytes(&hash, chip8->pattern, sizeof(chip8->pattern));
+	chip8_hash_bytes(&hash, chip8->gfx, sizeof(chip8->gfx));
+
+	/* zeroed pages hash like the zero page whoever owns them */
+	for (unsigned i = 0; i < CHIP8_COW_PAGES; i++) {
+		const chip8_page* const page = chip8->pages[i];
+
+		if (atomic_load_explicit(&page->refs, memory_order_relaxed)
+		    && memcmp(page->data, zero, sizeof(zero))) {
+			chip8_hash_word(&hash, i);
+			chip8_hash_bytes(&hash, page->data, sizeof(page->data));
+		}
+	}
+	return chip8_hash_final(hash);
+}
@@ -0,0 +1,79 @@
+/*
+ * @file chip8_hist.c
+ * @brief Implements percentiles and reporting of fixed size histograms.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "chip8.h"
+#include "chip8_hist.h"
+
+/*
+ * @brief Returns the largest value falling into a bucket.
+ */
+static uint64_t chip8_hist_bucket_max(const unsigned bucket)
+{
+	if (bucket < CHIP8_HIST_SUB) {
+		return bucket;
+	}
+	const unsigned shift = bucket / (CHIP8_HIST_SUB / 2) - 1;
+	const uint64_t sub = bucket - shift * (CHIP8_HIST_SUB / 2);
+
+	return ((sub + 1) << shift) - 1;
+}
+
+/*
+ * @brief Returns the value the given percentage of recorded values is at or
+ * below, 0 for an empty histogram.
+ */
+uint64_t chip8_hist_percentile(const chip8_hist hist[const static 1],
+		const double percentile)
+{
+	const double rank = hist->count * percentile / 100;
+	uint64_t seen = 0;
+
+	for (unsigned i = 0; i < CHIP8_HIST_BUCKETS && hist->count; i++) {
+		seen += hist->buckets[i];
+
+		if (seen && seen >= rank) {
+			const uint64_t value = chip8_hist_bucket_max(i);
+
+			return value < hist->max ? value : hist->max;
+		}
+	}
+	return hist->max;
+}
+
+/*
+ * @brief Adds the values recorded in src to dst.
+ */
+void chip8_merge_hist(chip8_hist dst[restrict const static 1],
+		const chip8_hist src[restrict const static 1])
+{
+	for (unsigned i = 0; i < CHIP8_HIST_BUCKETS; i++) {
+		dst->buckets[i] += src->buckets[i];
+	}
+	dst->count += src->count;
+	dst->max = src->max > dst->max ? src->max : dst->max;
+}
+
+/*
+ * @brief Prints a line of percentiles with values divided by scale, e.g.
+ * 1e6 and "ms" for nanoseconds shown in milliseconds.
+ */
+void chip8_print_hist(FILE* const file, const char label[static 1],
+		const chip8_hist hist[const static 1], const double scale,
+		const char unit[static 1])
+{
+	static const double percentiles[] = { 50, 90, 99, 99.9 };
+
+	fprintf(file, "%s:", label);
+
+	for (size_t i = 0; i < sizeof(percentiles) / sizeof(*percentiles); i++) {
+		fprintf(file, " p%g %.2f %s", percentiles[i],
+				chip8_hist_percentile(hist, percentiles[i]) / scale, unit);
+	}
+	fprintf(file, " max %.2f %s (%llu samples)\n", hist->max / scale, unit,
+			(unsigned long long) hist->count);
+}
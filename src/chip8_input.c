@@ -0,0 +1,58 @@
+/*
+ * @file chip8_input.c
+ * @brief Implements the keypad event queue between host and virtual machine.
+ *
+ * Events are timestamped when the host polls them and applied to the keypad
+ * bitmask on frame boundaries only, so every key transition is seen by the
+ * program at a predictable point in emulated time.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "chip8.h"
+#include "chip8_input.h"
+
+/*
+ * @brief Queues a keypad event, failing when the queue is full.
+ */
+chip8_rc chip8_push_input(chip8_input_queue queue[const static 1],
+		const chip8_key key, const bool pressed, const uint64_t time_ns)
+{
+	if (CHIP8_INPUT_QUEUE_SIZE == queue->tail - queue->head) {
+		return CHIP8_FAILURE;
+	}
+	queue->events[queue->tail++ & (CHIP8_INPUT_QUEUE_SIZE-1)] =
+		(chip8_input_event) {
+			.time_ns = time_ns,
+			.frame = queue->frame,
+			.key = key,
+			.pressed = pressed
+		};
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Applies queued events to the keypad of the virtual machine.
+ *
+ * A release of a key pressed during the same frame is held back until the
+ * next frame, so a tap shorter than a frame is still visible to the program
+ * for one whole frame instead of being lost.
+ */
+void chip8_apply_input(chip8_input_queue queue[const static 1],
+		chip8_vm chip8[const static 1])
+{
+	chip8_word pressed_keys = 0;
+
+	for (; queue->head != queue->tail; queue->head++) {
+		const chip8_input_event* const event =
+			&queue->events[queue->head & (CHIP8_INPUT_QUEUE_SIZE-1)];
+
+		if (!event->pressed && pressed_keys & 1 << event->key) {
+			break;
+		} else if (event->pressed) {
+			pressed_keys |= 1 << event->key;
+		}
+		chip8_set_key(chip8, event->key, event->pressed);
+	}
+}
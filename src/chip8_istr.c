@@ -5,21 +5,25 @@
  * This contains the chip-8 disassembler for decoding instructions into their
  * corresponding functions. This also contains the opcode function definitions
  * and instruction set array with the function pointers used by the main 
- * fetch-execute cycle.
+ * fetch-execute cycle, one specialized instruction set per quirk profile.
  * Function descriptions refer to variables defined in the chip-8 object
  * structure.
  *
  * @author Jonathan Alencar
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <GLFW/glfw3.h>
+#include <strings.h>
 
 #include "chip8.h"
 #include "chip8_io.h"
 #include "chip8_istr.h"
+#include "chip8_embed.h"
+#include "chip8_trace.h"
 #include "chip8_dbg.h"
 
 /*
@@ -33,12 +37,20 @@ chip8_opcode chip8_disassemble(const chip8_word istr_word)
 	switch (big_end & 0xF0) {
 		case 0x00: {
 			switch(lil_end) {
-				case 0xE0: {
-					draw_flag = true;
-					return CLS;
-				}
+				case 0xE0: return CLS;
 				case 0xEE: return RET;
-				default: return RCA;
+				case 0xFB: return SCR;
+				case 0xFC: return SCL;
+				case 0xFD: return HALT;
+				case 0xFE: return LORES;
+				case 0xFF: return HIRES;
+				default: {
+					switch(istr_word & 0x0FF0) {
+						case 0x00C0: return SCD;
+						case 0x00D0: return SCU;
+						default: return RCA;
+					}
+				}
 			}
 		}
 		case 0x10: {
@@ -47,7 +59,14 @@ chip8_opcode chip8_disassemble(const chip8_word istr_word)
 		case 0x20: return CALL;
 		case 0x30: return SKPEI;
 		case 0x40: return SKPNEI;
-		case 0x50: return SKPE;
+		case 0x50: {
+			switch(lil_end & 0x0F) {
+				case 0x00: return SKPE;
+				case 0x02: return RNGDMP;
+				case 0x03: return RNGLD;
+				default: return NOP;
+			}
+		}
 		case 0x60: return MOVI;
 		case 0x70: return ADDI;
 		case 0x80: {
@@ -61,26 +80,26 @@ chip8_opcode chip8_disassemble(const chip8_word istr_word)
 				case 0x06: return SHFR;
 				case 0x07: return SUBB;
 				case 0x0E: return SHFL;
+				default: return NOP;
 			}
 		}
 		case 0x90: return SKPNE;
 		case 0xA0: return MIV;
 		case 0xB0: return JMPI;
 		case 0xC0: return RNDMSK;
-		case 0xD0: {
-			draw_flag = true;
-			return DRWSPT;
-		}
+		case 0xD0: return lil_end & 0x0F ? DRWSPT : DRWBIG;
 		case 0xE0: {
-			glfwPollEvents();
-
 			switch(lil_end) {
 				case 0x9E: return SKPKEY;
 				case 0xA1: return SKPNKEY;
+				default: return NOP;
 			}
 		}
 		case 0xF0: {
 			switch(lil_end) {
+				case 0x00: return 0xF0 == big_end ? LDIL : NOP;
+				case 0x01: return PLANE;
+				case 0x02: return 0xF0 == big_end ? AUDIO : NOP;
 				case 0x07: return MOVDLY;
 				case 0x0A: {
 					return WTKEY;
@@ -89,15 +108,104 @@ chip8_opcode chip8_disassemble(const chip8_word istr_word)
 				case 0x18: return SETSND;
 				case 0x1E: return IADD;
 				case 0x29: return ISETSPT;
+				case 0x30: return BIGSPT;
 				case 0x33: return IBCD;
+				case 0x3A: return PITCH;
 				case 0x55: return REGDMP;
 				case 0x65: return REGLD;
+				case 0x75: return RPLDMP;
+				case 0x85: return RPLLD;
+				default: return NOP;
 			}
 		}
 		default: return NOP;
 	}
 }
 
+/*
+ * @brief XORs one sprite row into a display row and returns whether a set
+ * pixel was erased.
+ *
+ * The sprite row is left aligned in the most significant bits and shifted
+ * into place across word boundaries, pixels past the right edge of the
+ * words in use are clipped or wrap around to the left edge.
+ */
+static inline bool chip8_draw_row(uint64_t row[const static CHIP8_GFX_ROW_WORDS],
+		const unsigned words, const unsigned x, const uint64_t sprite,
+		const bool wrap)
+{
+	const unsigned shift = x % 64;
+	uint64_t bits[CHIP8_GFX_ROW_WORDS+1] = { 0 };
+	uint64_t erased = 0;
+
+	bits[x/64] = sprite >> shift;
+	bits[x/64+1] = shift ? sprite << (64 - shift) : 0;
+
+	if (wrap) {
+		bits[0] |= bits[words];
+	}
+
+	for (unsigned i = 0; i < words; i++) {
+		erased |= row[i] & bits[i];
+		row[i] ^= bits[i];
+	}
+	return erased;
+}
+
+/*
+ * @brief Draws a sprite row into a display row of a plane and updates the
+ * display hash with the row's change.
+ */
+static inline bool chip8_draw_gfx_row(chip8_vm chip8[const static 1],
+		const unsigned plane, const unsigned y, const unsigned words,
+		const unsigned x, const uint64_t sprite, const bool wrap)
+{
+	uint64_t* const row = chip8->gfx[plane][y];
+	bool erased;
+
+	if (chip8->gfx_stale) {
+		return chip8_draw_row(row, words, x, sprite, wrap);
+	} else if (!sprite) {
+		return false;
+	}
+	chip8->gfx_hash ^= chip8_gfx_row_hash(plane, y, row);
+	erased = chip8_draw_row(row, words, x, sprite, wrap);
+	chip8->gfx_hash ^= chip8_gfx_row_hash(plane, y, row);
+	return erased;
+}
+
+/*
+ * @brief Tells whether every pixel outside the display of the resolution is
+ * clear, low resolution leaves the second word and the lower rows unused.
+ */
+static inline bool chip8_gfx_clear_outside(const chip8_vm chip8[const static 1])
+{
+	const unsigned height = chip8_gfx_height(chip8);
+	const unsigned words = chip8_gfx_width(chip8) / 64;
+
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		for (unsigned y = 0; y < CHIP8_GFX_HIRES_HEIGHT; y++) {
+			for (unsigned w = y < height ? words : 0; w < CHIP8_GFX_ROW_WORDS;
+			     w++) {
+				if (chip8->gfx[p][y][w]) {
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * @brief Returns how far a taken skip advances the program counter, the
+ * skipped instruction is four bytes long if it is an F000 NNNN long load.
+ */
+static inline chip8_word chip8_skip(chip8_vm chip8[const static 1])
+{
+	return 0xF0 == chip8_mem_read(chip8, chip8->pc+2)
+		&& 0x00 == chip8_mem_read(chip8, chip8->pc+3) ? 6 : 4;
+}
+
 /*
  * @brief Calls RCA 1802 program at address NNN (not required for most ROMs).
  * 0x0NNN
@@ -110,12 +218,26 @@ void chip8_RCA(chip8_vm chip8[const static 1])
 }
 
 /*
- * @brief Clears the screen.
+ * @brief Clears the selected planes of the screen.
  * 0x00E0
  */
 void chip8_CLS(chip8_vm chip8[const static 1])
 {
-	memset(chip8->gfx, 0, sizeof(chip8->gfx));
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		if (!(chip8->plane >> p & 1)) {
+			continue;
+		}
+
+		for (unsigned y = 0; y < CHIP8_GFX_HIRES_HEIGHT && !chip8->gfx_stale;
+				y++) {
+			chip8->gfx_hash ^= chip8_gfx_row_hash(p, y, chip8->gfx[p][y]);
+		}
+		memset(chip8->gfx[p], 0, sizeof(chip8->gfx[p]));
+	}
+	CHIP8_CHECK(chip8, chip8->gfx_stale
+			|| chip8_rehash_gfx(chip8) == chip8->gfx_hash, CHIP8_FAULT_GFX_HASH);
+	CHIP8_TRACE1(clear, chip8->plane);
+	chip8->draw_flag = true;
 	chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0x00E0) CLS");
 }
@@ -126,9 +248,9 @@ void chip8_CLS(chip8_vm chip8[const static 1])
  */
 void chip8_RET(chip8_vm chip8[const static 1])
 {
-    chip8->sp -= 2;
-    chip8->pc = chip8->mem[chip8->sp] << 8;
-    chip8->pc += chip8->mem[chip8->sp+1];
+    CHIP8_CHECK(chip8, 0 < chip8->sp, CHIP8_FAULT_STACK_UNDERFLOW);
+    chip8->sp--;
+    chip8->pc = chip8->stack[chip8->sp & (CHIP8_STACK_SIZE-1)];
     CHIP8_ISTR_LOG("(0x00EE) RET");
 }
 
@@ -152,9 +274,10 @@ void chip8_CALL(chip8_vm chip8[const static 1])
 {
 	const chip8_word addr = chip8->istr & 0x0FFF;
 
-    chip8->mem[chip8->sp] = ((chip8->pc+2) & 0xFF00) >> 8;
-    chip8->mem[chip8->sp+1] = (chip8->pc+2) & 0x00FF;
-    chip8->sp += 2;
+    CHIP8_CHECK(chip8, CHIP8_STACK_SIZE > chip8->sp,
+		    CHIP8_FAULT_STACK_OVERFLOW);
+    chip8->stack[chip8->sp & (CHIP8_STACK_SIZE-1)] = chip8->pc+2;
+    chip8->sp++;
     chip8->pc = addr;
 	CHIP8_ISTR_LOG("(0x2%03X) CALL %u", addr, addr);
 }
@@ -169,7 +292,7 @@ void chip8_SKPEI(chip8_vm chip8[const static 1])
     const chip8_byte imdt = chip8->istr & 0x00FF;
 
     if (chip8->regs[regx] == imdt) {
-        chip8->pc += 4;
+        chip8->pc += chip8_skip(chip8);
     } else {
 		chip8->pc += 2;
 	}
@@ -186,7 +309,7 @@ void chip8_SKPNEI(chip8_vm chip8[const static 1])
     const chip8_byte imdt = chip8->istr & 0x00FF;
 
     if (chip8->regs[regx] != imdt) {
-        chip8->pc += 4;
+        chip8->pc += chip8_skip(chip8);
     } else {
 		chip8->pc += 2;
 	}
@@ -203,7 +326,7 @@ void chip8_SKPE(chip8_vm chip8[const static 1])
     const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
 
     if (chip8->regs[regx] == chip8->regs[regy]) {
-        chip8->pc += 4;
+        chip8->pc += chip8_skip(chip8);
     } else {
 		chip8->pc += 2;
 	}
@@ -253,43 +376,58 @@ void chip8_MOV(chip8_vm chip8[const static 1])
 }
 
 /*
- * @brief Sets V[X] to V[X] OR V[Y].
+ * @brief Sets V[X] to V[X] OR V[Y], clearing V[F] with vf_reset.
  * 0x8XY1
  */
-void chip8_OR(chip8_vm chip8[const static 1])
+static inline void chip8_OR(chip8_vm chip8[const static 1],
+		const bool vf_reset)
 {
     const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
     const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
 
     chip8->regs[regx] |= chip8->regs[regy];
+
+    if (vf_reset) {
+        chip8->regs[VF] = 0;
+    }
     chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0x8%X%X1) OR V[%X], V[%X]", regx, regy, regx, regy);
 }
 
 /*
- * @brief Sets V[X] to V[X] AND V[Y].
+ * @brief Sets V[X] to V[X] AND V[Y], clearing V[F] with vf_reset.
  * 0x8XY2
  */
-void chip8_AND(chip8_vm chip8[const static 1])
+static inline void chip8_AND(chip8_vm chip8[const static 1],
+		const bool vf_reset)
 {
     const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
     const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
 
     chip8->regs[regx] &= chip8->regs[regy];
+
+    if (vf_reset) {
+        chip8->regs[VF] = 0;
+    }
     chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0x8%X%X2) AND V[%X], V[%X]", regx, regy, regx, regy);
 }
 
 /*
- * @brief Sets V[X] to V[X] XOR V[Y].
+ * @brief Sets V[X] to V[X] XOR V[Y], clearing V[F] with vf_reset.
  * 0x8XY3
  */
-void chip8_XOR(chip8_vm chip8[const static 1])
+static inline void chip8_XOR(chip8_vm chip8[const static 1],
+		const bool vf_reset)
 {
     const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
     const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
 
     chip8->regs[regx] ^= chip8->regs[regy];
+
+    if (vf_reset) {
+        chip8->regs[VF] = 0;
+    }
     chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0x8%X%X3) XOR V[%X], V[%X]", regx, regy, regx, regy);
 }
@@ -297,18 +435,18 @@ void chip8_XOR(chip8_vm chip8[const static 1])
 /*
  * @brief Adds V[Y] to V[X] and sets V[F] to 0 or 1 if a carry occurs.
  * 0x8XY4
+ *
+ * Like every instruction setting a flag, V[F] is written after the result so
+ * the flag wins when X is F.
  */
 void chip8_ADD(chip8_vm chip8[const static 1])
 {
     const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
     const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
+    const unsigned sum = chip8->regs[regx] + chip8->regs[regy];
 
-    if (chip8->regs[regx] + chip8->regs[regy] < 0xFF) {
-        chip8->regs[VF] = 0;
-    } else {
-        chip8->regs[VF] = 1;
-    }
-    chip8->regs[regx] += chip8->regs[regy];
+    chip8->regs[regx] = sum;
+    chip8->regs[VF] = sum > 0xFF;
     chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0x8%X%X4) ADD V[%X], V[%X]", regx, regy, regx, regy);
 }
@@ -322,27 +460,28 @@ void chip8_SUB(chip8_vm chip8[const static 1])
     const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
     const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
 
-    if (chip8->regs[regx] < chip8->regs[regy]) {
-        chip8->regs[VF] = 0;
-    } else {
-        chip8->regs[VF] = 1;
-    }
+    const bool no_borrow = chip8->regs[regx] >= chip8->regs[regy];
+
     chip8->regs[regx] -= chip8->regs[regy];
+    chip8->regs[VF] = no_borrow;
     chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0x8%X%X5) SUB V[%X], V[%X]", regx, regy, regx, regy);
 }
 
 /*
- * @brief Sets V[F] to the LSB of V[X] and shifts V[X] to the right by 1.
+ * @brief Shifts V[X], or V[Y] into V[X] with shift_vy, to the right by 1 and
+ * sets V[F] to the bit shifted out.
  * 0x8XY6
  */
-void chip8_SHFR(chip8_vm chip8[const static 1])
+static inline void chip8_SHFR(chip8_vm chip8[const static 1],
+		const bool shift_vy)
 {
     const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
     const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
+    const chip8_byte src = chip8->regs[shift_vy ? regy : regx];
 
-    chip8->regs[VF] = chip8->regs[regx] & 0x01;
-    chip8->regs[regx] >>= 1;
+    chip8->regs[regx] = src >> 1;
+    chip8->regs[VF] = src & 0x01;
     chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0x8%X%X6) SHFR V[%X], V[%X]", regx, regy, regx, regy);
 }
@@ -357,27 +496,28 @@ void chip8_SUBB(chip8_vm chip8[const static 1])
     const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
     const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
 
-    if (chip8->regs[regy] < chip8->regs[regx]) {
-        chip8->regs[VF] = 0;
-    } else {
-        chip8->regs[VF] = 1;
-    }
+    const bool no_borrow = chip8->regs[regy] >= chip8->regs[regx];
+
     chip8->regs[regx] = chip8->regs[regy] - chip8->regs[regx];
+    chip8->regs[VF] = no_borrow;
     chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0x8%X%X7) SUBB V[%X], V[%X]", regx, regy, regx, regy);
 }
 
 /*
- * @brief Sets V[F] to the MSB of V[X] and shifts V[X] to the left by 1.
+ * @brief Shifts V[X], or V[Y] into V[X] with shift_vy, to the left by 1 and
+ * sets V[F] to the bit shifted out.
  * 0x8XYE
  */
-void chip8_SHFL(chip8_vm chip8[const static 1])
+static inline void chip8_SHFL(chip8_vm chip8[const static 1],
+		const bool shift_vy)
 {
     const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
     const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
+    const chip8_byte src = chip8->regs[shift_vy ? regy : regx];
 
-    chip8->regs[VF] = chip8->regs[regx] & 0x80;
-    chip8->regs[regx] <<= 1;
+    chip8->regs[regx] = src << 1;
+    chip8->regs[VF] = src >> 7;
     chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0x8%X%XE) SHFL V[%X], V[%X]", regx, regy, regx, regy);
 }
@@ -392,7 +532,7 @@ void chip8_SKPNE(chip8_vm chip8[const static 1])
     const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
 
     if (chip8->regs[regx] != chip8->regs[regy]) {
-        chip8->pc += 4;
+        chip8->pc += chip8_skip(chip8);
     } else {
 		chip8->pc += 2;
 	}
@@ -413,27 +553,35 @@ void chip8_MIV(chip8_vm chip8[const static 1])
 }
 
 /*
- * @brief Jumps to address NNN plus V[0].
+ * @brief Jumps to address NNN plus V[0], or plus V[X] with jump_vx.
  * 0xBNNN
  */
-void chip8_JMPI(chip8_vm chip8[const static 1])
+static inline void chip8_JMPI(chip8_vm chip8[const static 1],
+		const bool jump_vx)
 {
 	const chip8_word addr = chip8->istr & 0x0FFF;
+	const chip8_reg reg = jump_vx ? (chip8->istr & 0x0F00) >> 8 : V0;
 
-    chip8->pc = chip8->regs[V0] + addr;
+    chip8->pc = chip8->regs[reg] + addr;
 	CHIP8_ISTR_LOG("(0xB%03X) JMPI %u", addr, addr);
 }
 
 /*
  * @brief Sets V[X] equal to a bitwise AND between a random number and NN.
  * 0xCXNN
+ *
+ * The random numbers come from a xorshift generator seeded per machine, so
+ * runs with the same seed and input are reproducible.
  */
 void chip8_RNDMSK(chip8_vm chip8[const static 1])
 {
     const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
     const chip8_byte num = chip8->istr & 0x00FF;
 
-    chip8->regs[regx] = num & (rand() % 256);
+    chip8->rng ^= chip8->rng << 13;
+    chip8->rng ^= chip8->rng >> 17;
+    chip8->rng ^= chip8->rng << 5;
+    chip8->regs[regx] = num & (chip8->rng >> 24);
 	chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0xC%X%02X) RNDMSK V[%X], %u", regx, num, regx, num);
 }
@@ -441,28 +589,43 @@ void chip8_RNDMSK(chip8_vm chip8[const static 1])
 /*
  * @brief Draws a sprite at coordinate (V[X], V[Y]) with dimensions 8xN.
  * 0xDXYN
+ *
+ * The coordinate wraps around the display and the sprite is clipped at the
+ * right and bottom edges, or wraps around them with wrap. V[F] is set if any
+ * set pixel was erased.
+ * Every selected plane is drawn with its own N bytes of sprite data, in plane
+ * order starting at the index.
  */
-void chip8_DRWSPT(chip8_vm chip8[const static 1])
+static inline void chip8_DRWSPT(chip8_vm chip8[const static 1],
+		const bool wrap)
 {
 	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
 	const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
 	const chip8_byte hgt = chip8->istr & 0x000F;
-	const chip8_byte x = chip8->regs[regx];
-	const chip8_byte y = chip8->regs[regy];
-
-	chip8->regs[VF] = 0;
+	const unsigned height = chip8_gfx_height(chip8);
+	const unsigned words = chip8_gfx_width(chip8) / 64;
+	const unsigned x = chip8->regs[regx] % chip8_gfx_width(chip8);
+	const unsigned y = chip8->regs[regy] % height;
+	unsigned addr = chip8->idx;
+	bool erased = false;
+
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		if (!(chip8->plane >> p & 1)) {
+			continue;
+		}
 
-	for (chip8_byte bit_row, i = 0; i < hgt; i++) {
-		bit_row = chip8->mem[chip8->idx+i];
-		for (chip8_byte j = 0; j < 8; j++) {
-			if ((chip8_byte) ((bit_row >> (7-j)) << 7)) {
-				if (chip8->gfx[y+i][x+j]) {
-					chip8->regs[VF] = 1;
-				}
-				chip8->gfx[y+i][x+j] ^= 1;
-			}
+		for (unsigned i = 0; i < hgt && (wrap || y+i < height); i++) {
+			erased |= chip8_draw_gfx_row(chip8, p, (y+i) % height, words, x,
+					(uint64_t) chip8_mem_read(chip8, addr+i) << 56, wrap);
 		}
+		addr += hgt;
 	}
+	CHIP8_CHECK(chip8, chip8_gfx_clear_outside(chip8), CHIP8_FAULT_GFX);
+	CHIP8_CHECK(chip8, chip8->gfx_stale
+			|| chip8_rehash_gfx(chip8) == chip8->gfx_hash, CHIP8_FAULT_GFX_HASH);
+	CHIP8_TRACE4(draw, x, y, hgt, erased);
+	chip8->regs[VF] = erased;
+	chip8->draw_flag = true;
 	chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0xD%X%X%X) DRWSPT V[%X], V[%X], %u", regx, regy, hgt, regx,
 			regy, hgt);
@@ -476,8 +639,10 @@ void chip8_SKPKEY(chip8_vm chip8[const static 1])
 {
 	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
 
-	if (chip8_keys[chip8->regs[regx]]) {
-		chip8->pc += 4;
+	chip8->keys_read |= 1 << (chip8->regs[regx] & 0xF);
+
+	if (chip8->keys >> (chip8->regs[regx] & 0xF) & 1) {
+		chip8->pc += chip8_skip(chip8);
 	} else {
 		chip8->pc += 2;
 	}
@@ -492,8 +657,10 @@ void chip8_SKPNKEY(chip8_vm chip8[const static 1])
 {
 	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
 
-	if (!chip8_keys[chip8->regs[regx]]) {
-		chip8->pc += 4;
+	chip8->keys_read |= 1 << (chip8->regs[regx] & 0xF);
+
+	if (!(chip8->keys >> (chip8->regs[regx] & 0xF) & 1)) {
+		chip8->pc += chip8_skip(chip8);
 	} else {
 		chip8->pc += 2;
 	}
@@ -516,22 +683,17 @@ void chip8_MOVDLY(chip8_vm chip8[const static 1])
 /*
  * @brief Halts all instructions and stores next key press in V[X].
  * 0xFX0A
+ *
+ * The virtual machine only enters the waiting state here, the program counter
+ * stays on this instruction until chip8_set_key() delivers a key edge.
  */
 void chip8_WTKEY(chip8_vm chip8[const static 1])
 {
 	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
-	chip8_byte keys_state[CHIP8_KEY_SIZE];
 
-	memcpy(keys_state, chip8_keys, sizeof(chip8_keys));
-	glfwWaitEvents();
-
-	for (chip8_byte i = 0; i < CHIP8_KEY_SIZE; i++) {
-		if (chip8_keys[i] != keys_state[i]) {
-			chip8->regs[regx] = i;
-			break;
-		}
-	}
-	chip8->pc += 2;
+	chip8->state = CHIP8_WAITING_KEY;
+	chip8->wait_reg = regx;
+	CHIP8_TRACE1(wait_key, regx);
 	CHIP8_ISTR_LOG("(0xF%X0A) WTKEY V[%X]", regx, regx);
 }
 
@@ -595,77 +757,544 @@ void chip8_IBCD(chip8_vm chip8[const static 1])
 {
 	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
 
-	chip8->mem[chip8->idx+0] = chip8->regs[regx] / 100;
-	chip8->mem[chip8->idx+1] = (chip8->regs[regx] / 10) % 10;
-	chip8->mem[chip8->idx+2] = chip8->regs[regx] % 10;
+	chip8_mem_write(chip8, chip8->idx+0, chip8->regs[regx] / 100);
+	chip8_mem_write(chip8, chip8->idx+1, (chip8->regs[regx] / 10) % 10);
+	chip8_mem_write(chip8, chip8->idx+2, chip8->regs[regx] % 10);
 	chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0xF%X33) IBCD V[%X]", regx, regx);
 }
 
 /*
- * @brief Stores V[0] to V[X] in memory starting at the index.
+ * @brief Stores V[0] to V[X] in memory starting at the index, leaving the
+ * index past V[X] with mem_inc.
  * 0xFX55
  */
-void chip8_REGDMP(chip8_vm chip8[const static 1])
+static inline void chip8_REGDMP(chip8_vm chip8[const static 1],
+		const bool mem_inc)
 {
 	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
 
 	for (short i = regx; i >= 0; i--) {
-		chip8->mem[chip8->idx+i] = chip8->regs[i];
+		chip8_mem_write(chip8, chip8->idx+i, chip8->regs[i]);
+	}
+
+	if (mem_inc) {
+		chip8->idx += regx + 1;
 	}
 	chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0xF%X55) REGDMP V[%X]", regx, regx);
 }
 
 /*
- * @brief Fills V[0] to V[X] with values from memory starting at the index.
+ * @brief Fills V[0] to V[X] with values from memory starting at the index,
+ * leaving the index past V[X] with mem_inc.
  * 0xFX65
  */
-void chip8_REGLD(chip8_vm chip8[const static 1])
+static inline void chip8_REGLD(chip8_vm chip8[const static 1],
+		const bool mem_inc)
 {
 	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
 
 	for (short i = regx; i >= 0; i--) {
-		chip8->regs[i] = chip8->mem[chip8->idx+i];
+		chip8->regs[i] = chip8_mem_read(chip8, chip8->idx+i);
+	}
+
+	if (mem_inc) {
+		chip8->idx += regx + 1;
 	}
 	chip8->pc += 2;
 	CHIP8_ISTR_LOG("(0xF%X65) REGLD V[%X]", regx, regx);
 }
 
-chip8_istr* chip8_istr_set[CHIP8_ISTR_SET_SIZE] = {
-	[RCA]		= chip8_RCA,
-	[CLS]		= chip8_CLS,
-	[RET]		= chip8_RET,
-	[JMP]		= chip8_JMP,
-	[CALL]		= chip8_CALL,
-	[SKPEI]		= chip8_SKPEI,
-	[SKPNEI]	= chip8_SKPNEI,
-	[SKPE]		= chip8_SKPE,
-	[MOVI]		= chip8_MOVI,
-	[ADDI]		= chip8_ADDI,
-	[MOV]		= chip8_MOV,
-	[OR]		= chip8_OR,
-	[AND]		= chip8_AND,
-	[XOR]		= chip8_XOR,
-	[ADD]		= chip8_ADD,
-	[SUB]		= chip8_SUB,
-	[SHFR]		= chip8_SHFR,
-	[SUBB]		= chip8_SUBB,
-	[SHFL]		= chip8_SHFL,
-	[SKPNE]		= chip8_SKPNE,
-	[MIV]		= chip8_MIV,
-	[JMPI]		= chip8_JMPI,
-	[RNDMSK]	= chip8_RNDMSK,
-	[DRWSPT]	= chip8_DRWSPT,
-	[SKPKEY]	= chip8_SKPKEY,
-	[SKPNKEY]	= chip8_SKPNKEY,
-	[MOVDLY]	= chip8_MOVDLY,
-	[WTKEY]		= chip8_WTKEY,
-	[SETDLY]	= chip8_SETDLY,
-	[SETSND]	= chip8_SETSND,
-	[IADD]		= chip8_IADD,
-	[ISETSPT]	= chip8_ISETSPT,
-	[IBCD]		= chip8_IBCD,
-	[REGDMP]	= chip8_REGDMP,
-	[REGLD]		= chip8_REGLD
+/*
+ * @brief Scrolls the selected planes down by N pixels.
+ * 0x00CN
+ */
+void chip8_SCD(chip8_vm chip8[const static 1])
+{
+	const chip8_byte num = chip8->istr & 0x000F;
+	const unsigned height = chip8_gfx_height(chip8);
+
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		if (chip8->plane >> p & 1) {
+			memmove(chip8->gfx[p][num], chip8->gfx[p][0],
+					(height - num) * sizeof(*chip8->gfx[p]));
+			memset(chip8->gfx[p][0], 0, num * sizeof(*chip8->gfx[p]));
+		}
+	}
+	chip8->gfx_stale = true;
+	chip8->draw_flag = true;
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0x00C%X) SCD %u", num, num);
+}
+
+/*
+ * @brief Scrolls the selected planes right by 4 pixels.
+ * 0x00FB
+ */
+void chip8_SCR(chip8_vm chip8[const static 1])
+{
+	const unsigned height = chip8_gfx_height(chip8);
+	const uint64_t edge = chip8->hires ? UINT64_MAX : 0;
+
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		for (unsigned i = 0; i < height && chip8->plane >> p & 1; i++) {
+			uint64_t* const row = chip8->gfx[p][i];
+
+			row[1] = (row[1] >> 4 | row[0] << 60) & edge;
+			row[0] >>= 4;
+		}
+	}
+	chip8->gfx_stale = true;
+	chip8->draw_flag = true;
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0x00FB) SCR");
+}
+
+/*
+ * @brief Scrolls the selected planes left by 4 pixels.
+ * 0x00FC
+ */
+void chip8_SCL(chip8_vm chip8[const static 1])
+{
+	const unsigned height = chip8_gfx_height(chip8);
+
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		for (unsigned i = 0; i < height && chip8->plane >> p & 1; i++) {
+			uint64_t* const row = chip8->gfx[p][i];
+
+			row[0] = row[0] << 4 | row[1] >> 60;
+			row[1] <<= 4;
+		}
+	}
+	chip8->gfx_stale = true;
+	chip8->draw_flag = true;
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0x00FC) SCL");
+}
+
+/*
+ * @brief Exits the interpreter.
+ * 0x00FD
+ */
+void chip8_HALT(chip8_vm chip8[const static 1])
+{
+	chip8->state = CHIP8_HALTED;
+	CHIP8_ISTR_LOG("(0x00FD) HALT");
+}
+
+/*
+ * @brief Switches to 64x32 low resolution and clears the screen.
+ * 0x00FE
+ */
+void chip8_LORES(chip8_vm chip8[const static 1])
+{
+	memset(chip8->gfx, 0, sizeof(chip8->gfx));
+	chip8->hires = false;
+	chip8->gfx_hash = 0;
+	chip8->gfx_stale = false;
+	chip8->draw_flag = true;
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0x00FE) LORES");
+}
+
+/*
+ * @brief Switches to 128x64 high resolution and clears the screen.
+ * 0x00FF
+ */
+void chip8_HIRES(chip8_vm chip8[const static 1])
+{
+	memset(chip8->gfx, 0, sizeof(chip8->gfx));
+	chip8->hires = true;
+	chip8->gfx_hash = 0;
+	chip8->gfx_stale = false;
+	chip8->draw_flag = true;
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0x00FF) HIRES");
+}
+
+/*
+ * @brief Draws a 16x16 sprite at coordinate (V[X], V[Y]).
+ * 0xDXY0
+ *
+ * Rows are two bytes each, wrapping, clipping and planes match
+ * chip8_DRWSPT().
+ */
+static inline void chip8_DRWBIG(chip8_vm chip8[const static 1],
+		const bool wrap)
+{
+	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
+	const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
+	const unsigned height = chip8_gfx_height(chip8);
+	const unsigned words = chip8_gfx_width(chip8) / 64;
+	const unsigned x = chip8->regs[regx] % chip8_gfx_width(chip8);
+	const unsigned y = chip8->regs[regy] % height;
+	unsigned addr = chip8->idx;
+	bool erased = false;
+
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		if (!(chip8->plane >> p & 1)) {
+			continue;
+		}
+
+		for (unsigned i = 0; i < 16 && (wrap || y+i < height); i++) {
+			const chip8_word bit_row = chip8_mem_read(chip8, addr+2*i) << 8
+				| chip8_mem_read(chip8, addr+2*i+1);
+
+			erased |= chip8_draw_gfx_row(chip8, p, (y+i) % height, words, x,
+					(uint64_t) bit_row << 48, wrap);
+		}
+		addr += 32;
+	}
+	CHIP8_CHECK(chip8, chip8_gfx_clear_outside(chip8), CHIP8_FAULT_GFX);
+	CHIP8_CHECK(chip8, chip8->gfx_stale
+			|| chip8_rehash_gfx(chip8) == chip8->gfx_hash, CHIP8_FAULT_GFX_HASH);
+	CHIP8_TRACE4(draw, x, y, 16, erased);
+	chip8->regs[VF] = erased;
+	chip8->draw_flag = true;
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0xD%X%X0) DRWBIG V[%X], V[%X]", regx, regy, regx, regy);
+}
+
+/*
+ * @brief Sets index register to the location of the big font character in
+ * V[X].
+ * 0xFX30
+ */
+void chip8_BIGSPT(chip8_vm chip8[const static 1])
+{
+	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
+
+	chip8->idx = CHIP8_BIG_FONT_ADDR + 10 * (chip8->regs[regx] & 0xF);
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0xF%X30) BIGSPT V[%X]", regx, regx);
+}
+
+/*
+ * @brief Stores V[0] to V[X] in the RPL user flags.
+ * 0xFX75
+ */
+void chip8_RPLDMP(chip8_vm chip8[const static 1])
+{
+	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
+
+	memcpy(chip8->flags, chip8->regs, regx + 1);
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0xF%X75) RPLDMP V[%X]", regx, regx);
+}
+
+/*
+ * @brief Fills V[0] to V[X] from the RPL user flags.
+ * 0xFX85
+ */
+void chip8_RPLLD(chip8_vm chip8[const static 1])
+{
+	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
+
+	memcpy(chip8->regs, chip8->flags, regx + 1);
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0xF%X85) RPLLD V[%X]", regx, regx);
+}
+
+/*
+ * @brief Scrolls the selected planes up by N pixels.
+ * 0x00DN
+ */
+void chip8_SCU(chip8_vm chip8[const static 1])
+{
+	const chip8_byte num = chip8->istr & 0x000F;
+	const unsigned height = chip8_gfx_height(chip8);
+
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		if (chip8->plane >> p & 1) {
+			memmove(chip8->gfx[p][0], chip8->gfx[p][num],
+					(height - num) * sizeof(*chip8->gfx[p]));
+			memset(chip8->gfx[p][height - num], 0,
+					num * sizeof(*chip8->gfx[p]));
+		}
+	}
+	chip8->gfx_stale = true;
+	chip8->draw_flag = true;
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0x00D%X) SCU %u", num, num);
+}
+
+/*
+ * @brief Sets I to the 16-bit address NNNN following the instruction.
+ * 0xF000 0xNNNN
+ */
+void chip8_LDIL(chip8_vm chip8[const static 1])
+{
+	const chip8_word addr = chip8_mem_read(chip8, chip8->pc+2) << 8
+		| chip8_mem_read(chip8, chip8->pc+3);
+
+	chip8->idx = addr;
+	chip8->pc += 4;
+	CHIP8_ISTR_LOG("(0xF000) LDIL %u", addr);
+}
+
+/*
+ * @brief Selects the bitplanes N that drawing, clearing and scrolling affect.
+ * 0xFN01
+ */
+void chip8_PLANE(chip8_vm chip8[const static 1])
+{
+	const chip8_byte mask = (chip8->istr & 0x0F00) >> 8;
+
+	chip8->plane = mask & (CHIP8_GFX_COLORS-1);
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0xF%X01) PLANE %u", mask, mask);
+}
+
+/*
+ * @brief Loads the 16 byte audio pattern from memory starting at the index.
+ * 0xF002
+ */
+void chip8_AUDIO(chip8_vm chip8[const static 1])
+{
+	for (unsigned i = 0; i < CHIP8_PATTERN_SIZE; i++) {
+		chip8->pattern[i] = chip8_mem_read(chip8, chip8->idx+i);
+	}
+	chip8->has_pattern = true;
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0xF002) AUDIO");
+}
+
+/*
+ * @brief Sets the audio pattern playback pitch to V[X].
+ * 0xFX3A
+ */
+void chip8_PITCH(chip8_vm chip8[const static 1])
+{
+	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
+
+	chip8->pitch = chip8->regs[regx];
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0xF%X3A) PITCH V[%X]", regx, regx);
+}
+
+/*
+ * @brief Stores V[X] to V[Y] in memory starting at the index, in descending
+ * order if X is greater than Y. The index is left unchanged.
+ * 0x5XY2
+ */
+void chip8_RNGDMP(chip8_vm chip8[const static 1])
+{
+	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
+	const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
+	const int dir = regx <= regy ? 1 : -1;
+	const int count = regx <= regy ? regy - regx : regx - regy;
+
+	for (int i = 0, reg = regx; i <= count; i++, reg += dir) {
+		chip8_mem_write(chip8, chip8->idx+i, chip8->regs[reg]);
+	}
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0x5%X%X2) RNGDMP V[%X], V[%X]", regx, regy, regx, regy);
+}
+
+/*
+ * @brief Fills V[X] to V[Y] from memory starting at the index, in descending
+ * order if X is greater than Y. The index is left unchanged.
+ * 0x5XY3
+ */
+void chip8_RNGLD(chip8_vm chip8[const static 1])
+{
+	const chip8_reg regx = (chip8->istr & 0x0F00) >> 8;
+	const chip8_reg regy = (chip8->istr & 0x00F0) >> 4;
+	const int dir = regx <= regy ? 1 : -1;
+	const int count = regx <= regy ? regy - regx : regx - regy;
+
+	for (int i = 0, reg = regx; i <= count; i++, reg += dir) {
+		chip8->regs[reg] = chip8_mem_read(chip8, chip8->idx+i);
+	}
+	chip8->pc += 2;
+	CHIP8_ISTR_LOG("(0x5%X%X3) RNGLD V[%X], V[%X]", regx, regy, regx, regy);
+}
+
+/*
+ * @brief Instantiates the quirk dependent handlers of a profile, the quirks
+ * are constants so each instance compiles without quirk branches.
+ */
+#define CHIP8_QUIRK_HANDLERS(NAME, SHIFT_VY, MEM_INC, JUMP_VX, WRAP, VF_RESET) \
+static void chip8_OR_##NAME(chip8_vm chip8[const static 1])                   \
+{                                                                             \
+	chip8_OR(chip8, VF_RESET);                                                \
+}                                                                             \
+static void chip8_AND_##NAME(chip8_vm chip8[const static 1])                  \
+{                                                                             \
+	chip8_AND(chip8, VF_RESET);                                               \
+}                                                                             \
+static void chip8_XOR_##NAME(chip8_vm chip8[const static 1])                  \
+{                                                                             \
+	chip8_XOR(chip8, VF_RESET);                                               \
+}                                                                             \
+static void chip8_SHFR_##NAME(chip8_vm chip8[const static 1])                 \
+{                                                                             \
+	chip8_SHFR(chip8, SHIFT_VY);                                              \
+}                                                                             \
+static void chip8_SHFL_##NAME(chip8_vm chip8[const static 1])                 \
+{                                                                             \
+	chip8_SHFL(chip8, SHIFT_VY);                                              \
+}                                                                             \
+static void chip8_JMPI_##NAME(chip8_vm chip8[const static 1])                 \
+{                                                                             \
+	chip8_JMPI(chip8, JUMP_VX);                                               \
+}                                                                             \
+static void chip8_DRWSPT_##NAME(chip8_vm chip8[const static 1])               \
+{                                                                             \
+	chip8_DRWSPT(chip8, WRAP);                                                \
+}                                                                             \
+static void chip8_DRWBIG_##NAME(chip8_vm chip8[const static 1])               \
+{                                                                             \
+	chip8_DRWBIG(chip8, WRAP);                                                \
+}                                                                             \
+static void chip8_REGDMP_##NAME(chip8_vm chip8[const static 1])               \
+{                                                                             \
+	chip8_REGDMP(chip8, MEM_INC);                                             \
+}                                                                             \
+static void chip8_REGLD_##NAME(chip8_vm chip8[const static 1])                \
+{                                                                             \
+	chip8_REGLD(chip8, MEM_INC);                                              \
+}
+
+CHIP8_QUIRK_PROFILES(CHIP8_QUIRK_HANDLERS)
+
+/*
+ * @brief Expands to the instruction set of a profile.
+ */
+#define CHIP8_ISTR_SET(NAME, ...)           \
+	[CHIP8_QUIRKS_##NAME] = {               \
+		[RCA]		= chip8_RCA,            \
+		[CLS]		= chip8_CLS,            \
+		[RET]		= chip8_RET,            \
+		[JMP]		= chip8_JMP,            \
+		[CALL]		= chip8_CALL,           \
+		[SKPEI]		= chip8_SKPEI,          \
+		[SKPNEI]	= chip8_SKPNEI,         \
+		[SKPE]		= chip8_SKPE,           \
+		[MOVI]		= chip8_MOVI,           \
+		[ADDI]		= chip8_ADDI,           \
+		[MOV]		= chip8_MOV,            \
+		[OR]		= chip8_OR_##NAME,      \
+		[AND]		= chip8_AND_##NAME,     \
+		[XOR]		= chip8_XOR_##NAME,     \
+		[ADD]		= chip8_ADD,            \
+		[SUB]		= chip8_SUB,            \
+		[SHFR]		= chip8_SHFR_##NAME,    \
+		[SUBB]		= chip8_SUBB,           \
+		[SHFL]		= chip8_SHFL_##NAME,    \
+		[SKPNE]		= chip8_SKPNE,          \
+		[MIV]		= chip8_MIV,            \
+		[JMPI]		= chip8_JMPI_##NAME,    \
+		[RNDMSK]	= chip8_RNDMSK,         \
+		[DRWSPT]	= chip8_DRWSPT_##NAME,  \
+		[SKPKEY]	= chip8_SKPKEY,         \
+		[SKPNKEY]	= chip8_SKPNKEY,        \
+		[MOVDLY]	= chip8_MOVDLY,         \
+		[WTKEY]		= chip8_WTKEY,          \
+		[SETDLY]	= chip8_SETDLY,         \
+		[SETSND]	= chip8_SETSND,         \
+		[IADD]		= chip8_IADD,           \
+		[ISETSPT]	= chip8_ISETSPT,        \
+		[IBCD]		= chip8_IBCD,           \
+		[REGDMP]	= chip8_REGDMP_##NAME,  \
+		[REGLD]		= chip8_REGLD_##NAME,   \
+		[SCD]		= chip8_SCD,            \
+		[SCR]		= chip8_SCR,            \
+		[SCL]		= chip8_SCL,            \
+		[HALT]		= chip8_HALT,           \
+		[LORES]		= chip8_LORES,          \
+		[HIRES]		= chip8_HIRES,          \
+		[DRWBIG]	= chip8_DRWBIG_##NAME,  \
+		[BIGSPT]	= chip8_BIGSPT,         \
+		[RPLDMP]	= chip8_RPLDMP,         \
+		[RPLLD]		= chip8_RPLLD,          \
+		[SCU]		= chip8_SCU,            \
+		[LDIL]		= chip8_LDIL,           \
+		[PLANE]		= chip8_PLANE,          \
+		[AUDIO]		= chip8_AUDIO,          \
+		[PITCH]		= chip8_PITCH,          \
+		[RNGDMP]	= chip8_RNGDMP,         \
+		[RNGLD]		= chip8_RNGLD           \
+	},
+
+chip8_istr* const chip8_istr_set[CHIP8_QUIRKS_SIZE][CHIP8_ISTR_SET_SIZE] = {
+	CHIP8_QUIRK_PROFILES(CHIP8_ISTR_SET)
+};
+
+#define CHIP8_QUIRK_NAME(NAME, ...) [CHIP8_QUIRKS_##NAME] = #NAME,
+
+const char* const chip8_quirks_name[CHIP8_QUIRKS_SIZE] = {
+	CHIP8_QUIRK_PROFILES(CHIP8_QUIRK_NAME)
+};
+
+/* mnemonics of the opcodes, as the debugger disassembles them */
+const char* const chip8_istr_name[CHIP8_ISTR_SET_SIZE] = {
+	[RCA] = "RCA",
+	[CLS] = "CLS",
+	[RET] = "RET",
+	[JMP] = "JMP",
+	[CALL] = "CALL",
+	[SKPEI] = "SKPEI",
+	[SKPNEI] = "SKPNEI",
+	[SKPE] = "SKPE",
+	[MOVI] = "MOVI",
+	[ADDI] = "ADDI",
+	[MOV] = "MOV",
+	[OR] = "OR",
+	[AND] = "AND",
+	[XOR] = "XOR",
+	[ADD] = "ADD",
+	[SUB] = "SUB",
+	[SHFR] = "SHFR",
+	[SUBB] = "SUBB",
+	[SHFL] = "SHFL",
+	[SKPNE] = "SKPNE",
+	[MIV] = "MIV",
+	[JMPI] = "JMPI",
+	[RNDMSK] = "RNDMSK",
+	[DRWSPT] = "DRWSPT",
+	[SKPKEY] = "SKPKEY",
+	[SKPNKEY] = "SKPNKEY",
+	[MOVDLY] = "MOVDLY",
+	[WTKEY] = "WTKEY",
+	[SETDLY] = "SETDLY",
+	[SETSND] = "SETSND",
+	[IADD] = "IADD",
+	[ISETSPT] = "ISETSPT",
+	[IBCD] = "IBCD",
+	[REGDMP] = "REGDMP",
+	[REGLD] = "REGLD",
+	[SCD] = "SCD",
+	[SCR] = "SCR",
+	[SCL] = "SCL",
+	[HALT] = "HALT",
+	[LORES] = "LORES",
+	[HIRES] = "HIRES",
+	[DRWBIG] = "DRWBIG",
+	[BIGSPT] = "BIGSPT",
+	[RPLDMP] = "RPLDMP",
+	[RPLLD] = "RPLLD",
+	[SCU] = "SCU",
+	[LDIL] = "LDIL",
+	[PLANE] = "PLANE",
+	[AUDIO] = "AUDIO",
+	[PITCH] = "PITCH",
+	[RNGDMP] = "RNGDMP",
+	[RNGLD] = "RNGLD"
 };
+
+/*
+ * @brief Looks a quirk profile up by its case insensitive name.
+ */
+chip8_rc chip8_parse_quirks(chip8_quirks quirks[const static 1],
+		const char name[static 1])
+{
+	for (int i = 0; i < CHIP8_QUIRKS_SIZE; i++) {
+		if (!strcasecmp(name, chip8_quirks_name[i])) {
+			*quirks = i;
+			return CHIP8_SUCCESS;
+		}
+	}
+	return CHIP8_FAILURE;
+}
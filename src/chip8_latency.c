@@ -0,0 +1,113 @@
+/*
+ * @file chip8_latency.c
+ * @brief Implements input to photon latency and frame jitter measurements.
+ *
+ * Each key has at most one edge in flight, the oldest one not read yet, so
+ * bookkeeping takes fixed memory however fast keys are hit. The virtual
+ * machine marks keys its instructions read in keys_read, which is checked
+ * and cleared after every frame. Reads are therefore stamped with the end of
+ * the frame they happened in rather than the instruction that read, so
+ * latency is measured at frame granularity and a read may show up to a
+ * frame late.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "chip8.h"
+#include "chip8_hist.h"
+#include "chip8_input.h"
+#include "chip8_latency.h"
+#include "chip8_time.h"
+
+/*
+ * @brief Notes the edges chip8_apply_input() applied, the events from head
+ * up to the queue's current head.
+ */
+void chip8_latency_input(chip8_latency latency[const static 1],
+		const chip8_input_queue queue[const static 1], uint32_t head)
+{
+	for (; head != queue->head; head++) {
+		const chip8_input_event* const event =
+			&queue->events[head & (CHIP8_INPUT_QUEUE_SIZE-1)];
+
+		if (!latency->event_ns[event->key]) {
+			latency->event_ns[event->key] = event->time_ns;
+		}
+	}
+}
+
+/*
+ * @brief Records the interval since the previous frame started and the
+ * edges the frame's instructions read.
+ */
+void chip8_latency_frame(chip8_latency latency[const static 1],
+		chip8_vm chip8[const static 1], const uint64_t start_ns,
+		const uint64_t end_ns)
+{
+	if (latency->frame_ns) {
+		const uint64_t interval_ns = start_ns - latency->frame_ns;
+
+		chip8_hist_record(&latency->frame_interval, interval_ns);
+		chip8_hist_record(&latency->jitter, interval_ns > CHIP8_FRAME_NS
+				? interval_ns - CHIP8_FRAME_NS : CHIP8_FRAME_NS - interval_ns);
+	}
+	latency->frame_ns = start_ns;
+
+	for (unsigned key = 0; key < CHIP8_KEY_SIZE && chip8->keys_read; key++) {
+		if (!(chip8->keys_read >> key & 1) || !latency->event_ns[key]) {
+			continue;
+		}
+		chip8_hist_record(&latency->to_read,
+				end_ns - latency->event_ns[key]);
+		latency->read_event_ns[key] = latency->event_ns[key];
+		latency->read_ns[key] = end_ns;
+		latency->event_ns[key] = 0;
+	}
+	chip8->keys_read = 0;
+}
+
+/*
+ * @brief Completes the edges read since the last present with the times
+ * the render and the buffer swap returned.
+ */
+void chip8_latency_present(chip8_latency latency[const static 1],
+		const uint64_t render_ns, const uint64_t swap_ns)
+{
+	bool read = false;
+
+	for (unsigned key = 0; key < CHIP8_KEY_SIZE; key++) {
+		if (!latency->read_ns[key]) {
+			continue;
+		}
+		chip8_hist_record(&latency->to_render,
+				render_ns - latency->read_ns[key]);
+		chip8_hist_record(&latency->total,
+				swap_ns - latency->read_event_ns[key]);
+		latency->read_ns[key] = 0;
+		read = true;
+	}
+
+	if (read) {
+		chip8_hist_record(&latency->to_swap, swap_ns - render_ns);
+	}
+}
+
+void chip8_print_latency(FILE* const file,
+		const chip8_latency latency[const static 1])
+{
+	chip8_print_hist(file, "key event to read", &latency->to_read,
+			CHIP8_NS_PER_MS, "ms");
+	chip8_print_hist(file, "read to render", &latency->to_render,
+			CHIP8_NS_PER_MS, "ms");
+	chip8_print_hist(file, "render to swap", &latency->to_swap,
+			CHIP8_NS_PER_MS, "ms");
+	chip8_print_hist(file, "key event to swap", &latency->total,
+			CHIP8_NS_PER_MS, "ms");
+	chip8_print_hist(file, "frame interval", &latency->frame_interval,
+			CHIP8_NS_PER_MS, "ms");
+	chip8_print_hist(file, "frame jitter", &latency->jitter,
+			CHIP8_NS_PER_MS, "ms");
+}
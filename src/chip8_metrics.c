@@ -0,0 +1,398 @@
+/*
+ * @file chip8_metrics.c
+ * @brief Implements the Prometheus metrics exporter.
+ *
+ * Recording threads each own a shard of counters, the exporter thread sums
+ * the shards when a scrape arrives and answers it in the Prometheus text
+ * exposition format. Scrapes are rare next to the millions of updates per
+ * second, so all the cost of aggregation is taken on the exporter's side.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "chip8.h"
+#include "chip8_io.h"
+#include "chip8_istr.h"
+#include "chip8_metrics.h"
+#include "chip8_time.h"
+#include "chip8_dbg.h"
+
+#define CHIP8_METRICS_POLL_MS 100
+#define CHIP8_METRICS_REQUEST_MS 1000 /* wait for a request before answering */
+#define CHIP8_METRICS_REQUEST_SIZE 4096
+
+static const struct {
+	const char* name;
+	const char* type;
+	const char* help;
+	double scale; /* divides the recorded value */
+} chip8_metrics_info[CHIP8_METRICS_SIZE] = {
+	[CHIP8_METRIC_ISTRS] = {"chip8_instructions_total", "counter",
+		"Instructions executed.", 1},
+	[CHIP8_METRIC_FRAMES] = {"chip8_frames_total", "counter",
+		"Emulated 60 Hz frames.", 1},
+	[CHIP8_METRIC_PRESENTS] = {"chip8_presents_total", "counter",
+		"Frames presented or sent to a client.", 1},
+	[CHIP8_METRIC_SKIPPED] = {"chip8_frames_skipped_total", "counter",
+		"Emulated frames with a draw that was not presented.", 1},
+	[CHIP8_METRIC_DROPPED] = {"chip8_frames_dropped_total", "counter",
+		"Frames the host fell behind by and did not catch up on.", 1},
+	[CHIP8_METRIC_WAIT_KEY_NS] = {"chip8_wait_key_seconds_total", "counter",
+		"Time machines spent blocked in FX0A waiting for a key.",
+		CHIP8_NS_PER_SEC},
+	[CHIP8_METRIC_WAITING] = {"chip8_waiting_key", "gauge",
+		"Machines blocked in FX0A waiting for a key.", 1}
+};
+
+/*
+ * @brief Writes the summed shards in the text exposition format.
+ */
+static void chip8_metrics_format(FILE* const file,
+		chip8_metrics metrics[const static 1])
+{
+	uint64_t values[CHIP8_METRICS_SIZE] = { 0 };
+	uint64_t opcodes[CHIP8_ISTR_SET_SIZE] = { 0 };
+	struct timespec cpu;
+
+	for (unsigned s = 0; s < metrics->capacity; s++) {
+		chip8_metrics_shard* const shard = &metrics->shards[s];
+
+		if (!atomic_load_explicit(&shard->registered, memory_order_acquire)) {
+			continue;
+		}
+
+		for (unsigned i = 0; i < CHIP8_METRICS_SIZE; i++) {
+			values[i] += atomic_load_explicit(&shard->values[i],
+					memory_order_relaxed);
+		}
+
+		for (unsigned i = 0; i < CHIP8_ISTR_SET_SIZE; i++) {
+			opcodes[i] += atomic_load_explicit(&shard->opcodes[i],
+					memory_order_relaxed);
+		}
+	}
+
+	for (unsigned i = 0; i < CHIP8_METRICS_SIZE; i++) {
+		fprintf(file, "# HELP %s %s\n# TYPE %s %s\n",
+				chip8_metrics_info[i].name, chip8_metrics_info[i].help,
+				chip8_metrics_info[i].name, chip8_metrics_info[i].type);
+
+		if (1 == chip8_metrics_info[i].scale) {
+			fprintf(file, "%s %llu\n", chip8_metrics_info[i].name,
+					(unsigned long long) values[i]);
+		} else {
+			fprintf(file, "%s %.9f\n", chip8_metrics_info[i].name,
+					values[i] / chip8_metrics_info[i].scale);
+		}
+	}
+
+	fputs("# HELP chip8_opcodes_total Instructions executed by opcode.\n"
+			"# TYPE chip8_opcodes_total counter\n", file);
+
+	for (unsigned i = 0; i < CHIP8_ISTR_SET_SIZE; i++) {
+		fprintf(file, "chip8_opcodes_total{opcode=\"%s\"} %llu\n",
+				chip8_istr_name[i], (unsigned long long) opcodes[i]);
+	}
+
+	fputs("# HELP chip8_thread_cpu_seconds_total CPU time of recording "
+			"threads.\n# TYPE chip8_thread_cpu_seconds_total counter\n", file);
+
+	for (unsigned s = 0; s < metrics->capacity; s++) {
+		chip8_metrics_shard* const shard = &metrics->shards[s];
+
+		if (atomic_load_explicit(&shard->registered, memory_order_acquire)
+		    && shard->cpu_clocked && !clock_gettime(shard->cpu_clock, &cpu)) {
+			fprintf(file, "chip8_thread_cpu_seconds_total{thread=\"%s\"} "
+					"%.9f\n", shard->name,
+					cpu.tv_sec + cpu.tv_nsec / (double) CHIP8_NS_PER_SEC);
+		}
+	}
+
+	if (!clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu)) {
+		fprintf(file, "# HELP process_cpu_seconds_total Total user and system "
+				"CPU time spent in seconds.\n"
+				"# TYPE process_cpu_seconds_total counter\n"
+				"process_cpu_seconds_total %.9f\n",
+				cpu.tv_sec + cpu.tv_nsec / (double) CHIP8_NS_PER_SEC);
+	}
+}
+
+static chip8_rc chip8_metrics_send(const int fd, const char* data, size_t size)
+{
+	while (size) {
+		const ssize_t sent = send(fd, data, size, 0);
+
+		if (sent < 0 && EINTR != errno) {
+			return CHIP8_FAILURE;
+		} else if (sent > 0) {
+			data += sent;
+			size -= sent;
+		}
+	}
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Answers one connection with the current metrics.
+ *
+ * The request is read and ignored, so any path serves the metrics, but
+ * answering before it arrived would reset the connection on some clients.
+ */
+static void chip8_metrics_scrape(chip8_metrics metrics[const static 1],
+		const int fd)
+{
+	struct pollfd ready = { .fd = fd, .events = POLLIN };
+	char request[CHIP8_METRICS_REQUEST_SIZE];
+	char header[128];
+	FILE* file;
+	long size;
+	int header_size;
+
+	if (0 < poll(&ready, 1, CHIP8_METRICS_REQUEST_MS)) {
+		(void) recv(fd, request, sizeof(request), 0);
+	}
+
+	if (!(file = fmemopen(metrics->response, sizeof(metrics->response),
+			"w"))) {
+		CHIP8_PERROR("Metrics buffer open failed");
+		return;
+	}
+	chip8_metrics_format(file, metrics);
+	size = ftell(file);
+	fclose(file);
+	header_size = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+			"Content-Length: %ld\r\n\r\n", size);
+
+	if (chip8_metrics_send(fd, header, header_size)
+	    && chip8_metrics_send(fd, metrics->response, size)) {
+		metrics->scrapes++;
+	}
+}
+
+/*
+ * @brief Exporter thread accepting scrapes until the metrics are closed.
+ */
+static void* chip8_metrics_thread(void* const arg)
+{
+	chip8_metrics* const metrics = arg;
+	sigset_t pipe;
+
+	/* a scraper going away fails the send with EPIPE instead of a signal */
+	sigemptyset(&pipe);
+	sigaddset(&pipe, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipe, NULL);
+
+	while (atomic_load_explicit(&metrics->running, memory_order_acquire)) {
+		struct pollfd ready = { .fd = metrics->listen_fd, .events = POLLIN };
+		int fd;
+
+		if (0 < poll(&ready, 1, CHIP8_METRICS_POLL_MS)
+		    && 0 <= (fd = accept(metrics->listen_fd, NULL, NULL))) {
+			chip8_metrics_scrape(metrics, fd);
+			close(fd);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * @brief Creates the listening socket, a Unix socket replacing a stale one
+ * left at the path or a TCP port on the loopback interface.
+ */
+static int chip8_metrics_listen(chip8_metrics metrics[const static 1],
+		const char* const spec)
+{
+	struct sockaddr_un local = { .sun_family = AF_UNIX };
+	struct sockaddr_in loopback = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+	};
+	struct stat status;
+	char* end;
+	const int reuse = 1;
+	int fd;
+
+	if (!strncmp(spec, "unix:", 5)) {
+		metrics->path = strchr(spec, ':') + 1;
+
+		if (strlen(metrics->path) >= sizeof(local.sun_path)) {
+			fprintf(stderr, "great_chip-8::ERROR::METRICS: Socket path too "
+					"long %s\n", metrics->path);
+			return -1;
+		} else if (!stat(metrics->path, &status) && S_ISSOCK(status.st_mode)) {
+			unlink(metrics->path);
+		}
+		strcpy(local.sun_path, metrics->path);
+
+		if (0 > (fd = socket(AF_UNIX, SOCK_STREAM, 0))) {
+			CHIP8_PERROR("Metrics socket creation failed");
+			return -1;
+		} else if (bind(fd, (struct sockaddr*) &local, sizeof(local))) {
+			CHIP8_PERROR("Metrics socket bind failed");
+			close(fd);
+			return -1;
+		}
+	} else {
+		const unsigned long port = strtoul(spec, &end, 10);
+
+		if (*end || !port || port > UINT16_MAX) {
+			fprintf(stderr, "great_chip-8::ERROR::METRICS: Expected a port or "
+					"unix:<path>, got %s\n", spec);
+			return -1;
+		}
+		loopback.sin_port = htons(port);
+
+		if (0 > (fd = socket(AF_INET, SOCK_STREAM, 0))) {
+			CHIP8_PERROR("Metrics socket creation failed");
+			return -1;
+		} else if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse,
+		               sizeof(reuse))
+		           || bind(fd, (struct sockaddr*) &loopback,
+		               sizeof(loopback))) {
+			CHIP8_PERROR("Metrics socket bind failed");
+			close(fd);
+			return -1;
+		}
+	}
+
+	if (listen(fd, SOMAXCONN)) {
+		CHIP8_PERROR("Metrics socket listen failed");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * @brief Allocates shards for the given number of recording threads and
+ * starts serving them.
+ *
+ * The endpoint is "unix:<path>" for a Unix socket or a port number bound to
+ * the loopback interface only, metrics are not meant for the open network.
+ */
+chip8_rc chip8_open_metrics(chip8_metrics metrics[const static 1],
+		const char* const spec, const unsigned shards)
+{
+	metrics->path = NULL;
+	metrics->scrapes = 0;
+	metrics->capacity = shards;
+	atomic_init(&metrics->count, 0);
+	atomic_init(&metrics->running, true);
+
+	if (!(metrics->shards = aligned_alloc(_Alignof(chip8_metrics_shard),
+			shards * sizeof(*metrics->shards)))) {
+		CHIP8_PERROR("Metrics allocation failed");
+		return CHIP8_FAILURE;
+	}
+	memset(metrics->shards, 0, shards * sizeof(*metrics->shards));
+
+	if (0 > (metrics->listen_fd = chip8_metrics_listen(metrics, spec))) {
+		free(metrics->shards);
+		metrics->shards = NULL;
+		return CHIP8_FAILURE;
+	} else if (pthread_create(&metrics->thread, NULL, chip8_metrics_thread,
+			metrics)) {
+		CHIP8_ERR("ERROR::METRICS: Thread creation failed");
+		close(metrics->listen_fd);
+		free(metrics->shards);
+		metrics->shards = NULL;
+		return CHIP8_FAILURE;
+	}
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Hands the calling thread a shard to record into, NULL once every
+ * shard is taken. The thread's CPU time is exported under the given name.
+ */
+chip8_metrics_shard* chip8_metrics_register(
+		chip8_metrics metrics[const static 1], const char name[static 1])
+{
+	const unsigned index = atomic_fetch_add(&metrics->count, 1);
+	chip8_metrics_shard* shard;
+
+	if (index >= metrics->capacity) {
+		return NULL;
+	}
+	shard = &metrics->shards[index];
+	snprintf(shard->name, sizeof(shard->name), "%s", name);
+
+	shard->cpu_clocked = !pthread_getcpuclockid(pthread_self(),
+			&shard->cpu_clock);
+	atomic_store_explicit(&shard->registered, true, memory_order_release);
+	return shard;
+}
+
+/*
+ * @brief Adds the instructions counted by chip8_count_frame() to the shard
+ * and clears the counts.
+ */
+void chip8_metrics_opcodes(chip8_metrics_shard shard[const static 1],
+		uint32_t counts[const static CHIP8_ISTR_SET_SIZE])
+{
+	uint64_t istrs = 0;
+
+	for (unsigned i = 0; i < CHIP8_ISTR_SET_SIZE; i++) {
+		if (counts[i]) {
+			atomic_store_explicit(&shard->opcodes[i],
+					atomic_load_explicit(&shard->opcodes[i],
+						memory_order_relaxed) + counts[i],
+					memory_order_relaxed);
+			istrs += counts[i];
+			counts[i] = 0;
+		}
+	}
+	chip8_metrics_add(shard, CHIP8_METRIC_ISTRS, istrs);
+}
+
+/*
+ * @brief Accounts the time a machine spent blocked in FX0A up to now.
+ *
+ * wait_ns holds when the wait was last accounted and 0 while the machine
+ * is not waiting, so long waits show up in scrapes before they end.
+ */
+void chip8_metrics_wait(chip8_metrics_shard shard[const static 1],
+		uint64_t wait_ns[const static 1], const chip8_vm chip8[const static 1],
+		const uint64_t now_ns)
+{
+	if (*wait_ns) {
+		chip8_metrics_add(shard, CHIP8_METRIC_WAIT_KEY_NS, now_ns - *wait_ns);
+	}
+	*wait_ns = CHIP8_WAITING_KEY == chip8->state ? now_ns : 0;
+}
+
+/*
+ * @brief Stops the exporter thread and releases the shards, recording
+ * threads must be done with them.
+ */
+void chip8_close_metrics(chip8_metrics metrics[const static 1])
+{
+	if (!metrics->shards) {
+		return;
+	}
+	atomic_store_explicit(&metrics->running, false, memory_order_release);
+	pthread_join(metrics->thread, NULL);
+	close(metrics->listen_fd);
+
+	if (metrics->path) {
+		unlink(metrics->path);
+	}
+	free(metrics->shards);
+	metrics->shards = NULL;
+	CHIP8_DBG("Metrics closed after %llu scrapes",
+			(unsigned long long) metrics->scrapes);
+}
@@ -0,0 +1,105 @@
+/*
+ * @file chip8_ring.c
+ * @brief Implements the lock-free single-producer single-consumer byte ring.
+ *
+ * Used to hand data from the emulation thread to I/O threads without ever
+ * blocking the emulation thread, a full ring makes writes come up short
+ * instead.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_io.h"
+#include "chip8_ring.h"
+
+/*
+ * @brief Allocates a ring of at least the given capacity in bytes, rounded up
+ * to a power of two.
+ */
+chip8_rc chip8_init_ring(chip8_ring ring[const static 1], const size_t capacity)
+{
+	size_t size = 1;
+
+	while (size < capacity) {
+		size <<= 1;
+	}
+	ring->data = malloc(size);
+
+	if (!ring->data) {
+		CHIP8_PERROR("Ring allocation failed");
+		return CHIP8_FAILURE;
+	}
+	ring->mask = size - 1;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	return CHIP8_SUCCESS;
+}
+
+void chip8_free_ring(chip8_ring ring[const static 1])
+{
+	free(ring->data);
+	ring->data = NULL;
+}
+
+/*
+ * @brief Returns the number of bytes the consumer can read.
+ */
+size_t chip8_ring_readable(chip8_ring ring[const static 1])
+{
+	return atomic_load_explicit(&ring->tail, memory_order_acquire)
+		- atomic_load_explicit(&ring->head, memory_order_relaxed);
+}
+
+/*
+ * @brief Returns the number of bytes the producer can write.
+ */
+size_t chip8_ring_writable(chip8_ring ring[const static 1])
+{
+	return ring->mask + 1
+		- (atomic_load_explicit(&ring->tail, memory_order_relaxed)
+		- atomic_load_explicit(&ring->head, memory_order_acquire));
+}
+
+/*
+ * @brief Copies up to size bytes into the ring, returns the amount written.
+ * Producer side only.
+ */
+size_t chip8_ring_write(chip8_ring ring[const restrict static 1],
+		const void* restrict src, size_t size)
+{
+	const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	const size_t offset = tail & ring->mask;
+	size_t first;
+
+	if (size > chip8_ring_writable(ring)) {
+		size = chip8_ring_writable(ring);
+	}
+	first = ring->mask + 1 - offset < size ? ring->mask + 1 - offset : size;
+	memcpy(&ring->data[offset], src, first);
+	memcpy(ring->data, (const chip8_byte*) src + first, size - first);
+	atomic_store_explicit(&ring->tail, tail + size, memory_order_release);
+	return size;
+}
+
+/*
+ * @brief Copies up to size bytes out of the ring, returns the amount read.
+ * Consumer side only.
+ */
+size_t chip8_ring_read(chip8_ring ring[const restrict static 1],
+		void* restrict dst, size_t size)
+{
+	const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	const size_t offset = head & ring->mask;
+	size_t first;
+
+	if (size > chip8_ring_readable(ring)) {
+		size = chip8_ring_readable(ring);
+	}
+	first = ring->mask + 1 - offset < size ? ring->mask + 1 - offset : size;
+	memcpy(dst, &ring->data[offset], first);
+	memcpy((chip8_byte*) dst + first, ring->data, size - first);
+	atomic_store_explicit(&ring->head, head + size, memory_order_release);
+	return size;
+}
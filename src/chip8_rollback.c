@@ -0,0 +1,311 @@
+/*
+ * @file chip8_rollback.c
+ * @brief Implements rollback netplay of two peers sharing one keypad.
+ *
+ * Frames are numbered from the start of the session, inputs and hashes are
+ * kept in rings of CHIP8_ROLLBACK_INPUTS frames and snapshots in a ring of
+ * depth + 1. A peer runs at most depth frames past the remote inputs it
+ * received, and its peer at most depth frames past the inputs it received
+ * from it, so the rings hold every frame still needed by either.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_io.h"
+#include "chip8_hash.h"
+#include "chip8_hist.h"
+#include "chip8_rollback.h"
+#include "chip8_time.h"
+
+#define CHIP8_ROLLBACK_SLOT(FRAME) ((FRAME) & (CHIP8_ROLLBACK_INPUTS-1))
+
+static void chip8_put_le(chip8_byte dst[const static 1], const uint64_t value,
+		const unsigned size)
+{
+	for (unsigned i = 0; i < size; i++) {
+		dst[i] = value >> 8 * i;
+	}
+}
+
+static uint64_t chip8_get_le(const chip8_byte src[const static 1],
+		const unsigned size)
+{
+	uint64_t value = 0;
+
+	for (unsigned i = 0; i < size; i++) {
+		value |= (uint64_t) src[i] << 8 * i;
+	}
+	return value;
+}
+
+/*
+ * @brief Allocates the snapshot ring for the given local player, 0 for the
+ * left half of the keypad and 1 for the right half.
+ */
+chip8_rc chip8_init_rollback(chip8_rollback rollback[const static 1],
+		const unsigned player, const unsigned depth, const unsigned cycles)
+{
+	memset(rollback, 0, sizeof(*rollback));
+
+	if (!depth || depth > CHIP8_ROLLBACK_DEPTH_MAX) {
+		fprintf(stderr, "great_chip-8::ERROR::ROLLBACK: Depth must be 1 to "
+				"%d frames\n", CHIP8_ROLLBACK_DEPTH_MAX);
+		return CHIP8_FAILURE;
+	} else if (!(rollback->snapshots = aligned_alloc(_Alignof(chip8_vm),
+			(depth + 1) * sizeof(chip8_vm)))) {
+		CHIP8_PERROR("Snapshot ring allocation failed");
+		return CHIP8_FAILURE;
+	}
+
+	/* zeroed machines map no pages, the first copy into them maps them */
+	memset(rollback->snapshots, 0, (depth + 1) * sizeof(chip8_vm));
+	rollback->depth = depth;
+	rollback->cycles = cycles;
+	rollback->mask = player ? (chip8_word) ~CHIP8_ROLLBACK_LEFT_KEYS
+		: CHIP8_ROLLBACK_LEFT_KEYS;
+	return CHIP8_SUCCESS;
+}
+
+void chip8_free_rollback(chip8_rollback rollback[const static 1])
+{
+	if (!rollback->snapshots) {
+		return;
+	}
+
+	for (unsigned i = 0; i <= rollback->depth; i++) {
+		chip8_drop_vm(&rollback->snapshots[i]);
+	}
+	free(rollback->snapshots);
+	rollback->snapshots = NULL;
+}
+
+static inline chip8_vm* chip8_rollback_snapshot(
+		const chip8_rollback rollback[const static 1], const uint64_t frame)
+{
+	return &rollback->snapshots[frame % (rollback->depth + 1)];
+}
+
+/*
+ * @brief Applies the keys of both players in a frame as key edges, so FX0A
+ * sees them as it would from a local keypad.
+ */
+static chip8_rc chip8_rollback_run(chip8_rollback rollback[const static 1],
+		chip8_vm chip8[const static 1], const uint64_t frame)
+{
+	const unsigned slot = CHIP8_ROLLBACK_SLOT(frame);
+	const chip8_word keys = (rollback->local[slot] & rollback->mask)
+		| (rollback->remote[slot] & ~rollback->mask);
+
+	for (chip8_word changed = keys ^ chip8->keys; changed;
+			changed &= changed - 1) {
+		const unsigned key = __builtin_ctz(changed);
+
+		chip8_set_key(chip8, key, keys >> key & 1);
+	}
+	return chip8_run_frame(chip8, rollback->cycles);
+}
+
+/*
+ * @brief Restores the state of the first mispredicted frame and runs the
+ * frames since again, predicting the frames without remote input from the
+ * newest one received.
+ */
+static chip8_rc chip8_rollback_replay(chip8_rollback rollback[const static 1],
+		chip8_vm chip8[const static 1])
+{
+	const uint64_t start_ns = chip8_time_ns();
+	const chip8_word last = rollback->received
+		? rollback->remote[CHIP8_ROLLBACK_SLOT(rollback->received - 1)] : 0;
+	uint64_t replay_ns;
+
+	chip8_copy_vm(chip8, chip8_rollback_snapshot(rollback, rollback->replay));
+
+	for (uint64_t frame = rollback->replay; frame < rollback->frame; frame++) {
+		if (frame >= rollback->received) {
+			rollback->remote[CHIP8_ROLLBACK_SLOT(frame)] = last;
+		}
+
+		if (frame != rollback->replay) {
+			chip8_copy_vm(chip8_rollback_snapshot(rollback, frame), chip8);
+		}
+
+		if (!chip8_rollback_run(rollback, chip8, frame)) {
+			return CHIP8_FAILURE;
+		}
+	}
+	replay_ns = chip8_time_ns() - start_ns;
+	rollback->rollbacks++;
+	rollback->replayed += rollback->frame - rollback->replay;
+	rollback->replay_ns += replay_ns;
+	chip8_hist_record(&rollback->replay_time, replay_ns);
+	rollback->replay = rollback->frame;
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Counts a desynchronization when the peer's latest hash is of a
+ * frame hashed here too and differs.
+ */
+static void chip8_rollback_check(chip8_rollback rollback[const static 1])
+{
+	const chip8_rollback_hash* const hash = &rollback->hashes[
+		CHIP8_ROLLBACK_SLOT(rollback->peer_hash.frame)];
+
+	if (!rollback->peer_hash.frame || hash->frame != rollback->peer_hash.frame
+	    || hash->hash == rollback->peer_hash.hash) {
+		return;
+	} else if (!rollback->desyncs++) {
+		rollback->desync_frame = hash->frame;
+	}
+	rollback->peer_hash.frame = 0;
+}
+
+/*
+ * @brief Hashes the states at the start of the frames that got all their
+ * inputs, once pending replays have run. Each frame is hashed, so the
+ * latest hash of the peer is found here unless it is too old.
+ */
+static void chip8_rollback_confirm(chip8_rollback rollback[const static 1],
+		const chip8_vm chip8[const static 1])
+{
+	const uint64_t confirmed = rollback->received < rollback->frame
+		? rollback->received : rollback->frame;
+
+	for (uint64_t frame = rollback->hashed + 1; frame <= confirmed; frame++) {
+		chip8_rollback_hash* const hash = &rollback->hashes[
+			CHIP8_ROLLBACK_SLOT(frame)];
+
+		hash->frame = frame;
+		hash->hash = chip8_hash_vm(frame == rollback->frame ? chip8
+				: chip8_rollback_snapshot(rollback, frame)).lo;
+	}
+
+	if (confirmed > rollback->hashed) {
+		rollback->hashed = confirmed;
+		chip8_rollback_check(rollback);
+	}
+}
+
+/*
+ * @brief Runs pending replays, after which the machine is at the start of
+ * the next frame with the best known inputs.
+ */
+chip8_rc chip8_rollback_sync(chip8_rollback rollback[const static 1],
+		chip8_vm chip8[const static 1])
+{
+	if (rollback->replay < rollback->frame
+	    && !chip8_rollback_replay(rollback, chip8)) {
+		return CHIP8_FAILURE;
+	}
+	chip8_rollback_confirm(rollback, chip8);
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Replays mispredicted frames and runs the next frame with the given
+ * local keys, unless the peer is too far behind, which counts a stall.
+ */
+chip8_rc chip8_rollback_advance(chip8_rollback rollback[const static 1],
+		chip8_vm chip8[const static 1], const chip8_word keys)
+{
+	const unsigned slot = CHIP8_ROLLBACK_SLOT(rollback->frame);
+
+	if (!chip8_rollback_sync(rollback, chip8)) {
+		return CHIP8_FAILURE;
+	} else if (rollback->frame >= rollback->received + rollback->depth) {
+		rollback->stalls++;
+		return CHIP8_SUCCESS;
+	}
+	rollback->local[slot] = keys & rollback->mask;
+
+	if (rollback->frame >= rollback->received) {
+		rollback->remote[slot] = rollback->received
+			? rollback->remote[CHIP8_ROLLBACK_SLOT(rollback->received - 1)] : 0;
+	}
+	chip8_copy_vm(chip8_rollback_snapshot(rollback, rollback->frame), chip8);
+
+	if (!chip8_rollback_run(rollback, chip8, rollback->frame)) {
+		return CHIP8_FAILURE;
+	}
+	rollback->frame++;
+	rollback->replay = rollback->frame;
+	chip8_rollback_confirm(rollback, chip8);
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Writes a packet of the local inputs the peer has not acknowledged,
+ * returns its size.
+ */
+size_t chip8_rollback_pack(const chip8_rollback rollback[const static 1],
+		chip8_byte packet[const static CHIP8_ROLLBACK_PACKET_SIZE])
+{
+	const chip8_rollback_hash* const hash = &rollback->hashes[
+		CHIP8_ROLLBACK_SLOT(rollback->hashed)];
+	const uint64_t count = rollback->frame - rollback->acked
+		< CHIP8_ROLLBACK_INPUTS ? rollback->frame - rollback->acked
+		: CHIP8_ROLLBACK_INPUTS;
+
+	packet[0] = CHIP8_ROLLBACK_MAGIC;
+	packet[1] = count;
+	chip8_put_le(&packet[2], rollback->acked, 4);
+	chip8_put_le(&packet[6], rollback->received, 4);
+	chip8_put_le(&packet[10], hash->frame, 4);
+	chip8_put_le(&packet[14], hash->hash, 8);
+
+	for (unsigned i = 0; i < count; i++) {
+		chip8_put_le(&packet[CHIP8_ROLLBACK_HEADER_SIZE + 2 * i],
+				rollback->local[CHIP8_ROLLBACK_SLOT(rollback->acked + i)], 2);
+	}
+	return CHIP8_ROLLBACK_HEADER_SIZE + 2 * count;
+}
+
+/*
+ * @brief Takes the new remote inputs of a packet, a misprediction among
+ * them schedules a replay from its frame. Returns whether the packet was
+ * well-formed.
+ */
+chip8_rc chip8_rollback_unpack(chip8_rollback rollback[const static 1],
+		const chip8_byte* const packet, const size_t size)
+{
+	uint64_t frame;
+	uint64_t acked;
+
+	if (size < CHIP8_ROLLBACK_HEADER_SIZE || CHIP8_ROLLBACK_MAGIC != packet[0]
+	    || packet[1] > CHIP8_ROLLBACK_INPUTS
+	    || size != CHIP8_ROLLBACK_HEADER_SIZE + 2u * packet[1]) {
+		return CHIP8_FAILURE;
+	}
+	frame = chip8_get_le(&packet[2], 4);
+	acked = chip8_get_le(&packet[6], 4);
+
+	/* the peer runs at most depth frames past the inputs it has */
+	for (unsigned i = 0; i < packet[1]; i++, frame++) {
+		const chip8_word keys = chip8_get_le(
+				&packet[CHIP8_ROLLBACK_HEADER_SIZE + 2 * i], 2);
+		const unsigned slot = CHIP8_ROLLBACK_SLOT(frame);
+
+		if (frame != rollback->received
+		    || frame >= rollback->frame + rollback->depth) {
+			continue;
+		} else if (frame < rollback->frame && keys != rollback->remote[slot]
+		           && frame < rollback->replay) {
+			rollback->replay = frame;
+		}
+		rollback->remote[slot] = keys;
+		rollback->received++;
+	}
+
+	if (acked > rollback->acked && acked <= rollback->frame) {
+		rollback->acked = acked;
+	}
+	rollback->peer_hash.frame = chip8_get_le(&packet[10], 4);
+	rollback->peer_hash.hash = chip8_get_le(&packet[14], 8);
+	chip8_rollback_check(rollback);
+	return CHIP8_SUCCESS;
+}
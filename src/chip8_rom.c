@@ -0,0 +1,477 @@
+/*
+ * @file chip8_rom.c
+ * @brief Implements memory-mapped ROM loading and the ROM catalog cache.
+ *
+ * ROMs are mapped read-only, validated against the space available above
+ * the interpreter area and hashed so they can be identified independent of
+ * their file name.
+ * A catalog keeps the name, hash, size and analysis results of every ROM in a
+ * directory in a small text file, so listing a directory only needs a stat
+ * per file instead of reading every ROM again.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chip8.h"
+#include "chip8_io.h"
+#include "chip8_rom.h"
+#include "chip8_dbg.h"
+
+#define CHIP8_FNV_OFFSET 0xCBF29CE484222325ULL
+#define CHIP8_FNV_PRIME 0x00000100000001B3ULL
+
+/*
+ * @brief Computes the 64-bit FNV-1a hash of a block of memory.
+ */
+uint64_t chip8_hash(const void* const data, const size_t size)
+{
+	const chip8_byte* const bytes = data;
+	uint64_t hash = CHIP8_FNV_OFFSET;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= CHIP8_FNV_PRIME;
+	}
+	return hash;
+}
+
+/*
+ * @brief Maps a ROM file read-only and validates that it fits in memory.
+ */
+chip8_rc chip8_map_rom(chip8_rom rom[const static 1],
+		const char rom_path[static 1])
+{
+	struct stat rom_stat;
+	void* data;
+	const int fd = open(rom_path, O_RDONLY);
+
+	if (-1 == fd) {
+		return CHIP8_FAILURE;
+	} else if (-1 == fstat(fd, &rom_stat) || !S_ISREG(rom_stat.st_mode)) {
+		close(fd);
+		return CHIP8_FAILURE;
+	} else if (!rom_stat.st_size || CHIP8_ROM_MAX_SIZE < rom_stat.st_size) {
+		fprintf(stderr, "great_chip-8::ERROR::ROM: %s is %lld bytes, "
+				"expected 1 to %d\n", rom_path, (long long) rom_stat.st_size,
+				CHIP8_ROM_MAX_SIZE);
+		close(fd);
+		return CHIP8_FAILURE;
+	}
+	data = mmap(NULL, rom_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (MAP_FAILED == data) {
+		return CHIP8_FAILURE;
+	}
+	rom->data = data;
+	rom->size = rom_stat.st_size;
+	rom->hash = chip8_hash(rom->data, rom->size);
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Releases the mapping created by chip8_map_rom().
+ */
+void chip8_unmap_rom(chip8_rom rom[const static 1])
+{
+	if (rom->data) {
+		munmap((void*) rom->data, rom->size);
+	}
+	memset(rom, 0, sizeof(*rom));
+}
+
+/*
+ * @brief Quirk profiles of the bundled ROMs, the platform their opcodes
+ * belong to does not tell which interpreter they were written for.
+ */
+static const struct {
+	uint64_t hash;
+	chip8_quirks quirks;
+} chip8_known_roms[] = {
+	{ 0xE59FD57FA44ECB40ULL, CHIP8_QUIRKS_VIP },   /* 15_Puzzle */
+	{ 0x0FD332D0BC68C9F2ULL, CHIP8_QUIRKS_SCHIP }, /* Blinky */
+	{ 0x29BCAB9B664D212BULL, CHIP8_QUIRKS_VIP },   /* Blitz */
+	{ 0xC86E8FF63FCE668CULL, CHIP8_QUIRKS_VIP },   /* Brix */
+	{ 0xADF99268DB3C3BC9ULL, CHIP8_QUIRKS_VIP },   /* Connect4 */
+	{ 0x1BBB10C8E5CADBB5ULL, CHIP8_QUIRKS_VIP },   /* Guess */
+	{ 0x3F58EB4FA83DCD98ULL, CHIP8_QUIRKS_VIP },   /* Hidden */
+	{ 0x64E45391BA0238A1ULL, CHIP8_QUIRKS_VIP },   /* IBM_Logo */
+	{ 0xA8E9391EBB18DF6FULL, CHIP8_QUIRKS_VIP },   /* Kaleid */
+	{ 0x25E96E1086CE43CBULL, CHIP8_QUIRKS_VIP },   /* Maze */
+	{ 0x43DEF5533F6D8D25ULL, CHIP8_QUIRKS_VIP },   /* Merlin */
+	{ 0x71CDB8B926F1B988ULL, CHIP8_QUIRKS_VIP },   /* Missle */
+	{ 0x9495733F60624EE6ULL, CHIP8_QUIRKS_VIP },   /* Pong_1_Player */
+	{ 0x0F81C6A74DCD366EULL, CHIP8_QUIRKS_VIP },   /* Pong_2_Player */
+	{ 0x36F264B8F72349A6ULL, CHIP8_QUIRKS_VIP },   /* Puzzle */
+	{ 0x084084015E9AF9D3ULL, CHIP8_QUIRKS_VIP },   /* Random_Number_Test */
+	{ 0x8E547EBB12C026B4ULL, CHIP8_QUIRKS_SCHIP }, /* Space_Invaders */
+	{ 0xEC7CA0DE3E110327ULL, CHIP8_QUIRKS_VIP },   /* Syzygy */
+	{ 0x3E2C2D43B296B74CULL, CHIP8_QUIRKS_VIP },   /* Tank */
+	{ 0x04EB2109DC29B1ABULL, CHIP8_QUIRKS_VIP },   /* Tetris */
+	{ 0x56049E83866B207DULL, CHIP8_QUIRKS_VIP },   /* Tictac */
+	{ 0x8D8A02FA3A2ED293ULL, CHIP8_QUIRKS_VIP },   /* UFO */
+	{ 0xCDAA32787DEAA913ULL, CHIP8_QUIRKS_VIP },   /* VBrix */
+	{ 0xEAE1357F230D90C5ULL, CHIP8_QUIRKS_VIP },   /* Vers */
+	{ 0xB7E1D74B387BEDE6ULL, CHIP8_QUIRKS_VIP }    /* Wipeoff */
+};
+
+/*
+ * @brief Chooses the quirk profile of a ROM, by its hash when it is known,
+ * by the platform of the opcodes its code reaches otherwise and VIP when
+ * those are all CHIP-8 ones.
+ */
+chip8_quirks chip8_rom_quirks(const chip8_rom rom[const static 1])
+{
+	uint32_t flags;
+
+	for (size_t i = 0; i < sizeof(chip8_known_roms) / sizeof(*chip8_known_roms);
+			i++) {
+		if (rom->hash == chip8_known_roms[i].hash) {
+			return chip8_known_roms[i].quirks;
+		}
+	}
+	flags = chip8_analyze_rom(rom->data, rom->size);
+
+	if (flags & CHIP8_ROM_XOCHIP) {
+		return CHIP8_QUIRKS_MODERN;
+	} else if (flags & CHIP8_ROM_SCHIP) {
+		return CHIP8_QUIRKS_SCHIP;
+	}
+	return CHIP8_QUIRKS_VIP;
+}
+
+/*
+ * @brief Copies a memory-mapped ROM into the program area of memory and
+ * selects its quirk profile.
+ */
+chip8_rc chip8_load_rom(chip8_vm chip8[const static 1],
+		const char rom_path[static 1])
+{
+	chip8_rom rom;
+
+	if (!chip8_map_rom(&rom, rom_path)) {
+		return CHIP8_FAILURE;
+	}
+	if (!chip8_mem_load(chip8, CHIP8_ROM_ADDR, rom.data, rom.size)) {
+		chip8_unmap_rom(&rom);
+		return CHIP8_FAILURE;
+	}
+	chip8->quirks = chip8_rom_quirks(&rom);
+	CHIP8_DBG("Loaded %zu byte ROM with hash %016" PRIx64 ", quirks %d",
+			rom.size, rom.hash, chip8->quirks);
+	chip8_unmap_rom(&rom);
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Returns the hints a single instruction gives.
+ */
+static uint32_t chip8_istr_hints(const chip8_word istr)
+{
+	uint32_t flags = 0;
+
+	switch (istr & 0xF0FF) {
+		case 0xE09E:
+		case 0xE0A1:
+		case 0xF00A: flags |= CHIP8_ROM_INPUT; break;
+		case 0xF018: flags |= CHIP8_ROM_SOUND; break;
+		case 0xF030:
+		case 0xF075:
+		case 0xF085: flags |= CHIP8_ROM_SCHIP; break;
+		case 0xF001:
+		case 0xF03A: flags |= CHIP8_ROM_XOCHIP; break;
+	}
+
+	if ((istr & 0xFFF0) == 0x00C0 || (0x00FB <= istr && istr <= 0x00FF)) {
+		flags |= CHIP8_ROM_SCHIP;
+	} else if (0xF000 == istr || 0xF002 == istr
+		   || (istr & 0xFFF0) == 0x00D0 || (istr & 0xF00E) == 0x5002) {
+		flags |= CHIP8_ROM_XOCHIP;
+	}
+	return flags;
+}
+
+/*
+ * @brief Scans the instructions a ROM reaches from its entry point for
+ * opcodes hinting at its requirements.
+ *
+ * Both ways of every skip and call are followed, so sprites and tables
+ * between routines are never taken for instructions. Code only reached
+ * through BNNN or self-modification is missed, the results are hints.
+ * Jumps only reach the first 4 KB, XO-CHIP data above is never scanned.
+ */
+uint32_t chip8_analyze_rom(const chip8_byte data[const], const size_t size)
+{
+	enum { CHIP8_CODE_SIZE = 0x1000 - CHIP8_ROM_ADDR };
+	const size_t end = size < CHIP8_CODE_SIZE ? size : CHIP8_CODE_SIZE;
+	uint32_t flags = 0;
+	bool reached[CHIP8_CODE_SIZE] = { false };
+	chip8_word pending[CHIP8_CODE_SIZE];
+	size_t count = 0;
+
+	pending[count++] = 0;
+	reached[0] = true;
+
+	while (count) {
+		/* follows straight-line code until it ends or joins scanned code */
+		for (size_t i = pending[--count]; i+1 < end;) {
+			const chip8_word istr = data[i] << 8 | data[i+1];
+			const size_t target = (istr & 0x0FFF) - CHIP8_ROM_ADDR;
+			size_t branch = SIZE_MAX;
+			size_t next = 0xF000 == istr ? i+4 : i+2;
+
+			flags |= chip8_istr_hints(istr);
+
+			switch (istr >> 12) {
+				case 0x0:
+					if (0x00EE == istr || 0x00FD == istr) {
+						next = SIZE_MAX;
+					}
+					break;
+				case 0x1:
+					next = target;
+					break;
+				case 0x2:
+					branch = target;
+					break;
+				case 0x3:
+				case 0x4:
+				case 0x5:
+				case 0x9:
+				case 0xE:
+					branch = i+4;
+					break;
+				case 0xB:
+					next = SIZE_MAX;
+					break;
+			}
+
+			/* jumps below the program area wrap past every bound */
+			if (branch < end && !reached[branch]) {
+				reached[branch] = true;
+				pending[count++] = branch;
+			}
+
+			if (next >= end || reached[next]) {
+				break;
+			}
+			reached[next] = true;
+			i = next;
+		}
+	}
+	return flags;
+}
+
+static int chip8_compare_entries(const void* const lhs, const void* const rhs)
+{
+	return strcmp(((const chip8_rom_entry*) lhs)->name,
+			((const chip8_rom_entry*) rhs)->name);
+}
+
+/*
+ * @brief Appends an entry to the catalog, growing it as required.
+ */
+static chip8_rom_entry* chip8_push_entry(chip8_catalog catalog[const static 1])
+{
+	if (catalog->count == catalog->capacity) {
+		const size_t capacity = catalog->capacity ? 2 * catalog->capacity : 64;
+		chip8_rom_entry* const entries = realloc(catalog->entries,
+				capacity * sizeof(*entries));
+
+		if (!entries) {
+			CHIP8_PERROR("Catalog allocation failed");
+			return NULL;
+		}
+		catalog->entries = entries;
+		catalog->capacity = capacity;
+	}
+	return memset(&catalog->entries[catalog->count++], 0,
+			sizeof(*catalog->entries));
+}
+
+/*
+ * @brief Reads the cached catalog file, a missing or stale file is not an
+ * error since the catalog is rebuilt from the directory anyway.
+ */
+static void chip8_read_catalog(chip8_catalog cache[const static 1],
+		const char catalog_path[static 1])
+{
+	unsigned version;
+	chip8_rom_entry entry;
+	FILE* const file = fopen(catalog_path, "r");
+
+	if (!file) {
+		return;
+	} else if (1 != fscanf(file, "great_chip-8 catalog %u\n", &version)
+		   || CHIP8_CATALOG_VERSION != version) {
+		fclose(file);
+		return;
+	}
+
+	while (5 == fscanf(file, "%" SCNx64 " %" SCNu32 " %" SCNx32 " %" SCNd64
+			" %255[^\n]\n", &entry.hash, &entry.size, &entry.flags,
+			&entry.mtime, entry.name)) {
+		chip8_rom_entry* const cached = chip8_push_entry(cache);
+
+		if (!cached) {
+			break;
+		}
+		*cached = entry;
+	}
+	fclose(file);
+	qsort(cache->entries, cache->count, sizeof(*cache->entries),
+			chip8_compare_entries);
+}
+
+/*
+ * @brief Replaces the catalog file, written to a temporary file first so a
+ * concurrent reader never observes a partial catalog.
+ */
+static chip8_rc chip8_write_catalog(const chip8_catalog catalog[const static 1],
+		const char catalog_path[static 1])
+{
+	char tmp_path[CHIP8_PATH_MAX + sizeof(".tmp")];
+	FILE* file;
+
+	/* a truncated path would write the catalog to another file */
+	if (sizeof(tmp_path) <= (size_t) snprintf(tmp_path, sizeof(tmp_path),
+			"%s.tmp", catalog_path) || !(file = fopen(tmp_path, "w"))) {
+		return CHIP8_FAILURE;
+	}
+	fprintf(file, "great_chip-8 catalog %u\n", CHIP8_CATALOG_VERSION);
+
+	for (size_t i = 0; i < catalog->count; i++) {
+		const chip8_rom_entry* const entry = &catalog->entries[i];
+
+		fprintf(file, "%016" PRIx64 " %" PRIu32 " %" PRIx32 " %" PRId64 " %s\n",
+				entry->hash, entry->size, entry->flags, entry->mtime,
+				entry->name);
+	}
+
+	if (fclose(file) || rename(tmp_path, catalog_path)) {
+		remove(tmp_path);
+		return CHIP8_FAILURE;
+	}
+	return CHIP8_SUCCESS;
+}
+
+static bool chip8_is_rom_name(const char* const name)
+{
+	const size_t length = strlen(name);
+	const size_t ext_length = sizeof(CHIP8_ROM_EXT) - 1;
+
+	return name[0] != '.' && ext_length < length && CHIP8_ROM_NAME_MAX >= length
+		&& !strcmp(name + length - ext_length, CHIP8_ROM_EXT);
+}
+
+/*
+ * @brief Builds the catalog of a ROM directory.
+ *
+ * Entries whose size and modification time match the cached catalog are
+ * reused as is, every other ROM is mapped, hashed and analyzed.
+ * The catalog file is only rewritten when something changed.
+ */
+chip8_rc chip8_open_catalog(chip8_catalog catalog[const static 1],
+		const char rom_dir[static 1])
+{
+	char catalog_path[CHIP8_PATH_MAX];
+	char rom_path[CHIP8_PATH_MAX];
+	chip8_catalog cache = { 0 };
+	struct dirent* dir_entry;
+	struct stat rom_stat;
+	bool stale = false;
+	DIR* const dir = opendir(rom_dir);
+
+	memset(catalog, 0, sizeof(*catalog));
+
+	if (!dir) {
+		return CHIP8_FAILURE;
+	}
+	snprintf(catalog->dir, sizeof(catalog->dir), "%s", rom_dir);
+	snprintf(catalog_path, sizeof(catalog_path), "%s/" CHIP8_CATALOG_FILE,
+			rom_dir);
+	chip8_read_catalog(&cache, catalog_path);
+
+	while ((dir_entry = readdir(dir))) {
+		chip8_rom rom;
+		chip8_rom_entry key;
+		const chip8_rom_entry* cached;
+		chip8_rom_entry* entry;
+
+		if (!chip8_is_rom_name(dir_entry->d_name)
+		    || -1 == fstatat(dirfd(dir), dir_entry->d_name, &rom_stat, 0)
+		    || !S_ISREG(rom_stat.st_mode)) {
+			continue;
+		} else if (!(entry = chip8_push_entry(catalog))) {
+			break;
+		}
+		snprintf(key.name, sizeof(key.name), "%s", dir_entry->d_name);
+		cached = bsearch(&key, cache.entries, cache.count,
+				sizeof(*cache.entries), chip8_compare_entries);
+		*entry = key;
+		entry->mtime = (int64_t) rom_stat.st_mtim.tv_sec * 1000000000
+			+ rom_stat.st_mtim.tv_nsec;
+
+		if (cached && cached->mtime == entry->mtime
+		    && cached->size == rom_stat.st_size) {
+			*entry = *cached;
+			continue;
+		}
+		snprintf(rom_path, sizeof(rom_path), "%s/%s", rom_dir, entry->name);
+
+		if (!chip8_map_rom(&rom, rom_path)) {
+			catalog->count--;
+			continue;
+		}
+		entry->hash = rom.hash;
+		entry->size = rom.size;
+		entry->flags = chip8_analyze_rom(rom.data, rom.size);
+		chip8_unmap_rom(&rom);
+		stale = true;
+		CHIP8_DBG("Catalogued %s", entry->name);
+	}
+	closedir(dir);
+	stale |= cache.count != catalog->count;
+	chip8_close_catalog(&cache);
+	qsort(catalog->entries, catalog->count, sizeof(*catalog->entries),
+			chip8_compare_entries);
+
+	if (stale && !chip8_write_catalog(catalog, catalog_path)) {
+		CHIP8_PERROR("Catalog write failed");
+	}
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Looks up a ROM in the catalog by file name.
+ */
+const chip8_rom_entry* chip8_find_rom(const chip8_catalog catalog[const static 1],
+		const char name[static 1])
+{
+	chip8_rom_entry key;
+
+	snprintf(key.name, sizeof(key.name), "%s", name);
+	return bsearch(&key, catalog->entries, catalog->count,
+			sizeof(*catalog->entries), chip8_compare_entries);
+}
+
+/*
+ * @brief Frees the catalog entries.
+ */
+void chip8_close_catalog(chip8_catalog catalog[const static 1])
+{
+	free(catalog->entries);
+	catalog->entries = NULL;
+	catalog->count = 0;
+	catalog->capacity = 0;
+}
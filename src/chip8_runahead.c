@@ -0,0 +1,76 @@
+/*
+ * @file chip8_runahead.c
+ * @brief Implements run-ahead presentation on a scratch machine.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_hist.h"
+#include "chip8_runahead.h"
+#include "chip8_time.h"
+
+chip8_rc chip8_init_runahead(chip8_runahead runahead[const static 1],
+		const unsigned frames, const unsigned cycles)
+{
+	/* a zeroed machine maps no pages, the first copy into it maps them */
+	memset(runahead, 0, sizeof(*runahead));
+
+	if (frames > CHIP8_RUNAHEAD_MAX) {
+		fprintf(stderr, "great_chip-8::ERROR::RUNAHEAD: Run-ahead must be 0 "
+				"to %d frames\n", CHIP8_RUNAHEAD_MAX);
+		return CHIP8_FAILURE;
+	}
+	runahead->frames = frames;
+	runahead->cycles = cycles;
+	return CHIP8_SUCCESS;
+}
+
+void chip8_free_runahead(chip8_runahead runahead[const static 1])
+{
+	chip8_drop_vm(&runahead->ahead);
+}
+
+/*
+ * @brief Copies the machine and runs the copy frames ahead with the keys
+ * the machine holds, returns whether its instructions were valid.
+ */
+chip8_rc chip8_run_ahead(chip8_runahead runahead[const static 1],
+		const chip8_vm chip8[const static 1])
+{
+	const uint64_t start_ns = chip8_time_ns();
+	uint64_t run_ns;
+
+	chip8_copy_vm(&runahead->ahead, chip8);
+
+	for (unsigned i = 0; i < runahead->frames
+	     && CHIP8_HALTED != runahead->ahead.state; i++) {
+		if (!chip8_run_frame(&runahead->ahead, runahead->cycles)) {
+			return CHIP8_FAILURE;
+		}
+	}
+	run_ns = chip8_time_ns() - start_ns;
+	runahead->runs++;
+	runahead->run_ns += run_ns;
+	chip8_hist_record(&runahead->run_time, run_ns);
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Prints the time spent running ahead and its share of a 60 Hz frame.
+ */
+void chip8_print_runahead(FILE* const file,
+		const chip8_runahead runahead[const static 1])
+{
+	const double mean_ns = runahead->runs
+		? (double) runahead->run_ns / runahead->runs : 0;
+
+	chip8_print_hist(file, "run-ahead", &runahead->run_time, 1000.0, "us");
+	fprintf(file, "running %u frames ahead takes %.1f us, %.2f%% of a 60 Hz "
+			"frame\n", runahead->frames, mean_ns / 1000.0,
+			100.0 * mean_ns / CHIP8_FRAME_NS);
+}
@@ -0,0 +1,183 @@
+/*
+ * @file chip8_shm.c
+ * @brief Implements the POSIX shared memory frame and state export.
+ *
+ * The emulator publishes a copy of the machine state once per frame into a
+ * ring of seqlock versioned slots. Publishing is a few stores and a 2 KB
+ * copy without any syscall, readers never block it.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chip8.h"
+#include "chip8_io.h"
+#include "chip8_shm.h"
+
+/*
+ * @brief Creates the shared memory object, an object left behind by an
+ * earlier run is unlinked first so its readers keep their stale mapping
+ * instead of faulting on a truncated one.
+ */
+chip8_rc chip8_open_shm(chip8_shm shm[const static 1], const char* const name)
+{
+	int fd;
+	chip8_shm_ring* ring;
+
+	shm_unlink(name);
+
+	if (-1 == (fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644))) {
+		CHIP8_PERROR("Shared memory creation failed");
+		return CHIP8_FAILURE;
+	} else if (-1 == ftruncate(fd, sizeof(*ring))) {
+		CHIP8_PERROR("Shared memory sizing failed");
+		close(fd);
+		shm_unlink(name);
+		return CHIP8_FAILURE;
+	}
+	ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (MAP_FAILED == ring) {
+		CHIP8_PERROR("Shared memory mapping failed");
+		shm_unlink(name);
+		return CHIP8_FAILURE;
+	}
+	ring->version = CHIP8_SHM_VERSION;
+	ring->slot_count = CHIP8_SHM_SLOTS;
+	ring->slot_size = sizeof(chip8_shm_slot);
+	atomic_store_explicit(&ring->published, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memcpy(ring->magic, CHIP8_SHM_MAGIC, sizeof(ring->magic));
+
+	shm->ring = ring;
+	shm->name = name;
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Publishes the state at the end of a frame into the next slot.
+ */
+void chip8_shm_publish(chip8_shm shm[const static 1],
+		const chip8_vm chip8[const static 1])
+{
+	chip8_shm_ring* const ring = shm->ring;
+
+	if (!ring) {
+		return;
+	}
+	const uint64_t index = atomic_load_explicit(&ring->published,
+			memory_order_relaxed);
+	chip8_shm_slot* const slot = &ring->slots[index % CHIP8_SHM_SLOTS];
+	chip8_shm_state* const state = &slot->state;
+	const unsigned seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+	/* an odd sequence keeps readers from trusting the slot meanwhile */
+	atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	state->index = index;
+	state->frame = chip8->frame;
+	state->pc = chip8->pc;
+	state->sp = chip8->sp;
+	state->idx = chip8->idx;
+	state->keys = chip8->keys;
+	memcpy(state->regs, chip8->regs, sizeof(state->regs));
+	memcpy(state->stack, chip8->stack, sizeof(state->stack));
+	state->dly_tmr = chip8->dly_tmr;
+	state->snd_tmr = chip8->snd_tmr;
+	state->state = chip8->state;
+	state->quirks = chip8->quirks;
+	state->hires = chip8->hires;
+	state->plane = chip8->plane;
+	memcpy(state->gfx, chip8->gfx, sizeof(state->gfx));
+
+	atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+	atomic_store_explicit(&ring->published, index + 1, memory_order_release);
+}
+
+void chip8_close_shm(chip8_shm shm[const static 1])
+{
+	if (!shm->ring) {
+		return;
+	}
+	memset(shm->ring->magic, 0, sizeof(shm->ring->magic));
+	munmap(shm->ring, sizeof(*shm->ring));
+	shm_unlink(shm->name);
+	shm->ring = NULL;
+}
+
+/*
+ * @brief Maps an emulator's shared memory object read-only, returns NULL
+ * when it does not exist or has another layout.
+ */
+chip8_shm_ring* chip8_map_shm(const char name[const static 1])
+{
+	struct stat st;
+	chip8_shm_ring* ring;
+	const int fd = shm_open(name, O_RDONLY, 0);
+
+	if (-1 == fd) {
+		CHIP8_PERROR("Shared memory open failed");
+		return NULL;
+	} else if (-1 == fstat(fd, &st) || sizeof(*ring) != (size_t) st.st_size) {
+		CHIP8_ERR("ERROR::SHM: Shared memory object has an unknown size");
+		close(fd);
+		return NULL;
+	}
+	ring = mmap(NULL, sizeof(*ring), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (MAP_FAILED == ring) {
+		CHIP8_PERROR("Shared memory mapping failed");
+		return NULL;
+	} else if (memcmp(ring->magic, CHIP8_SHM_MAGIC, sizeof(ring->magic))
+	           || CHIP8_SHM_VERSION != ring->version
+	           || CHIP8_SHM_SLOTS != ring->slot_count
+	           || sizeof(chip8_shm_slot) != ring->slot_size) {
+		CHIP8_ERR("ERROR::SHM: Shared memory object has another layout");
+		munmap(ring, sizeof(*ring));
+		return NULL;
+	}
+	return ring;
+}
+
+/*
+ * @brief Copies the state of the given publication, fails when it is not
+ * published yet or its slot was already reused.
+ */
+chip8_rc chip8_shm_read(chip8_shm_ring ring[const static 1],
+		const uint64_t index, chip8_shm_state state[const static 1])
+{
+	const chip8_shm_slot* const slot = &ring->slots[index % CHIP8_SHM_SLOTS];
+	unsigned seq;
+
+	if (index >= atomic_load_explicit(&ring->published, memory_order_acquire)) {
+		return CHIP8_FAILURE;
+	}
+
+	/* the writer holds a slot for a copy's duration, so retrying is short */
+	do {
+		while (1 & (seq = atomic_load_explicit(&slot->seq,
+				memory_order_acquire)));
+		memcpy(state, &slot->state, sizeof(*state));
+		atomic_thread_fence(memory_order_acquire);
+	} while (seq != atomic_load_explicit(&slot->seq, memory_order_relaxed));
+
+	return index == state->index ? CHIP8_SUCCESS : CHIP8_FAILURE;
+}
+
+void chip8_unmap_shm(chip8_shm_ring* const ring)
+{
+	if (ring) {
+		munmap(ring, sizeof(*ring));
+	}
+}
@@ -0,0 +1,560 @@
+/*
+ * @file chip8_stream.c
+ * @brief Implements the delta-encoded display stream for spectator tools.
+ *
+ * The emulation thread only packs the display into the ring when something
+ * was drawn. The writer thread XORs it with the frame the viewer already
+ * has, elides unchanged frames and run-length encodes the rest, which turns
+ * the few bytes a sprite move touches into a handful of bytes on the wire.
+ * Keyframes are sent to every newly attached viewer, on resolution changes
+ * and every CHIP8_STREAM_KEY_INTERVAL frames.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "chip8.h"
+#include "chip8_io.h"
+#include "chip8_stream.h"
+#include "chip8_time.h"
+#include "chip8_dbg.h"
+
+#define CHIP8_STREAM_PAYLOAD 16 /* record offset of the payload */
+#define CHIP8_STREAM_ATTACH_NS (CHIP8_NS_PER_SEC / 20)
+#define CHIP8_STREAM_POLL_MS 100
+
+static size_t chip8_put_varint(chip8_byte dst[const static 1], uint64_t value)
+{
+	size_t size = 0;
+
+	for (; value >= 0x80; value >>= 7) {
+		dst[size++] = value | 0x80;
+	}
+	dst[size++] = value;
+	return size;
+}
+
+/*
+ * @brief Reads a varint, counting the bytes it took.
+ */
+static chip8_rc chip8_get_varint(FILE* const file, uint64_t value[const static 1],
+		uint64_t bytes[const static 1])
+{
+	int byte;
+
+	*value = 0;
+
+	for (unsigned shift = 0; shift < 64; shift += 7) {
+		if (EOF == (byte = getc(file))) {
+			return CHIP8_FAILURE;
+		}
+		++*bytes;
+		*value |= (uint64_t) (byte & 0x7F) << shift;
+
+		if (!(byte & 0x80)) {
+			return CHIP8_SUCCESS;
+		}
+	}
+	return CHIP8_FAILURE;
+}
+
+/*
+ * @brief Starts a zero run at two zero bytes, single zeros are cheaper as
+ * part of a literal.
+ */
+static inline bool chip8_zero_run(const chip8_byte src[const static 1],
+		const size_t i, const size_t size)
+{
+	return !src[i] && (i + 1 == size || !src[i + 1]);
+}
+
+/*
+ * @brief Run-length encodes size bytes, returns the encoded size.
+ */
+static size_t chip8_stream_rle(chip8_byte dst[restrict static 1],
+		const chip8_byte src[restrict static 1], const size_t size)
+{
+	size_t out = 0;
+
+	for (size_t i = 0, j; i < size; i = j) {
+		j = i;
+
+		if (chip8_zero_run(src, i, size)) {
+			while (j < size && !src[j]) {
+				j++;
+			}
+			out += chip8_put_varint(&dst[out], (j - i) << 1);
+		} else {
+			while (j < size && !chip8_zero_run(src, j, size)) {
+				j++;
+			}
+			out += chip8_put_varint(&dst[out], (j - i) << 1 | 1);
+			memcpy(&dst[out], &src[i], j - i);
+			out += j - i;
+		}
+	}
+	return out;
+}
+
+/*
+ * @brief Writes the magic and version a stream starts with.
+ */
+void chip8_stream_header(chip8_byte header[const static
+		CHIP8_STREAM_HEADER_SIZE])
+{
+	memcpy(header, CHIP8_STREAM_MAGIC, 4);
+	header[4] = CHIP8_STREAM_VERSION;
+}
+
+/*
+ * @brief Packs the planes of the current resolution into a stream frame.
+ */
+void chip8_stream_pack(chip8_stream_frame frame[const static 1],
+		const chip8_vm chip8[const static 1])
+{
+	const unsigned words = chip8_gfx_width(chip8) / 64;
+	const unsigned height = chip8_gfx_height(chip8);
+	chip8_byte* dst = frame->bits;
+
+	frame->frame = chip8->frame;
+	frame->hires = chip8->hires;
+
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		for (unsigned y = 0; y < height; y++) {
+			for (unsigned w = 0; w < words; w++) {
+				for (int shift = 56; shift >= 0; shift -= 8) {
+					*dst++ = chip8->gfx[p][y][w] >> shift;
+				}
+			}
+		}
+	}
+}
+
+/*
+ * @brief Writes all of data, waiting for a slow viewer only as long as the
+ * stream keeps running.
+ */
+static chip8_rc chip8_stream_send(chip8_stream stream[const static 1],
+		const chip8_byte* data, size_t size)
+{
+	while (size) {
+		struct pollfd ready = { .fd = stream->fd, .events = POLLOUT };
+		ssize_t written;
+
+		if (poll(&ready, 1, CHIP8_STREAM_POLL_MS) <= 0) {
+			if (!atomic_load_explicit(&stream->running, memory_order_acquire)) {
+				return CHIP8_FAILURE;
+			}
+			continue;
+		} else if ((written = write(stream->fd, data, size)) < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			return CHIP8_FAILURE;
+		}
+		data += written;
+		size -= written;
+		stream->bytes += written;
+	}
+	return CHIP8_SUCCESS;
+}
+
+static void chip8_stream_detach(chip8_stream stream[const static 1])
+{
+	if (0 <= stream->fd) {
+		close(stream->fd);
+		stream->fd = -1;
+	}
+	atomic_store_explicit(&stream->connected, false, memory_order_release);
+}
+
+/*
+ * @brief Sends the stream header to a new viewer, the next record it gets is
+ * a keyframe.
+ */
+static chip8_rc chip8_stream_start(chip8_stream stream[const static 1])
+{
+	chip8_byte header[CHIP8_STREAM_HEADER_SIZE];
+
+	chip8_stream_header(header);
+
+	if (!chip8_stream_send(stream, header, sizeof(header))) {
+		return CHIP8_FAILURE;
+	}
+	stream->encoder.synced = false;
+	atomic_store_explicit(&stream->connected, true, memory_order_release);
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Attaches the next viewer connecting to the socket or opening the
+ * FIFO, which gets the stream header and then a keyframe.
+ */
+static chip8_rc chip8_stream_attach(chip8_stream stream[const static 1])
+{
+	const uint64_t now_ns = chip8_time_ns();
+	int flags;
+
+	if (0 <= stream->fd) {
+		return CHIP8_SUCCESS;
+	} else if (now_ns < stream->attach_ns) {
+		return CHIP8_FAILURE;
+	}
+	stream->attach_ns = now_ns + CHIP8_STREAM_ATTACH_NS;
+
+	if (0 <= stream->listen_fd) {
+		stream->fd = accept(stream->listen_fd, NULL, NULL);
+	} else if (stream->path) {
+		/* without a reader opening a FIFO fails instead of blocking */
+		stream->fd = open(stream->path, O_WRONLY | O_NONBLOCK);
+	}
+
+	if (0 > stream->fd) {
+		return CHIP8_FAILURE;
+	} else if (-1 != (flags = fcntl(stream->fd, F_GETFL))) {
+		fcntl(stream->fd, F_SETFL, flags & ~O_NONBLOCK);
+	}
+
+	if (!chip8_stream_start(stream)) {
+		chip8_stream_detach(stream);
+		return CHIP8_FAILURE;
+	}
+	CHIP8_DBG("Stream viewer attached");
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Encodes the next frame as a keyframe or delta record for a viewer
+ * with the encoder's last frame, returns the record size.
+ *
+ * Returns 0 when the frame matches the last one and nothing needs to be
+ * sent. Otherwise the record is assumed to reach the viewer, which then
+ * has the new frame.
+ */
+size_t chip8_stream_encode(chip8_stream_encoder encoder[const static 1],
+		const chip8_stream_frame next[const static 1],
+		chip8_byte record[const static CHIP8_STREAM_RECORD_SIZE])
+{
+	const size_t size = CHIP8_GFX_PLANES * chip8_stream_plane_size(next->hires);
+	chip8_byte* const payload = &record[CHIP8_STREAM_PAYLOAD];
+	chip8_byte flags = next->hires ? CHIP8_STREAM_HIRES : 0;
+	size_t length;
+	size_t header_size = 1;
+
+	if (!encoder->synced || next->hires != encoder->last.hires
+	    || next->frame - encoder->key_frame >= CHIP8_STREAM_KEY_INTERVAL) {
+		flags |= CHIP8_STREAM_KEY;
+	} else if (!memcmp(next->bits, encoder->last.bits, size)) {
+		return 0;
+	}
+
+	if (!(flags & CHIP8_STREAM_KEY)) {
+		for (size_t i = 0; i < size; i++) {
+			encoder->delta[i] = next->bits[i] ^ encoder->last.bits[i];
+		}
+		length = chip8_stream_rle(payload, encoder->delta, size);
+
+		/* a delta of a mostly redrawn display can be larger than the frame */
+		if (length > size / 4) {
+			const size_t key_length = chip8_stream_rle(encoder->delta,
+					next->bits, size);
+
+			if (key_length < length) {
+				memcpy(payload, encoder->delta, key_length);
+				length = key_length;
+				flags |= CHIP8_STREAM_KEY;
+			}
+		}
+	} else {
+		length = chip8_stream_rle(payload, next->bits, size);
+	}
+
+	record[0] = flags;
+	header_size += chip8_put_varint(&record[header_size], next->frame);
+	header_size += chip8_put_varint(&record[header_size], length);
+	memmove(&record[header_size], payload, length);
+
+	if (flags & CHIP8_STREAM_KEY) {
+		encoder->key_frame = next->frame;
+		encoder->keyframes++;
+	}
+	encoder->last = *next;
+	encoder->synced = true;
+	return header_size + length;
+}
+
+/*
+ * @brief Writer thread encoding queued frames while a viewer is attached and
+ * discarding them otherwise.
+ */
+static void* chip8_stream_thread(void* const arg)
+{
+	chip8_stream* const stream = arg;
+	sigset_t pipe;
+	size_t size;
+
+	/* a viewer going away fails the write with EPIPE instead of a signal */
+	sigemptyset(&pipe);
+	sigaddset(&pipe, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipe, NULL);
+
+	while (atomic_load_explicit(&stream->running, memory_order_acquire)
+	       || (0 <= stream->fd && sizeof(stream->next)
+	           <= chip8_ring_readable(&stream->ring))) {
+		if (sizeof(stream->next) > chip8_ring_readable(&stream->ring)) {
+			chip8_stream_attach(stream);
+			chip8_sleep_until(chip8_time_ns() + CHIP8_NS_PER_SEC / 1000);
+			continue;
+		}
+		chip8_ring_read(&stream->ring, &stream->next, sizeof(stream->next));
+
+		if (!chip8_stream_attach(stream)
+		    || !(size = chip8_stream_encode(&stream->encoder, &stream->next,
+				stream->record))) {
+			continue;
+		} else if (!chip8_stream_send(stream, stream->record, size)) {
+			CHIP8_DBG("Stream viewer detached");
+			chip8_stream_detach(stream);
+		} else {
+			stream->frames++;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * @brief Creates a Unix socket listening for viewers, replacing a stale
+ * socket left at the path.
+ */
+static int chip8_stream_listen(const char* const path)
+{
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	struct stat status;
+	int fd;
+
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "great_chip-8::ERROR::STREAM: Socket path too long "
+				"%s\n", path);
+		return -1;
+	} else if (!stat(path, &status) && S_ISSOCK(status.st_mode)) {
+		unlink(path);
+	}
+	strcpy(address.sun_path, path);
+
+	if (0 > (fd = socket(AF_UNIX, SOCK_STREAM, 0))) {
+		CHIP8_PERROR("Stream socket creation failed");
+		return -1;
+	} else if (bind(fd, (struct sockaddr*) &address, sizeof(address))
+	           || listen(fd, 1)
+	           || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK)) {
+		CHIP8_PERROR("Stream socket setup failed");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * @brief Opens the stream output and starts the writer thread.
+ *
+ * The output is "-" for standard output, "unix:<path>" for a Unix socket
+ * serving one viewer at a time, or the path of a FIFO or a file. FIFO
+ * readers may come and go, each one starts with a keyframe.
+ */
+chip8_rc chip8_open_stream(chip8_stream stream[const static 1],
+		const char* const spec)
+{
+	struct stat status;
+
+	memset(stream, 0, sizeof(*stream));
+	stream->fd = -1;
+	stream->listen_fd = -1;
+	atomic_init(&stream->running, true);
+	atomic_init(&stream->connected, false);
+
+	if (!strncmp(spec, "unix:", 5)) {
+		stream->path = strchr(spec, ':') + 1;
+
+		if (0 > (stream->listen_fd = chip8_stream_listen(stream->path))) {
+			return CHIP8_FAILURE;
+		}
+	} else if (strcmp(spec, "-") && !stat(spec, &status)
+	           && S_ISFIFO(status.st_mode)) {
+		stream->path = spec;
+	} else if (0 > (stream->fd = strcmp(spec, "-")
+			? open(spec, O_WRONLY | O_CREAT | O_TRUNC, 0644)
+			: dup(STDOUT_FILENO))) {
+		CHIP8_PERROR("Stream output open failed");
+		return CHIP8_FAILURE;
+	}
+
+	if (!chip8_init_ring(&stream->ring,
+			CHIP8_STREAM_QUEUE * sizeof(chip8_stream_frame))) {
+		goto ERROR;
+	} else if (0 <= stream->fd && !chip8_stream_start(stream)) {
+		/* files and standard output are attached from the start */
+		CHIP8_PERROR("Stream header write failed");
+		chip8_free_ring(&stream->ring);
+		goto ERROR;
+	} else if (pthread_create(&stream->thread, NULL, chip8_stream_thread,
+			stream)) {
+		CHIP8_ERR("ERROR::STREAM: Thread creation failed");
+		chip8_free_ring(&stream->ring);
+		goto ERROR;
+	}
+	return CHIP8_SUCCESS;
+
+ERROR:
+	if (0 <= stream->fd) {
+		close(stream->fd);
+	}
+	if (0 <= stream->listen_fd) {
+		close(stream->listen_fd);
+	}
+	return CHIP8_FAILURE;
+}
+
+/*
+ * @brief Queues the display for the writer thread when it differs from the
+ * last queued one or the attached viewer has not been sent the current
+ * display yet.
+ *
+ * Called from the emulation thread only, a full ring drops the frame.
+ */
+void chip8_stream_push(chip8_stream stream[const static 1],
+		const chip8_vm chip8[const static 1])
+{
+	chip8_stream_frame frame;
+
+	if (!atomic_load_explicit(&stream->connected, memory_order_acquire)) {
+		stream->primed = false;
+		return;
+	} else if (stream->primed && (!chip8->draw_flag
+	           || chip8_gfx_hash(chip8) == stream->gfx_hash)) {
+		return;
+	} else if (sizeof(frame) > chip8_ring_writable(&stream->ring)) {
+		stream->dropped++;
+		stream->primed = false;
+		return;
+	}
+	chip8_stream_pack(&frame, chip8);
+	chip8_ring_write(&stream->ring, &frame, sizeof(frame));
+	stream->gfx_hash = chip8_gfx_hash(chip8);
+	stream->primed = true;
+}
+
+/*
+ * @brief Stops the writer thread once queued frames are written and closes
+ * the output.
+ */
+void chip8_close_stream(chip8_stream stream[const static 1])
+{
+	if (!stream->ring.data) {
+		return;
+	}
+	atomic_store_explicit(&stream->running, false, memory_order_release);
+	pthread_join(stream->thread, NULL);
+	chip8_stream_detach(stream);
+
+	if (0 <= stream->listen_fd) {
+		close(stream->listen_fd);
+		unlink(stream->path);
+	}
+	chip8_free_ring(&stream->ring);
+	CHIP8_DBG("Stream closed after %" PRIu64 " records, %" PRIu64
+			" keyframes, %" PRIu64 " bytes, %" PRIu64 " dropped",
+			stream->frames, stream->encoder.keyframes, stream->bytes,
+			stream->dropped);
+}
+
+/*
+ * @brief Checks the magic and version a stream starts with.
+ */
+chip8_rc chip8_stream_read_header(FILE* const file)
+{
+	chip8_byte header[CHIP8_STREAM_HEADER_SIZE];
+
+	return 1 == fread(header, sizeof(header), 1, file)
+		&& !memcmp(header, CHIP8_STREAM_MAGIC, 4)
+		&& CHIP8_STREAM_VERSION == header[4] ? CHIP8_SUCCESS : CHIP8_FAILURE;
+}
+
+/*
+ * @brief Reads the next record and applies it to the current frame.
+ *
+ * Fails at the end of the stream and on malformed records. Deltas read
+ * before the first keyframe leave the decoder unsynced.
+ */
+chip8_rc chip8_stream_decode(chip8_stream_decoder decoder[const static 1],
+		FILE* const file)
+{
+	chip8_stream_frame* const current = &decoder->current;
+	uint64_t frame;
+	uint64_t length;
+	int flags;
+	bool hires;
+	size_t size;
+	size_t out = 0;
+
+	if (EOF == (flags = getc(file))
+	    || !chip8_get_varint(file, &frame, &decoder->bytes)
+	    || !chip8_get_varint(file, &length, &decoder->bytes)
+	    || CHIP8_STREAM_RECORD_SIZE < length
+	    || (length && 1 != fread(decoder->record, length, 1, file))) {
+		return CHIP8_FAILURE;
+	}
+	hires = flags & CHIP8_STREAM_HIRES;
+	size = CHIP8_GFX_PLANES * chip8_stream_plane_size(hires);
+	decoder->bytes += 1 + length;
+
+	if (!(flags & CHIP8_STREAM_KEY) && (!decoder->synced
+	    || hires != current->hires)) {
+		decoder->synced = false;
+		return CHIP8_SUCCESS;
+	}
+
+	for (size_t in = 0; in < length;) {
+		uint64_t token = 0;
+		uint64_t count;
+
+		for (unsigned shift = 0; in < length && shift < 64; shift += 7) {
+			token |= (uint64_t) (decoder->record[in] & 0x7F) << shift;
+
+			if (!(decoder->record[in++] & 0x80)) {
+				break;
+			}
+		}
+		count = token >> 1;
+
+		if (count > size - out || (token & 1 && count > length - in)) {
+			return CHIP8_FAILURE;
+		}
+
+		for (uint64_t i = 0; i < count; i++, out++) {
+			const chip8_byte byte = token & 1 ? decoder->record[in++] : 0;
+
+			current->bits[out] = flags & CHIP8_STREAM_KEY ? byte
+				: current->bits[out] ^ byte;
+		}
+	}
+
+	if (size != out) {
+		return CHIP8_FAILURE;
+	}
+	current->frame = frame;
+	current->hires = hires;
+	decoder->synced = true;
+	return CHIP8_SUCCESS;
+}
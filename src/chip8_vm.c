@@ -0,0 +1,362 @@
+/*
+ * @file chip8_vm.c
+ * @brief Implements the chip-8 virtual machine core.
+ *
+ * This contains construction of the virtual machine, the fetch-execute
+ * cycle and the frame loop driving the timers at 60 Hz.
+ * Nothing in here depends on a window or input library, hosts feed key state
+ * in through chip8_set_key() between frames.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_io.h"
+#include "chip8_istr.h"
+#include "chip8_embed.h"
+#include "chip8_trace.h"
+#include "chip8_dbg.h"
+
+/* unwritten memory of every machine, never counted nor freed */
+static chip8_page chip8_zero_page;
+
+/*
+ * @brief Allocates a virtual machine with both fonts loaded into memory.
+ */
+chip8_vm* chip8_new_vm(void)
+{
+	chip8_vm* chip8 = aligned_alloc(_Alignof(chip8_vm), sizeof(*chip8));
+
+	if (!chip8) {
+		CHIP8_ERR("ERROR::Memory allocation failed");
+		return NULL;
+	}
+	memset(chip8, 0, sizeof(*chip8));
+	chip8->pc = CHIP8_ROM_ADDR;
+	chip8->sp = 0;
+	chip8->idx = 0;
+	chip8->plane = 1;
+	chip8->pitch = 64;
+	chip8_seed(chip8, 0);
+
+	for (unsigned i = 0; i < CHIP8_COW_PAGES; i++) {
+		chip8->pages[i] = &chip8_zero_page;
+	}
+
+	if (!chip8_mem_load(chip8, CHIP8_FONT_ADDR, chip8_font, sizeof(chip8_font))
+	    || !chip8_mem_load(chip8, CHIP8_BIG_FONT_ADDR, chip8_big_font,
+			sizeof(chip8_big_font))) {
+		chip8_free_vm(chip8);
+		return NULL;
+	}
+	return chip8;
+}
+
+/*
+ * @brief Unmaps a page, freeing it with its last mapping.
+ */
+static inline void chip8_release_page(chip8_page* const page)
+{
+	if (page && page != &chip8_zero_page && 1 == atomic_fetch_sub_explicit(
+			&page->refs, 1, memory_order_acq_rel)) {
+		free(page);
+	}
+}
+
+/*
+ * @brief Gives the machine a private copy of a memory page it shares,
+ * returns NULL and halts the machine when the copy cannot be allocated.
+ */
+chip8_page* chip8_own_page(chip8_vm chip8[const static 1], const unsigned index)
+{
+	chip8_page* const shared = chip8->pages[index];
+	chip8_page* page;
+
+	if (1 == atomic_load_explicit(&shared->refs, memory_order_acquire)) {
+		return shared;
+	} else if (!(page = malloc(sizeof(*page)))) {
+		CHIP8_PERROR("Memory page allocation failed");
+		chip8->state = CHIP8_HALTED;
+		return NULL;
+	}
+	memcpy(page->data, shared->data, sizeof(page->data));
+	atomic_init(&page->refs, 1);
+	chip8->pages[index] = page;
+	chip8_release_page(shared);
+	return page;
+}
+
+/*
+ * @brief Copies a machine, the copy shares all memory pages with the
+ * original until either writes to them. Pages the destination already maps
+ * are kept and pages it owns alone are overwritten in place, so restoring a
+ * snapshot costs about the pages written since. The destination may also be
+ * zeroed memory that never held a machine.
+ */
+void chip8_copy_vm(chip8_vm dst[restrict const static 1],
+		const chip8_vm src[restrict const static 1])
+{
+	chip8_page* pages[CHIP8_COW_PAGES];
+
+	for (unsigned i = 0; i < CHIP8_COW_PAGES; i++) {
+		chip8_page* const page = dst->pages[i];
+
+		pages[i] = src->pages[i];
+
+		if (page == src->pages[i]) {
+			continue;
+		} else if (page && 1 == atomic_load_explicit(&page->refs,
+				memory_order_acquire)) {
+			memcpy(page->data, src->pages[i]->data, sizeof(page->data));
+			pages[i] = page;
+			continue;
+		} else if (&chip8_zero_page != src->pages[i]) {
+			atomic_fetch_add_explicit(&src->pages[i]->refs, 1,
+					memory_order_relaxed);
+		}
+		chip8_release_page(page);
+	}
+	*dst = *src;
+	memcpy(dst->pages, pages, sizeof(pages));
+}
+
+/*
+ * @brief Releases the memory pages of a machine embedded in another
+ * structure, its memory reads as zeroes afterwards.
+ */
+void chip8_drop_vm(chip8_vm chip8[const static 1])
+{
+	for (unsigned i = 0; i < CHIP8_COW_PAGES; i++) {
+		chip8_release_page(chip8->pages[i]);
+		chip8->pages[i] = &chip8_zero_page;
+	}
+}
+
+void chip8_free_vm(chip8_vm* const chip8)
+{
+	if (chip8) {
+		chip8_drop_vm(chip8);
+		free(chip8);
+	}
+}
+
+/*
+ * @brief Copies a block into memory starting at addr, without marking
+ * pages dirty, returns whether its pages could be allocated.
+ */
+chip8_rc chip8_mem_load(chip8_vm chip8[const static 1], unsigned addr,
+		const void* const src, size_t size)
+{
+	const chip8_byte* bytes = src;
+
+	while (size) {
+		const unsigned offset = addr & (CHIP8_COW_SIZE-1);
+		const size_t count = size < CHIP8_COW_SIZE - offset ? size
+			: CHIP8_COW_SIZE - offset;
+		chip8_page* const page = chip8_own_page(chip8,
+				addr >> CHIP8_COW_SHIFT & (CHIP8_COW_PAGES-1));
+
+		if (!page) {
+			return CHIP8_FAILURE;
+		}
+		memcpy(&page->data[offset], bytes, count);
+		addr += count;
+		bytes += count;
+		size -= count;
+	}
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Fetch next instruction from loaded chip-8 ROM.
+ */
+static inline chip8_word chip8_fetch(chip8_vm chip8[const static 1])
+{
+	const unsigned offset = chip8->pc & (CHIP8_COW_SIZE-1);
+
+	/* both bytes come from one page lookup unless they straddle pages */
+	if (CHIP8_COW_SIZE-1 != offset) {
+		const chip8_byte* const data =
+			chip8->pages[chip8->pc >> CHIP8_COW_SHIFT]->data;
+
+		CHIP8_CHECK(chip8, chip8->pc+1u < chip8_mem_size(chip8),
+				CHIP8_FAULT_MEM);
+		return data[offset] << 8 | data[offset+1];
+	}
+	return chip8_mem_read(chip8, chip8->pc) << 8
+		| chip8_mem_read(chip8, chip8->pc+1);
+}
+
+/*
+ * @brief Fetches, disassembles and executes a single instruction, counting
+ * it by opcode when given counts. Inlined with constant counts, so the
+ * uncounted frame loop has no trace of the counting.
+ */
+static inline chip8_rc chip8_exec(chip8_vm chip8[const static 1],
+		uint32_t* const counts)
+{
+	chip8_opcode opcode;
+
+	if (CHIP8_WAITING_KEY == chip8->state) {
+		return CHIP8_SUCCESS;
+	}
+	chip8->istr = chip8_fetch(chip8);
+	opcode = chip8_disassemble(chip8->istr);
+	CHIP8_TRACE2(istr, chip8->pc, chip8->istr);
+
+	if (NOP == opcode) {
+		return CHIP8_FAILURE;
+	} else if (counts) {
+		counts[opcode]++;
+	}
+	chip8_istr_set[chip8->quirks][opcode](chip8);
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Fetches, disassembles and executes a single instruction.
+ */
+chip8_rc chip8_step(chip8_vm chip8[const static 1])
+{
+	return chip8_exec(chip8, NULL);
+}
+
+/*
+ * @brief Executes a single instruction like chip8_step(), adding it to
+ * counts, CHIP8_ISTR_SET_SIZE entries by opcode.
+ */
+chip8_rc chip8_count_step(chip8_vm chip8[const static 1],
+		uint32_t counts[const])
+{
+	return chip8_exec(chip8, counts);
+}
+
+/*
+ * @brief Seeds the random number generator of CXNN, zero selects a fixed
+ * default seed.
+ */
+void chip8_seed(chip8_vm chip8[const static 1], const uint32_t seed)
+{
+	chip8->rng = seed ? seed : 0x2545F491;
+}
+
+/*
+ * @brief Counts the delay and sound timers down once.
+ */
+void chip8_tick_timers(chip8_vm chip8[const static 1])
+{
+	CHIP8_TRACE2(timers, chip8->dly_tmr, chip8->snd_tmr);
+
+	if (chip8->dly_tmr) {
+		chip8->dly_tmr--;
+	}
+
+	if (chip8->snd_tmr) {
+		chip8->snd_tmr--;
+	}
+}
+
+/*
+ * @brief Starts an emulated 60 Hz frame, counting the timers down once.
+ *
+ * Timers tick at the start of the frame, so a sound timer still set once the
+ * frame has run means the beep sounds for the next 1/60 s.
+ */
+void chip8_start_frame(chip8_vm chip8[const static 1])
+{
+	CHIP8_TRACE1(frame_start, chip8->frame);
+	chip8_tick_timers(chip8);
+}
+
+/*
+ * @brief Ends the frame started by chip8_start_frame() once its
+ * instructions ran.
+ */
+void chip8_end_frame(chip8_vm chip8[const static 1])
+{
+	/* a scroll moved every row, rehash once instead of after each scroll */
+	if (chip8->gfx_stale) {
+		chip8->gfx_hash = chip8_rehash_gfx(chip8);
+		chip8->gfx_stale = false;
+	}
+	CHIP8_TRACE1(frame_end, chip8->frame);
+	chip8->frame++;
+}
+
+/*
+ * @brief Runs one emulated 60 Hz frame of the given number of instructions.
+ *
+ * The frame ends early when FX0A starts waiting for a key, the timers keep
+ * counting down while it waits.
+ */
+static inline chip8_rc chip8_run(chip8_vm chip8[const static 1],
+		const unsigned cycles, uint32_t* const counts)
+{
+	chip8_start_frame(chip8);
+
+	for (unsigned i = 0; i < cycles && CHIP8_RUNNING == chip8->state; i++) {
+		if (!chip8_exec(chip8, counts)) {
+			return CHIP8_FAILURE;
+		}
+	}
+	chip8_end_frame(chip8);
+	return CHIP8_SUCCESS;
+}
+
+chip8_rc chip8_run_frame(chip8_vm chip8[const static 1], const unsigned cycles)
+{
+	return chip8_run(chip8, cycles, NULL);
+}
+
+/*
+ * @brief Runs one frame like chip8_run_frame(), adding the instructions it
+ * executed to counts, CHIP8_ISTR_SET_SIZE entries by opcode.
+ */
+chip8_rc chip8_count_frame(chip8_vm chip8[const static 1],
+		const unsigned cycles, uint32_t counts[const])
+{
+	return chip8_run(chip8, cycles, counts);
+}
+
+/*
+ * @brief Sets the state of a single key on the keypad.
+ *
+ * A press or release edge completes a pending FX0A, storing the key and
+ * moving past the instruction.
+ */
+void chip8_set_key(chip8_vm chip8[const static 1], const chip8_key key,
+		const bool pressed)
+{
+	if (CHIP8_WAITING_KEY == chip8->state
+	    && pressed != (chip8->keys >> key & 1)) {
+		chip8->regs[chip8->wait_reg] = key;
+		chip8->keys_read |= 1 << key;
+		chip8->pc += 2;
+		chip8->state = CHIP8_RUNNING;
+		CHIP8_TRACE1(key_resume, key);
+	}
+
+	if (pressed) {
+		chip8->keys |= 1 << key;
+	} else {
+		chip8->keys &= ~(1 << key);
+	}
+}
+
+/*
+ * @brief Hashes the whole display from scratch, the value gfx_hash is kept
+ * at by the instructions changing it unless gfx_stale is set.
+ */
+uint64_t chip8_rehash_gfx(const chip8_vm chip8[const static 1])
+{
+	uint64_t hash = 0;
+
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		for (unsigned y = 0; y < CHIP8_GFX_HIRES_HEIGHT; y++) {
+			hash ^= chip8_gfx_row_hash(p, y, chip8->gfx[p][y]);
+		}
+	}
+	return hash;
+}
@@ -1,10 +1,15 @@
 #version 330 core
 
+in vec2 texcoord;
+
 out vec4 color;
 
-uniform vec3 sprite_color;
+uniform usampler2D display; /* color index per pixel */
+uniform vec3 palette[4];
 
 void main()
 {
-	color = vec4(sprite_color, 1.0f);
+	ivec2 texel = ivec2(texcoord * vec2(textureSize(display, 0)));
+
+	color = vec4(palette[texelFetch(display, texel, 0).r], 1.0f);
 }
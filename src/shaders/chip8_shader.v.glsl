@@ -2,10 +2,10 @@
 
 layout (location = 0) in vec2 vertex; /* vertex <x, y> coordinates */
 
-uniform mat4 projection;
-uniform mat4 model;
+out vec2 texcoord; /* display texture coordinates */
 
 void main()
 {
-    gl_Position = projection * model * vec4(vertex, 0.0f, 1.0f);
+    texcoord = vertex;
+    gl_Position = vec4(2.0f * vertex.x - 1.0f, 1.0f - 2.0f * vertex.y, 0.0f, 1.0f);
 }
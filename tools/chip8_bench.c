@@ -0,0 +1,178 @@
+/*
+ * @file chip8_bench.c
+ * @brief Measures how fast the core emulates frames without a window.
+ *
+ * Each ROM runs for a fixed number of 60 Hz frames at the given number of
+ * instructions per frame with the keypad cycling through every key, so ROMs
+ * waiting on FX0A keep running. Without ROM arguments a synthesized
+ * stress ROM drawing 16x16 sprites and scrolling on both XO-CHIP planes in
+ * high resolution every iteration is measured instead. With -r every frame
+ * is also run ahead that many frames on a copy, as the front end does, and
+ * the frame time includes it.
+ *
+ * usage: chip8_bench [-c cycles] [-n frames] [-r frames] [rom...]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "chip8.h"
+#include "chip8_rom.h"
+#include "chip8_runahead.h"
+#include "chip8_time.h"
+
+#define CHIP8_BENCH_CYCLES 1000
+#define CHIP8_BENCH_FRAMES 600
+
+/* two plane high resolution stress loop, I points at the sprites after it */
+static const chip8_word chip8_bench_rom[] = {
+	0x00FF, /* 0x200 HIRES */
+	0xF301, /* 0x202 PLANE 3 */
+	0x6000, /* 0x204 MOVI V0, 0 */
+	0x6100, /* 0x206 MOVI V1, 0 */
+	0xA220, /* 0x208 MIV 0x220 */
+	0xD010, /* 0x20A DRWBIG V0, V1 */
+	0x7003, /* 0x20C ADDI V0, 3 */
+	0x7105, /* 0x20E ADDI V1, 5 */
+	0xD01A, /* 0x210 DRWSPT V0, V1, 10 */
+	0x00C1, /* 0x212 SCD 1 */
+	0x00FB, /* 0x214 SCR */
+	0x00FC, /* 0x216 SCL */
+	0x8204, /* 0x218 ADD V2, V0 */
+	0x3200, /* 0x21A SKPEI V2, 0 */
+	0x7301, /* 0x21C ADDI V3, 1 */
+	0x120A, /* 0x21E JMP 0x20A */
+	0xFFFF, 0x8001, 0xBFFD, 0xA005, 0xAFF5, 0xA815, 0xABD5, 0xAA55,
+	0xAA55, 0xABD5, 0xA815, 0xAFF5, 0xA005, 0xBFFD, 0x8001, 0xFFFF,
+	0x0000, 0x7FFE, 0x4002, 0x5FFA, 0x500A, 0x57EA, 0x542A, 0x55AA,
+	0x55AA, 0x542A, 0x57EA, 0x500A, 0x5FFA, 0x4002, 0x7FFE, 0x0000
+};
+
+/*
+ * @brief Loads the synthesized stress ROM in place of a ROM file.
+ */
+static void chip8_load_bench_rom(chip8_vm chip8[const static 1])
+{
+	for (size_t i = 0; i < sizeof(chip8_bench_rom) / sizeof(*chip8_bench_rom);
+			i++) {
+		const chip8_byte istr[] = {
+			chip8_bench_rom[i] >> 8, chip8_bench_rom[i] & 0xFF
+		};
+
+		chip8_mem_load(chip8, CHIP8_ROM_ADDR+2*i, istr, sizeof(istr));
+	}
+	chip8->quirks = CHIP8_QUIRKS_MODERN;
+}
+
+/*
+ * @brief Runs a single ROM and prints its frame time statistics, returns
+ * whether it ran at full speed on average.
+ */
+static chip8_rc chip8_bench(const char* const rom_path, const unsigned cycles,
+		const unsigned frames, const unsigned ahead)
+{
+	uint64_t total_ns = 0;
+	uint64_t worst_ns = 0;
+	double mean_ns;
+	chip8_runahead runahead;
+	chip8_vm* const chip8 = chip8_new_vm();
+
+	if (!chip8) {
+		return CHIP8_FAILURE;
+	} else if (!chip8_init_runahead(&runahead, ahead, cycles)) {
+		chip8_free_vm(chip8);
+		return CHIP8_FAILURE;
+	} else if (rom_path && !chip8_load_rom(chip8, rom_path)) {
+		fprintf(stderr, "%s: ROM load failed\n", rom_path);
+		chip8_free_vm(chip8);
+		chip8_free_runahead(&runahead);
+		return CHIP8_FAILURE;
+	} else if (!rom_path) {
+		chip8_load_bench_rom(chip8);
+	}
+
+	for (unsigned i = 0; i < frames && CHIP8_HALTED != chip8->state; i++) {
+		const uint64_t start_ns = chip8_time_ns();
+		uint64_t frame_ns;
+
+		chip8_set_key(chip8, i / 4 % CHIP8_KEY_SIZE, i % 4 < 2);
+
+		if (!chip8_run_frame(chip8, cycles)) {
+			fprintf(stderr, "%s: invalid instruction 0x%04X at 0x%04X\n",
+					rom_path ? rom_path : "stress", chip8->istr, chip8->pc);
+			break;
+		} else if (ahead && !chip8_run_ahead(&runahead, chip8)) {
+			fprintf(stderr, "%s: invalid instruction 0x%04X at 0x%04X ahead\n",
+					rom_path ? rom_path : "stress", runahead.ahead.istr,
+					runahead.ahead.pc);
+			break;
+		}
+		frame_ns = chip8_time_ns() - start_ns;
+		total_ns += frame_ns;
+		worst_ns = worst_ns < frame_ns ? frame_ns : worst_ns;
+	}
+	mean_ns = (double) total_ns / (chip8->frame ? chip8->frame : 1);
+
+	/* instruction rate is an upper bound for frames cut short by FX0A */
+	printf("%-28s %6s %8.2f us/frame %8.2f us worst %8.1f M istr/s "
+			"%8.1fx realtime\n", rom_path ? rom_path : "stress",
+			chip8->hires ? "hires" : "lores", mean_ns / 1000.0,
+			worst_ns / 1000.0, cycles * (ahead + 1) * 1000.0 / mean_ns,
+			CHIP8_FRAME_NS / mean_ns);
+
+	if (ahead) {
+		chip8_print_runahead(stdout, &runahead);
+	}
+	chip8_free_runahead(&runahead);
+	chip8_free_vm(chip8);
+	return mean_ns < CHIP8_FRAME_NS ? CHIP8_SUCCESS : CHIP8_FAILURE;
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	unsigned cycles = CHIP8_BENCH_CYCLES;
+	unsigned frames = CHIP8_BENCH_FRAMES;
+	unsigned ahead = 0;
+	int exit_state = EXIT_SUCCESS;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "c:n:r:"))) {
+		switch (opt) {
+			case 'c':
+				cycles = strtoul(optarg, NULL, 0);
+				break;
+			case 'n':
+				frames = strtoul(optarg, NULL, 0);
+				break;
+			case 'r':
+				ahead = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-c cycles] [-n frames] [-r frames] "
+						"[rom...]\n",
+						argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	printf("%u frames of %u instructions", frames, cycles);
+
+	if (ahead) {
+		printf(", each run %u frames ahead", ahead);
+	}
+	putchar('\n');
+
+	if (optind == argc && !chip8_bench(NULL, cycles, frames, ahead)) {
+		exit_state = EXIT_FAILURE;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		if (!chip8_bench(argv[i], cycles, frames, ahead)) {
+			exit_state = EXIT_FAILURE;
+		}
+	}
+	return exit_state;
+}
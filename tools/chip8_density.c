@@ -0,0 +1,142 @@
+/*
+ * @file chip8_density.c
+ * @brief Measures the resident memory of many instances of one ROM.
+ *
+ * Every instance is copied from one loaded machine, seeded differently and
+ * run for a number of frames with the keypad cycling through every key.
+ * The resident set growth is reported per instance after copying and after
+ * running, next to the memory the instances' own pages account for and the
+ * size a machine with flat 64 KB memory would have.
+ *
+ * usage: chip8_density [-n instances] [-f frames] rom
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "chip8_rom.h"
+#include "chip8_time.h"
+
+#define CHIP8_DENSITY_INSTANCES 100000
+#define CHIP8_DENSITY_FRAMES 60
+
+/*
+ * @brief Returns the resident set size of the process in bytes, 0 where
+ * /proc is not available.
+ */
+static size_t chip8_resident(void)
+{
+	unsigned long pages = 0;
+	FILE* const statm = fopen("/proc/self/statm", "r");
+
+	if (!statm) {
+		return 0;
+	} else if (1 != fscanf(statm, "%*u %lu", &pages)) {
+		pages = 0;
+	}
+	fclose(statm);
+	return pages * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * @brief Counts the memory pages a machine alone maps.
+ */
+static unsigned chip8_private_pages(const chip8_vm chip8[const static 1])
+{
+	unsigned count = 0;
+
+	for (unsigned i = 0; i < CHIP8_COW_PAGES; i++) {
+		count += 1 == atomic_load_explicit(&chip8->pages[i]->refs,
+				memory_order_relaxed);
+	}
+	return count;
+}
+
+static int chip8_density_usage(const char program[static 1])
+{
+	fprintf(stderr, "usage: %s [-n instances] [-f frames] rom\n", program);
+	return EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	unsigned count = CHIP8_DENSITY_INSTANCES;
+	unsigned frames = CHIP8_DENSITY_FRAMES;
+	uint64_t private = 0;
+	chip8_vm* rom;
+	chip8_vm* vms;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "n:f:"))) {
+		switch (opt) {
+			case 'n':
+				count = strtoul(optarg, NULL, 0);
+				break;
+			case 'f':
+				frames = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				return chip8_density_usage(argv[0]);
+		}
+	}
+
+	if (optind + 1 != argc || !count) {
+		return chip8_density_usage(argv[0]);
+	} else if (!(rom = chip8_new_vm())) {
+		return EXIT_FAILURE;
+	} else if (!chip8_load_rom(rom, argv[optind])) {
+		fprintf(stderr, "%s: ROM load failed\n", argv[optind]);
+		chip8_free_vm(rom);
+		return EXIT_FAILURE;
+	}
+	const size_t base = chip8_resident();
+
+	if (!(vms = aligned_alloc(_Alignof(chip8_vm), count * sizeof(*vms)))) {
+		perror("chip8_density");
+		chip8_free_vm(rom);
+		return EXIT_FAILURE;
+	}
+	memset(vms, 0, count * sizeof(*vms));
+
+	for (unsigned i = 0; i < count; i++) {
+		chip8_copy_vm(&vms[i], rom);
+		chip8_seed(&vms[i], i + 1);
+	}
+	const size_t copied = chip8_resident();
+	const uint64_t start_ns = chip8_time_ns();
+
+	for (unsigned i = 0; i < count; i++) {
+		for (unsigned f = 0; f < frames && CHIP8_HALTED != vms[i].state; f++) {
+			chip8_set_key(&vms[i], (i + f / 4) % CHIP8_KEY_SIZE, f % 4 < 2);
+			chip8_run_frame(&vms[i], CHIP8_CYCLES_PER_FRAME);
+		}
+		private += chip8_private_pages(&vms[i]);
+	}
+	const double run_s = (chip8_time_ns() - start_ns)
+		/ (double) CHIP8_NS_PER_SEC;
+	const size_t ran = chip8_resident();
+
+	printf("%s: %u instances, %u frames in %.2f s\n", argv[optind], count,
+			frames, run_s);
+	printf("machine %zu bytes, flat 64 KB memory machine %zu bytes\n",
+			sizeof(chip8_vm), sizeof(chip8_vm) - sizeof(rom->pages)
+			+ CHIP8_MEM_SIZE);
+	printf("resident %.2f KB/instance copied, %.2f KB/instance run, "
+			"%.2f private pages/instance (%.0f bytes)\n",
+			(copied - base) / 1024.0 / count, (ran - base) / 1024.0 / count,
+			(double) private / count,
+			(double) private / count * sizeof(chip8_page));
+
+	for (unsigned i = 0; i < count; i++) {
+		chip8_drop_vm(&vms[i]);
+	}
+	free(vms);
+	chip8_free_vm(rom);
+	return EXIT_SUCCESS;
+}
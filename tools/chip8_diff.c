@@ -0,0 +1,497 @@
+/*
+ * @file chip8_diff.c
+ * @brief Differential tester running two execution engines in lockstep.
+ *
+ * Every ROM is run on the reference engine, chip8_step() disassembling each
+ * instruction, and on a candidate engine with the same seed and the same
+ * generated key presses. Registers, timers and the stack are compared every
+ * few instructions and all of memory and both display planes every frame.
+ * On a mismatch both machines are restored from the snapshot taken at the
+ * start of the frame and the first diverging instruction is bisected.
+ *
+ * The candidate is a predecoded engine looking every instruction word up in
+ * a table built from chip8_disassemble(), new engines plug in as another
+ * chip8_diff_engine. ROMs are spread over worker threads.
+ *
+ * Both engines share the instruction handlers, so -f checks the harness
+ * itself: a bit of the candidate's CXNN state is flipped at the start of the
+ * given frame and every ROM must be reported diverging in exactly that frame.
+ * A flipped VF would do for most ROMs, but those overwriting it before it is
+ * read never diverge, no instruction overwrites the random state.
+ *
+ * usage: chip8_diff [-c cycles] [-n frames] [-e every] [-s seed] [-j jobs]
+ *                   [-f frame] rom...
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "chip8.h"
+#include "chip8_istr.h"
+#include "chip8_rom.h"
+#include "chip8_time.h"
+
+#define CHIP8_DIFF_CYCLES 1000
+#define CHIP8_DIFF_FRAMES 3600
+#define CHIP8_DIFF_EVERY 16 /* instructions between register comparisons */
+#define CHIP8_DIFF_SEED 0xC8D1FF
+#define CHIP8_DIFF_WORDS 0x10000
+
+/*
+ * @brief Execution engine under test, stepping a single instruction.
+ */
+typedef struct chip8_diff_engine {
+	const char* name;
+	chip8_rc (*step)(chip8_vm[const static 1]);
+} chip8_diff_engine;
+
+/*
+ * @brief Options and work queue shared by the worker threads.
+ */
+typedef struct chip8_diff_job {
+	char** roms;
+	int count;
+	atomic_int next; /* next ROM to pick up */
+	atomic_int failed; /* ROMs that diverged or failed to load */
+	atomic_uint_fast64_t istrs; /* instructions executed by both engines */
+	unsigned cycles;
+	unsigned frames;
+	unsigned every;
+	uint32_t seed;
+	bool inject; /* self-check, a fault is injected into the candidate */
+	uint64_t fault; /* frame the fault is injected at */
+} chip8_diff_job;
+
+/* handlers for every instruction word, NULL for invalid instructions */
+static chip8_istr* chip8_decoded[CHIP8_QUIRKS_SIZE][CHIP8_DIFF_WORDS];
+
+/*
+ * @brief Builds the predecoded handler table of every quirk profile.
+ */
+static void chip8_decode_all(void)
+{
+	for (unsigned istr = 0; istr < CHIP8_DIFF_WORDS; istr++) {
+		const chip8_opcode opcode = chip8_disassemble(istr);
+
+		for (unsigned quirks = 0; quirks < CHIP8_QUIRKS_SIZE; quirks++) {
+			chip8_decoded[quirks][istr] = NOP == opcode ? NULL
+					: chip8_istr_set[quirks][opcode];
+		}
+	}
+}
+
+/*
+ * @brief Candidate engine executing through the predecoded table.
+ */
+static chip8_rc chip8_step_decoded(chip8_vm chip8[const static 1])
+{
+	chip8_istr* handler;
+
+	if (CHIP8_WAITING_KEY == chip8->state) {
+		return CHIP8_SUCCESS;
+	}
+	chip8->istr = chip8_mem_read(chip8, chip8->pc) << 8
+			| chip8_mem_read(chip8, chip8->pc+1);
+	handler = chip8_decoded[chip8->quirks][chip8->istr];
+
+	if (!handler) {
+		return CHIP8_FAILURE;
+	}
+	handler(chip8);
+	return CHIP8_SUCCESS;
+}
+
+static const chip8_diff_engine chip8_reference = {"reference", chip8_step};
+static const chip8_diff_engine chip8_candidate = {"decoded", chip8_step_decoded};
+
+/*
+ * @brief Presses or releases one key derived from the seed and frame, so a
+ * replayed frame sees the same input without keeping any state.
+ */
+static void chip8_diff_input(chip8_vm chip8[const static 1],
+		const uint32_t seed, const uint64_t frame)
+{
+	uint64_t hash = (frame + seed) * 0x9E3779B97F4A7C15ULL;
+
+	hash ^= hash >> 31;
+	hash *= 0xBF58476D1CE4E5B9ULL;
+	hash ^= hash >> 27;
+	chip8_set_key(chip8, hash % CHIP8_KEY_SIZE, hash >> 8 & 1);
+}
+
+/*
+ * @brief Applies the frame's key press and timer tick, and under -f corrupts
+ * the candidate at the start of the faulty frame.
+ */
+static void chip8_diff_start_frame(chip8_vm chip8[const static 1],
+		const chip8_diff_job job[const static 1],
+		const chip8_diff_engine engine[const static 1])
+{
+	chip8_diff_input(chip8, job->seed, chip8->frame);
+	chip8_tick_timers(chip8);
+
+	if (job->inject && job->fault == chip8->frame
+	    && &chip8_candidate == engine) {
+		chip8->rng ^= 1;
+	}
+}
+
+/*
+ * @brief Compares memory, skipping the pages both machines still share.
+ */
+static bool chip8_diff_mem_equal(const chip8_vm a[const static 1],
+		const chip8_vm b[const static 1])
+{
+	for (unsigned i = 0; i < CHIP8_COW_PAGES; i++) {
+		if (a->pages[i] != b->pages[i] && memcmp(a->pages[i]->data,
+				b->pages[i]->data, sizeof(a->pages[i]->data))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * @brief Compares the state cheap enough to check every few instructions.
+ */
+static bool chip8_diff_regs_equal(const chip8_vm a[const static 1],
+		const chip8_vm b[const static 1])
+{
+	return a->pc == b->pc && a->sp == b->sp && a->idx == b->idx
+		&& a->dly_tmr == b->dly_tmr && a->snd_tmr == b->snd_tmr
+		&& a->state == b->state && a->rng == b->rng
+		&& !memcmp(a->regs, b->regs, sizeof(a->regs))
+		&& !memcmp(a->stack, b->stack, sizeof(a->stack));
+}
+
+/*
+ * @brief Compares the whole machine state including memory and display.
+ */
+static bool chip8_diff_equal(const chip8_vm a[const static 1],
+		const chip8_vm b[const static 1])
+{
+	return chip8_diff_regs_equal(a, b) && a->istr == b->istr
+		&& a->keys == b->keys && a->hires == b->hires
+		&& a->plane == b->plane && a->pitch == b->pitch
+		&& a->has_pattern == b->has_pattern && a->frame == b->frame
+		&& !memcmp(a->flags, b->flags, sizeof(a->flags))
+		&& !memcmp(a->pattern, b->pattern, sizeof(a->pattern))
+		&& !memcmp(a->gfx, b->gfx, sizeof(a->gfx))
+		&& chip8_diff_mem_equal(a, b);
+}
+
+/*
+ * @brief Restores a machine from the snapshot taken at the start of a frame
+ * and replays the frame up to the given number of instructions.
+ */
+static chip8_rc chip8_diff_replay(chip8_vm chip8[const static 1],
+		const chip8_vm snapshot[const static 1],
+		const chip8_diff_engine engine[const static 1],
+		const chip8_diff_job job[const static 1], const unsigned count)
+{
+	chip8_copy_vm(chip8, snapshot);
+	chip8_diff_start_frame(chip8, job, engine);
+
+	for (unsigned i = 0; i < count && CHIP8_RUNNING == chip8->state; i++) {
+		if (!engine->step(chip8)) {
+			return CHIP8_FAILURE;
+		}
+	}
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Prints each field differing between the two machines.
+ */
+static void chip8_diff_print(const chip8_vm a[const static 1],
+		const chip8_vm b[const static 1])
+{
+	#define CHIP8_DIFF_FIELD(FMT, FIELD) \
+		if (a->FIELD != b->FIELD) { \
+			printf("  %-10s " FMT " " FMT "\n", #FIELD, a->FIELD, b->FIELD); \
+		}
+
+	CHIP8_DIFF_FIELD("0x%04X", pc)
+	CHIP8_DIFF_FIELD("%6u", sp)
+	CHIP8_DIFF_FIELD("0x%04X", idx)
+	CHIP8_DIFF_FIELD("0x%04X", istr)
+	CHIP8_DIFF_FIELD("%6u", dly_tmr)
+	CHIP8_DIFF_FIELD("%6u", snd_tmr)
+	CHIP8_DIFF_FIELD("%6u", state)
+	CHIP8_DIFF_FIELD("0x%04X", keys)
+	CHIP8_DIFF_FIELD("%6u", hires)
+	CHIP8_DIFF_FIELD("%6u", plane)
+	CHIP8_DIFF_FIELD("%6u", pitch)
+	CHIP8_DIFF_FIELD("0x%08X", rng)
+	#undef CHIP8_DIFF_FIELD
+
+	for (unsigned i = 0; i < REG_BANK_SIZE; i++) {
+		if (a->regs[i] != b->regs[i]) {
+			printf("  V%-9X 0x%02X   0x%02X\n", i, a->regs[i], b->regs[i]);
+		}
+	}
+
+	for (unsigned i = 0; i < CHIP8_STACK_SIZE; i++) {
+		if (a->stack[i] != b->stack[i]) {
+			printf("  stack[%2u]  0x%04X 0x%04X\n", i, a->stack[i], b->stack[i]);
+		}
+	}
+
+	for (unsigned i = 0; i < CHIP8_MEM_SIZE; i++) {
+		if (chip8_mem_peek(a, i) != chip8_mem_peek(b, i)) {
+			printf("  mem[%04X]  0x%02X   0x%02X\n", i, chip8_mem_peek(a, i),
+					chip8_mem_peek(b, i));
+		}
+	}
+
+	for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+		for (unsigned y = 0; y < CHIP8_GFX_HIRES_HEIGHT; y++) {
+			if (memcmp(a->gfx[p][y], b->gfx[p][y], sizeof(a->gfx[p][y]))) {
+				printf("  gfx[%u][%2u] differs\n", p, y);
+			}
+		}
+	}
+}
+
+/*
+ * @brief Bisects the first instruction of the frame after which the engines
+ * disagree and reports it, count is a number of instructions known to
+ * diverge.
+ */
+static void chip8_diff_bisect(const char rom_path[static 1],
+		const chip8_vm snapshot[const static 1],
+		const chip8_diff_job job[const static 1], unsigned count,
+		chip8_vm a[const static 1], chip8_vm b[const static 1])
+{
+	unsigned lo = 0;
+	chip8_word pc;
+
+	while (count - lo > 1) {
+		const unsigned mid = lo + (count - lo) / 2;
+		const chip8_rc rc_a = chip8_diff_replay(a, snapshot, &chip8_reference,
+				job, mid);
+		const chip8_rc rc_b = chip8_diff_replay(b, snapshot, &chip8_candidate,
+				job, mid);
+
+		if (rc_a != rc_b || !chip8_diff_equal(a, b)) {
+			count = mid;
+		} else {
+			lo = mid;
+		}
+	}
+	chip8_diff_replay(a, snapshot, &chip8_reference, job, lo);
+	pc = a->pc;
+	chip8_diff_replay(a, snapshot, &chip8_reference, job, count);
+	chip8_diff_replay(b, snapshot, &chip8_candidate, job, count);
+
+	flockfile(stdout);
+	printf("%s: diverged in frame %llu instruction %u at 0x%04X istr 0x%04X "
+			"quirks %s\n", rom_path, (unsigned long long) snapshot->frame,
+			count, pc, a->istr, chip8_quirks_name[a->quirks]);
+	printf("  %-10s %-6s %-6s\n", "field", chip8_reference.name,
+			chip8_candidate.name);
+	chip8_diff_print(a, b);
+	funlockfile(stdout);
+}
+
+/*
+ * @brief Runs a single ROM on both engines, returns whether they agreed or
+ * under -f whether they diverged in the faulty frame.
+ */
+static chip8_rc chip8_diff_rom(chip8_diff_job job[static 1],
+		const char rom_path[static 1])
+{
+	chip8_vm* const a = chip8_new_vm();
+	chip8_vm* const b = chip8_new_vm();
+	chip8_vm* const snapshot = chip8_new_vm();
+	chip8_rc rc = CHIP8_FAILURE;
+	uint64_t istrs = 0;
+	const char* end = "ran";
+	bool caught = false;
+
+	if (!a || !b || !snapshot) {
+		goto EXIT;
+	} else if (!chip8_load_rom(a, rom_path)) {
+		fprintf(stderr, "%s: ROM load failed\n", rom_path);
+		goto EXIT;
+	}
+	chip8_seed(a, job->seed);
+	chip8_copy_vm(b, a);
+	rc = CHIP8_SUCCESS;
+
+	for (unsigned frame = 0; frame < job->frames; frame++) {
+		unsigned i = 0;
+		chip8_rc rc_a = CHIP8_SUCCESS;
+		chip8_rc rc_b = CHIP8_SUCCESS;
+		bool diverged = false;
+
+		chip8_copy_vm(snapshot, a);
+		chip8_diff_start_frame(a, job, &chip8_reference);
+		chip8_diff_start_frame(b, job, &chip8_candidate);
+
+		while (i < job->cycles && (CHIP8_RUNNING == a->state
+				|| CHIP8_RUNNING == b->state)) {
+			rc_a = chip8_reference.step(a);
+			rc_b = chip8_candidate.step(b);
+			i++;
+
+			if (rc_a != rc_b || (!(i % job->every)
+					&& !chip8_diff_regs_equal(a, b))) {
+				diverged = true;
+				break;
+			} else if (!rc_a) {
+				break;
+			}
+		}
+		istrs += i;
+
+		if (!diverged && rc_a) {
+			a->frame++;
+			b->frame++;
+		}
+		diverged = diverged || !chip8_diff_equal(a, b);
+
+		if (diverged) {
+			chip8_diff_bisect(rom_path, snapshot, job, i, a, b);
+			caught = job->fault == snapshot->frame;
+			rc = CHIP8_FAILURE;
+			end = "diverged";
+			break;
+		} else if (!rc_a) {
+			end = "stopped on an invalid instruction";
+			break;
+		} else if (CHIP8_HALTED == a->state) {
+			end = "halted";
+			break;
+		}
+	}
+
+	/* the self-check passes on the divergence report naming the fault */
+	if (job->inject) {
+		rc = caught;
+		end = caught ? "caught the injected fault" : "missed the injected fault";
+	}
+
+	if (rc || job->inject) {
+		flockfile(stdout);
+		printf("%-28s %6s %8llu frames %10llu istr %s\n", rom_path,
+				chip8_quirks_name[a->quirks], (unsigned long long) a->frame,
+				(unsigned long long) istrs, end);
+		funlockfile(stdout);
+	}
+	atomic_fetch_add(&job->istrs, istrs);
+EXIT:
+	chip8_free_vm(snapshot);
+	chip8_free_vm(b);
+	chip8_free_vm(a);
+	return rc;
+}
+
+/*
+ * @brief Worker thread taking ROMs off the shared queue until it is empty.
+ */
+static void* chip8_diff_worker(void* arg)
+{
+	chip8_diff_job* const job = arg;
+	int rom;
+
+	while ((rom = atomic_fetch_add(&job->next, 1)) < job->count) {
+		if (!chip8_diff_rom(job, job->roms[rom])) {
+			atomic_fetch_add(&job->failed, 1);
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	chip8_diff_job job = {
+		.cycles = CHIP8_DIFF_CYCLES,
+		.frames = CHIP8_DIFF_FRAMES,
+		.every = CHIP8_DIFF_EVERY,
+		.seed = CHIP8_DIFF_SEED
+	};
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_t* threads;
+	uint64_t start_ns;
+	double elapsed_ns;
+	int started = 0;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "c:n:e:s:j:f:"))) {
+		switch(opt) {
+			case 'c':
+				job.cycles = strtoul(optarg, NULL, 0);
+				break;
+			case 'n':
+				job.frames = strtoul(optarg, NULL, 0);
+				break;
+			case 'e':
+				job.every = strtoul(optarg, NULL, 0);
+				break;
+			case 's':
+				job.seed = strtoul(optarg, NULL, 0);
+				break;
+			case 'j':
+				jobs = strtol(optarg, NULL, 0);
+				break;
+			case 'f':
+				job.inject = true;
+				job.fault = strtoull(optarg, NULL, 0);
+				break;
+			default:
+				goto USAGE;
+		}
+	}
+
+	if (optind == argc || !job.every || 1 > jobs
+	    || (job.inject && job.fault >= job.frames)) {
+		goto USAGE;
+	}
+	job.roms = &argv[optind];
+	job.count = argc - optind;
+	jobs = jobs < job.count ? jobs : job.count;
+
+	if (!(threads = calloc(jobs, sizeof(*threads)))) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+	chip8_decode_all();
+	start_ns = chip8_time_ns();
+
+	for (; started < jobs; started++) {
+		if (pthread_create(&threads[started], NULL, chip8_diff_worker, &job)) {
+			break;
+		}
+	}
+
+	/* without any worker thread the ROMs still run on this one */
+	if (!started) {
+		chip8_diff_worker(&job);
+	}
+
+	for (int i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	elapsed_ns = chip8_time_ns() - start_ns;
+
+	printf("%d of %d ROMs %s, %.1f M istr in %.2f s on %d threads "
+			"(%.1f M istr/s per engine)\n", atomic_load(&job.failed), job.count,
+			job.inject ? "missed the injected fault" : "diverged",
+			atomic_load(&job.istrs) / 1e6, elapsed_ns / CHIP8_NS_PER_SEC,
+			started ? started : 1, atomic_load(&job.istrs) * 1000.0 / elapsed_ns);
+	return atomic_load(&job.failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+USAGE:
+	fprintf(stderr, "usage: %s [-c cycles] [-n frames] [-e every] [-s seed] "
+			"[-j jobs] [-f frame] rom...\n", argv[0]);
+	return EXIT_FAILURE;
+}
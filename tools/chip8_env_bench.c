@@ -0,0 +1,116 @@
+/*
+ * @file chip8_env_bench.c
+ * @brief Measures how many environment steps per second a batch sustains.
+ *
+ * Every machine takes a random action from the default action set each
+ * step, so the numbers include keypad changes, episode resets and
+ * observation writes.
+ *
+ * usage: chip8_env_bench [-n envs] [-j threads] [-k frame_skip] [-s steps]
+ *                        [-o packed|bytes] rom
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "chip8.h"
+#include "chip8_env.h"
+#include "chip8_time.h"
+
+#define CHIP8_ENV_BENCH_COUNT 256
+#define CHIP8_ENV_BENCH_STEPS 1000
+
+static int chip8_env_bench_usage(const char program[static 1])
+{
+	fprintf(stderr, "usage: %s [-n envs] [-j threads] [-k frame_skip] "
+			"[-s steps] [-o packed|bytes] rom\n", program);
+	return EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	chip8_env_config config = {
+		.count = CHIP8_ENV_BENCH_COUNT,
+		.frame_skip = 4
+	};
+	unsigned steps = CHIP8_ENV_BENCH_STEPS;
+	uint64_t resets = 0;
+	uint32_t state = 1;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "n:j:k:s:o:"))) {
+		switch (opt) {
+			case 'n':
+				config.count = strtoul(optarg, NULL, 0);
+				break;
+			case 'j':
+				config.threads = strtoul(optarg, NULL, 0);
+				break;
+			case 'k':
+				config.frame_skip = strtoul(optarg, NULL, 0);
+				break;
+			case 's':
+				steps = strtoul(optarg, NULL, 0);
+				break;
+			case 'o':
+				config.obs = strcmp(optarg, "bytes") ? CHIP8_ENV_OBS_PACKED
+					: CHIP8_ENV_OBS_BYTES;
+				break;
+			default:
+				return chip8_env_bench_usage(argv[0]);
+		}
+	}
+
+	if (optind + 1 != argc) {
+		return chip8_env_bench_usage(argv[0]);
+	}
+	chip8_env* const env = chip8_new_env(&config, argv[optind]);
+
+	if (!env) {
+		return EXIT_FAILURE;
+	}
+	const unsigned count = env->config.count;
+	chip8_byte* const obs = malloc(count * chip8_env_obs_size(env));
+	uint32_t* const actions = malloc(count * sizeof(*actions));
+	float* const rewards = malloc(count * sizeof(*rewards));
+	uint8_t* const dones = malloc(count * sizeof(*dones));
+
+	if (!obs || !actions || !rewards || !dones) {
+		perror("chip8_env_bench");
+		chip8_free_env(env);
+		return EXIT_FAILURE;
+	}
+	chip8_env_reset(env, NULL, obs);
+	const uint64_t start_ns = chip8_time_ns();
+
+	for (unsigned s = 0; s < steps; s++) {
+		for (unsigned i = 0; i < count; i++) {
+			state = state * 1664525U + 1013904223U;
+			actions[i] = (state >> 16) % env->config.action_count;
+		}
+		chip8_env_step(env, actions, obs, rewards, dones);
+
+		for (unsigned i = 0; i < count; i++) {
+			resets += dones[i];
+		}
+	}
+	const double secs = (chip8_time_ns() - start_ns)
+		/ (double) CHIP8_NS_PER_SEC;
+	const double rate = (double) steps * count / secs;
+
+	printf("%u envs on %u threads, %u steps of %u frames, %zu byte "
+			"observations\n", count, env->worker_count, steps,
+			env->config.frame_skip, chip8_env_obs_size(env));
+	printf("%.2f s, %.0f steps/s, %.0f frames/s, %llu resets\n", secs, rate,
+			rate * env->config.frame_skip, (unsigned long long) resets);
+	chip8_free_env(env);
+	free(obs);
+	free(actions);
+	free(rewards);
+	free(dones);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,705 @@
+/*
+ * @file chip8_explore.c
+ * @brief Searches the states a ROM reaches through keypad input.
+ *
+ * From the state after a number of idle warm up frames every action, no key
+ * or a single key held for a few frames, is tried on every reached state.
+ * States are identified by their 128-bit hash and kept in a lock-free hash
+ * set shared by all threads, so each is expanded only once. Breadth-first
+ * search expands whole levels in order and finds the shortest input to a
+ * goal, best-first search expands states closest to the goal value first.
+ * States no action changes beyond the keypad, such as halted or hung
+ * programs, are reported as stuck.
+ *
+ * Goals compare a register or a memory byte with a value, e.g. v3>=5 or
+ * 0x1F0==2.
+ *
+ * usage: chip8_explore [-b] [-c cycles] [-d depth] [-f frames] [-g goal]
+ *                      [-j threads] [-k keys] [-n states] [-w warmup] rom
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "chip8_rom.h"
+#include "chip8_hash.h"
+#include "chip8_time.h"
+
+#define CHIP8_EXPLORE_FRAMES 4 /* frames an action is held */
+#define CHIP8_EXPLORE_STATES 100000
+#define CHIP8_EXPLORE_ACTIONS (1 + CHIP8_KEY_SIZE)
+#define CHIP8_EXPLORE_NONE UINT32_MAX
+
+/*
+ * @brief Comparison of a goal.
+ */
+typedef enum chip8_explore_op {
+	CHIP8_EXPLORE_EQ,
+	CHIP8_EXPLORE_NE,
+	CHIP8_EXPLORE_LT,
+	CHIP8_EXPLORE_LE,
+	CHIP8_EXPLORE_GT,
+	CHIP8_EXPLORE_GE
+} chip8_explore_op;
+
+typedef struct chip8_explore_goal {
+	bool set;
+	bool reg; /* compares V[addr] instead of memory */
+	unsigned addr;
+	chip8_explore_op op;
+	unsigned value;
+} chip8_explore_goal;
+
+/*
+ * @brief Lock-free set of 128-bit state hashes.
+ *
+ * Open addressing with linear probing. An insert claims an empty slot by
+ * swapping in the low word, then publishes the high word, lookups meeting a
+ * claimed slot wait for it. Neither word of a stored hash is ever zero.
+ */
+typedef struct chip8_state_set {
+	struct {
+		atomic_uint_fast64_t lo;
+		atomic_uint_fast64_t hi;
+	}* slots;
+	size_t mask;
+} chip8_state_set;
+
+/*
+ * @brief Reached state, the input leading to it is in the step log.
+ */
+typedef struct chip8_explore_node {
+	chip8_vm vm;
+	chip8_hash128 hash;
+	uint32_t id; /* step log index */
+	uint32_t depth; /* actions from the start */
+	unsigned distance; /* to the goal value, orders best-first search */
+} chip8_explore_node;
+
+/*
+ * @brief Action leading to a state from its parent state.
+ */
+typedef struct chip8_explore_step {
+	uint32_t parent;
+	chip8_byte action;
+} chip8_explore_step;
+
+typedef struct chip8_explorer {
+	unsigned cycles;
+	unsigned frames;
+	unsigned max_depth;
+	uint32_t max_states;
+	bool best_first;
+	chip8_explore_goal goal;
+	unsigned action_count;
+	chip8_word actions[CHIP8_EXPLORE_ACTIONS]; /* keypad bitmask per action */
+
+	chip8_state_set set;
+	chip8_explore_step* steps;
+	atomic_uint_fast32_t step_count;
+	atomic_uint_fast32_t found; /* step of the first goal state */
+	atomic_uint_fast32_t stuck_first; /* step of the first stuck state */
+	atomic_uint_fast64_t stuck;
+	atomic_uint_fast64_t duplicates;
+	atomic_uint_fast64_t expanded;
+	atomic_bool full;
+
+	/* queue of states to expand, FIFO or a heap on the goal distance */
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	chip8_explore_node** queue;
+	size_t queue_head;
+	size_t queue_size;
+	size_t queue_cap;
+	unsigned busy; /* threads expanding a state */
+	unsigned level; /* breadth-first depth being expanded */
+	bool stop;
+} chip8_explorer;
+
+static chip8_rc chip8_init_set(chip8_state_set set[const static 1],
+		const size_t states)
+{
+	size_t capacity = 1024;
+
+	/* at most half full keeps probe sequences short */
+	while (capacity < 2 * states) {
+		capacity <<= 1;
+	}
+
+	if (!(set->slots = calloc(capacity, sizeof(*set->slots)))) {
+		return CHIP8_FAILURE;
+	}
+	set->mask = capacity - 1;
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Adds a hash to the set, returns whether it was not in it yet.
+ */
+static bool chip8_set_insert(chip8_state_set set[const static 1],
+		chip8_hash128 hash)
+{
+	hash.lo += !hash.lo;
+	hash.hi += !hash.hi;
+
+	for (size_t i = hash.lo & set->mask;; i = (i + 1) & set->mask) {
+		uint_fast64_t lo = atomic_load_explicit(&set->slots[i].lo,
+				memory_order_acquire);
+		uint_fast64_t hi;
+
+		if (!lo && atomic_compare_exchange_strong_explicit(&set->slots[i].lo,
+				&lo, hash.lo, memory_order_acq_rel, memory_order_acquire)) {
+			atomic_store_explicit(&set->slots[i].hi, hash.hi,
+					memory_order_release);
+			return true;
+		} else if (lo != hash.lo) {
+			continue;
+		}
+
+		/* the slot was claimed with the same low word a moment ago */
+		while (!(hi = atomic_load_explicit(&set->slots[i].hi,
+				memory_order_acquire)));
+
+		if (hi == hash.hi) {
+			return false;
+		}
+	}
+}
+
+static unsigned chip8_goal_value(const chip8_explore_goal goal[const static 1],
+		const chip8_vm chip8[const static 1])
+{
+	return goal->reg ? chip8->regs[goal->addr & 0xF]
+		: chip8_mem_peek(chip8, goal->addr);
+}
+
+/*
+ * @brief Returns how far the goal value is from satisfying the goal, zero
+ * when it does.
+ */
+static unsigned chip8_goal_distance(const chip8_explore_goal goal[const static 1],
+		const chip8_vm chip8[const static 1])
+{
+	const unsigned value = chip8_goal_value(goal, chip8);
+
+	if (!goal->set) {
+		return 1;
+	}
+
+	switch (goal->op) {
+		case CHIP8_EXPLORE_EQ:
+			return value > goal->value ? value - goal->value
+				: goal->value - value;
+		case CHIP8_EXPLORE_NE:
+			return value == goal->value;
+		case CHIP8_EXPLORE_LT:
+			return value < goal->value ? 0 : value - goal->value + 1;
+		case CHIP8_EXPLORE_LE:
+			return value <= goal->value ? 0 : value - goal->value;
+		case CHIP8_EXPLORE_GT:
+			return value > goal->value ? 0 : goal->value - value + 1;
+		case CHIP8_EXPLORE_GE:
+			return value >= goal->value ? 0 : goal->value - value;
+	}
+	return 1;
+}
+
+/*
+ * @brief Parses a goal such as v3>=5 or 0x1F0==2.
+ */
+static chip8_rc chip8_parse_goal(chip8_explore_goal goal[const static 1],
+		const char spec[static 1])
+{
+	/* two character operators are tried before their prefixes */
+	static const struct {
+		const char* name;
+		chip8_explore_op op;
+	} ops[] = {
+		{ "==", CHIP8_EXPLORE_EQ }, { "!=", CHIP8_EXPLORE_NE },
+		{ "<=", CHIP8_EXPLORE_LE }, { ">=", CHIP8_EXPLORE_GE },
+		{ "<", CHIP8_EXPLORE_LT }, { ">", CHIP8_EXPLORE_GT }
+	};
+	char* end;
+
+	goal->reg = 'v' == spec[0] || 'V' == spec[0];
+	goal->addr = strtoul(&spec[goal->reg], &end, goal->reg ? 16 : 0);
+
+	if (end == &spec[goal->reg] || (goal->reg && REG_BANK_SIZE <= goal->addr)
+	    || CHIP8_MEM_SIZE <= goal->addr) {
+		return CHIP8_FAILURE;
+	}
+
+	for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+		const size_t length = strlen(ops[i].name);
+
+		if (!strncmp(end, ops[i].name, length)) {
+			goal->op = ops[i].op;
+			goal->value = strtoul(end + length, &end, 0);
+			goal->set = !*end;
+			return goal->set ? CHIP8_SUCCESS : CHIP8_FAILURE;
+		}
+	}
+	return CHIP8_FAILURE;
+}
+
+/*
+ * @brief Orders best-first nodes by goal distance, then depth.
+ */
+static inline bool chip8_node_before(const chip8_explore_node a[const static 1],
+		const chip8_explore_node b[const static 1])
+{
+	return a->distance < b->distance
+		|| (a->distance == b->distance && a->depth < b->depth);
+}
+
+/*
+ * @brief Queues a node, the lock must be held.
+ */
+static chip8_rc chip8_queue_push(chip8_explorer explorer[const static 1],
+		chip8_explore_node* const node)
+{
+	chip8_explore_node** queue = explorer->queue;
+
+	if (explorer->queue_head + explorer->queue_size == explorer->queue_cap) {
+		/* a FIFO first reclaims the slots it already popped */
+		if (explorer->queue_head) {
+			memmove(queue, &queue[explorer->queue_head],
+					explorer->queue_size * sizeof(*queue));
+			explorer->queue_head = 0;
+		} else if (!(queue = realloc(queue, 2 * explorer->queue_cap
+				* sizeof(*queue)))) {
+			return CHIP8_FAILURE;
+		} else {
+			explorer->queue = queue;
+			explorer->queue_cap *= 2;
+		}
+	}
+
+	if (!explorer->best_first) {
+		queue[explorer->queue_head + explorer->queue_size++] = node;
+		return CHIP8_SUCCESS;
+	}
+
+	/* sift up the binary heap */
+	size_t i = explorer->queue_size++;
+
+	for (; i && chip8_node_before(node, queue[(i - 1) / 2]); i = (i - 1) / 2) {
+		queue[i] = queue[(i - 1) / 2];
+	}
+	queue[i] = node;
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Takes the next node to expand, NULL when breadth-first search has
+ * to finish the level first. The lock must be held.
+ */
+static chip8_explore_node* chip8_queue_pop(chip8_explorer explorer[const static 1])
+{
+	chip8_explore_node** const queue = explorer->queue;
+	chip8_explore_node* node;
+
+	if (!explorer->queue_size) {
+		return NULL;
+	} else if (!explorer->best_first) {
+		node = queue[explorer->queue_head];
+
+		if (node->depth > explorer->level) {
+			return NULL;
+		}
+		explorer->queue_head++;
+		explorer->queue_size--;
+		return node;
+	}
+	node = queue[0];
+
+	/* sift the last node down from the root */
+	chip8_explore_node* const last = queue[--explorer->queue_size];
+	size_t i = 0;
+
+	for (size_t child; (child = 2 * i + 1) < explorer->queue_size; i = child) {
+		if (child + 1 < explorer->queue_size
+		    && chip8_node_before(queue[child + 1], queue[child])) {
+			child++;
+		}
+
+		if (!chip8_node_before(queue[child], last)) {
+			break;
+		}
+		queue[i] = queue[child];
+	}
+	queue[i] = last;
+	return node;
+}
+
+static chip8_explore_node* chip8_new_node(void)
+{
+	chip8_explore_node* const node = aligned_alloc(_Alignof(chip8_explore_node),
+			sizeof(*node));
+
+	if (node) {
+		memset(&node->vm, 0, sizeof(node->vm));
+	}
+	return node;
+}
+
+static void chip8_free_node(chip8_explore_node* const node)
+{
+	chip8_drop_vm(&node->vm);
+	free(node);
+}
+
+/*
+ * @brief Records a new state in the step log, returns its index or
+ * CHIP8_EXPLORE_NONE once the state limit is reached.
+ */
+static uint32_t chip8_log_step(chip8_explorer explorer[const static 1],
+		const uint32_t parent, const unsigned action)
+{
+	const uint32_t id = atomic_fetch_add_explicit(&explorer->step_count, 1,
+			memory_order_relaxed);
+
+	if (id >= explorer->max_states) {
+		atomic_store_explicit(&explorer->full, true, memory_order_relaxed);
+		return CHIP8_EXPLORE_NONE;
+	}
+	explorer->steps[id].parent = parent;
+	explorer->steps[id].action = action;
+	return id;
+}
+
+/*
+ * @brief Whether running frames left a machine as it was apart from the
+ * keypad and bookkeeping, memory pages still being shared means nothing
+ * was written.
+ */
+static bool chip8_explore_unchanged(const chip8_vm a[const static 1],
+		const chip8_vm b[const static 1])
+{
+	return a->pc == b->pc && a->sp == b->sp && a->idx == b->idx
+		&& a->dly_tmr == b->dly_tmr && a->snd_tmr == b->snd_tmr
+		&& a->state == b->state && a->plane == b->plane && a->rng == b->rng
+		&& a->hires == b->hires && !memcmp(a->regs, b->regs, sizeof(a->regs))
+		&& !memcmp(a->stack, b->stack, sizeof(a->stack))
+		&& !memcmp(a->pages, b->pages, sizeof(a->pages))
+		&& chip8_gfx_hash(a) == chip8_gfx_hash(b);
+}
+
+/*
+ * @brief Tries every action on a state, returns the number of new states
+ * left in children.
+ */
+static unsigned chip8_expand(chip8_explorer explorer[const static 1],
+		const chip8_explore_node parent[const static 1],
+		chip8_explore_node* children[const static CHIP8_EXPLORE_ACTIONS])
+{
+	unsigned count = 0;
+	bool stuck = true;
+	uint_fast32_t none = CHIP8_EXPLORE_NONE;
+
+	for (unsigned a = 0; a < explorer->action_count; a++) {
+		chip8_explore_node* child = chip8_new_node();
+
+		if (!child) {
+			atomic_store_explicit(&explorer->full, true, memory_order_relaxed);
+			break;
+		}
+		chip8_copy_vm(&child->vm, &parent->vm);
+
+		for (unsigned key = 0; key < CHIP8_KEY_SIZE; key++) {
+			chip8_set_key(&child->vm, key, explorer->actions[a] >> key & 1);
+		}
+
+		for (unsigned f = 0; f < explorer->frames
+				&& CHIP8_HALTED != child->vm.state; f++) {
+			if (!chip8_run_frame(&child->vm, explorer->cycles)) {
+				child->vm.state = CHIP8_HALTED;
+			}
+		}
+		stuck = stuck && chip8_explore_unchanged(&child->vm, &parent->vm);
+		child->hash = chip8_hash_vm(&child->vm);
+
+		if (!chip8_set_insert(&explorer->set, child->hash)) {
+			atomic_fetch_add_explicit(&explorer->duplicates, 1,
+					memory_order_relaxed);
+			chip8_free_node(child);
+			continue;
+		} else if (CHIP8_EXPLORE_NONE == (child->id = chip8_log_step(explorer,
+				parent->id, a))) {
+			chip8_free_node(child);
+			break;
+		}
+		child->depth = parent->depth + 1;
+		child->distance = chip8_goal_distance(&explorer->goal, &child->vm);
+
+		if (explorer->goal.set && !child->distance) {
+			atomic_compare_exchange_strong(&explorer->found, &none, child->id);
+		}
+		children[count++] = child;
+	}
+
+	if (stuck) {
+		atomic_fetch_add_explicit(&explorer->stuck, 1, memory_order_relaxed);
+		none = CHIP8_EXPLORE_NONE;
+		atomic_compare_exchange_strong(&explorer->stuck_first, &none,
+				parent->id);
+	}
+	atomic_fetch_add_explicit(&explorer->expanded, 1, memory_order_relaxed);
+	return count;
+}
+
+static void* chip8_explore_thread(void* const arg)
+{
+	chip8_explorer* const explorer = arg;
+	chip8_explore_node* children[CHIP8_EXPLORE_ACTIONS];
+
+	pthread_mutex_lock(&explorer->lock);
+
+	for (;;) {
+		chip8_explore_node* node = NULL;
+
+		while (!explorer->stop && !(node = chip8_queue_pop(explorer))) {
+			if (explorer->busy) {
+				pthread_cond_wait(&explorer->ready, &explorer->lock);
+			} else if (explorer->queue_size) {
+				explorer->level = explorer->queue[explorer->queue_head]->depth;
+			} else {
+				explorer->stop = true;
+			}
+		}
+
+		if (explorer->stop) {
+			pthread_cond_broadcast(&explorer->ready);
+			pthread_mutex_unlock(&explorer->lock);
+			return NULL;
+		}
+		explorer->busy++;
+		pthread_mutex_unlock(&explorer->lock);
+
+		const unsigned count = node->depth < explorer->max_depth
+			? chip8_expand(explorer, node, children) : 0;
+
+		chip8_free_node(node);
+		pthread_mutex_lock(&explorer->lock);
+		explorer->busy--;
+
+		for (unsigned i = 0; i < count; i++) {
+			if (!chip8_queue_push(explorer, children[i])) {
+				atomic_store_explicit(&explorer->full, true,
+						memory_order_relaxed);
+				chip8_free_node(children[i]);
+			}
+		}
+		explorer->stop = explorer->stop
+			|| CHIP8_EXPLORE_NONE != atomic_load(&explorer->found)
+			|| atomic_load_explicit(&explorer->full, memory_order_relaxed);
+		pthread_cond_broadcast(&explorer->ready);
+	}
+}
+
+/*
+ * @brief Prints the actions leading from the start to a state.
+ */
+static void chip8_print_path(const chip8_explorer explorer[const static 1],
+		const char label[static 1], const uint32_t id)
+{
+	unsigned depth = 0;
+
+	for (uint32_t step = id; step; step = explorer->steps[step].parent) {
+		depth++;
+	}
+	char* const path = malloc(depth + 1);
+
+	if (!path) {
+		return;
+	}
+	path[depth] = '\0';
+
+	for (uint32_t step = id, i = depth; step;
+			step = explorer->steps[step].parent) {
+		const chip8_word keys = explorer->actions[explorer->steps[step].action];
+
+		path[--i] = keys ? "0123456789ABCDEF"[__builtin_ctz(keys)] : '-';
+	}
+	printf("%s at depth %u, %u frames per action: %s\n", label, depth,
+			explorer->frames, depth ? path : "none");
+	free(path);
+}
+
+static int chip8_explore_usage(const char program[static 1])
+{
+	fprintf(stderr, "usage: %s [-b] [-c cycles] [-d depth] [-f frames] "
+			"[-g goal] [-j threads] [-k keys] [-n states] [-w warmup] rom\n"
+			"  goal compares vX or a memory address with a value,"
+			" e.g. v3>=5 or 0x1F0==2\n", program);
+	return EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	chip8_explorer explorer = {
+		.cycles = CHIP8_CYCLES_PER_FRAME,
+		.frames = CHIP8_EXPLORE_FRAMES,
+		.max_depth = UINT32_MAX,
+		.max_states = CHIP8_EXPLORE_STATES,
+		.queue_cap = 1024
+	};
+	const char* keys = "0123456789ABCDEF";
+	unsigned threads = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned warmup = 0;
+	pthread_t* workers;
+	chip8_explore_node* root;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "bc:d:f:g:j:k:n:w:"))) {
+		switch (opt) {
+			case 'b':
+				explorer.best_first = true;
+				break;
+			case 'c':
+				explorer.cycles = strtoul(optarg, NULL, 0);
+				break;
+			case 'd':
+				explorer.max_depth = strtoul(optarg, NULL, 0);
+				break;
+			case 'f':
+				explorer.frames = strtoul(optarg, NULL, 0);
+				break;
+			case 'g':
+				if (!chip8_parse_goal(&explorer.goal, optarg)) {
+					fprintf(stderr, "%s: invalid goal %s\n", argv[0], optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'j':
+				threads = strtoul(optarg, NULL, 0);
+				break;
+			case 'k':
+				keys = optarg;
+				break;
+			case 'n':
+				explorer.max_states = strtoul(optarg, NULL, 0);
+				break;
+			case 'w':
+				warmup = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				return chip8_explore_usage(argv[0]);
+		}
+	}
+
+	if (optind + 1 != argc || !explorer.max_states
+	    || CHIP8_EXPLORE_STATES * 100 < explorer.max_states) {
+		return chip8_explore_usage(argv[0]);
+	} else if (explorer.best_first && !explorer.goal.set) {
+		fprintf(stderr, "%s: best-first search needs a goal\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	threads = threads ? threads : 1;
+	explorer.actions[explorer.action_count++] = 0;
+
+	for (const char* key = keys; *key; key++) {
+		const char digit[] = { *key, '\0' };
+		char* end;
+		const unsigned value = strtoul(digit, &end, 16);
+
+		if (*end || CHIP8_EXPLORE_ACTIONS == explorer.action_count) {
+			return chip8_explore_usage(argv[0]);
+		}
+		explorer.actions[explorer.action_count++] = 1 << value;
+	}
+	atomic_init(&explorer.found, CHIP8_EXPLORE_NONE);
+	atomic_init(&explorer.stuck_first, CHIP8_EXPLORE_NONE);
+	atomic_init(&explorer.step_count, 1);
+	pthread_mutex_init(&explorer.lock, NULL);
+	pthread_cond_init(&explorer.ready, NULL);
+
+	if (!(root = chip8_new_node()) || !(workers = calloc(threads,
+			sizeof(*workers)))
+	    || !(explorer.steps = calloc(explorer.max_states,
+			sizeof(*explorer.steps)))
+	    || !(explorer.queue = malloc(explorer.queue_cap
+			* sizeof(*explorer.queue)))
+	    || !chip8_init_set(&explorer.set, explorer.max_states)) {
+		perror("chip8_explore");
+		return EXIT_FAILURE;
+	}
+	chip8_vm* const start = chip8_new_vm();
+
+	if (!start || !chip8_load_rom(start, argv[optind])) {
+		fprintf(stderr, "%s: ROM load failed\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	for (unsigned f = 0; f < warmup && CHIP8_HALTED != start->state; f++) {
+		chip8_run_frame(start, explorer.cycles);
+	}
+	chip8_copy_vm(&root->vm, start);
+	chip8_free_vm(start);
+	root->hash = chip8_hash_vm(&root->vm);
+	root->distance = chip8_goal_distance(&explorer.goal, &root->vm);
+	chip8_set_insert(&explorer.set, root->hash);
+	chip8_queue_push(&explorer, root);
+
+	if (explorer.goal.set && !root->distance) {
+		atomic_store(&explorer.found, 0);
+		explorer.stop = true;
+	}
+	const uint64_t start_ns = chip8_time_ns();
+
+	for (unsigned i = 0; i < threads; i++) {
+		if (pthread_create(&workers[i], NULL, chip8_explore_thread, &explorer)) {
+			perror("chip8_explore: pthread_create");
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (unsigned i = 0; i < threads; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	const double secs = (chip8_time_ns() - start_ns)
+		/ (double) CHIP8_NS_PER_SEC;
+	const uint32_t states = atomic_load(&explorer.step_count);
+	const uint32_t found = atomic_load(&explorer.found);
+	const uint32_t stuck_first = atomic_load(&explorer.stuck_first);
+
+	printf("%s: %s search on %u threads, %u actions of %u frames\n",
+			argv[optind], explorer.best_first ? "best-first" : "breadth-first",
+			threads, explorer.action_count, explorer.frames);
+	printf("%u states, %llu expanded, %llu duplicates pruned, %llu stuck, "
+			"%.2f s, %.0f states/s%s\n", states < explorer.max_states ? states
+			: explorer.max_states,
+			(unsigned long long) atomic_load(&explorer.expanded),
+			(unsigned long long) atomic_load(&explorer.duplicates),
+			(unsigned long long) atomic_load(&explorer.stuck), secs,
+			atomic_load(&explorer.expanded) * explorer.action_count / secs,
+			atomic_load(&explorer.full) ? ", state limit reached" : "");
+
+	if (CHIP8_EXPLORE_NONE != stuck_first) {
+		chip8_print_path(&explorer, "first stuck state", stuck_first);
+	}
+
+	if (CHIP8_EXPLORE_NONE != found) {
+		chip8_print_path(&explorer, "goal reached", found);
+	} else if (explorer.goal.set) {
+		printf("goal not reached\n");
+	}
+
+	for (size_t i = 0; i < explorer.queue_size; i++) {
+		chip8_free_node(explorer.queue[explorer.queue_head + i]);
+	}
+	free(explorer.queue);
+	free(explorer.set.slots);
+	free(explorer.steps);
+	free(workers);
+	return CHIP8_EXPLORE_NONE != found || !explorer.goal.set ? EXIT_SUCCESS
+		: EXIT_FAILURE;
+}
@@ -1,124 +1,148 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 uint8_t chip8_font[] = {
 	 /* 0 */
-	0b11110000,
-	0b10010000,
-	0b10010000,
-	0b10010000,
-	0b11110000,
+	0xF0, /* ####.... */
+	0x90, /* #..#.... */
+	0x90, /* #..#.... */
+	0x90, /* #..#.... */
+	0xF0, /* ####.... */
 
 	 /* 1 */
-	0b00100000,
-	0b01100000,
-	0b00100000,
-	0b00100000,
-	0b01110000,
+	0x20, /* ..#..... */
+	0x60, /* .##..... */
+	0x20, /* ..#..... */
+	0x20, /* ..#..... */
+	0x70, /* .###.... */
 
 	 /* 2 */
-	0b11110000,
-	0b00010000,
-	0b11110000,
-	0b10000000,
-	0b11110000,
+	0xF0, /* ####.... */
+	0x10, /* ...#.... */
+	0xF0, /* ####.... */
+	0x80, /* #....... */
+	0xF0, /* ####.... */
 
 	 /* 3 */
-	0b11110000,
-	0b00010000,
-	0b11110000,
-	0b00010000,
-	0b11110000,
+	0xF0, /* ####.... */
+	0x10, /* ...#.... */
+	0xF0, /* ####.... */
+	0x10, /* ...#.... */
+	0xF0, /* ####.... */
 
 	 /* 4 */
-	0b10010000,
-	0b10010000,
-	0b11110000,
-	0b00010000,
-	0b00010000,
+	0x90, /* #..#.... */
+	0x90, /* #..#.... */
+	0xF0, /* ####.... */
+	0x10, /* ...#.... */
+	0x10, /* ...#.... */
 
 	 /* 5 */
-	0b11110000,
-	0b10000000,
-	0b11110000,
-	0b00010000,
-	0b11110000,
+	0xF0, /* ####.... */
+	0x80, /* #....... */
+	0xF0, /* ####.... */
+	0x10, /* ...#.... */
+	0xF0, /* ####.... */
 
 	 /* 6 */
-	0b11110000,
-	0b10000000,
-	0b11110000,
-	0b10010000,
-	0b11110000,
+	0xF0, /* ####.... */
+	0x80, /* #....... */
+	0xF0, /* ####.... */
+	0x90, /* #..#.... */
+	0xF0, /* ####.... */
 
 	 /* 7 */
-	0b11110000,
-	0b00010000,
-	0b01110000,
-	0b01000000,
-	0b01000000,
+	0xF0, /* ####.... */
+	0x10, /* ...#.... */
+	0x70, /* .###.... */
+	0x40, /* .#...... */
+	0x40, /* .#...... */
 
 	 /* 8 */
-	0b11110000,
-	0b10010000,
-	0b11110000,
-	0b10010000,
-	0b11110000,
+	0xF0, /* ####.... */
+	0x90, /* #..#.... */
+	0xF0, /* ####.... */
+	0x90, /* #..#.... */
+	0xF0, /* ####.... */
 
 	 /* 9 */
-	0b11110000,
-	0b10010000,
-	0b11110000,
-	0b00010000,
-	0b00010000,
+	0xF0, /* ####.... */
+	0x90, /* #..#.... */
+	0xF0, /* ####.... */
+	0x10, /* ...#.... */
+	0x10, /* ...#.... */
 
 	 /* A */
-	0b11110000,
-	0b10010000,
-	0b11110000,
-	0b10010000,
-	0b10010000,
+	0xF0, /* ####.... */
+	0x90, /* #..#.... */
+	0xF0, /* ####.... */
+	0x90, /* #..#.... */
+	0x90, /* #..#.... */
 
 	 /* B */
-	0b11100000,
-	0b10010000,
-	0b11100000,
-	0b10010000,
-	0b11100000,
+	0xE0, /* ###..... */
+	0x90, /* #..#.... */
+	0xE0, /* ###..... */
+	0x90, /* #..#.... */
+	0xE0, /* ###..... */
 	
 	 /* C */
-	0b11110000,
-	0b10000000,
-	0b10000000,
-	0b10000000,
-	0b11110000,
+	0xF0, /* ####.... */
+	0x80, /* #....... */
+	0x80, /* #....... */
+	0x80, /* #....... */
+	0xF0, /* ####.... */
 
 	 /* D */
-	0b11100000,
-	0b10010000,
-	0b10010000,
-	0b10010000,
-	0b11100000,
+	0xE0, /* ###..... */
+	0x90, /* #..#.... */
+	0x90, /* #..#.... */
+	0x90, /* #..#.... */
+	0xE0, /* ###..... */
 
 	 /* E */
-	0b11110000,
-	0b10000000,
-	0b11110000,
-	0b10000000,
-	0b11110000,
+	0xF0, /* ####.... */
+	0x80, /* #....... */
+	0xF0, /* ####.... */
+	0x80, /* #....... */
+	0xF0, /* ####.... */
 
 	 /* F */
-	0b11110000,
-	0b10000000,
-	0b11100000,
-	0b10000000,
-	0b10000000,
+	0xF0, /* ####.... */
+	0x80, /* #....... */
+	0xE0, /* ###..... */
+	0x80, /* #....... */
+	0x80, /* #....... */
 };
 
-int main(void) {
-	char c;
-	FILE* const file = fopen("../assets/chip8_font.c8f", "wb");
+/* SUPER-CHIP 8x10 font selected by FX30, one glyph per line */
+uint8_t chip8_big_font[] = {
+	0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, /* 0 */
+	0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, /* 1 */
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, /* 2 */
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, /* 3 */
+	0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, /* 4 */
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, /* 5 */
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, /* 6 */
+	0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, /* 7 */
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, /* 8 */
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, /* 9 */
+	0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, /* A */
+	0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, /* B */
+	0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, /* C */
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, /* D */
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, /* E */
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  /* F */
+};
+
+/*
+ * @brief Writes the raw font to a binary font file.
+ */
+static int chip8_write_font(const char font_path[static 1])
+{
+	FILE* const file = fopen(font_path, "wb");
 
 	if (!file) {
 		return EXIT_FAILURE;
@@ -131,3 +155,79 @@ int main(void) {
 	fclose(file);
 	return EXIT_SUCCESS;
 }
+
+/*
+ * @brief Emits the contents of a file as a NUL terminated C array.
+ */
+static int chip8_embed_file(FILE* const out, const char name[static 1],
+		const char file_path[static 1])
+{
+	int c;
+	size_t count = 0;
+	FILE* const file = fopen(file_path, "rb");
+
+	if (!file) {
+		perror(file_path);
+		return EXIT_FAILURE;
+	}
+	fprintf(out, "\n/* %s */\nconst char %s[] = {", file_path, name);
+
+	while (EOF != (c = fgetc(file))) {
+		fprintf(out, "%s0x%02X,", count++ % 12 ? " " : "\n\t", c);
+	}
+	fprintf(out, "%s0x00\n};\n", count % 12 ? " " : "\n\t");
+	fclose(file);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * @brief Generates a C translation unit embedding both fonts and the shaders.
+ */
+static int chip8_write_embed(const char out_path[static 1],
+		const char vert_path[static 1], const char frag_path[static 1])
+{
+	FILE* const out = fopen(out_path, "w");
+
+	if (!out) {
+		perror(out_path);
+		return EXIT_FAILURE;
+	}
+	fputs("/* generated by chip8_font_gen, do not edit */\n\n"
+			"#include \"chip8.h\"\n#include \"chip8_embed.h\"\n\n"
+			"const chip8_byte chip8_font[CHIP8_FONT_SIZE] = {", out);
+
+	for (size_t i = 0; i < sizeof(chip8_font); i++) {
+		fprintf(out, "%s0x%02X,", i % 5 ? " " : "\n\t", chip8_font[i]);
+	}
+	fputs("\n};\n\nconst chip8_byte chip8_big_font[CHIP8_BIG_FONT_SIZE] = {",
+			out);
+
+	for (size_t i = 0; i < sizeof(chip8_big_font); i++) {
+		fprintf(out, "%s0x%02X,", i % 10 ? " " : "\n\t", chip8_big_font[i]);
+	}
+	fputs("\n};\n", out);
+
+	if (chip8_embed_file(out, "chip8_vert_shader_src", vert_path)
+	    || chip8_embed_file(out, "chip8_frag_shader_src", frag_path)) {
+		fclose(out);
+		remove(out_path);
+		return EXIT_FAILURE;
+	}
+	return fclose(out) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * usage: chip8_font_gen [font.c8f]
+ *        chip8_font_gen -c embed.c vertex.glsl fragment.glsl
+ */
+int main(int argc, char* argv[argc+1])
+{
+	if (argc == 5 && !strcmp(argv[1], "-c")) {
+		return chip8_write_embed(argv[2], argv[3], argv[4]);
+	} else if (argc <= 2) {
+		return chip8_write_font(argc == 2 ? argv[1] : "../assets/chip8_font.c8f");
+	}
+	fprintf(stderr, "usage: %s [font.c8f]\n"
+			"       %s -c embed.c vertex.glsl fragment.glsl\n", argv[0], argv[0]);
+	return EXIT_FAILURE;
+}
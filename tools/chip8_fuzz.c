@@ -0,0 +1,486 @@
+/*
+ * @file chip8_fuzz.c
+ * @brief Coverage guided fuzzer of the key presses and random seed of a ROM.
+ *
+ * An input is a random seed and the keypad state of every frame. Inputs are
+ * mutated from a corpus and kept when they reach new edges between guest
+ * program counters, counted in an AFL style bitmap. The core is built with
+ * CHIP8_CHECKED, so out of bounds memory and display accesses and stack
+ * overflows are reported as crashes and saved for replay.
+ *
+ * Every execution restores the machine from a snapshot taken after the
+ * warm up frames, copying back only the memory pages it wrote.
+ *
+ * usage: chip8_fuzz [-c cycles] [-n frames] [-w warmup] [-t seconds]
+ *                   [-s seed] [-o dir] [-r crash] rom
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <getopt.h>
+
+#include "chip8.h"
+#include "chip8_istr.h"
+#include "chip8_rom.h"
+#include "chip8_time.h"
+
+#ifndef CHIP8_CHECKED
+	#error "chip8_fuzz must be built against the CHIP8_CHECKED core"
+#endif
+
+#define CHIP8_FUZZ_CYCLES CHIP8_CYCLES_PER_FRAME
+#define CHIP8_FUZZ_FRAMES 32 /* frames per execution */
+#define CHIP8_FUZZ_MAX_FRAMES 256
+#define CHIP8_FUZZ_SECONDS 10
+#define CHIP8_FUZZ_MAP 0x1000 /* edge bitmap entries, one per guest address */
+#define CHIP8_FUZZ_CORPUS 4096
+#define CHIP8_FUZZ_CRASHES 256
+#define CHIP8_FUZZ_MUTATIONS 64 /* executions per corpus entry and round */
+
+/*
+ * @brief Random seed and keypad state of each frame of one execution.
+ */
+typedef struct chip8_fuzz_input {
+	uint32_t seed;
+	chip8_word keys[CHIP8_FUZZ_MAX_FRAMES];
+} chip8_fuzz_input;
+
+/*
+ * @brief Outcome of a single execution.
+ */
+typedef struct chip8_fuzz_result {
+	chip8_byte fault; /* chip8_fault, none when it ran all frames */
+	bool invalid; /* stopped on an invalid instruction */
+	chip8_word pc; /* instruction that faulted */
+	chip8_word istr;
+	uint64_t frame;
+} chip8_fuzz_result;
+
+/*
+ * @brief Fuzzer state for a single ROM.
+ */
+typedef struct chip8_fuzz {
+	chip8_vm* chip8;
+	chip8_vm* snapshot; /* machine after the warm up frames */
+	unsigned cycles;
+	unsigned frames;
+	uint64_t rng; /* mutation random number generator */
+
+	chip8_byte trace[CHIP8_FUZZ_MAP]; /* edge hit counts of one execution */
+	chip8_byte virgin[CHIP8_FUZZ_MAP]; /* hit count buckets not seen yet */
+	unsigned edges; /* edges seen by any execution */
+
+	chip8_fuzz_input* corpus;
+	unsigned corpus_size;
+	uint32_t crashes[CHIP8_FUZZ_CRASHES]; /* fault and pc of saved crashes */
+	unsigned crash_count;
+	const char* out_dir;
+	uint64_t execs;
+} chip8_fuzz;
+
+static const char* const chip8_fault_name[CHIP8_FAULT_SIZE] = {
+	"none", "memory", "display", "stack overflow", "stack underflow",
+	"display hash"
+};
+
+/*
+ * @brief Returns the next 64 random bits of the mutation generator.
+ */
+static inline uint64_t chip8_fuzz_rand(chip8_fuzz fuzz[static 1])
+{
+	fuzz->rng ^= fuzz->rng << 13;
+	fuzz->rng ^= fuzz->rng >> 7;
+	fuzz->rng ^= fuzz->rng << 17;
+	return fuzz->rng;
+}
+
+/*
+ * @brief Maps one of the 4096 guest addresses to a random bitmap location.
+ */
+static inline unsigned chip8_fuzz_loc(const chip8_word pc)
+{
+	return (pc & 0xFFF) * 2654435761U >> 20 & (CHIP8_FUZZ_MAP-1);
+}
+
+/*
+ * @brief Runs one input from the snapshot, recording the edges between
+ * consecutive program counters.
+ */
+static chip8_fuzz_result chip8_fuzz_run(chip8_fuzz fuzz[static 1],
+		const chip8_fuzz_input input[static 1])
+{
+	chip8_vm* const chip8 = fuzz->chip8;
+	chip8_fuzz_result result = {0};
+	unsigned prev = chip8_fuzz_loc(fuzz->snapshot->pc) >> 1;
+
+	chip8_copy_vm(chip8, fuzz->snapshot);
+	chip8_seed(chip8, input->seed);
+	memset(fuzz->trace, 0, sizeof(fuzz->trace));
+	fuzz->execs++;
+
+	for (unsigned f = 0; f < fuzz->frames; f++) {
+		const chip8_word changed = chip8->keys ^ input->keys[f];
+
+		for (unsigned key = 0; key < CHIP8_KEY_SIZE; key++) {
+			if (changed >> key & 1) {
+				chip8_set_key(chip8, key, input->keys[f] >> key & 1);
+			}
+		}
+		chip8_tick_timers(chip8);
+
+		for (unsigned i = 0; i < fuzz->cycles && CHIP8_RUNNING == chip8->state;
+				i++) {
+			const chip8_word pc = chip8->pc;
+			unsigned loc;
+
+			if (!chip8_step(chip8)) {
+				result.invalid = true;
+				return result;
+			} else if (chip8->fault) {
+				result.fault = chip8->fault;
+				result.pc = pc;
+				result.istr = chip8->istr;
+				result.frame = f;
+				return result;
+			}
+			loc = chip8_fuzz_loc(chip8->pc);
+			fuzz->trace[loc ^ prev]++;
+			prev = loc >> 1;
+		}
+
+		if (CHIP8_HALTED == chip8->state) {
+			break;
+		}
+		chip8->frame++;
+	}
+	return result;
+}
+
+/*
+ * @brief Returns the AFL hit count bucket of an edge count.
+ */
+static inline chip8_byte chip8_fuzz_bucket(const chip8_byte count)
+{
+	if (count < 4) {
+		return count == 3 ? 4 : count;
+	} else if (count < 8) {
+		return 8;
+	} else if (count < 16) {
+		return 16;
+	} else if (count < 32) {
+		return 32;
+	}
+	return count < 128 ? 64 : 128;
+}
+
+/*
+ * @brief Merges the trace of the last execution into the seen buckets,
+ * returns whether it hit a new edge or a new hit count of one.
+ */
+static bool chip8_fuzz_new_coverage(chip8_fuzz fuzz[static 1])
+{
+	bool new_coverage = false;
+
+	for (unsigned i = 0; i < CHIP8_FUZZ_MAP; i += sizeof(uint64_t)) {
+		uint64_t word;
+
+		memcpy(&word, &fuzz->trace[i], sizeof(word));
+
+		if (!word) {
+			continue;
+		}
+
+		for (unsigned j = i; j < i + sizeof(uint64_t); j++) {
+			const chip8_byte bucket = chip8_fuzz_bucket(fuzz->trace[j]);
+
+			if (bucket & fuzz->virgin[j]) {
+				fuzz->edges += 0xFF == fuzz->virgin[j];
+				fuzz->virgin[j] &= ~bucket;
+				new_coverage = true;
+			}
+		}
+	}
+	return new_coverage;
+}
+
+/*
+ * @brief Applies a few random mutations to an input.
+ */
+static void chip8_fuzz_mutate(chip8_fuzz fuzz[static 1],
+		chip8_fuzz_input input[static 1])
+{
+	const unsigned count = 1 + chip8_fuzz_rand(fuzz) % 4;
+
+	for (unsigned m = 0; m < count; m++) {
+		const uint64_t r = chip8_fuzz_rand(fuzz);
+		const unsigned frame = (r >> 8) % fuzz->frames;
+		const unsigned len = 1 + (r >> 24) % (fuzz->frames - frame);
+
+		switch(r % 6) {
+			case 0: /* toggle one key for a single frame */
+				input->keys[frame] ^= 1 << (r >> 40) % CHIP8_KEY_SIZE;
+				break;
+			case 1: /* hold one key down over a range of frames */
+				for (unsigned f = frame; f < frame + len; f++) {
+					input->keys[f] |= 1 << (r >> 40) % CHIP8_KEY_SIZE;
+				}
+				break;
+			case 2: /* release every key over a range of frames */
+				memset(&input->keys[frame], 0, len * sizeof(*input->keys));
+				break;
+			case 3: /* random keypad state */
+				input->keys[frame] = r >> 40;
+				break;
+			case 4: /* splice frames from another corpus entry */
+				memcpy(&input->keys[frame],
+						&fuzz->corpus[(r >> 40) % fuzz->corpus_size].keys[frame],
+						len * sizeof(*input->keys));
+				break;
+			default:
+				input->seed = r >> 32;
+				break;
+		}
+	}
+}
+
+/*
+ * @brief Writes an input to a file, returns whether it was written.
+ */
+static chip8_rc chip8_fuzz_save(const char path[static 1],
+		const chip8_fuzz_input input[static 1], const unsigned frames)
+{
+	FILE* const file = fopen(path, "wb");
+	chip8_rc rc = CHIP8_SUCCESS;
+
+	if (!file) {
+		perror(path);
+		return CHIP8_FAILURE;
+	}
+
+	if (1 != fwrite(&input->seed, sizeof(input->seed), 1, file)
+	    || frames != fwrite(input->keys, sizeof(*input->keys), frames, file)) {
+		perror(path);
+		rc = CHIP8_FAILURE;
+	}
+	fclose(file);
+	return rc;
+}
+
+/*
+ * @brief Reads an input saved by chip8_fuzz_save(), returns the number of
+ * frames read or zero on failure.
+ */
+static unsigned chip8_fuzz_load(const char path[static 1],
+		chip8_fuzz_input input[static 1])
+{
+	FILE* const file = fopen(path, "rb");
+	size_t frames = 0;
+
+	if (!file) {
+		perror(path);
+		return 0;
+	}
+	memset(input, 0, sizeof(*input));
+
+	if (1 == fread(&input->seed, sizeof(input->seed), 1, file)) {
+		frames = fread(input->keys, sizeof(*input->keys),
+				CHIP8_FUZZ_MAX_FRAMES, file);
+	}
+	fclose(file);
+	return frames;
+}
+
+/*
+ * @brief Reports a crash once per fault and instruction address.
+ */
+static void chip8_fuzz_crash(chip8_fuzz fuzz[static 1],
+		const chip8_fuzz_input input[static 1],
+		const chip8_fuzz_result result[static 1])
+{
+	const uint32_t id = (uint32_t) result->fault << 16 | result->pc;
+	char path[4096];
+
+	for (unsigned i = 0; i < fuzz->crash_count; i++) {
+		if (id == fuzz->crashes[i]) {
+			return;
+		}
+	}
+
+	if (CHIP8_FUZZ_CRASHES == fuzz->crash_count) {
+		return;
+	}
+	fuzz->crashes[fuzz->crash_count++] = id;
+	printf("crash: %s fault at 0x%04X istr 0x%04X in frame %llu, seed 0x%08X "
+			"after %llu executions\n", chip8_fault_name[result->fault],
+			result->pc, result->istr, (unsigned long long) result->frame,
+			input->seed, (unsigned long long) fuzz->execs);
+
+	if (fuzz->out_dir) {
+		snprintf(path, sizeof(path), "%s/crash-%04X-%u.bin", fuzz->out_dir,
+				result->pc, result->fault);
+		chip8_fuzz_save(path, input, fuzz->frames);
+	}
+}
+
+/*
+ * @brief Runs an input and keeps it in the corpus if it found new coverage.
+ */
+static void chip8_fuzz_one(chip8_fuzz fuzz[static 1],
+		const chip8_fuzz_input input[static 1])
+{
+	const chip8_fuzz_result result = chip8_fuzz_run(fuzz, input);
+
+	if (result.fault) {
+		chip8_fuzz_crash(fuzz, input, &result);
+	} else if (chip8_fuzz_new_coverage(fuzz)
+	           && fuzz->corpus_size < CHIP8_FUZZ_CORPUS) {
+		fuzz->corpus[fuzz->corpus_size++] = *input;
+	}
+}
+
+/*
+ * @brief Fuzzes until the time runs out, returns whether no crash was found.
+ */
+static chip8_rc chip8_fuzz_loop(chip8_fuzz fuzz[static 1],
+		const unsigned seconds)
+{
+	const uint64_t start_ns = chip8_time_ns();
+	const uint64_t end_ns = start_ns + seconds * CHIP8_NS_PER_SEC;
+	uint64_t report_ns = start_ns + CHIP8_NS_PER_SEC;
+	chip8_fuzz_input input = {0};
+	uint64_t now_ns = start_ns;
+
+	/* the empty input seeds the corpus */
+	fuzz->corpus_size = 1;
+	fuzz->corpus[0] = input;
+	chip8_fuzz_one(fuzz, &input);
+
+	for (unsigned entry = 0; now_ns < end_ns;
+			entry = (entry + 1) % fuzz->corpus_size) {
+		for (unsigned i = 0; i < CHIP8_FUZZ_MUTATIONS; i++) {
+			input = fuzz->corpus[entry];
+			chip8_fuzz_mutate(fuzz, &input);
+			chip8_fuzz_one(fuzz, &input);
+		}
+		now_ns = chip8_time_ns();
+
+		if (now_ns >= report_ns) {
+			printf("%llu executions, %.0f/s, %u edges, %u inputs, %u crashes\n",
+					(unsigned long long) fuzz->execs, fuzz->execs * 1e9
+					/ (now_ns - start_ns), fuzz->edges, fuzz->corpus_size,
+					fuzz->crash_count);
+			report_ns += CHIP8_NS_PER_SEC;
+		}
+	}
+	printf("done: %llu executions, %.0f/s, %u edges, %u inputs, %u crashes\n",
+			(unsigned long long) fuzz->execs, fuzz->execs * 1e9
+			/ (now_ns - start_ns), fuzz->edges, fuzz->corpus_size,
+			fuzz->crash_count);
+	return fuzz->crash_count ? CHIP8_FAILURE : CHIP8_SUCCESS;
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	static chip8_fuzz fuzz;
+	unsigned warmup = 0;
+	unsigned seconds = CHIP8_FUZZ_SECONDS;
+	const char* replay = NULL;
+	int exit_state = EXIT_FAILURE;
+	int opt;
+
+	fuzz.cycles = CHIP8_FUZZ_CYCLES;
+	fuzz.frames = CHIP8_FUZZ_FRAMES;
+	fuzz.rng = chip8_time_ns() | 1;
+
+	while (-1 != (opt = getopt(argc, argv, "c:n:w:t:s:o:r:"))) {
+		switch(opt) {
+			case 'c':
+				fuzz.cycles = strtoul(optarg, NULL, 0);
+				break;
+			case 'n':
+				fuzz.frames = strtoul(optarg, NULL, 0);
+				break;
+			case 'w':
+				warmup = strtoul(optarg, NULL, 0);
+				break;
+			case 't':
+				seconds = strtoul(optarg, NULL, 0);
+				break;
+			case 's':
+				fuzz.rng = strtoull(optarg, NULL, 0) | 1;
+				break;
+			case 'o':
+				fuzz.out_dir = optarg;
+				break;
+			case 'r':
+				replay = optarg;
+				break;
+			default:
+				goto USAGE;
+		}
+	}
+
+	if (optind + 1 != argc || !fuzz.frames
+	    || CHIP8_FUZZ_MAX_FRAMES < fuzz.frames) {
+		goto USAGE;
+	}
+	fuzz.chip8 = chip8_new_vm();
+	fuzz.snapshot = chip8_new_vm();
+	fuzz.corpus = calloc(CHIP8_FUZZ_CORPUS, sizeof(*fuzz.corpus));
+	memset(fuzz.virgin, 0xFF, sizeof(fuzz.virgin));
+
+	if (!fuzz.chip8 || !fuzz.snapshot || !fuzz.corpus) {
+		goto EXIT;
+	} else if (!chip8_load_rom(fuzz.snapshot, argv[optind])) {
+		fprintf(stderr, "%s: ROM load failed\n", argv[optind]);
+		goto EXIT;
+	}
+
+	for (unsigned i = 0; i < warmup; i++) {
+		if (!chip8_run_frame(fuzz.snapshot, fuzz.cycles)) {
+			break;
+		}
+	}
+	fuzz.snapshot->dirty = 0;
+	chip8_copy_vm(fuzz.chip8, fuzz.snapshot);
+
+	if (replay) {
+		static chip8_fuzz_input input;
+		chip8_fuzz_result result;
+
+		if (!(fuzz.frames = chip8_fuzz_load(replay, &input))) {
+			goto EXIT;
+		}
+		result = chip8_fuzz_run(&fuzz, &input);
+
+		if (result.fault) {
+			printf("%s: %s fault at 0x%04X istr 0x%04X in frame %llu\n", replay,
+					chip8_fault_name[result.fault], result.pc, result.istr,
+					(unsigned long long) result.frame);
+		} else {
+			printf("%s: no fault in %u frames%s\n", replay, fuzz.frames,
+					result.invalid ? ", stopped on an invalid instruction" : "");
+		}
+		exit_state = result.fault ? EXIT_FAILURE : EXIT_SUCCESS;
+	} else {
+		printf("%s: %u frames of %u instructions, quirks %s\n", argv[optind],
+				fuzz.frames, fuzz.cycles,
+				chip8_quirks_name[fuzz.snapshot->quirks]);
+		exit_state = chip8_fuzz_loop(&fuzz, seconds) ? EXIT_SUCCESS
+				: EXIT_FAILURE;
+	}
+EXIT:
+	free(fuzz.corpus);
+	chip8_free_vm(fuzz.snapshot);
+	chip8_free_vm(fuzz.chip8);
+	return exit_state;
+
+USAGE:
+	fprintf(stderr, "usage: %s [-c cycles] [-n frames] [-w warmup] "
+			"[-t seconds] [-s seed] [-o dir] [-r crash] rom\n", argv[0]);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,804 @@
+/*
+ * @file chip8_golden.c
+ * @brief Golden frame regression runner.
+ *
+ * Every ROM runs headless with a fixed seed and its scripted key presses
+ * and the display is hashed at the frames listed in the golden file. A ROM
+ * whose hash differs from the committed one gets a PNG showing the golden
+ * frame, the frame it drew and their difference side by side. Each ROM runs
+ * in its own process, so a crash or a hang past the timeout fails only that
+ * ROM, with up to -j processes at a time.
+ *
+ * The golden directory holds:
+ *  - golden.txt: "cycles N" followed by "rom frame hash" lines
+ *  - ROM.pgm: golden frames as netpbm images of color indices
+ *  - ROM.keys: optional "frame key press|release" lines
+ *
+ * -u runs every ROM of the ROM directory and rewrites the golden files with
+ * the frames given by -f.
+ *
+ * usage: chip8_golden [-r roms] [-g golden] [-o out] [-j jobs] [-t seconds]
+ *                     [-u] [-c cycles] [-f frame,...]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "chip8.h"
+#include "chip8_rom.h"
+
+#define CHIP8_GOLDEN_DIR "roms/golden"
+#define CHIP8_GOLDEN_FILE "golden.txt"
+#define CHIP8_GOLDEN_OUT "golden_diff"
+#define CHIP8_GOLDEN_CYCLES 20
+#define CHIP8_GOLDEN_CAPTURES "60,600,1200"
+#define CHIP8_GOLDEN_TIMEOUT 10 /* seconds per ROM */
+#define CHIP8_GOLDEN_SEED 0x601DE
+#define CHIP8_GOLDEN_MAX_FRAMES 16 /* captures per ROM */
+#define CHIP8_GOLDEN_MAX_KEYS 256 /* scripted key events per ROM */
+#define CHIP8_GOLDEN_SCALE 4 /* PNG pixels per high resolution pixel */
+
+/*
+ * @brief Golden frames of one ROM and the process checking them.
+ */
+typedef struct chip8_golden_rom {
+	char name[CHIP8_ROM_NAME_MAX+1];
+	uint64_t frames[CHIP8_GOLDEN_MAX_FRAMES]; /* ascending frame numbers */
+	uint64_t hashes[CHIP8_GOLDEN_MAX_FRAMES];
+	unsigned count;
+	pid_t pid; /* checking process, zero when not running */
+	int output; /* read end of the pipe of its output */
+	bool recorded; /* hashes were recorded by -u */
+} chip8_golden_rom;
+
+/*
+ * @brief Key press or release at the start of a frame.
+ */
+typedef struct chip8_golden_key {
+	uint64_t frame;
+	chip8_key key;
+	bool pressed;
+} chip8_golden_key;
+
+/*
+ * @brief Display contents as color indices, in its own resolution.
+ */
+typedef struct chip8_golden_image {
+	unsigned width;
+	unsigned height;
+	chip8_byte pixels[CHIP8_GFX_HIRES_HEIGHT][CHIP8_GFX_HIRES_WIDTH];
+} chip8_golden_image;
+
+/*
+ * @brief Runner options.
+ */
+typedef struct chip8_golden_opts {
+	const char* rom_dir;
+	const char* golden_dir;
+	const char* out_dir;
+	unsigned cycles;
+	unsigned timeout;
+	bool update;
+} chip8_golden_opts;
+
+/* diff colors: unchanged pixels are dimmed, removed red, added green */
+static const chip8_byte chip8_golden_palette[CHIP8_GFX_COLORS][3] = {
+	{0x00, 0x00, 0x00}, {0xFF, 0xFF, 0xFF}, {0x99, 0x99, 0x99},
+	{0x4C, 0x4C, 0x4C}
+};
+
+/*
+ * @brief Hashes the display, including the resolution it is shown in.
+ */
+static uint64_t chip8_golden_hash(const chip8_vm chip8[const static 1])
+{
+	return chip8_hash(chip8->gfx, sizeof(chip8->gfx)) ^ chip8->hires;
+}
+
+/*
+ * @brief Captures the display of the current resolution.
+ */
+static void chip8_golden_capture(const chip8_vm chip8[const static 1],
+		chip8_golden_image image[static 1])
+{
+	image->width = chip8_gfx_width(chip8);
+	image->height = chip8_gfx_height(chip8);
+
+	for (unsigned y = 0; y < image->height; y++) {
+		for (unsigned x = 0; x < image->width; x++) {
+			image->pixels[y][x] = chip8_get_pixel(chip8, x, y);
+		}
+	}
+}
+
+/*
+ * @brief Writes an image as a binary netpbm graymap of color indices.
+ */
+static chip8_rc chip8_golden_write_pgm(const char path[static 1],
+		const chip8_golden_image image[static 1])
+{
+	FILE* const file = fopen(path, "wb");
+	chip8_rc rc = CHIP8_SUCCESS;
+
+	if (!file) {
+		perror(path);
+		return CHIP8_FAILURE;
+	}
+	fprintf(file, "P5\n%u %u\n%u\n", image->width, image->height,
+			CHIP8_GFX_COLORS-1);
+
+	for (unsigned y = 0; y < image->height; y++) {
+		if (image->width != fwrite(image->pixels[y], 1, image->width, file)) {
+			rc = CHIP8_FAILURE;
+		}
+	}
+
+	if (fclose(file) || !rc) {
+		perror(path);
+		return CHIP8_FAILURE;
+	}
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Reads an image written by chip8_golden_write_pgm().
+ */
+static chip8_rc chip8_golden_read_pgm(const char path[static 1],
+		chip8_golden_image image[static 1])
+{
+	FILE* const file = fopen(path, "rb");
+	unsigned maxval;
+	chip8_rc rc = CHIP8_SUCCESS;
+
+	if (!file) {
+		return CHIP8_FAILURE;
+	}
+
+	if (3 != fscanf(file, "P5 %u %u %u", &image->width, &image->height, &maxval)
+	    || CHIP8_GFX_HIRES_WIDTH < image->width
+	    || CHIP8_GFX_HIRES_HEIGHT < image->height || EOF == fgetc(file)) {
+		rc = CHIP8_FAILURE;
+	}
+
+	for (unsigned y = 0; rc && y < image->height; y++) {
+		if (image->width != fread(image->pixels[y], 1, image->width, file)) {
+			rc = CHIP8_FAILURE;
+		}
+	}
+	fclose(file);
+	return rc;
+}
+
+/*
+ * @brief Updates a CRC-32 as used by PNG chunks.
+ */
+static uint32_t chip8_golden_crc(uint32_t crc, const chip8_byte data[],
+		const size_t size)
+{
+	crc = ~crc;
+
+	for (size_t i = 0; i < size; i++) {
+		crc ^= data[i];
+
+		for (unsigned bit = 0; bit < 8; bit++) {
+			crc = crc >> 1 ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+/*
+ * @brief Writes one PNG chunk.
+ */
+static void chip8_golden_chunk(FILE file[static 1], const char type[static 4],
+		const chip8_byte data[], const size_t size)
+{
+	const chip8_byte header[8] = {
+		size >> 24, size >> 16, size >> 8, size,
+		type[0], type[1], type[2], type[3]
+	};
+	uint32_t crc = chip8_golden_crc(0, &header[4], 4);
+	chip8_byte trailer[4];
+
+	/* empty chunks such as IEND have no data to pass along */
+	if (size) {
+		crc = chip8_golden_crc(crc, data, size);
+	}
+	trailer[0] = crc >> 24;
+	trailer[1] = crc >> 16;
+	trailer[2] = crc >> 8;
+	trailer[3] = crc;
+	fwrite(header, 1, sizeof(header), file);
+
+	if (size) {
+		fwrite(data, 1, size, file);
+	}
+	fwrite(trailer, 1, sizeof(trailer), file);
+}
+
+/*
+ * @brief Writes 8-bit RGB rows, each starting with its filter byte, as a PNG
+ * with uncompressed deflate blocks.
+ */
+static chip8_rc chip8_golden_write_png(const char path[static 1],
+		const unsigned width, const unsigned height,
+		const chip8_byte rows[const])
+{
+	const size_t size = (size_t) height * (1 + 3 * width);
+	const size_t blocks = (size + 0xFFFE) / 0xFFFF;
+	const chip8_byte signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A,
+			'\n'};
+	const chip8_byte ihdr[13] = {
+		width >> 24, width >> 16, width >> 8, width,
+		height >> 24, height >> 16, height >> 8, height,
+		8, 2, 0, 0, 0
+	};
+	chip8_byte* const zlib = malloc(2 + 5 * blocks + size + 4);
+	chip8_byte* out = zlib;
+	uint32_t a = 1;
+	uint32_t b = 0;
+	FILE* file;
+
+	if (!zlib) {
+		return CHIP8_FAILURE;
+	}
+	*out++ = 0x78;
+	*out++ = 0x01;
+
+	for (size_t offset = 0; offset < size; offset += 0xFFFF) {
+		const size_t len = size - offset < 0xFFFF ? size - offset : 0xFFFF;
+
+		*out++ = offset + len == size;
+		*out++ = len;
+		*out++ = len >> 8;
+		*out++ = ~len;
+		*out++ = ~len >> 8;
+		memcpy(out, &rows[offset], len);
+		out += len;
+	}
+
+	for (size_t i = 0; i < size; i++) {
+		a = (a + rows[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	*out++ = b >> 8;
+	*out++ = b;
+	*out++ = a >> 8;
+	*out++ = a;
+
+	if (!(file = fopen(path, "wb"))) {
+		perror(path);
+		free(zlib);
+		return CHIP8_FAILURE;
+	}
+	fwrite(signature, 1, sizeof(signature), file);
+	chip8_golden_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+	chip8_golden_chunk(file, "IDAT", zlib, out - zlib);
+	chip8_golden_chunk(file, "IEND", NULL, 0);
+	free(zlib);
+
+	if (fclose(file)) {
+		perror(path);
+		return CHIP8_FAILURE;
+	}
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Returns a pixel of an image stretched to the high resolution.
+ */
+static inline chip8_byte chip8_golden_sample(
+		const chip8_golden_image image[static 1], const unsigned x,
+		const unsigned y)
+{
+	if (!image->width || !image->height) {
+		return 0;
+	}
+	return image->pixels[y * image->height / CHIP8_GFX_HIRES_HEIGHT]
+		[x * image->width / CHIP8_GFX_HIRES_WIDTH];
+}
+
+/*
+ * @brief Writes the golden image, the actual image and their difference side
+ * by side as a PNG.
+ */
+static chip8_rc chip8_golden_write_diff(const char path[static 1],
+		const chip8_golden_image expected[static 1],
+		const chip8_golden_image actual[static 1])
+{
+	const unsigned panel = CHIP8_GFX_HIRES_WIDTH * CHIP8_GOLDEN_SCALE;
+	const unsigned width = 3 * panel;
+	const unsigned height = CHIP8_GFX_HIRES_HEIGHT * CHIP8_GOLDEN_SCALE;
+	const size_t stride = 1 + 3 * width;
+	chip8_byte* const rows = calloc(height, stride);
+	chip8_rc rc;
+
+	if (!rows) {
+		return CHIP8_FAILURE;
+	}
+
+	for (unsigned y = 0; y < height; y++) {
+		chip8_byte* pixel = &rows[y * stride + 1];
+
+		for (unsigned x = 0; x < width; x++, pixel += 3) {
+			const unsigned gx = x % panel / CHIP8_GOLDEN_SCALE;
+			const unsigned gy = y / CHIP8_GOLDEN_SCALE;
+			const chip8_byte old = chip8_golden_sample(expected, gx, gy);
+			const chip8_byte new = chip8_golden_sample(actual, gx, gy);
+
+			if (x < panel) {
+				memcpy(pixel, chip8_golden_palette[old], 3);
+			} else if (x < 2 * panel) {
+				memcpy(pixel, chip8_golden_palette[new], 3);
+			} else if (old == new) {
+				for (unsigned c = 0; c < 3; c++) {
+					pixel[c] = chip8_golden_palette[new][c] / 4;
+				}
+			} else {
+				pixel[0] = old ? 0xFF : 0x00;
+				pixel[1] = new ? 0xFF : 0x00;
+				pixel[2] = 0x00;
+			}
+		}
+	}
+	rc = chip8_golden_write_png(path, width, height, rows);
+	free(rows);
+	return rc;
+}
+
+/*
+ * @brief Reads the key script of a ROM, a missing script means no input.
+ * Returns the number of events or -1 on a malformed script.
+ */
+static int chip8_golden_read_keys(const char path[static 1],
+		chip8_golden_key keys[static CHIP8_GOLDEN_MAX_KEYS])
+{
+	FILE* const file = fopen(path, "r");
+	char line[256];
+	int count = 0;
+
+	if (!file) {
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		unsigned long long frame;
+		unsigned key;
+		char action[16];
+
+		if ('#' == line[0] || '\n' == line[0]) {
+			continue;
+		} else if (CHIP8_GOLDEN_MAX_KEYS == count
+		           || 3 != sscanf(line, "%llu %x %15s", &frame, &key, action)
+		           || CHIP8_KEY_SIZE <= key
+		           || (strcmp(action, "press") && strcmp(action, "release"))) {
+			fprintf(stderr, "%s: invalid line: %s", path, line);
+			count = -1;
+			break;
+		}
+		keys[count++] = (chip8_golden_key) {
+			.frame = frame,
+			.key = key,
+			.pressed = !strcmp(action, "press")
+		};
+	}
+	fclose(file);
+	return count;
+}
+
+/*
+ * @brief Removes the extension from a ROM file name.
+ */
+static void chip8_golden_stem(const char name[static 1], char stem[static 1],
+		const size_t size)
+{
+	const char* const dot = strrchr(name, '.');
+	const int len = dot ? (int) (dot - name) : (int) strlen(name);
+
+	snprintf(stem, size, "%.*s", len, name);
+}
+
+/*
+ * @brief Runs one ROM up to its last golden frame, printing a line per
+ * frame to the output. Returns whether every frame matched.
+ */
+static chip8_rc chip8_golden_run(const chip8_golden_opts opts[static 1],
+		chip8_golden_rom rom[static 1], FILE output[static 1])
+{
+	chip8_golden_key keys[CHIP8_GOLDEN_MAX_KEYS];
+	static chip8_golden_image actual;
+	static chip8_golden_image expected;
+	char stem[CHIP8_ROM_NAME_MAX+1];
+	char path[CHIP8_PATH_MAX];
+	chip8_vm* chip8;
+	chip8_rc rc = CHIP8_SUCCESS;
+	int key_count;
+	int next_key = 0;
+	unsigned capture = 0;
+
+	chip8_golden_stem(rom->name, stem, sizeof(stem));
+	snprintf(path, sizeof(path), "%s/%s.keys", opts->golden_dir, stem);
+
+	if (-1 == (key_count = chip8_golden_read_keys(path, keys))) {
+		return CHIP8_FAILURE;
+	}
+	snprintf(path, sizeof(path), "%s/%s", opts->rom_dir, rom->name);
+
+	if (!(chip8 = chip8_new_vm())) {
+		return CHIP8_FAILURE;
+	} else if (!chip8_load_rom(chip8, path)) {
+		fprintf(output, "ROM load failed\n");
+		chip8_free_vm(chip8);
+		return CHIP8_FAILURE;
+	}
+	chip8_seed(chip8, CHIP8_GOLDEN_SEED);
+
+	while (capture < rom->count) {
+		for (; next_key < key_count && keys[next_key].frame <= chip8->frame;
+				next_key++) {
+			chip8_set_key(chip8, keys[next_key].key, keys[next_key].pressed);
+		}
+
+		if (CHIP8_HALTED != chip8->state
+		    && !chip8_run_frame(chip8, opts->cycles)) {
+			fprintf(output, "invalid instruction 0x%04X at 0x%04X in frame %llu\n",
+					chip8->istr, chip8->pc, (unsigned long long) chip8->frame);
+			rc = CHIP8_FAILURE;
+			break;
+		} else if (CHIP8_HALTED == chip8->state) {
+			chip8->frame++;
+		}
+
+		if (chip8->frame != rom->frames[capture]) {
+			continue;
+		}
+		chip8_golden_capture(chip8, &actual);
+		snprintf(path, sizeof(path), "%s/%s-%llu.pgm", opts->golden_dir, stem,
+				(unsigned long long) chip8->frame);
+
+		if (opts->update) {
+			rom->hashes[capture] = chip8_golden_hash(chip8);
+			rc &= chip8_golden_write_pgm(path, &actual);
+			fprintf(output, "hash %016llx\n",
+					(unsigned long long) rom->hashes[capture]);
+		} else if (chip8_golden_hash(chip8) != rom->hashes[capture]) {
+			if (!chip8_golden_read_pgm(path, &expected)) {
+				memset(&expected, 0, sizeof(expected));
+			}
+			snprintf(path, sizeof(path), "%s/%s-%llu.png", opts->out_dir, stem,
+					(unsigned long long) chip8->frame);
+			chip8_golden_write_diff(path, &expected, &actual);
+			fprintf(output, "frame %llu differs, see %s\n",
+					(unsigned long long) chip8->frame, path);
+			rc = CHIP8_FAILURE;
+		}
+		capture++;
+	}
+	chip8_free_vm(chip8);
+	return rc;
+}
+
+/*
+ * @brief Forks the process checking a ROM, killed by SIGALRM once it runs
+ * past the timeout.
+ */
+static chip8_rc chip8_golden_spawn(const chip8_golden_opts opts[static 1],
+		chip8_golden_rom rom[static 1])
+{
+	int fds[2];
+
+	if (pipe(fds)) {
+		perror("pipe");
+		return CHIP8_FAILURE;
+	}
+	fflush(stdout);
+
+	if (-1 == (rom->pid = fork())) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		rom->pid = 0;
+		return CHIP8_FAILURE;
+	} else if (!rom->pid) {
+		FILE* const output = fdopen(fds[1], "w");
+		chip8_rc rc;
+
+		close(fds[0]);
+		alarm(opts->timeout);
+		rc = output && chip8_golden_run(opts, rom, output);
+		_exit(output && !fclose(output) && rc ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	close(fds[1]);
+	rom->output = fds[0];
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Collects the output and exit status of a finished ROM process,
+ * returns whether it passed.
+ */
+static chip8_rc chip8_golden_reap(const chip8_golden_opts opts[static 1],
+		chip8_golden_rom rom[static 1], const int status)
+{
+	FILE* const output = fdopen(rom->output, "r");
+	const bool passed = WIFEXITED(status) && EXIT_SUCCESS == WEXITSTATUS(status);
+	unsigned recorded = 0;
+	char line[256];
+
+	rom->pid = 0;
+
+	if (WIFSIGNALED(status) && SIGALRM == WTERMSIG(status)) {
+		printf("%-28s timed out after %u s\n", rom->name, opts->timeout);
+	} else if (WIFSIGNALED(status)) {
+		printf("%-28s crashed: %s\n", rom->name, strsignal(WTERMSIG(status)));
+	} else if (!opts->update) {
+		printf("%-28s %s\n", rom->name, passed ? "ok" : "FAILED");
+	}
+
+	while (output && fgets(line, sizeof(line), output)) {
+		unsigned long long hash;
+
+		if (opts->update && recorded < rom->count
+		    && 1 == sscanf(line, "hash %llx", &hash)) {
+			rom->hashes[recorded++] = hash;
+		} else {
+			printf("    %s", line);
+		}
+	}
+	rom->recorded = passed && opts->update && recorded == rom->count;
+
+	if (output) {
+		fclose(output);
+	} else {
+		close(rom->output);
+	}
+	return passed ? CHIP8_SUCCESS : CHIP8_FAILURE;
+}
+
+/*
+ * @brief Reads the golden file, returns the number of ROMs or -1.
+ */
+static int chip8_golden_read(const chip8_golden_opts opts[static 1],
+		chip8_golden_rom** const roms, unsigned cycles[static 1])
+{
+	char path[CHIP8_PATH_MAX];
+	char line[512];
+	FILE* file;
+	int count = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", opts->golden_dir, CHIP8_GOLDEN_FILE);
+
+	if (!(file = fopen(path, "r"))) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		char name[CHIP8_ROM_NAME_MAX+1];
+		unsigned long long frame;
+		unsigned long long hash;
+		chip8_golden_rom* rom = count ? &(*roms)[count-1] : NULL;
+
+		if ('#' == line[0] || '\n' == line[0]
+		    || 1 == sscanf(line, "cycles %u", cycles)) {
+			continue;
+		} else if (3 != sscanf(line, "%255s %llu %llx", name, &frame, &hash)) {
+			fprintf(stderr, "%s: invalid line: %s", path, line);
+			count = -1;
+			break;
+		}
+
+		if (!rom || strcmp(rom->name, name)) {
+			chip8_golden_rom* const grown = realloc(*roms,
+					(count + 1) * sizeof(**roms));
+
+			if (!grown) {
+				count = -1;
+				break;
+			}
+			*roms = grown;
+			rom = memset(&grown[count++], 0, sizeof(*grown));
+			strcpy(rom->name, name);
+		}
+
+		if (CHIP8_GOLDEN_MAX_FRAMES == rom->count
+		    || (rom->count && frame <= rom->frames[rom->count-1])) {
+			fprintf(stderr, "%s: frames of %s not ascending or too many\n",
+					path, name);
+			count = -1;
+			break;
+		}
+		rom->frames[rom->count] = frame;
+		rom->hashes[rom->count++] = hash;
+	}
+	fclose(file);
+	return count;
+}
+
+/*
+ * @brief Lists every ROM of the ROM directory with the capture frames,
+ * returns the number of ROMs or -1.
+ */
+static int chip8_golden_list(const chip8_golden_opts opts[static 1],
+		const char captures[static 1], chip8_golden_rom** const roms)
+{
+	uint64_t frames[CHIP8_GOLDEN_MAX_FRAMES];
+	unsigned frame_count = 0;
+	chip8_catalog catalog;
+	int count;
+	char* end;
+
+	for (const char* c = captures; *c && CHIP8_GOLDEN_MAX_FRAMES > frame_count;
+			c = ',' == *end ? end + 1 : end) {
+		frames[frame_count] = strtoull(c, &end, 10);
+
+		if (end == c || (frame_count && frames[frame_count]
+				<= frames[frame_count-1])) {
+			fprintf(stderr, "capture frames must be ascending: %s\n", captures);
+			return -1;
+		}
+		frame_count++;
+	}
+
+	if (!chip8_open_catalog(&catalog, opts->rom_dir)) {
+		return -1;
+	} else if (!(*roms = calloc(catalog.count ? catalog.count : 1,
+			sizeof(**roms)))) {
+		chip8_close_catalog(&catalog);
+		return -1;
+	}
+
+	for (size_t i = 0; i < catalog.count; i++) {
+		strcpy((*roms)[i].name, catalog.entries[i].name);
+		memcpy((*roms)[i].frames, frames, sizeof(frames));
+		(*roms)[i].count = frame_count;
+	}
+	count = catalog.count;
+	chip8_close_catalog(&catalog);
+	return count;
+}
+
+/*
+ * @brief Rewrites the golden file with the hashes of the recorded ROMs.
+ */
+static chip8_rc chip8_golden_write(const chip8_golden_opts opts[static 1],
+		const chip8_golden_rom roms[const], const int count)
+{
+	char path[CHIP8_PATH_MAX];
+	FILE* file;
+
+	snprintf(path, sizeof(path), "%s/%s", opts->golden_dir, CHIP8_GOLDEN_FILE);
+
+	if (!(file = fopen(path, "w"))) {
+		perror(path);
+		return CHIP8_FAILURE;
+	}
+	fprintf(file, "# rom frame hash, regenerate with chip8_golden -u\n"
+			"cycles %u\n", opts->cycles);
+
+	for (int i = 0; i < count; i++) {
+		for (unsigned j = 0; roms[i].recorded && j < roms[i].count; j++) {
+			fprintf(file, "%s %llu %016llx\n", roms[i].name,
+					(unsigned long long) roms[i].frames[j],
+					(unsigned long long) roms[i].hashes[j]);
+		}
+	}
+
+	if (fclose(file)) {
+		perror(path);
+		return CHIP8_FAILURE;
+	}
+	return CHIP8_SUCCESS;
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	chip8_golden_opts opts = {
+		.rom_dir = "roms",
+		.golden_dir = CHIP8_GOLDEN_DIR,
+		.out_dir = CHIP8_GOLDEN_OUT,
+		.cycles = CHIP8_GOLDEN_CYCLES,
+		.timeout = CHIP8_GOLDEN_TIMEOUT
+	};
+	const char* captures = CHIP8_GOLDEN_CAPTURES;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	chip8_golden_rom* roms = NULL;
+	int count;
+	int next = 0;
+	int running = 0;
+	int failed = 0;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "r:g:o:j:t:uc:f:"))) {
+		switch(opt) {
+			case 'r':
+				opts.rom_dir = optarg;
+				break;
+			case 'g':
+				opts.golden_dir = optarg;
+				break;
+			case 'o':
+				opts.out_dir = optarg;
+				break;
+			case 'j':
+				jobs = strtol(optarg, NULL, 0);
+				break;
+			case 't':
+				opts.timeout = strtoul(optarg, NULL, 0);
+				break;
+			case 'u':
+				opts.update = true;
+				break;
+			case 'c':
+				opts.cycles = strtoul(optarg, NULL, 0);
+				break;
+			case 'f':
+				captures = optarg;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-r roms] [-g golden] [-o out] "
+						"[-j jobs] [-t seconds] [-u] [-c cycles] "
+						"[-f frame,...]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	count = opts.update ? chip8_golden_list(&opts, captures, &roms)
+		: chip8_golden_read(&opts, &roms, &opts.cycles);
+
+	if (0 > count) {
+		free(roms);
+		return EXIT_FAILURE;
+	}
+
+	if (mkdir(opts.update ? opts.golden_dir : opts.out_dir, 0755)
+	    && EEXIST != errno) {
+		perror(opts.update ? opts.golden_dir : opts.out_dir);
+	}
+	jobs = 1 > jobs ? 1 : jobs;
+
+	while (next < count || running) {
+		int status;
+		pid_t pid;
+
+		if (next < count && running < jobs) {
+			if (chip8_golden_spawn(&opts, &roms[next])) {
+				running++;
+			} else {
+				failed++;
+			}
+			next++;
+			continue;
+		}
+
+		if (-1 == (pid = wait(&status))) {
+			perror("wait");
+			break;
+		}
+
+		for (int i = 0; i < count; i++) {
+			if (pid == roms[i].pid) {
+				failed += !chip8_golden_reap(&opts, &roms[i], status);
+				running--;
+				break;
+			}
+		}
+	}
+
+	if (opts.update && !chip8_golden_write(&opts, roms, count)) {
+		failed = count;
+	}
+	printf("%d of %d ROMs %s\n", count - failed, count,
+			opts.update ? "recorded" : "passed");
+	free(roms);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
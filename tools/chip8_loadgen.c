@@ -0,0 +1,395 @@
+/*
+ * @file chip8_loadgen.c
+ * @brief Synthetic load for chip8_server, many sessions pressing keys.
+ *
+ * Each thread connects its share of the sessions and sends every session
+ * a random key press or release at the given rate. Input latency is the time
+ * from sending an event to receiving the acknowledgment the server sends with
+ * the first frame run after applying it, which includes waiting for the
+ * server's next 60 Hz tick. Frame records are parsed but not decoded.
+ *
+ * usage: chip8_loadgen [-j threads] [-n sessions] [-r rate] [-s socket]
+ *        [-t seconds]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#include "chip8.h"
+#include "chip8_hist.h"
+#include "chip8_server.h"
+#include "chip8_stream.h"
+#include "chip8_time.h"
+
+#define CHIP8_LOADGEN_SESSIONS 1000
+#define CHIP8_LOADGEN_RATE 4 /* key events per session and second */
+#define CHIP8_LOADGEN_SECONDS 10
+#define CHIP8_LOADGEN_EVENTS 256
+#define CHIP8_LOADGEN_TICK_NS (CHIP8_NS_PER_SEC / 1000)
+#define CHIP8_LOADGEN_INFLIGHT 64 /* send times kept per session */
+#define CHIP8_LOADGEN_IN_SIZE (2 * CHIP8_STREAM_RECORD_SIZE)
+
+typedef struct chip8_client {
+	int fd;
+	uint32_t seq; /* next input sequence number */
+	uint64_t next_ns; /* when to send the next input */
+	uint64_t sent_ns[CHIP8_LOADGEN_INFLIGHT];
+	bool header; /* stream header received */
+	size_t in_size;
+	chip8_byte in[CHIP8_LOADGEN_IN_SIZE];
+} chip8_client;
+
+typedef struct chip8_loadgen {
+	const char* path;
+	unsigned sessions; /* of this thread */
+	uint64_t interval_ns; /* between inputs of a session */
+	uint64_t end_ns;
+	uint32_t rng;
+
+	pthread_t thread;
+	chip8_client* clients;
+	unsigned connected;
+	unsigned closed; /* connections the server closed */
+	uint64_t inputs;
+	uint64_t acks;
+	uint64_t records;
+	uint64_t bytes;
+	chip8_hist latency; /* input to frame latency in ns */
+} chip8_loadgen;
+
+static inline uint32_t chip8_loadgen_rand(chip8_loadgen gen[const static 1])
+{
+	gen->rng ^= gen->rng << 13;
+	gen->rng ^= gen->rng >> 17;
+	gen->rng ^= gen->rng << 5;
+	return gen->rng;
+}
+
+static int chip8_loadgen_connect(const char path[static 1])
+{
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	int fd;
+
+	strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+	if (0 > (fd = socket(AF_UNIX, SOCK_STREAM, 0))) {
+		return -1;
+	} else if (connect(fd, (struct sockaddr*) &address, sizeof(address))
+	           || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * @brief Reads a varint from a partially received message, returns its size
+ * or 0 when it is incomplete.
+ */
+static size_t chip8_loadgen_varint(const chip8_byte src[const static 1],
+		const size_t size, uint64_t value[const static 1])
+{
+	*value = 0;
+
+	for (size_t i = 0; i < size && i < 10; i++) {
+		*value |= (uint64_t) (src[i] & 0x7F) << 7 * i;
+
+		if (!(src[i] & 0x80)) {
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * @brief Consumes complete server messages, returns false on a protocol
+ * error.
+ */
+static bool chip8_loadgen_parse(chip8_loadgen gen[const static 1],
+		chip8_client client[const static 1], const uint64_t now_ns)
+{
+	size_t used = 0;
+
+	if (!client->header) {
+		if (CHIP8_STREAM_HEADER_SIZE > client->in_size) {
+			return true;
+		} else if (memcmp(client->in, CHIP8_STREAM_MAGIC, 4)) {
+			return false;
+		}
+		client->header = true;
+		used = CHIP8_STREAM_HEADER_SIZE;
+	}
+
+	while (used < client->in_size) {
+		const chip8_byte* const msg = &client->in[used];
+		const size_t size = client->in_size - used;
+		uint64_t frame;
+		uint64_t length;
+		size_t frame_size;
+		size_t length_size;
+
+		if (CHIP8_SERVER_ACK == msg[0]) {
+			uint32_t seq;
+
+			if (CHIP8_SERVER_ACK_SIZE > size) {
+				break;
+			}
+			seq = chip8_get_le32(&msg[1]);
+			chip8_hist_record(&gen->latency, now_ns
+					- client->sent_ns[seq % CHIP8_LOADGEN_INFLIGHT]);
+			gen->acks++;
+			used += CHIP8_SERVER_ACK_SIZE;
+		} else if (CHIP8_SERVER_FRAME == msg[0]) {
+			if (3 > size
+			    || !(frame_size = chip8_loadgen_varint(&msg[2], size - 2,
+			            &frame))
+			    || !(length_size = chip8_loadgen_varint(&msg[2 + frame_size],
+			            size - 2 - frame_size, &length))) {
+				break;
+			} else if (2 + frame_size + length_size + length > size) {
+				break;
+			}
+			gen->records++;
+			used += 2 + frame_size + length_size + length;
+		} else {
+			return false;
+		}
+	}
+	memmove(client->in, &client->in[used], client->in_size - used);
+	client->in_size -= used;
+	return client->in_size < CHIP8_LOADGEN_IN_SIZE;
+}
+
+static void chip8_loadgen_close(chip8_loadgen gen[const static 1],
+		chip8_client client[const static 1])
+{
+	if (0 <= client->fd) {
+		close(client->fd);
+		client->fd = -1;
+		gen->closed++;
+	}
+}
+
+static void chip8_loadgen_read(chip8_loadgen gen[const static 1],
+		chip8_client client[const static 1])
+{
+	for (;;) {
+		const ssize_t size = recv(client->fd, &client->in[client->in_size],
+				CHIP8_LOADGEN_IN_SIZE - client->in_size, 0);
+
+		if (!size || (size < 0 && EAGAIN != errno && EWOULDBLOCK != errno
+		              && EINTR != errno)) {
+			chip8_loadgen_close(gen, client);
+			return;
+		} else if (size < 0) {
+			return;
+		}
+		gen->bytes += size;
+		client->in_size += size;
+
+		if (!chip8_loadgen_parse(gen, client, chip8_time_ns())) {
+			fprintf(stderr, "chip8_loadgen: protocol error\n");
+			chip8_loadgen_close(gen, client);
+			return;
+		}
+	}
+}
+
+/*
+ * @brief Sends the inputs that are due, a full socket delays them.
+ */
+static void chip8_loadgen_send(chip8_loadgen gen[const static 1],
+		const uint64_t now_ns)
+{
+	for (unsigned i = 0; i < gen->sessions; i++) {
+		chip8_client* const client = &gen->clients[i];
+		const uint32_t rand = chip8_loadgen_rand(gen);
+		chip8_byte msg[CHIP8_SERVER_MSG_SIZE] = {
+			CHIP8_SERVER_KEY, rand % CHIP8_KEY_SIZE, rand >> 8 & 1, 0
+		};
+
+		if (0 > client->fd || now_ns < client->next_ns) {
+			continue;
+		}
+		chip8_put_le32(&msg[4], client->seq);
+
+		if (sizeof(msg) == send(client->fd, msg, sizeof(msg), MSG_NOSIGNAL)) {
+			client->sent_ns[client->seq++ % CHIP8_LOADGEN_INFLIGHT] = now_ns;
+			client->next_ns += gen->interval_ns;
+			gen->inputs++;
+		}
+	}
+}
+
+static void* chip8_loadgen_thread(void* const arg)
+{
+	chip8_loadgen* const gen = arg;
+	const struct itimerspec period = {
+		.it_interval = { .tv_nsec = CHIP8_LOADGEN_TICK_NS },
+		.it_value = { .tv_nsec = CHIP8_LOADGEN_TICK_NS }
+	};
+	struct epoll_event events[CHIP8_LOADGEN_EVENTS];
+	struct epoll_event event = { .events = EPOLLIN };
+	const int epoll_fd = epoll_create1(0);
+	const int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	const uint64_t start_ns = chip8_time_ns();
+
+	if (0 > epoll_fd || 0 > timer_fd
+	    || timerfd_settime(timer_fd, 0, &period, NULL)
+	    || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event)) {
+		perror("chip8_loadgen: epoll or timerfd setup");
+		return NULL;
+	}
+
+	for (unsigned i = 0; i < gen->sessions; i++) {
+		chip8_client* const client = &gen->clients[i];
+
+		event.events = EPOLLIN | EPOLLET;
+		event.data.ptr = client;
+		client->next_ns = start_ns + chip8_loadgen_rand(gen) % gen->interval_ns;
+
+		if (0 > (client->fd = chip8_loadgen_connect(gen->path))
+		    || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client->fd, &event)) {
+			perror("chip8_loadgen: connect");
+			break;
+		}
+		gen->connected++;
+	}
+
+	while (chip8_time_ns() < gen->end_ns) {
+		const int count = epoll_wait(epoll_fd, events, CHIP8_LOADGEN_EVENTS,
+				100);
+
+		for (int i = 0; i < count; i++) {
+			uint64_t expirations;
+
+			if (!events[i].data.ptr) {
+				if (sizeof(expirations) == read(timer_fd, &expirations,
+						sizeof(expirations))) {
+					chip8_loadgen_send(gen, chip8_time_ns());
+				}
+			} else if (0 <= ((chip8_client*) events[i].data.ptr)->fd) {
+				chip8_loadgen_read(gen, events[i].data.ptr);
+			}
+		}
+	}
+
+	for (unsigned i = 0; i < gen->sessions; i++) {
+		if (0 <= gen->clients[i].fd) {
+			close(gen->clients[i].fd);
+		}
+	}
+	close(timer_fd);
+	close(epoll_fd);
+	return NULL;
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	const char* path = CHIP8_SERVER_SOCKET;
+	unsigned sessions = CHIP8_LOADGEN_SESSIONS;
+	unsigned rate = CHIP8_LOADGEN_RATE;
+	unsigned seconds = CHIP8_LOADGEN_SECONDS;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	chip8_loadgen* gens;
+	struct rlimit files;
+	uint64_t acks = 0;
+	uint64_t inputs = 0;
+	uint64_t records = 0;
+	uint64_t bytes = 0;
+	unsigned connected = 0;
+	unsigned closed = 0;
+	chip8_hist latency = { 0 };
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "j:n:r:s:t:"))) {
+		switch (opt) {
+			case 'j':
+				threads = strtol(optarg, NULL, 0);
+				break;
+			case 'n':
+				sessions = strtoul(optarg, NULL, 0);
+				break;
+			case 'r':
+				rate = strtoul(optarg, NULL, 0);
+				break;
+			case 's':
+				path = optarg;
+				break;
+			case 't':
+				seconds = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-j threads] [-n sessions] [-r rate] "
+						"[-s socket] [-t seconds]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	threads = threads < 1 ? 1 : threads > sessions ? sessions : threads;
+	rate = rate ? rate : 1;
+
+	if (!getrlimit(RLIMIT_NOFILE, &files)) {
+		files.rlim_cur = files.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &files);
+	}
+
+	if (!(gens = calloc(threads, sizeof(*gens)))) {
+		perror("chip8_loadgen: calloc");
+		return EXIT_FAILURE;
+	}
+
+	for (long t = 0; t < threads; t++) {
+		chip8_loadgen* const gen = &gens[t];
+
+		gen->path = path;
+		gen->sessions = sessions / threads + (t < sessions % threads);
+		gen->interval_ns = CHIP8_NS_PER_SEC / rate;
+		gen->end_ns = chip8_time_ns() + seconds * CHIP8_NS_PER_SEC;
+		gen->rng = 0x2545F491 + t;
+
+		if (!(gen->clients = calloc(gen->sessions, sizeof(*gen->clients)))
+		    || pthread_create(&gen->thread, NULL, chip8_loadgen_thread, gen)) {
+			perror("chip8_loadgen: thread");
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (long t = 0; t < threads; t++) {
+		pthread_join(gens[t].thread, NULL);
+		connected += gens[t].connected;
+		closed += gens[t].closed;
+		inputs += gens[t].inputs;
+		acks += gens[t].acks;
+		records += gens[t].records;
+		bytes += gens[t].bytes;
+		chip8_merge_hist(&latency, &gens[t].latency);
+	}
+	printf("%u sessions connected, %u closed by the server, %" PRIu64
+			" inputs, %" PRIu64 " acknowledged, %.1f records/s per session, "
+			"%.1f KB/s\n", connected, closed, inputs, acks,
+			connected ? records / (double) seconds / connected : 0.0,
+			bytes / 1024.0 / seconds);
+
+	chip8_print_hist(stdout, "input to frame latency", &latency,
+			CHIP8_NS_PER_MS, "ms");
+
+	for (long t = 0; t < threads; t++) {
+		free(gens[t].clients);
+	}
+	free(gens);
+	return connected == sessions ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,356 @@
+/*
+ * @file chip8_netplay.c
+ * @brief Headless rollback netplay peer over loopback UDP.
+ *
+ * Two processes, one per player, run the same ROM in lockstep with
+ * rollback: each presses random keys of its half of the keypad and
+ * exchanges inputs with its peer. Outgoing packets pass through a shim
+ * delaying them by the given latency plus random jitter and dropping the
+ * given share, which stands in for a real network. Once both peers have
+ * every input of the given number of frames, each prints its rollback
+ * statistics and the hash of the final state, which match when the peers
+ * stayed in sync.
+ *
+ * usage: chip8_netplay -p player -b port -r port [-c cycles] [-d depth]
+ *        [-j jitter] [-k rate] [-l latency] [-n frames] [-x loss] rom
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "chip8.h"
+#include "chip8_hash.h"
+#include "chip8_hist.h"
+#include "chip8_rollback.h"
+#include "chip8_rom.h"
+#include "chip8_time.h"
+
+#define CHIP8_NETPLAY_FRAMES 600
+#define CHIP8_NETPLAY_RATE 4 /* key changes per second */
+#define CHIP8_NETPLAY_QUEUE 256 /* packets held by the latency shim */
+#define CHIP8_NETPLAY_LINGER_NS (2 * CHIP8_NS_PER_SEC) /* resend after done */
+#define CHIP8_NETPLAY_TIMEOUT_NS (10 * CHIP8_NS_PER_SEC)
+#define CHIP8_NETPLAY_SEED 1 /* of the machine's CXNN, the same on both */
+
+/*
+ * @brief Packet held back by the latency shim until it is due.
+ */
+typedef struct chip8_netplay_packet {
+	uint64_t due_ns; /* 0 for a free slot */
+	size_t size;
+	chip8_byte data[CHIP8_ROLLBACK_PACKET_SIZE];
+} chip8_netplay_packet;
+
+typedef struct chip8_netplay {
+	int fd;
+	struct sockaddr_in remote;
+	uint64_t latency_ns;
+	uint64_t jitter_ns;
+	unsigned loss; /* percent of packets dropped */
+	uint32_t rng;
+	uint64_t sent;
+	uint64_t dropped;
+	chip8_netplay_packet queue[CHIP8_NETPLAY_QUEUE];
+} chip8_netplay;
+
+static inline uint32_t chip8_netplay_rand(uint32_t rng[const static 1])
+{
+	*rng ^= *rng << 13;
+	*rng ^= *rng >> 17;
+	*rng ^= *rng << 5;
+	return *rng;
+}
+
+static int chip8_netplay_bind(const unsigned port)
+{
+	struct sockaddr_in local = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+	};
+	int fd;
+
+	if (0 > (fd = socket(AF_INET, SOCK_DGRAM, 0))) {
+		perror("chip8_netplay: socket");
+		return -1;
+	} else if (bind(fd, (struct sockaddr*) &local, sizeof(local))
+	           || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK)) {
+		perror("chip8_netplay: bind");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * @brief Queues a packet in the shim, due after the latency and a random
+ * part of the jitter, unless it is one of the dropped ones.
+ */
+static void chip8_netplay_send(chip8_netplay net[const static 1],
+		const chip8_byte data[const static 1], const size_t size)
+{
+	chip8_netplay_packet* packet = NULL;
+
+	if (chip8_netplay_rand(&net->rng) % 100 < net->loss) {
+		net->dropped++;
+		return;
+	}
+
+	for (unsigned i = 0; i < CHIP8_NETPLAY_QUEUE && !packet; i++) {
+		packet = net->queue[i].due_ns ? NULL : &net->queue[i];
+	}
+
+	if (!packet) {
+		net->dropped++;
+		return;
+	}
+	packet->due_ns = chip8_time_ns() + net->latency_ns + (net->jitter_ns
+			? chip8_netplay_rand(&net->rng) % net->jitter_ns : 0);
+	packet->size = size;
+	memcpy(packet->data, data, size);
+}
+
+/*
+ * @brief Sends the packets that are due, returns when the next one is due
+ * or UINT64_MAX.
+ */
+static uint64_t chip8_netplay_flush(chip8_netplay net[const static 1])
+{
+	const uint64_t now_ns = chip8_time_ns();
+	uint64_t next_ns = UINT64_MAX;
+
+	for (unsigned i = 0; i < CHIP8_NETPLAY_QUEUE; i++) {
+		chip8_netplay_packet* const packet = &net->queue[i];
+
+		if (!packet->due_ns) {
+			continue;
+		} else if (packet->due_ns > now_ns) {
+			next_ns = packet->due_ns < next_ns ? packet->due_ns : next_ns;
+			continue;
+		}
+		sendto(net->fd, packet->data, packet->size, 0,
+				(struct sockaddr*) &net->remote, sizeof(net->remote));
+		packet->due_ns = 0;
+		net->sent++;
+	}
+	return next_ns;
+}
+
+/*
+ * @brief Takes every packet received so far, returns whether there was one.
+ */
+static bool chip8_netplay_receive(chip8_netplay net[const static 1],
+		chip8_rollback rollback[const static 1])
+{
+	chip8_byte data[CHIP8_ROLLBACK_PACKET_SIZE];
+	bool received = false;
+	ssize_t size;
+
+	while (0 <= (size = recv(net->fd, data, sizeof(data), 0))) {
+		received |= chip8_rollback_unpack(rollback, data, size);
+	}
+	return received;
+}
+
+/*
+ * @brief Presses or releases a random key of the local player now and then.
+ */
+static chip8_word chip8_netplay_keys(chip8_word keys, const chip8_word mask,
+		const unsigned rate, uint32_t rng[const static 1])
+{
+	const unsigned key = chip8_netplay_rand(rng) % CHIP8_KEY_SIZE;
+
+	if (chip8_netplay_rand(rng) % CHIP8_FRAME_RATE < rate && mask >> key & 1) {
+		keys ^= 1 << key;
+	}
+	return keys;
+}
+
+static void chip8_netplay_report(const chip8_rollback rollback[const static 1],
+		const chip8_netplay net[const static 1], const unsigned player,
+		const chip8_vm chip8[const static 1])
+{
+	const double frame_ns = rollback->replayed
+		? rollback->replay_ns / (double) rollback->replayed : 0;
+
+	printf("player %u: %" PRIu64 " frames, %" PRIu64 " rollbacks, %" PRIu64
+			" frames replayed, %" PRIu64 " stalls, %" PRIu64 " desyncs",
+			player, rollback->frame, rollback->rollbacks, rollback->replayed,
+			rollback->stalls, rollback->desyncs);
+
+	if (rollback->desyncs) {
+		printf(" from frame %" PRIu64, rollback->desync_frame);
+	}
+	printf(", %" PRIu64 " packets sent, %" PRIu64 " dropped\n", net->sent,
+			net->dropped);
+	chip8_print_hist(stdout, "replay time", &rollback->replay_time,
+			CHIP8_NS_PER_MS / 1000, "us");
+	printf("replaying %u frames takes %.1f us, %.2f%% of a 60 Hz frame\n",
+			rollback->depth, rollback->depth * frame_ns / 1000,
+			rollback->depth * frame_ns * 100 / CHIP8_FRAME_NS);
+	printf("state after %" PRIu64 " frames %016" PRIx64 "\n", rollback->frame,
+			chip8_hash_vm(chip8).lo);
+}
+
+static void chip8_netplay_usage(const char program[static 1])
+{
+	fprintf(stderr, "usage: %s -p player -b port -r port [-c cycles] "
+			"[-d depth] [-j jitter] [-k rate] [-l latency] [-n frames] "
+			"[-x loss] rom\n"
+			"  -p player   1 for the left half of the keypad, 2 for the right\n"
+			"  -b port     loopback UDP port to receive on\n"
+			"  -r port     loopback UDP port of the peer\n"
+			"  -d depth    frames a misprediction may reach back (default %d)\n"
+			"  -j jitter   random extra delay of sent packets in ms\n"
+			"  -k rate     key changes per second (default %d)\n"
+			"  -l latency  delay of sent packets in ms\n"
+			"  -n frames   frames to run (default %d)\n"
+			"  -x loss     percent of sent packets dropped\n",
+			program, CHIP8_ROLLBACK_DEPTH, CHIP8_NETPLAY_RATE,
+			CHIP8_NETPLAY_FRAMES);
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	static chip8_netplay net = {
+		.remote = { .sin_family = AF_INET }
+	};
+	static chip8_rollback rollback;
+	unsigned player = 0;
+	unsigned port = 0;
+	unsigned remote_port = 0;
+	unsigned cycles = CHIP8_CYCLES_PER_FRAME;
+	unsigned depth = CHIP8_ROLLBACK_DEPTH;
+	unsigned rate = CHIP8_NETPLAY_RATE;
+	uint64_t frames = CHIP8_NETPLAY_FRAMES;
+	uint64_t deadline_ns;
+	uint64_t heard_ns;
+	uint64_t done_ns = 0;
+	uint32_t key_rng;
+	chip8_word keys = 0;
+	chip8_vm* chip8;
+	int exit_state = EXIT_FAILURE;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "b:c:d:j:k:l:n:p:r:x:"))) {
+		switch (opt) {
+			case 'b':
+				port = strtoul(optarg, NULL, 0);
+				break;
+			case 'c':
+				cycles = strtoul(optarg, NULL, 0);
+				break;
+			case 'd':
+				depth = strtoul(optarg, NULL, 0);
+				break;
+			case 'j':
+				net.jitter_ns = strtoull(optarg, NULL, 0) * 1000000;
+				break;
+			case 'k':
+				rate = strtoul(optarg, NULL, 0);
+				break;
+			case 'l':
+				net.latency_ns = strtoull(optarg, NULL, 0) * 1000000;
+				break;
+			case 'n':
+				frames = strtoull(optarg, NULL, 0);
+				break;
+			case 'p':
+				player = strtoul(optarg, NULL, 0);
+				break;
+			case 'r':
+				remote_port = strtoul(optarg, NULL, 0);
+				break;
+			case 'x':
+				net.loss = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				chip8_netplay_usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind + 1 != argc || (1 != player && 2 != player) || !port
+	    || !remote_port || port > UINT16_MAX || remote_port > UINT16_MAX) {
+		chip8_netplay_usage(argv[0]);
+		return EXIT_FAILURE;
+	} else if (!(chip8 = chip8_new_vm())
+	           || !chip8_load_rom(chip8, argv[optind])) {
+		fprintf(stderr, "%s: ROM load failed\n", argv[optind]);
+		return EXIT_FAILURE;
+	} else if (!chip8_init_rollback(&rollback, player - 1, depth, cycles)
+	           || 0 > (net.fd = chip8_netplay_bind(port))) {
+		chip8_free_vm(chip8);
+		return EXIT_FAILURE;
+	}
+	chip8_seed(chip8, CHIP8_NETPLAY_SEED);
+	net.remote.sin_port = htons(remote_port);
+	net.remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	net.rng = 0x2545F491 * player;
+	key_rng = 0x9E3779B9 * player;
+	deadline_ns = heard_ns = chip8_time_ns();
+
+	for (;;) {
+		chip8_byte packet[CHIP8_ROLLBACK_PACKET_SIZE];
+		uint64_t now_ns;
+
+		if (chip8_netplay_receive(&net, &rollback)) {
+			heard_ns = chip8_time_ns();
+		}
+
+		if (rollback.frame < frames) {
+			const uint64_t frame = rollback.frame;
+
+			if (!chip8_rollback_advance(&rollback, chip8, keys)) {
+				fprintf(stderr, "chip8_netplay: execution failed\n");
+				break;
+			} else if (frame != rollback.frame) {
+				keys = chip8_netplay_keys(keys, rollback.mask, rate, &key_rng);
+			}
+		} else if (!chip8_rollback_sync(&rollback, chip8)) {
+			fprintf(stderr, "chip8_netplay: execution failed\n");
+			break;
+		}
+		chip8_netplay_send(&net, packet, chip8_rollback_pack(&rollback,
+				packet));
+		now_ns = chip8_time_ns();
+
+		/* keep resending a while, the peer may still miss the last inputs */
+		if (rollback.frame == frames && rollback.received >= frames) {
+			done_ns = done_ns ? done_ns : now_ns;
+
+			if (now_ns - done_ns > CHIP8_NETPLAY_LINGER_NS + net.latency_ns
+					+ net.jitter_ns) {
+				exit_state = rollback.desyncs ? EXIT_FAILURE : EXIT_SUCCESS;
+				break;
+			}
+		} else if (now_ns - heard_ns > CHIP8_NETPLAY_TIMEOUT_NS) {
+			fprintf(stderr, "chip8_netplay: peer timed out\n");
+			break;
+		}
+
+		/* the shim sends delayed packets while the frame waits */
+		deadline_ns += CHIP8_FRAME_NS;
+
+		for (uint64_t due_ns; (due_ns = chip8_netplay_flush(&net))
+				< deadline_ns;) {
+			chip8_sleep_until(due_ns);
+		}
+		chip8_sleep_until(deadline_ns);
+	}
+	chip8_netplay_report(&rollback, &net, player, chip8);
+	close(net.fd);
+	chip8_free_rollback(&rollback);
+	chip8_free_vm(chip8);
+	return exit_state;
+}
@@ -0,0 +1,692 @@
+/*
+ * @file chip8_server.c
+ * @brief Hosts many concurrent sessions, each with its own virtual machine,
+ * behind a Unix socket.
+ *
+ * Every worker thread owns an epoll instance, a 60 Hz timerfd and the
+ * sessions handed to it by the accepting main thread. On each tick a worker
+ * applies queued input to all its sessions, runs one frame of each and
+ * sends the display as a delta-encoded stream record. Sessions live in one
+ * allocation with fixed-capacity input and output buffers, so handling
+ * messages never allocates. A session whose client has not drained the
+ * last record skips sending frames until it has, emulation keeps running.
+ * On exit each worker reports its tick times, which give the number of
+ * sessions a core sustains at 60 Hz. With -p each worker also records into
+ * its own metrics shard, served in Prometheus text format while it runs.
+ *
+ * usage: chip8_server [-c cycles] [-j workers] [-m max] [-p metrics]
+ *                     [-s socket] rom...
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#include "chip8.h"
+#include "chip8_hist.h"
+#include "chip8_input.h"
+#include "chip8_istr.h"
+#include "chip8_metrics.h"
+#include "chip8_ring.h"
+#include "chip8_rom.h"
+#include "chip8_server.h"
+#include "chip8_stream.h"
+#include "chip8_time.h"
+
+#define CHIP8_SERVER_CYCLES CHIP8_CYCLES_PER_FRAME
+#define CHIP8_SERVER_MAX 4096 /* sessions per worker */
+#define CHIP8_SERVER_EVENTS 256 /* epoll events per wait */
+#define CHIP8_SERVER_CATCHUP 4 /* frames run for one late tick at most */
+#define CHIP8_SERVER_IN_SIZE (8 * CHIP8_SERVER_MSG_SIZE)
+#define CHIP8_SERVER_OUT_SIZE \
+	(CHIP8_STREAM_HEADER_SIZE + CHIP8_SERVER_ACK_SIZE + 1 \
+	 + CHIP8_STREAM_RECORD_SIZE)
+
+/*
+ * @brief Client connection with its virtual machine.
+ */
+typedef struct chip8_session {
+	chip8_vm vm;
+	chip8_input_queue input; /* keypad events applied before the next frame */
+	chip8_stream_encoder encoder; /* display the client has */
+	uint64_t gfx_hash; /* display hash of the last encoded frame */
+	uint64_t wait_ns; /* FX0A wait accounted up to, 0 while not waiting */
+	int fd; /* connection, -1 once closed */
+	unsigned slot; /* index in the worker's session list */
+	uint32_t ack; /* sequence number of the last input received */
+	bool ack_pending; /* acknowledge it with the next frame */
+	size_t in_size; /* bytes of a partial message */
+	size_t out_head; /* next byte to send */
+	size_t out_tail; /* end of the queued bytes */
+	chip8_byte in[CHIP8_SERVER_IN_SIZE];
+	chip8_byte out[CHIP8_SERVER_OUT_SIZE];
+} chip8_session;
+
+typedef struct chip8_server chip8_server;
+
+/*
+ * @brief Event loop thread and the sessions it runs.
+ */
+typedef struct chip8_worker {
+	chip8_server* server;
+	pthread_t thread;
+	int epoll_fd;
+	int timer_fd;
+	chip8_ring handoff; /* accepted sessions from the main thread */
+	atomic_uint count; /* sessions, read by the main thread to balance */
+	chip8_session** sessions; /* active sessions */
+	chip8_session** closed; /* sessions freed after the event batch */
+	unsigned closed_count;
+	chip8_stream_frame frame; /* packing scratch */
+	chip8_metrics_shard* shard; /* NULL without metrics */
+	uint32_t opcodes[CHIP8_ISTR_SET_SIZE]; /* counted since the last tick */
+	uint64_t waiting; /* sessions blocked in FX0A this tick */
+
+	uint64_t peak; /* most sessions at once */
+	uint64_t ticks;
+	uint64_t late; /* ticks that found expired timer periods waiting */
+	uint64_t records; /* frame records sent */
+	uint64_t skipped; /* frames not sent to clients still draining */
+	uint64_t bytes; /* bytes sent */
+	uint64_t session_ticks; /* sum of sessions over ticks */
+	uint64_t tick_ns; /* sum of tick times */
+	chip8_hist tick_time; /* tick time histogram in ns */
+} chip8_worker;
+
+struct chip8_server {
+	unsigned cycles;
+	unsigned max; /* sessions per worker */
+	chip8_vm** roms; /* loaded virtual machines sessions start as */
+	chip8_metrics* metrics; /* NULL without -p */
+	unsigned rom_count;
+	unsigned worker_count;
+	chip8_worker* workers;
+};
+
+static atomic_bool chip8_server_stop;
+
+/* epoll data of the listening and timer descriptors, sessions use pointers */
+static chip8_byte chip8_server_timer;
+
+static void chip8_server_signal(const int signal)
+{
+	(void) signal;
+	atomic_store(&chip8_server_stop, true);
+}
+
+/*
+ * @brief Tells whether a nonblocking socket call failed only for now and is
+ * retried once the socket is ready again.
+ */
+static inline bool chip8_server_again(const int error)
+{
+#if EAGAIN != EWOULDBLOCK
+	if (EWOULDBLOCK == error) {
+		return true;
+	}
+#endif
+	return EAGAIN == error || EINTR == error;
+}
+
+/*
+ * @brief Sends as much of the queued output as the socket takes, failing
+ * only when the connection is gone.
+ */
+static chip8_rc chip8_session_flush(chip8_worker worker[const static 1],
+		chip8_session session[const static 1])
+{
+	while (session->out_head < session->out_tail) {
+		const ssize_t sent = send(session->fd,
+				&session->out[session->out_head],
+				session->out_tail - session->out_head, MSG_NOSIGNAL);
+
+		if (sent < 0) {
+			return chip8_server_again(errno) ? CHIP8_SUCCESS : CHIP8_FAILURE;
+		}
+		session->out_head += sent;
+		worker->bytes += sent;
+	}
+	session->out_head = session->out_tail = 0;
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Frees a session with the memory pages its machine owns.
+ */
+static void chip8_free_session(chip8_session* const session)
+{
+	chip8_drop_vm(&session->vm);
+	free(session);
+}
+
+/*
+ * @brief Removes a session from the worker, its memory is released once the
+ * current event batch no longer refers to it.
+ */
+static void chip8_session_close(chip8_worker worker[const static 1],
+		chip8_session session[const static 1])
+{
+	const unsigned last = atomic_load_explicit(&worker->count,
+			memory_order_relaxed) - 1;
+
+	if (0 > session->fd) {
+		return;
+	}
+	close(session->fd);
+	session->fd = -1;
+	worker->sessions[session->slot] = worker->sessions[last];
+	worker->sessions[session->slot]->slot = session->slot;
+	worker->closed[worker->closed_count++] = session;
+	atomic_store_explicit(&worker->count, last, memory_order_relaxed);
+}
+
+/*
+ * @brief Reads keypad messages until the socket is drained.
+ */
+static void chip8_session_read(chip8_worker worker[const static 1],
+		chip8_session session[const static 1])
+{
+	for (;;) {
+		const ssize_t size = recv(session->fd, &session->in[session->in_size],
+				CHIP8_SERVER_IN_SIZE - session->in_size, 0);
+		size_t used = 0;
+
+		if (!size || (size < 0 && !chip8_server_again(errno))) {
+			chip8_session_close(worker, session);
+			return;
+		} else if (size < 0) {
+			return;
+		}
+		session->in_size += size;
+
+		for (; session->in_size - used >= CHIP8_SERVER_MSG_SIZE;
+				used += CHIP8_SERVER_MSG_SIZE) {
+			const chip8_byte* const msg = &session->in[used];
+
+			if (CHIP8_SERVER_KEY != msg[0]) {
+				chip8_session_close(worker, session);
+				return;
+			}
+			/* a full queue drops the event, the acknowledgment still goes out */
+			chip8_push_input(&session->input, msg[1] % CHIP8_KEY_SIZE, msg[2],
+					chip8_time_ns());
+			session->ack = chip8_get_le32(&msg[4]);
+			session->ack_pending = true;
+		}
+		memmove(session->in, &session->in[used], session->in_size - used);
+		session->in_size -= used;
+	}
+}
+
+/*
+ * @brief Runs the frames of one tick and queues the acknowledgment and frame
+ * record, unless the client still has not drained the previous ones.
+ */
+static void chip8_session_tick(chip8_worker worker[const static 1],
+		chip8_session session[const static 1], const uint64_t frames)
+{
+	size_t size;
+
+	for (uint64_t i = 0; i < frames; i++) {
+		session->input.frame = session->vm.frame;
+		chip8_apply_input(&session->input, &session->vm);
+
+		if (worker->shard) {
+			chip8_count_frame(&session->vm, worker->server->cycles,
+					worker->opcodes);
+		} else {
+			chip8_run_frame(&session->vm, worker->server->cycles);
+		}
+	}
+
+	if (worker->shard) {
+		chip8_metrics_wait(worker->shard, &session->wait_ns, &session->vm,
+				chip8_time_ns());
+		worker->waiting += CHIP8_WAITING_KEY == session->vm.state;
+	}
+
+	if (!chip8_session_flush(worker, session)) {
+		chip8_session_close(worker, session);
+		return;
+	} else if (session->out_tail) {
+		worker->skipped++;
+
+		if (worker->shard) {
+			chip8_metrics_add(worker->shard, CHIP8_METRIC_SKIPPED, 1);
+		}
+		return;
+	} else if (session->ack_pending) {
+		session->out[session->out_tail] = CHIP8_SERVER_ACK;
+		chip8_put_le32(&session->out[session->out_tail + 1], session->ack);
+		session->out_tail += CHIP8_SERVER_ACK_SIZE;
+		session->ack_pending = false;
+	}
+
+	/* a redraw of the display the client already has is not encoded */
+	if (!session->encoder.synced || (session->vm.draw_flag
+	    && chip8_gfx_hash(&session->vm) != session->gfx_hash)) {
+		chip8_stream_pack(&worker->frame, &session->vm);
+		session->gfx_hash = chip8_gfx_hash(&session->vm);
+
+		if ((size = chip8_stream_encode(&session->encoder, &worker->frame,
+				&session->out[session->out_tail + 1]))) {
+			session->out[session->out_tail] = CHIP8_SERVER_FRAME;
+			session->out_tail += 1 + size;
+			worker->records++;
+
+			if (worker->shard) {
+				chip8_metrics_add(worker->shard, CHIP8_METRIC_PRESENTS, 1);
+			}
+		}
+	}
+	session->vm.draw_flag = false;
+
+	if (!chip8_session_flush(worker, session)) {
+		chip8_session_close(worker, session);
+	}
+}
+
+/*
+ * @brief Adopts the sessions accepted for this worker since the last tick.
+ */
+static void chip8_worker_adopt(chip8_worker worker[const static 1])
+{
+	chip8_session* session;
+
+	while (sizeof(session) <= chip8_ring_readable(&worker->handoff)) {
+		const unsigned count = atomic_load_explicit(&worker->count,
+				memory_order_relaxed);
+		struct epoll_event event = {
+			.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET
+		};
+
+		chip8_ring_read(&worker->handoff, &session, sizeof(session));
+		event.data.ptr = session;
+
+		if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, session->fd, &event)) {
+			perror("chip8_server: epoll_ctl");
+			close(session->fd);
+			chip8_free_session(session);
+			continue;
+		}
+		session->slot = count;
+		worker->sessions[count] = session;
+		atomic_store_explicit(&worker->count, count + 1, memory_order_relaxed);
+		worker->peak = count + 1 > worker->peak ? count + 1 : worker->peak;
+	}
+}
+
+/*
+ * @brief Runs a tick over every session and records how long it took.
+ */
+static void chip8_worker_tick(chip8_worker worker[const static 1])
+{
+	const uint64_t start_ns = chip8_time_ns();
+	uint64_t expirations;
+	uint64_t tick_ns;
+
+	if (sizeof(expirations) != read(worker->timer_fd, &expirations,
+			sizeof(expirations))) {
+		return;
+	} else if (1 < expirations) {
+		worker->late++;
+
+		if (worker->shard && CHIP8_SERVER_CATCHUP < expirations) {
+			chip8_metrics_add(worker->shard, CHIP8_METRIC_DROPPED,
+					expirations - CHIP8_SERVER_CATCHUP);
+		}
+		expirations = expirations < CHIP8_SERVER_CATCHUP ? expirations
+			: CHIP8_SERVER_CATCHUP;
+	}
+	chip8_worker_adopt(worker);
+	worker->waiting = 0;
+
+	/* closing swaps the last session into the slot, so walk backwards */
+	for (unsigned i = atomic_load_explicit(&worker->count,
+			memory_order_relaxed); i--;) {
+		chip8_session_tick(worker, worker->sessions[i], expirations);
+	}
+
+	/* opcode counts of all sessions are published once per tick */
+	if (worker->shard) {
+		chip8_metrics_opcodes(worker->shard, worker->opcodes);
+		chip8_metrics_add(worker->shard, CHIP8_METRIC_FRAMES, expirations
+				* atomic_load_explicit(&worker->count, memory_order_relaxed));
+		chip8_metrics_set(worker->shard, CHIP8_METRIC_WAITING,
+				worker->waiting);
+	}
+	tick_ns = chip8_time_ns() - start_ns;
+	worker->ticks++;
+	worker->tick_ns += tick_ns;
+	worker->session_ticks += atomic_load_explicit(&worker->count,
+			memory_order_relaxed);
+	chip8_hist_record(&worker->tick_time, tick_ns);
+}
+
+static void* chip8_worker_thread(void* const arg)
+{
+	chip8_worker* const worker = arg;
+	struct epoll_event events[CHIP8_SERVER_EVENTS];
+	char name[CHIP8_METRICS_NAME_SIZE];
+
+	if (worker->server->metrics) {
+		snprintf(name, sizeof(name), "worker %u",
+				(unsigned) (worker - worker->server->workers));
+		worker->shard = chip8_metrics_register(worker->server->metrics, name);
+	}
+
+	while (!atomic_load(&chip8_server_stop)) {
+		const int count = epoll_wait(worker->epoll_fd, events,
+				CHIP8_SERVER_EVENTS, -1);
+
+		for (int i = 0; i < count; i++) {
+			chip8_session* const session = events[i].data.ptr;
+
+			if (&chip8_server_timer == events[i].data.ptr) {
+				chip8_worker_tick(worker);
+				continue;
+			} else if (0 > session->fd) {
+				continue;
+			} else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+				chip8_session_close(worker, session);
+				continue;
+			} else if (events[i].events & EPOLLIN) {
+				chip8_session_read(worker, session);
+			}
+
+			if (0 <= session->fd && events[i].events & EPOLLOUT
+			    && !chip8_session_flush(worker, session)) {
+				chip8_session_close(worker, session);
+			}
+		}
+
+		for (; worker->closed_count; worker->closed_count--) {
+			chip8_free_session(worker->closed[worker->closed_count - 1]);
+		}
+	}
+
+	for (unsigned i = atomic_load(&worker->count); i--;) {
+		close(worker->sessions[i]->fd);
+		chip8_free_session(worker->sessions[i]);
+	}
+	return NULL;
+}
+
+static chip8_rc chip8_init_worker(chip8_worker worker[const static 1],
+		chip8_server server[const static 1])
+{
+	const struct itimerspec period = {
+		.it_interval = { .tv_nsec = CHIP8_FRAME_NS },
+		.it_value = { .tv_nsec = CHIP8_FRAME_NS }
+	};
+	struct epoll_event event = {
+		.events = EPOLLIN,
+		.data.ptr = &chip8_server_timer
+	};
+
+	worker->server = server;
+	atomic_init(&worker->count, 0);
+
+	if (!(worker->sessions = calloc(server->max, sizeof(*worker->sessions)))
+	    || !(worker->closed = calloc(server->max, sizeof(*worker->closed)))) {
+		perror("chip8_server: calloc");
+		return CHIP8_FAILURE;
+	} else if (!chip8_init_ring(&worker->handoff,
+			server->max * sizeof(chip8_session*))) {
+		return CHIP8_FAILURE;
+	} else if (0 > (worker->epoll_fd = epoll_create1(0))
+	           || 0 > (worker->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+	                   TFD_NONBLOCK))
+	           || timerfd_settime(worker->timer_fd, 0, &period, NULL)
+	           || epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->timer_fd,
+	                   &event)) {
+		perror("chip8_server: epoll or timerfd setup");
+		return CHIP8_FAILURE;
+	}
+	return CHIP8_SUCCESS;
+}
+
+/*
+ * @brief Returns the sessions of a worker including those still waiting in
+ * its handoff ring, which it adopts only on its next tick.
+ */
+static inline unsigned chip8_worker_load(chip8_worker worker[const static 1])
+{
+	return atomic_load_explicit(&worker->count, memory_order_relaxed)
+		+ chip8_ring_readable(&worker->handoff) / sizeof(chip8_session*);
+}
+
+/*
+ * @brief Creates a session running the next ROM and hands it to the worker
+ * with the fewest sessions.
+ *
+ * Sessions queued for adoption count towards a worker's load, otherwise a
+ * burst of connections within one tick would all go to the same worker.
+ */
+static void chip8_server_accept(chip8_server server[const static 1],
+		const int fd, const uint64_t index)
+{
+	chip8_worker* worker = &server->workers[0];
+	unsigned load = chip8_worker_load(worker);
+	chip8_session* session;
+
+	for (unsigned i = 1; i < server->worker_count; i++) {
+		const unsigned other = chip8_worker_load(&server->workers[i]);
+
+		if (other < load) {
+			worker = &server->workers[i];
+			load = other;
+		}
+	}
+
+	if (server->max <= load
+	    || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK)
+	    || !(session = aligned_alloc(_Alignof(chip8_session),
+			sizeof(*session)))) {
+		close(fd);
+		return;
+	}
+	/* sessions share the ROM's memory pages until they write to them */
+	memset(&session->vm, 0, sizeof(session->vm));
+	chip8_copy_vm(&session->vm, server->roms[index % server->rom_count]);
+	chip8_seed(&session->vm, (uint32_t) (index + 1));
+	memset(&session->input, 0, sizeof(session->input));
+	session->encoder.synced = false;
+	session->encoder.keyframes = 0;
+	session->fd = fd;
+	session->wait_ns = 0;
+	session->ack_pending = false;
+	session->in_size = 0;
+	session->out_head = 0;
+	chip8_stream_header(session->out);
+	session->out_tail = CHIP8_STREAM_HEADER_SIZE;
+	chip8_ring_write(&worker->handoff, &session, sizeof(session));
+}
+
+static int chip8_server_listen(const char path[static 1])
+{
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	int fd;
+
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "chip8_server: socket path too long\n");
+		return -1;
+	}
+	strcpy(address.sun_path, path);
+	unlink(path);
+
+	if (0 > (fd = socket(AF_UNIX, SOCK_STREAM, 0))
+	    || bind(fd, (struct sockaddr*) &address, sizeof(address))
+	    || listen(fd, SOMAXCONN)) {
+		perror("chip8_server: listen");
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * @brief Prints per worker tick statistics and the sessions a core would
+ * sustain at the measured cost per session.
+ */
+static void chip8_server_report(const chip8_server server[const static 1])
+{
+	uint64_t session_ticks = 0;
+	uint64_t tick_ns = 0;
+
+	for (unsigned w = 0; w < server->worker_count; w++) {
+		const chip8_worker* const worker = &server->workers[w];
+		const uint64_t p50 = chip8_hist_percentile(&worker->tick_time, 50);
+		const uint64_t p99 = chip8_hist_percentile(&worker->tick_time, 99);
+
+		printf("worker %u: peak %" PRIu64 " sessions, %" PRIu64 " ticks "
+				"(%" PRIu64 " late), tick p50 %" PRIu64 " us p99 %" PRIu64
+				" us max %" PRIu64 " us, "
+				"%" PRIu64 " records, %" PRIu64 " skipped, %.1f KB/s\n",
+				w, worker->peak, worker->ticks, worker->late, p50 / 1000,
+				p99 / 1000, worker->tick_time.max / 1000,
+				worker->records, worker->skipped,
+				worker->ticks ? worker->bytes * (double) CHIP8_FRAME_RATE
+					/ worker->ticks / 1024 : 0.0);
+		session_ticks += worker->session_ticks;
+		tick_ns += worker->tick_ns;
+	}
+
+	if (tick_ns) {
+		printf("%.1f us per session frame, %.0f sessions per core at 60 Hz\n",
+				tick_ns / 1000.0 / session_ticks,
+				CHIP8_FRAME_NS * (double) session_ticks / tick_ns);
+	}
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	chip8_server server = {
+		.cycles = CHIP8_SERVER_CYCLES,
+		.max = CHIP8_SERVER_MAX,
+		.worker_count = sysconf(_SC_NPROCESSORS_ONLN)
+	};
+	const char* path = CHIP8_SERVER_SOCKET;
+	const char* metrics_spec = NULL;
+	chip8_metrics metrics = { 0 };
+	struct rlimit files;
+	struct sigaction action = { .sa_handler = chip8_server_signal };
+	uint64_t accepted = 0;
+	unsigned started = 0;
+	int listen_fd;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "c:j:m:p:s:"))) {
+		switch (opt) {
+			case 'c':
+				server.cycles = strtoul(optarg, NULL, 0);
+				break;
+			case 'j':
+				server.worker_count = strtoul(optarg, NULL, 0);
+				break;
+			case 'm':
+				server.max = strtoul(optarg, NULL, 0);
+				break;
+			case 'p':
+				metrics_spec = optarg;
+				break;
+			case 's':
+				path = optarg;
+				break;
+			default:
+				goto USAGE;
+		}
+	}
+
+	if (optind == argc || !server.worker_count || !server.max) {
+		goto USAGE;
+	}
+	server.rom_count = argc - optind;
+
+	if (!(server.roms = calloc(server.rom_count, sizeof(*server.roms)))
+	    || !(server.workers = calloc(server.worker_count,
+	            sizeof(*server.workers)))) {
+		perror("chip8_server: calloc");
+		return EXIT_FAILURE;
+	}
+
+	for (unsigned i = 0; i < server.rom_count; i++) {
+		if (!(server.roms[i] = chip8_new_vm())
+		    || !chip8_load_rom(server.roms[i], argv[optind + i])) {
+			fprintf(stderr, "%s: ROM load failed\n", argv[optind + i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* every session is a descriptor, allow as many as the hard limit */
+	if (!getrlimit(RLIMIT_NOFILE, &files)) {
+		files.rlim_cur = files.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &files);
+	}
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	if (metrics_spec) {
+		if (!chip8_open_metrics(&metrics, metrics_spec, server.worker_count)) {
+			return EXIT_FAILURE;
+		}
+		server.metrics = &metrics;
+	}
+
+	if (0 > (listen_fd = chip8_server_listen(path))) {
+		chip8_close_metrics(&metrics);
+		return EXIT_FAILURE;
+	}
+
+	for (; started < server.worker_count; started++) {
+		if (!chip8_init_worker(&server.workers[started], &server)
+		    || pthread_create(&server.workers[started].thread, NULL,
+		            chip8_worker_thread, &server.workers[started])) {
+			break;
+		}
+	}
+	server.worker_count = started;
+	printf("chip8_server: %u workers on %s\n", started, path);
+	fflush(stdout);
+
+	while (started && !atomic_load(&chip8_server_stop)) {
+		struct pollfd ready = { .fd = listen_fd, .events = POLLIN };
+		int fd;
+
+		if (0 < poll(&ready, 1, 100) && 0 <= (fd = accept(listen_fd, NULL,
+				NULL))) {
+			chip8_server_accept(&server, fd, accepted++);
+		}
+	}
+
+	for (unsigned i = 0; i < started; i++) {
+		pthread_join(server.workers[i].thread, NULL);
+	}
+	close(listen_fd);
+	unlink(path);
+	chip8_close_metrics(&metrics);
+	chip8_server_report(&server);
+	return started ? EXIT_SUCCESS : EXIT_FAILURE;
+
+USAGE:
+	fprintf(stderr, "usage: %s [-c cycles] [-j workers] [-m max] [-p metrics] "
+			"[-s socket] rom...\n"
+			"  -p metrics  serve Prometheus metrics on a loopback port or"
+			" unix:<socket>\n", argv[0]);
+	return EXIT_FAILURE;
+}
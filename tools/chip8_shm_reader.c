@@ -0,0 +1,124 @@
+/*
+ * @file chip8_shm_reader.c
+ * @brief Follows the state an emulator publishes to shared memory.
+ *
+ * Example reader of the export enabled with `great_chip-8 -m`. It polls the
+ * ring every millisecond, prints one line per published frame and counts
+ * frames overwritten before it got to them. It stops when the emulator
+ * exits or after the given number of frames.
+ *
+ * usage: chip8_shm_reader [-q] [-n frames] [name]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+
+#include "chip8.h"
+#include "chip8_shm.h"
+#include "chip8_time.h"
+
+#define CHIP8_SHM_READER_POLL_NS 1000000
+
+/*
+ * @brief Counts the pixels lit in any plane.
+ */
+static unsigned chip8_lit_pixels(const chip8_shm_state state[const static 1])
+{
+	unsigned lit = 0;
+
+	for (unsigned y = 0; y < CHIP8_GFX_HIRES_HEIGHT; y++) {
+		for (unsigned w = 0; w < CHIP8_GFX_ROW_WORDS; w++) {
+			uint64_t row = 0;
+
+			for (unsigned p = 0; p < CHIP8_GFX_PLANES; p++) {
+				row |= state->gfx[p][y][w];
+			}
+			lit += __builtin_popcountll(row);
+		}
+	}
+	return lit;
+}
+
+static void chip8_print_state(const chip8_shm_state state[const static 1])
+{
+	printf("frame %8" PRIu64 " pc %04X I %04X dt %3u st %3u %s %4u lit  V",
+			state->frame, state->pc, state->idx, state->dly_tmr,
+			state->snd_tmr, state->hires ? "hires" : "lores",
+			chip8_lit_pixels(state));
+
+	for (unsigned r = 0; r < REG_BANK_SIZE; r++) {
+		printf(" %02X", state->regs[r]);
+	}
+	putchar('\n');
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	const char* name = CHIP8_SHM_NAME;
+	uint64_t limit = UINT64_MAX;
+	uint64_t read = 0;
+	uint64_t missed = 0;
+	bool quiet = false;
+	chip8_shm_ring* ring;
+	chip8_shm_state state;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "qn:"))) {
+		switch (opt) {
+			case 'q':
+				quiet = true;
+				break;
+			case 'n':
+				limit = strtoull(optarg, NULL, 0);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-q] [-n frames] [name]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc) {
+		name = argv[optind];
+	}
+
+	if (!(ring = chip8_map_shm(name))) {
+		return EXIT_FAILURE;
+	}
+	const uint64_t start_ns = chip8_time_ns();
+	uint64_t next = atomic_load_explicit(&ring->published, memory_order_acquire);
+
+	/* the emulator clears the magic when it exits */
+	while (read < limit && !memcmp(ring->magic, CHIP8_SHM_MAGIC,
+			sizeof(ring->magic))) {
+		const uint64_t published = atomic_load_explicit(&ring->published,
+				memory_order_acquire);
+
+		if (next + CHIP8_SHM_SLOTS < published) {
+			missed += published - CHIP8_SHM_SLOTS - next;
+			next = published - CHIP8_SHM_SLOTS;
+		}
+
+		for (; next < published && read < limit; next++) {
+			if (!chip8_shm_read(ring, next, &state)) {
+				missed++;
+				continue;
+			}
+			read++;
+
+			if (!quiet) {
+				chip8_print_state(&state);
+			}
+		}
+		chip8_sleep_until(chip8_time_ns() + CHIP8_SHM_READER_POLL_NS);
+	}
+	fprintf(stderr, "%" PRIu64 " frames read, %" PRIu64 " missed in %.2f s\n",
+			read, missed, (chip8_time_ns() - start_ns)
+			/ (double) CHIP8_NS_PER_SEC);
+	chip8_unmap_shm(ring);
+	return EXIT_SUCCESS;
+}
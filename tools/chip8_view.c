@@ -0,0 +1,154 @@
+/*
+ * @file chip8_view.c
+ * @brief Decodes a display stream written by great_chip-8 -o and draws it in
+ * the terminal.
+ *
+ * Every character cell shows two pixels with an upper half block colored by
+ * ANSI 256-color escapes. With -q nothing is drawn and the stream is only
+ * decoded, the statistics printed at the end give its bandwidth per second
+ * of emulated time.
+ *
+ * usage: chip8_view [-q] [-|fifo|file|unix:socket]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "chip8.h"
+#include "chip8_stream.h"
+
+/* background, plane 1, plane 2 and both planes */
+static const unsigned chip8_view_palette[CHIP8_GFX_COLORS] = {
+	16, 231, 208, 160
+};
+
+/*
+ * @brief Opens standard input, a FIFO, a file or connects to the socket of a
+ * running emulator.
+ */
+static FILE* chip8_view_open(const char source[static 1])
+{
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	int fd;
+
+	if (!strcmp(source, "-")) {
+		return stdin;
+	} else if (strncmp(source, "unix:", 5)) {
+		return fopen(source, "rb");
+	} else if (sizeof(address.sun_path) <= (size_t) snprintf(address.sun_path,
+			sizeof(address.sun_path), "%s", &source[5])) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+
+	if (0 > (fd = socket(AF_UNIX, SOCK_STREAM, 0))) {
+		return NULL;
+	} else if (connect(fd, (struct sockaddr*) &address, sizeof(address))) {
+		close(fd);
+		return NULL;
+	}
+	return fdopen(fd, "rb");
+}
+
+/*
+ * @brief Draws the current frame two rows per line from the top left corner.
+ */
+static void chip8_view_draw(const chip8_stream_frame frame[const static 1])
+{
+	const unsigned width = frame->hires ? CHIP8_GFX_HIRES_WIDTH
+		: CHIP8_GFX_RES_WIDTH;
+	const unsigned height = frame->hires ? CHIP8_GFX_HIRES_HEIGHT
+		: CHIP8_GFX_RES_HEIGHT;
+
+	printf("\033[H");
+
+	for (unsigned y = 0; y < height; y += 2) {
+		unsigned last = CHIP8_GFX_COLORS * CHIP8_GFX_COLORS;
+
+		for (unsigned x = 0; x < width; x++) {
+			const unsigned top = chip8_stream_pixel(frame, x, y);
+			const unsigned bottom = chip8_stream_pixel(frame, x, y + 1);
+
+			/* escapes only where the colors change keep lines short */
+			if (top * CHIP8_GFX_COLORS + bottom != last) {
+				last = top * CHIP8_GFX_COLORS + bottom;
+				printf("\033[38;5;%u;48;5;%um", chip8_view_palette[top],
+						chip8_view_palette[bottom]);
+			}
+			fputs("▀", stdout);
+		}
+		printf("\033[0m\033[K\n");
+	}
+	printf("\033[Jframe %" PRIu64 "\n", frame->frame);
+	fflush(stdout);
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	static chip8_stream_decoder decoder;
+	bool quiet = false;
+	uint64_t records = 0;
+	uint64_t first = 0;
+	int opt;
+	int exit_state = EXIT_SUCCESS;
+	FILE* file;
+
+	while (-1 != (opt = getopt(argc, argv, "q"))) {
+		switch (opt) {
+			case 'q':
+				quiet = true;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-q] [-|fifo|file|unix:socket]\n",
+						argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (!(file = chip8_view_open(optind < argc ? argv[optind] : "-"))) {
+		perror("chip8_view: open failed");
+		return EXIT_FAILURE;
+	} else if (!chip8_stream_read_header(file)) {
+		fprintf(stderr, "chip8_view: not a display stream\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!quiet) {
+		printf("\033[2J");
+	}
+
+	while (chip8_stream_decode(&decoder, file)) {
+		if (!decoder.synced) {
+			continue;
+		} else if (!records++) {
+			first = decoder.current.frame;
+		}
+
+		if (!quiet) {
+			chip8_view_draw(&decoder.current);
+		}
+	}
+
+	if (ferror(file) || !feof(file)) {
+		fprintf(stderr, "chip8_view: malformed stream\n");
+		exit_state = EXIT_FAILURE;
+	}
+	fprintf(stderr, "chip8_view: %" PRIu64 " records, %" PRIu64 " bytes, "
+			"frames %" PRIu64 "-%" PRIu64 ", %.2f KB per emulated second\n",
+			records, decoder.bytes + CHIP8_STREAM_HEADER_SIZE, first,
+			decoder.current.frame,
+			records ? (decoder.bytes + CHIP8_STREAM_HEADER_SIZE)
+				* (double) CHIP8_FRAME_RATE / 1024
+				/ (decoder.current.frame - first + 1) : 0.0);
+	fclose(file);
+	return exit_state;
+}